@@ -0,0 +1,250 @@
+/******************************************************************************
+ * FTP-Server
+ * Author: Evan Myers
+ * Date: October 2026
+ *
+ * Description:
+ *   Throughput of the TYPE A line ending kernels of src/ascii.c. Each kernel
+ *   translates text of a given mean line length in blocks the size of a
+ *   transfer buffer, and is compared with a loop that looks at one byte at a
+ *   time. The output of every kernel is checked against that of the loop.
+ *
+ *   The kernels are static, so ascii.c is included here rather than linked.
+ *   Build and run from src/ with "make ascii_bench && ./ascii_bench".
+ *****************************************************************************/
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "../src/ascii.c"
+
+//The text translated by each run, and the block each kernel call is given.
+#define TEXT_SIZE (16 * 1024 * 1024)
+#define BLOCK_SIZE (64 * 1024)
+
+//How long each kernel is run for, in seconds.
+#define RUN_SECONDS 0.5
+
+
+typedef struct {
+  const char *name;
+  encode_fn_t encode;
+  decode_fn_t decode;
+  bool usable;
+} kernel_t;
+
+
+//Local function prototypes.
+static size_t encode_bytewise (const uint8_t *in, size_t len, uint8_t *out);
+static size_t decode_bytewise (const uint8_t *in, size_t len, uint8_t *out,
+			       bool *pendingCR);
+static void make_text (uint8_t *text, size_t size, int meanLine);
+static double now (void);
+static double run_encode (encode_fn_t fn, const uint8_t *in, uint8_t *out);
+static double run_decode (decode_fn_t fn, const uint8_t *in, size_t len,
+			  uint8_t *out);
+
+
+/* The pipeline functions ascii.c calls, which the kernels do not need. */
+void pipe_stage_init (pipe_stage_t *stage, const char *name,
+		      pipe_push_fn_t push, pipe_finish_fn_t finish, void *state)
+{
+}
+
+int pipe_next (pipe_stage_t *stage, const uint8_t *data, size_t len)
+{
+  return 0;
+}
+
+
+int main (int argc, char *argv[])
+{
+  static const int meanLines[] = {16, 80, 1000};
+  kernel_t kernels[] = {
+    {"bytewise", encode_bytewise, decode_bytewise, true},
+    {"memchr", encode_scalar, decode_scalar, true},
+#ifdef ASCII_X86_SIMD
+    {"sse2", encode_sse2, decode_sse2, false},
+    {"avx2", encode_avx2, decode_avx2, false},
+#endif
+  };
+  uint8_t *text, *crlf, *out, *check;
+  size_t crlfLen, checkLen;
+  bool pendingCR;
+  int i, k;
+
+  text = malloc (TEXT_SIZE);
+  crlf = malloc (TEXT_SIZE * 2);
+  out = malloc (TEXT_SIZE * 2);
+  check = malloc (TEXT_SIZE * 2);
+  if (text == NULL || crlf == NULL || out == NULL || check == NULL) {
+    fprintf (stderr, "%s: malloc failed\n", __FUNCTION__);
+    return EXIT_FAILURE;
+  }
+
+#ifdef ASCII_X86_SIMD
+  __builtin_cpu_init ();
+  kernels[2].usable = __builtin_cpu_supports ("sse2");
+  kernels[3].usable = __builtin_cpu_supports ("avx2");
+#endif
+
+  printf ("%10s  %8s  %14s  %14s\n", "mean line", "kernel", "encode MiB/s",
+	  "decode MiB/s");
+  for (i = 0; i < sizeof (meanLines) / sizeof (meanLines[0]); i++) {
+    make_text (text, TEXT_SIZE, meanLines[i]);
+    crlfLen = encode_bytewise (text, TEXT_SIZE, crlf);
+
+    for (k = 0; k < sizeof (kernels) / sizeof (kernels[0]); k++) {
+      double encodeRate, decodeRate;
+
+      if (!kernels[k].usable) {
+	printf ("%10d  %8s  %14s  %14s\n", meanLines[i], kernels[k].name,
+		"-", "-");
+	continue;
+      }
+
+      //Check the kernel against the bytewise loop, over whole blocks.
+      encodeRate = run_encode (kernels[k].encode, text, out);
+      if (memcmp (out, crlf, crlfLen) != 0) {
+	fprintf (stderr, "%s: the %s encoder differs\n", __FUNCTION__,
+		 kernels[k].name);
+	return EXIT_FAILURE;
+      }
+      decodeRate = run_decode (kernels[k].decode, crlf, crlfLen, out);
+      pendingCR = false;
+      checkLen = decode_bytewise (crlf, crlfLen, check, &pendingCR);
+      if (memcmp (out, check, checkLen) != 0 || memcmp (check, text,
+							 TEXT_SIZE) != 0) {
+	fprintf (stderr, "%s: the %s decoder differs\n", __FUNCTION__,
+		 kernels[k].name);
+	return EXIT_FAILURE;
+      }
+
+      printf ("%10d  %8s  %14.0f  %14.0f\n", meanLines[i], kernels[k].name,
+	      encodeRate, decodeRate);
+    }
+  }
+
+  free (text);
+  free (crlf);
+  free (out);
+  free (check);
+  return EXIT_SUCCESS;
+}
+
+
+/******************************************************************************
+ * The loop the kernels are compared with, one byte at a time.
+ *****************************************************************************/
+static size_t encode_bytewise (const uint8_t *in, size_t len, uint8_t *out)
+{
+  uint8_t *o = out;
+  size_t i;
+
+  for (i = 0; i < len; i++) {
+    if (in[i] == '\n')
+      *o++ = '\r';
+    *o++ = in[i];
+  }
+
+  return o - out;
+}
+
+
+static size_t decode_bytewise (const uint8_t *in, size_t len, uint8_t *out,
+			       bool *pendingCR)
+{
+  uint8_t *o = out;
+  size_t i;
+
+  for (i = 0; i < len; i++) {
+    if (in[i] != '\r')
+      *o++ = in[i];
+    else if (i + 1 == len)
+      *pendingCR = true;
+    else if (in[i + 1] != '\n')
+      *o++ = '\r';
+  }
+
+  return o - out;
+}
+
+
+/******************************************************************************
+ * Fill a buffer with printable text, in lines of a random length about the
+ * mean given. The last byte is a line ending.
+ *****************************************************************************/
+static void make_text (uint8_t *text, size_t size, int meanLine)
+{
+  size_t i, lineEnd = 0;
+
+  srand (1);
+  for (i = 0; i < size; i++) {
+    if (i == lineEnd) {
+      lineEnd = i + 1 + rand () % (2 * meanLine);
+      text[i] = '\n';
+    } else {
+      text[i] = ' ' + rand () % 95;
+    }
+  }
+  text[size - 1] = '\n';
+}
+
+
+static double now (void)
+{
+  struct timespec ts;
+
+  clock_gettime (CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+
+/******************************************************************************
+ * Run a kernel over the text in blocks until RUN_SECONDS have passed, and
+ * return the rate of the input in MiB/s. The last pass is left in 'out'.
+ *****************************************************************************/
+static double run_encode (encode_fn_t fn, const uint8_t *in, uint8_t *out)
+{
+  double start = now (), elapsed;
+  size_t done = 0, off, o;
+
+  do {
+    for (off = 0, o = 0; off < TEXT_SIZE; off += BLOCK_SIZE)
+      o += fn (in + off, BLOCK_SIZE, out + o);
+    done += TEXT_SIZE;
+  } while ((elapsed = now () - start) < RUN_SECONDS);
+
+  return done / elapsed / (1024 * 1024);
+}
+
+
+/******************************************************************************
+ * The same for a decoder. A CR held back at the end of a block is written
+ * before the next block, as decode_push() does, unless it starts a CRLF.
+ *****************************************************************************/
+static double run_decode (decode_fn_t fn, const uint8_t *in, size_t len,
+			  uint8_t *out)
+{
+  double start = now (), elapsed;
+  size_t done = 0, off, block, o;
+  bool pendingCR;
+
+  do {
+    pendingCR = false;
+    for (off = 0, o = 0; off < len; off += block) {
+      block = len - off < BLOCK_SIZE ? len - off : BLOCK_SIZE;
+      if (pendingCR) {
+	pendingCR = false;
+	if (in[off] != '\n')
+	  out[o++] = '\r';
+      }
+      o += fn (in + off, block, out + o, &pendingCR);
+    }
+    done += len;
+  } while ((elapsed = now () - start) < RUN_SECONDS);
+
+  return done / elapsed / (1024 * 1024);
+}
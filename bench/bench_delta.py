@@ -0,0 +1,268 @@
+###############################################################################
+# FTP-Server
+# Author: Evan Myers
+# Date: October 2026
+#
+# Description:
+#   Bytes on the wire and time of delta transfers of a changed file, against
+#   a full STOR and RETR of it. A random file is changed by a number of small
+#   overwrites, or by as many small insertions, which shift the rest of the
+#   file. The upload is SITE DSIG then SITE DSTOR of a delta against the copy
+#   of the server, the download is SITE DBASE with the signature of the old
+#   copy then SITE DRETR. Both results are checked against the new file.
+#
+#   The signature and the delta of the client side are computed in Python,
+#   before the transfers that are timed, so the time is that of the server and
+#   the network alone. Over the loopback interface the per-session rate limit
+#   (SESSION_RATE_LIMIT_CONFIG) stands in for a slower link.
+#
+#   eg. python3 bench/bench_delta.py --size 64 --edits 16 --rate 10
+###############################################################################
+import hashlib
+import io
+import itertools
+import os
+import random
+import struct
+
+import benchlib
+from benchlib import MIB, Measure, Server
+
+
+#The limits of the block size of a signature, as in delta.h.
+MIN_BLOCK = 1024
+MAX_BLOCK = 131072
+
+#The length of each overwrite or insertion.
+EDIT_LEN = 64
+
+MASK = 0xffffffff
+
+
+def block_size(size):
+    """The block size the server chooses for a file, see delta_block_size()."""
+    bs = MIN_BLOCK
+    while bs < MAX_BLOCK and bs * bs < size:
+        bs *= 2
+    return bs
+
+
+def sums(block):
+    """The two sums of the weak checksum of a block."""
+    return sum(block) & MASK, sum(itertools.accumulate(block)) & MASK
+
+
+def weak(s1, s2):
+    return (s1 & 0xffff) | ((s2 << 16) & MASK)
+
+
+def signature(data):
+    """The signature of a basis, as sent by SITE DBASE and SITE DSIG."""
+    bs = block_size(len(data))
+    out = [struct.pack('>IQ', bs, len(data))]
+    for i in range(0, len(data), bs):
+        block = data[i:i + bs]
+        out.append(struct.pack('>I', weak(*sums(block))) +
+                   hashlib.md5(block).digest())
+    return b''.join(out)
+
+
+def parse_signature(sig):
+    """Return the block size, size and (weak, strong) blocks of a signature."""
+    bs, size = struct.unpack_from('>IQ', sig)
+    blocks = [(struct.unpack_from('>I', sig, i)[0], sig[i + 4:i + 20])
+              for i in range(12, len(sig), 20)]
+    return bs, size, blocks
+
+
+def encode(new, sig):
+    """The delta of a new file against the signature of its basis. The block
+    after the last one found is tried first, and the window is only rolled
+    over the new file where it differs."""
+    bs, size, blocks = parse_signature(sig)
+    lengths = [min(bs, size - i * bs) for i in range(len(blocks))]
+    table = {}
+    for i, (w, _) in enumerate(blocks):
+        table.setdefault(w, []).append(i)
+
+    ops = [struct.pack('>I', bs)]
+    run = None
+    lit = pos = 0
+    last = -1
+    rolling = False
+    s1 = s2 = 0
+
+    def emit_run():
+        if run is not None:
+            ops.append(b'C' + struct.pack('>II', run[0], run[1]))
+
+    def match(block, length):
+        nonlocal run, lit, pos, last, rolling
+        if pos > lit:
+            emit_run()
+            run = None
+            ops.append(b'L' + struct.pack('>I', pos - lit) + new[lit:pos])
+        if run is not None and run[0] + run[1] == block:
+            run[1] += 1
+        else:
+            emit_run()
+            run = [block, 1]
+        pos += length
+        lit = pos
+        last = block
+        rolling = False
+
+    n = len(new)
+    while pos + bs <= n:
+        window = new[pos:pos + bs]
+        if not rolling:
+            nxt = last + 1
+            if nxt < len(blocks) and lengths[nxt] == bs and \
+               hashlib.md5(window).digest() == blocks[nxt][1]:
+                match(nxt, bs)
+                continue
+            s1, s2 = sums(window)
+            rolling = True
+        found = None
+        for i in table.get(weak(s1, s2), ()):
+            if lengths[i] == bs and hashlib.md5(window).digest() == blocks[i][1]:
+                found = i
+                break
+        if found is not None:
+            match(found, bs)
+            continue
+        if pos + bs == n:
+            break
+        out, into = new[pos], new[pos + bs]
+        s1 = (s1 - out + into) & MASK
+        s2 = (s2 - bs * out + s1) & MASK
+        pos += 1
+
+    #A short last block of the basis may end the new file too.
+    if blocks and n - pos < bs and n - pos == lengths[-1] and \
+       hashlib.md5(new[pos:]).digest() == blocks[-1][1]:
+        match(len(blocks) - 1, n - pos)
+    if n > lit:
+        emit_run()
+        run = None
+        ops.append(b'L' + struct.pack('>I', n - lit) + new[lit:n])
+    emit_run()
+    ops.append(b'E' + hashlib.md5(new).digest())
+    return b''.join(ops)
+
+
+def decode(basis, delta):
+    """Build the new file from a basis and a delta, and check its MD5."""
+    bs, = struct.unpack_from('>I', delta)
+    out = []
+    i = 4
+    while True:
+        op = delta[i:i + 1]
+        if op == b'C':
+            block, count = struct.unpack_from('>II', delta, i + 1)
+            out.append(basis[block * bs:(block + count) * bs])
+            i += 9
+        elif op == b'L':
+            length, = struct.unpack_from('>I', delta, i + 1)
+            out.append(delta[i + 5:i + 5 + length])
+            i += 5 + length
+        elif op == b'E':
+            data = b''.join(out)
+            if hashlib.md5(data).digest() != delta[i + 1:i + 17]:
+                raise RuntimeError('the delta does not end with its MD5')
+            return data
+        else:
+            raise RuntimeError('unknown delta operation %r' % op)
+
+
+def change(data, edits, insert, rand):
+    """Overwrite or insert EDIT_LEN random bytes at a number of offsets."""
+    new = bytearray(data)
+    for offset in sorted(rand.randrange(len(data)) for _ in range(edits))[::-1]:
+        patch = os.urandom(EDIT_LEN)
+        if insert:
+            new[offset:offset] = patch
+        else:
+            new[offset:offset + EDIT_LEN] = patch
+    return bytes(new)
+
+
+def run(binary, scenario, old, new, rate):
+    """Upload and download the new file in full and as deltas, and return a
+    row of the results for each direction."""
+    rows = []
+    with Server(binary, SESSION_RATE_LIMIT_CONFIG=str(int(rate * MIB))) \
+            as server:
+        with open(server.path('up.bin'), 'wb') as f:
+            f.write(old)
+        with open(server.path('down.bin'), 'wb') as f:
+            f.write(new)
+        ftp = server.login()
+        ftp.voidcmd('TYPE I')
+
+        with Measure(server) as full:
+            ftp.storbinary('STOR full.bin', io.BytesIO(new), blocksize=1 << 20)
+        with Measure(server) as first:
+            received = []
+            ftp.retrbinary('SITE DSIG up.bin', received.append,
+                           blocksize=1 << 20)
+        sig = b''.join(received)
+        delta = encode(new, sig)
+        with Measure(server) as second:
+            ftp.storbinary('SITE DSTOR up.bin', io.BytesIO(delta),
+                           blocksize=1 << 20)
+        with open(server.path('up.bin'), 'rb') as f:
+            if f.read() != new:
+                raise RuntimeError('%s: DSTOR: the file differs' % scenario)
+        rows.append(row(binary, scenario, 'upload', len(new), full,
+                        len(sig) + len(delta), (first, second)))
+
+        with Measure(server) as full:
+            if benchlib.retr(ftp, 'down.bin') != len(new):
+                raise RuntimeError('%s: RETR: the file is short' % scenario)
+        sig = signature(old)
+        with Measure(server) as first:
+            ftp.storbinary('SITE DBASE', io.BytesIO(sig), blocksize=1 << 20)
+        with Measure(server) as second:
+            received = []
+            ftp.retrbinary('SITE DRETR down.bin', received.append,
+                           blocksize=1 << 20)
+        delta = b''.join(received)
+        if decode(old, delta) != new:
+            raise RuntimeError('%s: DRETR: the file differs' % scenario)
+        rows.append(row(binary, scenario, 'download', len(new), full,
+                        len(sig) + len(delta), (first, second)))
+        ftp.quit()
+    return rows
+
+
+def row(binary, scenario, direction, size, full, wire, parts):
+    return [benchlib.label(binary), scenario, direction,
+            '%.1f' % (size / MIB), '%.1f' % (wire / 1024),
+            '%.2f%%' % (100 * wire / size),
+            '%.3f' % full.wall, '%.3f' % sum(p.wall for p in parts),
+            '%.3f' % full.cpu, '%.3f' % sum(p.cpu for p in parts)]
+
+
+def main():
+    args = benchlib.arguments('Delta transfers of a changed file.',
+                              size=(int, 64, 'file size in MiB'),
+                              edits=(int, 16, 'number of changes'),
+                              rate=(float, 0, 'rate of the session in MiB/s, '
+                                    '0 for no limit'))
+    rand = random.Random(1)
+    old = os.urandom(args.size * MIB)
+    cases = [('overwrite', change(old, args.edits, False, rand)),
+             ('insert', change(old, args.edits, True, rand))]
+    rows = []
+    for binary in args.server:
+        for scenario, new in cases:
+            rows.extend(run(binary, scenario, old, new, args.rate))
+
+    benchlib.report(rows, ['server', 'change', 'direction', 'file MiB',
+                           'wire KiB', 'of file', 'full s', 'delta s',
+                           'full CPU s', 'delta CPU s'])
+
+
+if __name__ == '__main__':
+    main()
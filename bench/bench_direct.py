@@ -0,0 +1,124 @@
+###############################################################################
+# FTP-Server
+# Author: Evan Myers
+# Date: October 2026
+#
+# Description:
+#   The effect of a bulk upload on the downloads of hot files, with the upload
+#   written through the page cache and with O_DIRECT (DIRECT_IO_DIRS_CONFIG).
+#   A set of hot files is read into the page cache, then one session STORs a
+#   large file while another RETRs the hot files over and over. The share of
+#   the hot files in the page cache is sampled during the upload, which is the
+#   hit rate the downloads see, and the upload leaves its own file in the cache
+#   or not.
+#
+#   The upload has to be larger than the free memory to push the hot files
+#   out, by default it is the size of the memory of the machine.
+#
+#   eg. python3 bench/bench_direct.py --hot 512 --ingest 8192
+###############################################################################
+import os
+import threading
+import time
+
+import benchlib
+from benchlib import MIB, Server
+
+
+#How often the hot files are checked for being in the page cache, in seconds.
+SAMPLE_INTERVAL = 0.5
+
+
+class Upload:
+    """A file-like source of 'size' bytes, one random block over and over."""
+
+    def __init__(self, size):
+        self.left = size
+        self.block = os.urandom(8 * MIB)
+
+    def read(self, n):
+        n = min(n, self.left, len(self.block))
+        self.left -= n
+        return self.block[:n]
+
+
+def memory_mib():
+    with open('/proc/meminfo') as f:
+        for line in f:
+            if line.startswith('MemTotal:'):
+                return int(line.split()[1]) // 1024
+    return 4096
+
+
+def run(binary, direct, args):
+    """Upload while the hot files are downloaded, and return a row of the
+    results."""
+    hot_names = ['hot%d.bin' % i for i in range(args.hot_files)]
+    with Server(binary, DIRECT_IO_DIRS_CONFIG='.' if direct else '',
+                CHECKSUM_CONFIG='NONE') as server:
+        for name in hot_names:
+            benchlib.write_random(server.path(name),
+                                  args.hot * MIB // args.hot_files)
+            benchlib.warm(server.path(name))
+
+        done = threading.Event()
+        downloaded = [0]
+        samples = []
+
+        def download():
+            ftp = server.login()
+            ftp.voidcmd('TYPE I')
+            while not done.is_set():
+                for name in hot_names:
+                    downloaded[0] += benchlib.retr(ftp, name)
+            ftp.quit()
+
+        def sample():
+            while not done.wait(SAMPLE_INTERVAL):
+                samples.append(sum(benchlib.resident(server.path(name))
+                                   for name in hot_names) / len(hot_names))
+
+        threads = [threading.Thread(target=download),
+                   threading.Thread(target=sample)]
+        ftp = server.login()
+        ftp.voidcmd('TYPE I')
+        for t in threads:
+            t.start()
+        start = time.perf_counter()
+        ftp.storbinary('STOR ingest.bin', Upload(args.ingest * MIB),
+                       blocksize=1 << 20)
+        wall = time.perf_counter() - start
+        done.set()
+        for t in threads:
+            t.join()
+        ftp.quit()
+
+        hot_after = sum(benchlib.resident(server.path(name))
+                        for name in hot_names) / len(hot_names)
+        return [benchlib.label(binary), 'direct' if direct else 'buffered',
+                '%.0f' % (args.ingest / wall),
+                '%.0f' % (downloaded[0] / MIB / wall),
+                '%.0f%%' % (100 * sum(samples) / max(len(samples), 1)),
+                '%.0f%%' % (100 * min(samples, default=hot_after)),
+                '%.0f%%' % (100 * hot_after),
+                '%.0f%%' % (100 * benchlib.resident(server.path('ingest.bin')))]
+
+
+def main():
+    args = benchlib.arguments('Hot file downloads during a bulk upload.',
+                              hot=(int, 512, 'size of the hot files in MiB'),
+                              hot_files=(int, 16, 'number of hot files'),
+                              ingest=(int, memory_mib(), 'size of the upload '
+                                      'in MiB'))
+    rows = []
+    for binary in args.server:
+        for direct in (False, True):
+            rows.append(run(binary, direct, args))
+
+    benchlib.report(rows, ['server', 'upload', 'upload MiB/s',
+                           'RETR MiB/s', 'hot cached', 'hot min', 'hot after',
+                           'upload cached'])
+
+
+if __name__ == '__main__':
+    main()
@@ -0,0 +1,96 @@
+###############################################################################
+# FTP-Server
+# Author: Evan Myers
+# Date: October 2026
+#
+# Description:
+#   Files per second of small file downloads, one RETR per file against
+#   batches of SITE MRETR. MRETR sends each file of a batch as a frame on one
+#   data connection: the length of the path (2 bytes), the path, the size of
+#   the file (8 bytes) and its data, with numbers big-endian. A path length of
+#   0 ends the batch.
+#
+#   A server from before commands were started without waiting out the
+#   session loop's select() takes about 300 ms for each RETR, give it fewer
+#   files.
+#
+#   eg. python3 bench/bench_mretr.py --files 2000 --batch 250
+###############################################################################
+import os
+import random
+import struct
+import time
+
+import benchlib
+from benchlib import Server
+
+
+def read_exact(conn, n):
+    data = bytearray()
+    while len(data) < n:
+        chunk = conn.recv(n - len(data))
+        if not chunk:
+            raise EOFError('the data connection closed in a frame')
+        data += chunk
+    return bytes(data)
+
+
+def mretr(ftp, names):
+    """Retrieve a batch of files with SITE MRETR, and return them by name."""
+    conn = ftp.transfercmd('SITE MRETR ' + ' '.join(names))
+    files = {}
+    while True:
+        length, = struct.unpack('>H', read_exact(conn, 2))
+        if length == 0:
+            break
+        name = read_exact(conn, length).decode()
+        size, = struct.unpack('>Q', read_exact(conn, 8))
+        files[name] = read_exact(conn, size)
+    conn.close()
+    ftp.voidresp()
+    return files
+
+
+def main():
+    args = benchlib.arguments('Small file downloads, RETR against MRETR.',
+                              files=(int, 2000, 'number of files'),
+                              batch=(int, 250, 'files per MRETR'))
+    rand = random.Random(1)
+    rows = []
+    for binary in args.server:
+        with Server(binary) as server:
+            names = ['f%05d.dat' % i for i in range(args.files)]
+            content = {}
+            for name in names:
+                content[name] = os.urandom(rand.randrange(2048, 10241))
+                with open(server.path(name), 'wb') as f:
+                    f.write(content[name])
+
+            ftp = server.login()
+            ftp.voidcmd('TYPE I')
+
+            start = time.perf_counter()
+            for name in names:
+                data = []
+                ftp.retrbinary('RETR ' + name, data.append)
+                if b''.join(data) != content[name]:
+                    raise RuntimeError('RETR %s: the file differs' % name)
+            wall = time.perf_counter() - start
+            rows.append([benchlib.label(binary), 'RETR', len(names),
+                         '%.0f' % (len(names) / wall)])
+
+            start = time.perf_counter()
+            for i in range(0, len(names), args.batch):
+                batch = names[i:i + args.batch]
+                if mretr(ftp, batch) != {n: content[n] for n in batch}:
+                    raise RuntimeError('MRETR: the files differ')
+            wall = time.perf_counter() - start
+            rows.append([benchlib.label(binary), 'MRETR %d' % args.batch,
+                         len(names), '%.0f' % (len(names) / wall)])
+            ftp.quit()
+
+    benchlib.report(rows, ['server', 'command', 'files', 'files/s'])
+
+
+if __name__ == '__main__':
+    main()
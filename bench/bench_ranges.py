@@ -0,0 +1,91 @@
+###############################################################################
+# FTP-Server
+# Author: Evan Myers
+# Date: October 2026
+#
+# Description:
+#   Aggregate throughput of a segmented RETR against the number of streams.
+#   The file is split into as many byte ranges as there are streams, and each
+#   range is fetched with RANG and RETR on a session of its own, at the same
+#   time. The ranges are put back together and checked against the file.
+#
+#   Over the loopback interface one stream is not held back by latency, so
+#   the per-session rate limit (SESSION_RATE_LIMIT_CONFIG) stands in for the
+#   rate one TCP stream reaches on a long link.
+#
+#   eg. python3 bench/bench_ranges.py --stream-rate 50 --streams 1,2,4,8
+###############################################################################
+import threading
+
+import benchlib
+from benchlib import MIB, Measure, Server
+
+
+def fetch(server, start, end, buf, errors):
+    """RETR the bytes start to end of the file into buf, on a new session."""
+    try:
+        ftp = server.login()
+        ftp.voidcmd('TYPE I')
+        ftp.sendcmd('RANG %d %d' % (start, end - 1))
+        conn = ftp.transfercmd('RETR ranges.bin')
+        view = memoryview(buf)
+        got = start
+        while got < end:
+            n = conn.recv_into(view[got:end])
+            if n == 0:
+                break
+            got += n
+        conn.close()
+        ftp.voidresp()
+        ftp.quit()
+        if got != end:
+            errors.append('range %d-%d: received %d bytes'
+                          % (start, end, got - start))
+    except Exception as e:
+        errors.append('range %d-%d: %s' % (start, end, e))
+
+
+def main():
+    args = benchlib.arguments('Throughput of a RETR split over streams.',
+                              size=(int, 512, 'file size in MiB'),
+                              stream_rate=(float, 50, 'rate of each stream in '
+                                           'MiB/s, 0 for no limit'),
+                              streams=(str, '1,2,4,8', 'numbers of streams'))
+    counts = [int(n) for n in args.streams.split(',')]
+    size = args.size * MIB
+    rows = []
+    for binary in args.server:
+        with Server(binary, SESSION_RATE_LIMIT_CONFIG=str(
+                int(args.stream_rate * MIB))) as server:
+            path = server.path('ranges.bin')
+            benchlib.write_random(path, size)
+            benchlib.warm(path)
+            with open(path, 'rb') as f:
+                content = f.read()
+
+            for count in counts:
+                buf = bytearray(size)
+                errors = []
+                bounds = [size * i // count for i in range(count + 1)]
+                threads = [threading.Thread(target=fetch,
+                                            args=(server, bounds[i],
+                                                  bounds[i + 1], buf, errors))
+                           for i in range(count)]
+                with Measure(server) as m:
+                    for t in threads:
+                        t.start()
+                    for t in threads:
+                        t.join()
+                if errors:
+                    raise RuntimeError('; '.join(errors))
+                if buf != content:
+                    raise RuntimeError('%d streams: the file differs' % count)
+                rows.append([benchlib.label(binary), count,
+                             '%.0f' % (size / MIB / m.wall),
+                             '%.3f' % (m.cpu * 1024 * MIB / size)])
+
+    benchlib.report(rows, ['server', 'streams', 'MiB/s', 'server CPU s/GiB'])
+
+
+if __name__ == '__main__':
+    main()
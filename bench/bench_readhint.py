@@ -0,0 +1,139 @@
+###############################################################################
+# FTP-Server
+# Author: Evan Myers
+# Date: October 2026
+#
+# Description:
+#   Page cache hit ratio of a mixed download workload, with and without the
+#   page cache hints of downloads (READAHEAD_CONFIG and DROP_BEHIND_CONFIG).
+#   One session RETRs a set of small hot files over and over, while another
+#   RETRs large cold files once each, read from the disk. The share of the hot
+#   files in the page cache is sampled during the cold downloads, which is the
+#   hit rate the hot downloads see, and the rate of the cold downloads shows
+#   the effect of readahead.
+#
+#   The cold files have to be larger than the free memory to push the hot
+#   files out, by default they add up to the size of the memory of the
+#   machine. They are written once, and linked into the root of each server.
+#
+#   eg. python3 bench/bench_readhint.py --hot 256 --cold 8192
+###############################################################################
+import os
+import shutil
+import tempfile
+import threading
+import time
+
+import benchlib
+from benchlib import MIB, Server
+
+
+#How often the hot files are checked for being in the page cache, in seconds.
+SAMPLE_INTERVAL = 0.5
+
+#The number of hot and cold files.
+HOT_FILES = 64
+COLD_FILES = 4
+
+#The settings compared: no hints, then readahead and drop-behind of the cold
+#files, which are larger than the threshold.
+CONFIGS = [('none', {'READAHEAD_CONFIG': '0', 'DROP_BEHIND_CONFIG': '0'}),
+           ('hints', {'READAHEAD_CONFIG': '8388608',
+                      'DROP_BEHIND_CONFIG': str(256 * MIB)})]
+
+
+def memory_mib():
+    with open('/proc/meminfo') as f:
+        for line in f:
+            if line.startswith('MemTotal:'):
+                return int(line.split()[1]) // 1024
+    return 4096
+
+
+def write_cold(path, size):
+    """Write a file of one random block over and over, and drop it from the
+    page cache."""
+    block = os.urandom(8 * MIB)
+    with open(path, 'wb') as f:
+        for left in range(size, 0, -len(block)):
+            f.write(block[:min(left, len(block))])
+    benchlib.drop_caches(path)
+
+
+def run(binary, name, settings, cold_dir, args):
+    """Download the cold files while the hot files are downloaded, and return
+    a row of the results."""
+    hot_names = ['hot%d.bin' % i for i in range(HOT_FILES)]
+    cold_names = sorted(os.listdir(cold_dir))
+    with Server(binary, **settings) as server:
+        for hot in hot_names:
+            benchlib.write_random(server.path(hot), args.hot * MIB // HOT_FILES)
+            benchlib.warm(server.path(hot))
+        for cold in cold_names:
+            benchlib.drop_caches(os.path.join(cold_dir, cold))
+            os.link(os.path.join(cold_dir, cold), server.path(cold))
+
+        done = threading.Event()
+        hot_bytes = [0]
+        samples = []
+
+        def download():
+            ftp = server.login()
+            ftp.voidcmd('TYPE I')
+            while not done.is_set():
+                for hot in hot_names:
+                    hot_bytes[0] += benchlib.retr(ftp, hot)
+            ftp.quit()
+
+        def sample():
+            while not done.wait(SAMPLE_INTERVAL):
+                samples.append(sum(benchlib.resident(server.path(hot))
+                                   for hot in hot_names) / len(hot_names))
+
+        threads = [threading.Thread(target=download),
+                   threading.Thread(target=sample)]
+        ftp = server.login()
+        ftp.voidcmd('TYPE I')
+        for t in threads:
+            t.start()
+        start = time.perf_counter()
+        cold_bytes = sum(benchlib.retr(ftp, cold) for cold in cold_names)
+        wall = time.perf_counter() - start
+        done.set()
+        for t in threads:
+            t.join()
+        ftp.quit()
+
+        cold_cached = sum(benchlib.resident(server.path(cold))
+                          for cold in cold_names) / len(cold_names)
+        return [benchlib.label(binary), name,
+                '%.0f' % (cold_bytes / MIB / wall),
+                '%.0f' % (hot_bytes[0] / MIB / wall),
+                '%.0f%%' % (100 * sum(samples) / max(len(samples), 1)),
+                '%.0f%%' % (100 * min(samples, default=1.0)),
+                '%.0f%%' % (100 * cold_cached)]
+
+
+def main():
+    args = benchlib.arguments('Page cache hit ratio of hot and cold downloads.',
+                              hot=(int, 256, 'size of the hot files in MiB'),
+                              cold=(int, memory_mib(), 'size of the cold files '
+                                    'in MiB'))
+    cold_dir = tempfile.mkdtemp(prefix='ftpd-bench-')
+    try:
+        for i in range(COLD_FILES):
+            write_cold(os.path.join(cold_dir, 'cold%d.bin' % i),
+                       args.cold * MIB // COLD_FILES)
+        rows = []
+        for binary in args.server:
+            for name, settings in CONFIGS:
+                rows.append(run(binary, name, settings, cold_dir, args))
+    finally:
+        shutil.rmtree(cold_dir, ignore_errors=True)
+
+    benchlib.report(rows, ['server', 'hints', 'cold MiB/s', 'hot MiB/s',
+                           'hot cached', 'hot min', 'cold cached'])
+
+
+if __name__ == '__main__':
+    main()
@@ -0,0 +1,45 @@
+###############################################################################
+# FTP-Server
+# Author: Evan Myers
+# Date: October 2026
+#
+# Description:
+#   Throughput of an image (TYPE I) RETR of a large file that is in the page
+#   cache, and the CPU time the server spends per GiB. The server sends such
+#   a file with sendfile(); give the server of the commit before zero-copy
+#   RETR with --server to compare with the fread() and send() loop.
+#
+#   eg. python3 bench/bench_retr.py --server src/ftpd \
+#         --server "$(bench/build.sh <commit>~1)"
+###############################################################################
+import benchlib
+from benchlib import MIB, Measure, Server
+
+
+def main():
+    args = benchlib.arguments('Throughput of RETR of a cached file.',
+                              size=(int, 1024, 'file size in MiB'),
+                              runs=(int, 3, 'downloads per server'))
+    rows = []
+    for binary in args.server:
+        with Server(binary) as server:
+            path = server.path('retr.bin')
+            benchlib.write_random(path, args.size * MIB)
+            benchlib.warm(path)
+            ftp = server.login()
+            ftp.voidcmd('TYPE I')
+            for run in range(args.runs):
+                with Measure(server) as m:
+                    got = benchlib.retr(ftp, 'retr.bin')
+                if got != args.size * MIB:
+                    raise RuntimeError('received %d bytes' % got)
+                rows.append([benchlib.label(binary), run + 1,
+                             '%.0f' % (got / MIB / m.wall),
+                             '%.3f' % (m.cpu * 1024 * MIB / got)])
+            ftp.quit()
+
+    benchlib.report(rows, ['server', 'run', 'MiB/s', 'server CPU s/GiB'])
+
+
+if __name__ == '__main__':
+    main()
@@ -0,0 +1,103 @@
+###############################################################################
+# FTP-Server
+# Author: Evan Myers
+# Date: October 2026
+#
+# Description:
+#   Effective throughput of MODE Z downloads at each compression level, with
+#   the server CPU time it costs. A text file like a log is sent in MODE S,
+#   then in MODE Z at the levels given. The server rate limit
+#   (RATE_LIMIT_CONFIG) stands in for a slow link, so a level that compresses
+#   more moves the file faster until the server runs out of CPU. The cache of
+#   compressed files is off, so every download is compressed.
+#
+#   eg. python3 bench/bench_zmode.py --link 12.5 --levels 1,6,9
+###############################################################################
+import random
+import zlib
+
+import benchlib
+from benchlib import MIB, Measure, Server
+
+
+def write_log(path, size):
+    """A file of log lines, which deflate compresses about 5-10 times."""
+    rand = random.Random(1)
+    hosts = ['10.0.%d.%d' % (rand.randrange(4), rand.randrange(256))
+             for i in range(64)]
+    paths = ['/api/v1/items/%d' % i for i in range(500)] + \
+            ['/static/app.js', '/static/style.css', '/index.html']
+    with open(path, 'w') as f:
+        written = 0
+        second = 0
+        while written < size:
+            line = '%s - - [19/Oct/2026:%02d:%02d:%02d +0000] "GET %s HTTP/1.1" ' \
+                   '%d %d "-" "client/%d.%d"\n' % (
+                       rand.choice(hosts), second // 3600 % 24,
+                       second // 60 % 60, second % 60, rand.choice(paths),
+                       rand.choice((200, 200, 200, 304, 404)),
+                       rand.randrange(100, 50000), rand.randrange(1, 4),
+                       rand.randrange(10))
+            second += rand.randrange(2)
+            f.write(line)
+            written += len(line)
+
+
+def download(ftp, name, mode):
+    """RETR a file in a mode, and return the bytes on the wire and the data."""
+    wire = [0]
+    inflate = zlib.decompressobj()
+    out = []
+
+    def received(block):
+        wire[0] += len(block)
+        out.append(inflate.decompress(block) if mode == 'Z' else block)
+
+    ftp.retrbinary('RETR ' + name, received, blocksize=1 << 20)
+    return wire[0], b''.join(out)
+
+
+def main():
+    args = benchlib.arguments('Throughput and CPU of MODE Z at each level.',
+                              size=(int, 256, 'file size in MiB'),
+                              link=(float, 12.5, 'link rate in MiB/s, '
+                                    '0 for no limit'),
+                              levels=(str, '1,3,6,9', 'compression levels'))
+    levels = [int(l) for l in args.levels.split(',')]
+    rows = []
+    for binary in args.server:
+        with Server(binary, RATE_LIMIT_CONFIG=str(int(args.link * MIB)),
+                    ZCACHE_SIZE_CONFIG='0') as server:
+            path = server.path('access.log')
+            write_log(path, args.size * MIB)
+            benchlib.warm(path)
+            with open(path, 'rb') as f:
+                content = f.read()
+
+            ftp = server.login()
+            ftp.voidcmd('TYPE I')
+            for level in [None] + levels:
+                if level is None:
+                    ftp.voidcmd('MODE S')
+                else:
+                    ftp.voidcmd('MODE Z')
+                    ftp.voidcmd('OPTS MODE Z LEVEL %d' % level)
+                with Measure(server) as m:
+                    wire, data = download(ftp, 'access.log',
+                                          'S' if level is None else 'Z')
+                if data != content:
+                    raise RuntimeError('level %s: the file differs' % level)
+                rows.append([benchlib.label(binary),
+                             'S' if level is None else 'Z %d' % level,
+                             '%.1f' % (len(content) / wire),
+                             '%.1f' % (wire / MIB / m.wall),
+                             '%.1f' % (len(content) / MIB / m.wall),
+                             '%.2f' % (m.cpu * MIB * 1024 / len(content))])
+            ftp.quit()
+
+    benchlib.report(rows, ['server', 'mode', 'ratio', 'wire MiB/s',
+                           'effective MiB/s', 'server CPU s/GiB'])
+
+
+if __name__ == '__main__':
+    main()
@@ -0,0 +1,153 @@
+###############################################################################
+# FTP-Server
+# Author: Evan Myers
+# Date: October 2026
+#
+# Description:
+#   Helpers shared by the benchmarks. A benchmark starts a server with the
+#   harness of the tests (tests/ftptest.py), and may be given other server
+#   executables to compare with, eg. one built from the commit before a
+#   change with bench/build.sh.
+#
+#   The numbers are those of the machine the benchmark runs on, over the
+#   loopback interface.
+###############################################################################
+import argparse
+import ctypes
+import ctypes.util
+import mmap
+import os
+import sys
+import time
+
+sys.path.insert(0, os.path.join(os.path.dirname(os.path.dirname(
+    os.path.abspath(__file__))), 'tests'))
+from ftptest import REPO, Server
+
+
+MIB = 1024 * 1024
+
+libc = ctypes.CDLL(ctypes.util.find_library('c'), use_errno=True)
+libc.mmap.restype = ctypes.c_void_p
+libc.mmap.argtypes = [ctypes.c_void_p, ctypes.c_size_t, ctypes.c_int,
+                      ctypes.c_int, ctypes.c_int, ctypes.c_long]
+libc.munmap.argtypes = [ctypes.c_void_p, ctypes.c_size_t]
+libc.mincore.argtypes = [ctypes.c_void_p, ctypes.c_size_t, ctypes.c_char_p]
+
+
+def arguments(description, **extra):
+    """Parse the options every benchmark takes, and the extra ones given as
+    name=(type, default, help)."""
+    parser = argparse.ArgumentParser(description=description)
+    parser.add_argument('--server', action='append', default=[],
+                        help='a server executable to run, may be given more '
+                        'than once (default: src/ftpd)')
+    for name, (kind, default, text) in extra.items():
+        parser.add_argument('--' + name.replace('_', '-'), type=kind,
+                            default=default, help=text)
+    args = parser.parse_args()
+    if not args.server:
+        args.server = [os.path.join(REPO, 'src', 'ftpd')]
+    return args
+
+
+def label(binary):
+    """A short name of a server executable for the results."""
+    path = os.path.abspath(binary)
+    if path.startswith(REPO + os.sep):
+        return os.path.relpath(path, REPO)
+    return binary
+
+
+def write_random(path, size):
+    with open(path, 'wb') as f:
+        for left in range(size, 0, -MIB):
+            f.write(os.urandom(min(left, MIB)))
+
+
+def cpu_seconds(pid):
+    """The user and system time a process has used, in seconds."""
+    with open('/proc/%d/stat' % pid) as f:
+        fields = f.read().rsplit(')', 1)[1].split()
+    return (int(fields[11]) + int(fields[12])) / os.sysconf('SC_CLK_TCK')
+
+
+class Measure:
+    """The wall and server CPU time of the block of a with statement."""
+
+    def __init__(self, server):
+        self.pid = server.proc.pid
+
+    def __enter__(self):
+        self.cpu = cpu_seconds(self.pid)
+        self.start = time.perf_counter()
+        return self
+
+    def __exit__(self, *exc):
+        self.wall = time.perf_counter() - self.start
+        self.cpu = cpu_seconds(self.pid) - self.cpu
+        return False
+
+
+def drop_caches(path=None):
+    """Drop the pages of a file from the page cache, or of every file if none
+    is given (this needs root)."""
+    if path is None:
+        os.sync()
+        with open('/proc/sys/vm/drop_caches', 'w') as f:
+            f.write('3\n')
+        return
+    fd = os.open(path, os.O_RDONLY)
+    os.fdatasync(fd)
+    os.posix_fadvise(fd, 0, 0, os.POSIX_FADV_DONTNEED)
+    os.close(fd)
+
+
+def warm(path):
+    """Read a file into the page cache."""
+    with open(path, 'rb') as f:
+        while f.read(8 * MIB):
+            pass
+
+
+def resident(path):
+    """The fraction of the pages of a file that are in the page cache."""
+    size = os.path.getsize(path)
+    if size == 0:
+        return 1.0
+    pages = (size + mmap.PAGESIZE - 1) // mmap.PAGESIZE
+    vec = ctypes.create_string_buffer(pages)
+    fd = os.open(path, os.O_RDONLY)
+    try:
+        addr = libc.mmap(None, size, mmap.PROT_READ, mmap.MAP_SHARED, fd, 0)
+        if addr == ctypes.c_void_p(-1).value:
+            raise OSError(ctypes.get_errno(), 'mmap')
+        try:
+            if libc.mincore(addr, size, vec) != 0:
+                raise OSError(ctypes.get_errno(), 'mincore')
+        finally:
+            libc.munmap(addr, size)
+    finally:
+        os.close(fd)
+    return sum(b & 1 for b in vec.raw) / pages
+
+
+def retr(ftp, name, sink=None):
+    """RETR a file, and return the bytes received."""
+    count = [0]
+
+    def received(block):
+        count[0] += len(block)
+        if sink is not None:
+            sink(block)
+
+    ftp.retrbinary('RETR ' + name, received, blocksize=1 << 20)
+    return count[0]
+
+
+def report(rows, header):
+    """Print a table of results."""
+    widths = [max(len(str(r[i])) for r in [header] + rows)
+              for i in range(len(header))]
+    for row in [header] + rows:
+        print('  '.join(str(c).rjust(w) for c, w in zip(row, widths)))
@@ -0,0 +1,31 @@
+#!/bin/sh
+###############################################################################
+# FTP-Server
+# Author: Evan Myers
+# Date: October 2026
+#
+# Description:
+#   Build the server of a commit, to compare a change with the server before
+#   it in a benchmark. Prints the path of the executable.
+#
+#   Usage: bench/build.sh <commit> [directory]
+#   eg.    python3 bench/bench_retr.py --server "$(bench/build.sh HEAD~1)"
+###############################################################################
+set -e
+
+if [ $# -lt 1 ]; then
+  echo "usage: $0 <commit> [directory]" >&2
+  exit 2
+fi
+
+repo=$(cd "$(dirname "$0")/.." && pwd)
+commit=$(git -C "$repo" rev-parse --short "$1")
+dir=${2:-${TMPDIR:-/tmp}/ftpd-$commit}
+
+mkdir -p "$dir"
+git -C "$repo" archive "$commit" | tar -x -C "$dir"
+make -C "$dir/src" ftpd > "$dir/build.log" 2>&1 || {
+  echo "$0: the build failed, see $dir/build.log" >&2
+  exit 1
+}
+echo "$dir/src/ftpd"
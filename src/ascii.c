@@ -0,0 +1,472 @@
+/******************************************************************************
+ * FTP-Server
+ * Author: Evan Myers
+ * Date: October 2026
+ *
+ * Description:
+ *   Line ending translation for TYPE A transfers. See ascii.h for an overview.
+ *
+ *   Each kernel searches a block of input for the line ending character, and
+ *   copies the block unchanged when there is none, which is the common case
+ *   for text with long lines. Otherwise the bytes between line endings are
+ *   copied, and the line endings are rewritten. The kernel is chosen once,
+ *   from the features of the processor the server is running on.
+ *****************************************************************************/
+#include <errno.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "ascii.h"
+#include "pipeline.h"
+
+/* The vector kernels are compiled with per-function target attributes, so
+ * the server still runs on processors without AVX2. */
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define ASCII_X86_SIMD
+#include <immintrin.h>
+#endif
+
+
+//Translate a block of data. 'out' must have room for the translated data.
+typedef size_t (*encode_fn_t) (const uint8_t *in, size_t len, uint8_t *out);
+typedef size_t (*decode_fn_t) (const uint8_t *in, size_t len, uint8_t *out,
+			       bool *pendingCR);
+
+
+//Local function prototypes.
+static void select_kernels (void);
+static int reserve (ascii_conv_t *ac, size_t size);
+static int encode_push (pipe_stage_t *stage, const uint8_t *data, size_t len);
+static int decode_push (pipe_stage_t *stage, const uint8_t *data, size_t len);
+static int decode_finish (pipe_stage_t *stage);
+static size_t encode_scalar (const uint8_t *in, size_t len, uint8_t *out);
+static size_t decode_scalar (const uint8_t *in, size_t len, uint8_t *out,
+			     bool *pendingCR);
+#ifdef ASCII_X86_SIMD
+static void copy_run_sse2 (uint8_t *out, const uint8_t *in, size_t len,
+			   bool wide);
+static void copy_run_avx2 (uint8_t *out, const uint8_t *in, size_t len,
+			   bool wide);
+static size_t encode_sse2 (const uint8_t *in, size_t len, uint8_t *out);
+static size_t decode_sse2 (const uint8_t *in, size_t len, uint8_t *out,
+			   bool *pendingCR);
+static size_t encode_avx2 (const uint8_t *in, size_t len, uint8_t *out);
+static size_t decode_avx2 (const uint8_t *in, size_t len, uint8_t *out,
+			   bool *pendingCR);
+#endif
+
+
+//The kernels in use, set once by select_kernels().
+static pthread_once_t kernelsOnce = PTHREAD_ONCE_INIT;
+static encode_fn_t encode = encode_scalar;
+static decode_fn_t decode = decode_scalar;
+
+
+/******************************************************************************
+ * ascii_start - see ascii.h
+ *****************************************************************************/
+void ascii_start (ascii_conv_t *ac)
+{
+  pthread_once (&kernelsOnce, select_kernels);
+
+  ac->pendingCR = false;
+  ac->out = NULL;
+  ac->outSize = 0;
+}
+
+
+/******************************************************************************
+ * ascii_end - see ascii.h
+ *****************************************************************************/
+void ascii_end (ascii_conv_t *ac)
+{
+  free (ac->out);
+  ac->out = NULL;
+  ac->outSize = 0;
+}
+
+
+/******************************************************************************
+ * ascii_encode - see ascii.h
+ *****************************************************************************/
+const uint8_t *ascii_encode (ascii_conv_t *ac, const uint8_t *in, size_t len,
+			     size_t *outLen)
+{
+  //Every byte may be a LF, which doubles in size.
+  if (reserve (ac, len * 2) == -1)
+    return NULL;
+
+  *outLen = encode (in, len, ac->out);
+  return ac->out;
+}
+
+
+/******************************************************************************
+ * ascii_stage - see ascii.h
+ *****************************************************************************/
+void ascii_stage (ascii_conv_t *ac, pipe_stage_t *stage, bool send)
+{
+  if (send)
+    pipe_stage_init (stage, "ascii-encode", encode_push, NULL, ac);
+  else
+    pipe_stage_init (stage, "ascii-decode", decode_push, decode_finish, ac);
+}
+
+
+/******************************************************************************
+ * The stage that translates data to be sent.
+ *****************************************************************************/
+static int encode_push (pipe_stage_t *stage, const uint8_t *data, size_t len)
+{
+  const uint8_t *out;
+  size_t outLen;
+
+  if ((out = ascii_encode (stage->state, data, len, &outLen)) == NULL)
+    return -1;
+
+  return pipe_next (stage, out, outLen);
+}
+
+
+/******************************************************************************
+ * The stage that translates received data. A CR that is not followed by LF
+ * is passed on unchanged.
+ *****************************************************************************/
+static int decode_push (pipe_stage_t *stage, const uint8_t *data, size_t len)
+{
+  ascii_conv_t *ac = stage->state;
+  uint8_t *out;
+  size_t outLen;
+
+  //The output is never longer than the input, plus a held back CR.
+  if (reserve (ac, len + 1) == -1)
+    return -1;
+  out = ac->out;
+
+  //Complete a CRLF that was split between the last buffer and this one.
+  if (ac->pendingCR) {
+    ac->pendingCR = false;
+    if (data[0] == '\n') {
+      *out++ = '\n';
+      ++data;
+      --len;
+    } else {
+      *out++ = '\r';
+    }
+  }
+
+  outLen = (out - ac->out) + decode (data, len, out, &ac->pendingCR);
+  return pipe_next (stage, ac->out, outLen);
+}
+
+
+/******************************************************************************
+ * Pass on a CR held back at the end of the received data.
+ *****************************************************************************/
+static int decode_finish (pipe_stage_t *stage)
+{
+  ascii_conv_t *ac = stage->state;
+
+  if (!ac->pendingCR)
+    return 0;
+
+  ac->pendingCR = false;
+  return pipe_next (stage, (const uint8_t *)"\r", 1);
+}
+
+
+/******************************************************************************
+ * Choose the fastest kernels supported by the processor.
+ *****************************************************************************/
+static void select_kernels (void)
+{
+#ifdef ASCII_X86_SIMD
+  __builtin_cpu_init ();
+  if (__builtin_cpu_supports ("avx2")) {
+    encode = encode_avx2;
+    decode = decode_avx2;
+  } else if (__builtin_cpu_supports ("sse2")) {
+    encode = encode_sse2;
+    decode = decode_sse2;
+  }
+#endif
+}
+
+
+/******************************************************************************
+ * Grow the output buffer to hold at least 'size' bytes.
+ *
+ * Return values:
+ *   0    success
+ *  -1    error, the buffer is unchanged.
+ *****************************************************************************/
+static int reserve (ascii_conv_t *ac, size_t size)
+{
+  uint8_t *out;
+
+  if (size <= ac->outSize)
+    return 0;
+
+  if ((out = realloc (ac->out, size)) == NULL) {
+    fprintf (stderr, "%s: realloc of %zu bytes failed\n", __FUNCTION__, size);
+    return -1;
+  }
+
+  ac->out = out;
+  ac->outSize = size;
+  return 0;
+}
+
+
+/******************************************************************************
+ * The portable LF to CRLF kernel. memchr() finds each LF, and the text
+ * between them is copied with memcpy().
+ *****************************************************************************/
+static size_t encode_scalar (const uint8_t *in, size_t len, uint8_t *out)
+{
+  const uint8_t *end = in + len;
+  const uint8_t *lf;
+  uint8_t *o = out;
+
+  while ((lf = memchr (in, '\n', end - in)) != NULL) {
+    memcpy (o, in, lf - in);
+    o += lf - in;
+    *o++ = '\r';
+    *o++ = '\n';
+    in = lf + 1;
+  }
+  memcpy (o, in, end - in);
+  o += end - in;
+
+  return o - out;
+}
+
+
+/******************************************************************************
+ * The portable CRLF to LF kernel. A CR that ends the input is not written,
+ * instead 'pendingCR' is set for the caller to resolve with the next input.
+ *****************************************************************************/
+static size_t decode_scalar (const uint8_t *in, size_t len, uint8_t *out,
+			     bool *pendingCR)
+{
+  const uint8_t *end = in + len;
+  const uint8_t *cr;
+  uint8_t *o = out;
+
+  while ((cr = memchr (in, '\r', end - in)) != NULL) {
+    memcpy (o, in, cr - in);
+    o += cr - in;
+    if (cr + 1 == end)
+      *pendingCR = true;
+    else if (cr[1] != '\n')
+      *o++ = '\r';
+    in = cr + 1;
+  }
+  memcpy (o, in, end - in);
+  o += end - in;
+
+  return o - out;
+}
+
+
+#ifdef ASCII_X86_SIMD
+/* The vector kernels share one pattern. A bit mask of the line endings in each
+ * block is built with a compare and a movemask. A block without any is stored
+ * as it is, otherwise each set bit is visited in turn. The tail of the input
+ * that does not fill a block is left to the portable kernels.
+ *
+ * The bytes between two line endings in a block are copied as a whole vector
+ * while a vector of input is left after the block. The bytes written past the
+ * run are overwritten by the next one, and the output, which is at least as
+ * long as the input left, has room for them. */
+
+
+/******************************************************************************
+ * Copy a run of bytes that is shorter than a vector, as a whole vector when
+ * 'wide', which costs less than a call to memcpy() of a variable length.
+ *****************************************************************************/
+__attribute__ ((target ("sse2")))
+static void copy_run_sse2 (uint8_t *out, const uint8_t *in, size_t len,
+			   bool wide)
+{
+  if (wide)
+    _mm_storeu_si128 ((__m128i *)out, _mm_loadu_si128 ((const __m128i *)in));
+  else
+    memcpy (out, in, len);
+}
+
+
+__attribute__ ((target ("avx2")))
+static void copy_run_avx2 (uint8_t *out, const uint8_t *in, size_t len,
+			   bool wide)
+{
+  if (wide)
+    _mm256_storeu_si256 ((__m256i *)out,
+			 _mm256_loadu_si256 ((const __m256i *)in));
+  else
+    memcpy (out, in, len);
+}
+
+
+/******************************************************************************
+ * The SSE2 LF to CRLF kernel, 16 bytes at a time.
+ *****************************************************************************/
+__attribute__ ((target ("sse2")))
+static size_t encode_sse2 (const uint8_t *in, size_t len, uint8_t *out)
+{
+  const __m128i lf = _mm_set1_epi8 ('\n');
+  uint8_t *o = out;
+  size_t i = 0;
+
+  for (; i + 16 <= len; i += 16) {
+    __m128i v = _mm_loadu_si128 ((const __m128i *)(in + i));
+    unsigned int mask = _mm_movemask_epi8 (_mm_cmpeq_epi8 (v, lf));
+    unsigned int start = 0;
+    bool wide = i + 32 <= len;
+
+    if (mask == 0) {
+      _mm_storeu_si128 ((__m128i *)o, v);
+      o += 16;
+      continue;
+    }
+
+    while (mask != 0) {
+      unsigned int pos = __builtin_ctz (mask);
+      copy_run_sse2 (o, in + i + start, pos - start, wide);
+      o += pos - start;
+      *o++ = '\r';
+      *o++ = '\n';
+      start = pos + 1;
+      mask &= mask - 1;
+    }
+    copy_run_sse2 (o, in + i + start, 16 - start, wide);
+    o += 16 - start;
+  }
+
+  return (o - out) + encode_scalar (in + i, len - i, o);
+}
+
+
+/******************************************************************************
+ * The SSE2 CRLF to LF kernel, 16 bytes at a time.
+ *****************************************************************************/
+__attribute__ ((target ("sse2")))
+static size_t decode_sse2 (const uint8_t *in, size_t len, uint8_t *out,
+			   bool *pendingCR)
+{
+  const __m128i cr = _mm_set1_epi8 ('\r');
+  uint8_t *o = out;
+  size_t i = 0;
+
+  for (; i + 16 <= len; i += 16) {
+    __m128i v = _mm_loadu_si128 ((const __m128i *)(in + i));
+    unsigned int mask = _mm_movemask_epi8 (_mm_cmpeq_epi8 (v, cr));
+    unsigned int start = 0;
+    bool wide = i + 32 <= len;
+
+    if (mask == 0) {
+      _mm_storeu_si128 ((__m128i *)o, v);
+      o += 16;
+      continue;
+    }
+
+    while (mask != 0) {
+      unsigned int pos = __builtin_ctz (mask);
+      copy_run_sse2 (o, in + i + start, pos - start, wide);
+      o += pos - start;
+      if (i + pos + 1 == len)
+	*pendingCR = true;
+      else if (in[i + pos + 1] != '\n')
+	*o++ = '\r';
+      start = pos + 1;
+      mask &= mask - 1;
+    }
+    copy_run_sse2 (o, in + i + start, 16 - start, wide);
+    o += 16 - start;
+  }
+
+  return (o - out) + decode_scalar (in + i, len - i, o, pendingCR);
+}
+
+
+/******************************************************************************
+ * The AVX2 LF to CRLF kernel, 32 bytes at a time.
+ *****************************************************************************/
+__attribute__ ((target ("avx2")))
+static size_t encode_avx2 (const uint8_t *in, size_t len, uint8_t *out)
+{
+  const __m256i lf = _mm256_set1_epi8 ('\n');
+  uint8_t *o = out;
+  size_t i = 0;
+
+  for (; i + 32 <= len; i += 32) {
+    __m256i v = _mm256_loadu_si256 ((const __m256i *)(in + i));
+    unsigned int mask = _mm256_movemask_epi8 (_mm256_cmpeq_epi8 (v, lf));
+    unsigned int start = 0;
+    bool wide = i + 64 <= len;
+
+    if (mask == 0) {
+      _mm256_storeu_si256 ((__m256i *)o, v);
+      o += 32;
+      continue;
+    }
+
+    while (mask != 0) {
+      unsigned int pos = __builtin_ctz (mask);
+      copy_run_avx2 (o, in + i + start, pos - start, wide);
+      o += pos - start;
+      *o++ = '\r';
+      *o++ = '\n';
+      start = pos + 1;
+      mask &= mask - 1;
+    }
+    copy_run_avx2 (o, in + i + start, 32 - start, wide);
+    o += 32 - start;
+  }
+
+  return (o - out) + encode_sse2 (in + i, len - i, o);
+}
+
+
+/******************************************************************************
+ * The AVX2 CRLF to LF kernel, 32 bytes at a time.
+ *****************************************************************************/
+__attribute__ ((target ("avx2")))
+static size_t decode_avx2 (const uint8_t *in, size_t len, uint8_t *out,
+			   bool *pendingCR)
+{
+  const __m256i cr = _mm256_set1_epi8 ('\r');
+  uint8_t *o = out;
+  size_t i = 0;
+
+  for (; i + 32 <= len; i += 32) {
+    __m256i v = _mm256_loadu_si256 ((const __m256i *)(in + i));
+    unsigned int mask = _mm256_movemask_epi8 (_mm256_cmpeq_epi8 (v, cr));
+    unsigned int start = 0;
+    bool wide = i + 64 <= len;
+
+    if (mask == 0) {
+      _mm256_storeu_si256 ((__m256i *)o, v);
+      o += 32;
+      continue;
+    }
+
+    while (mask != 0) {
+      unsigned int pos = __builtin_ctz (mask);
+      copy_run_avx2 (o, in + i + start, pos - start, wide);
+      o += pos - start;
+      if (i + pos + 1 == len)
+	*pendingCR = true;
+      else if (in[i + pos + 1] != '\n')
+	*o++ = '\r';
+      start = pos + 1;
+      mask &= mask - 1;
+    }
+    copy_run_avx2 (o, in + i + start, 32 - start, wide);
+    o += 32 - start;
+  }
+
+  return (o - out) + decode_sse2 (in + i, len - i, o, pendingCR);
+}
+#endif //ASCII_X86_SIMD
@@ -0,0 +1,81 @@
+/******************************************************************************
+ * FTP-Server
+ * Author: Evan Myers
+ * Date: October 2026
+ *
+ * Description:
+ *   Line ending translation for TYPE A (ASCII) transfers. Files are stored
+ *   with UNIX line endings (LF), and RFC 959 requires ASCII data on the data
+ *   connection to use CRLF. A file that is sent has each LF replaced by CRLF,
+ *   and a file that is received has each CRLF replaced by LF.
+ *
+ *   The translation runs for every byte of an ASCII transfer, so it searches
+ *   for line endings 16 or 32 bytes at a time with SSE2 or AVX2 when the
+ *   processor supports it, and copies the bytes between them in bulk. A
+ *   portable byte loop is used on other processors.
+ *****************************************************************************/
+#ifndef __ASCII_H__
+#define __ASCII_H__
+
+
+#include <stdbool.h>    //Required for 'bool' in structure.
+#include <stddef.h>     //Required for 'size_t' in structure.
+#include <stdint.h>     //Required for 'uint8_t' in structure.
+#include "pipeline.h"   //Required for 'pipe_stage_t' in function prototype.
+
+
+/******************************************************************************
+ * The state of the translation of one transfer. A CR received at the end of
+ * one buffer may be the first half of a CRLF split across two buffers, so it
+ * is held back until the next buffer shows what follows it.
+ *****************************************************************************/
+typedef struct {
+  bool pendingCR;   //A CR ended the last buffer that was decoded.
+  uint8_t *out;     //Holds the translated data.
+  size_t outSize;
+} ascii_conv_t;
+
+
+/******************************************************************************
+ * Prepare the translation state for a transfer.
+ *****************************************************************************/
+void ascii_start (ascii_conv_t *ac);
+
+
+/******************************************************************************
+ * Release the translation state of a transfer.
+ *****************************************************************************/
+void ascii_end (ascii_conv_t *ac);
+
+
+/******************************************************************************
+ * Translate file data to be sent, replacing each LF with CRLF.
+ *
+ * Arguments:
+ *       ac - The translation state.
+ *       in - The file data.
+ *      len - The number of bytes of file data.
+ *   outLen - Set to the number of bytes of translated data.
+ *
+ * Returns:
+ *   The translated data, which is valid until the next call with 'ac', or
+ *   NULL if memory could not be allocated.
+ *****************************************************************************/
+const uint8_t *ascii_encode (ascii_conv_t *ac, const uint8_t *in, size_t len,
+			     size_t *outLen);
+
+
+/******************************************************************************
+ * Prepare a pipeline stage that translates the data of a transfer.
+ *
+ * Arguments:
+ *      ac - The translation state of the transfer.
+ *   stage - The stage to initialize.
+ *    send - True to replace each LF of a file that is sent with CRLF, false
+ *           to replace each CRLF of a file that is received with LF. A
+ *           received CR that is not followed by LF is stored unchanged.
+ *****************************************************************************/
+void ascii_stage (ascii_conv_t *ac, pipe_stage_t *stage, bool send);
+
+
+#endif //__ASCII_H__
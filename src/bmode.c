@@ -0,0 +1,299 @@
+/******************************************************************************
+ * FTP-Server
+ * Author: Evan Myers
+ * Date: October 2026
+ *
+ * Description:
+ *   Block framing for the MODE B transfer mode. See bmode.h for an overview.
+ *****************************************************************************/
+#include <errno.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/socket.h>
+#include "bmode.h"
+#include "net.h"
+#include "pipeline.h"
+#include "reply.h"
+#include "tls.h"
+#include "transfer.h"
+
+
+//A restart marker is sent each time this many bytes of the file are sent.
+#define BMODE_MARKER_INTERVAL (4 * 1024 * 1024)
+
+
+//Local function prototypes.
+static int send_block (int sfd, uint8_t desc, const uint8_t *data, size_t len,
+		       int flags);
+static int send_marker_if_due (bmode_send_t *bs);
+static int send_push (pipe_stage_t *stage, const uint8_t *data, size_t len);
+static int send_finish (pipe_stage_t *stage);
+static int recv_push (pipe_stage_t *stage, const uint8_t *data, size_t len);
+
+
+/******************************************************************************
+ * bmode_send_start - see bmode.h
+ *****************************************************************************/
+void bmode_send_start (bmode_send_t *bs, int sfd, long long offset)
+{
+  bs->sfd = sfd;
+  bs->offset = offset;
+  bs->nextMarker = offset + BMODE_MARKER_INTERVAL;
+}
+
+
+/******************************************************************************
+ * bmode_send - see bmode.h
+ *****************************************************************************/
+int bmode_send (bmode_send_t *bs, const uint8_t *data, size_t len)
+{
+  size_t blockLen;
+
+  if (send_marker_if_due (bs) == -1)
+    return -1;
+
+  while (len > 0) {
+    blockLen = (len > BMODE_MAX_BLOCK) ? BMODE_MAX_BLOCK : len;
+    if (send_block (bs->sfd, 0, data, blockLen, 0) == -1)
+      return -1;
+
+    data += blockLen;
+    len -= blockLen;
+    bs->offset += blockLen;
+  }
+
+  return 0;
+}
+
+
+/******************************************************************************
+ * bmode_send_header - see bmode.h
+ *****************************************************************************/
+int bmode_send_header (bmode_send_t *bs, size_t len)
+{
+  if (send_marker_if_due (bs) == -1)
+    return -1;
+
+  //MSG_MORE holds the header back until the block data joins it.
+  if (send_block (bs->sfd, 0, NULL, len, MSG_MORE) == -1)
+    return -1;
+
+  bs->offset += len;
+  return 0;
+}
+
+
+/******************************************************************************
+ * bmode_send_eof - see bmode.h
+ *****************************************************************************/
+int bmode_send_eof (bmode_send_t *bs)
+{
+  return send_block (bs->sfd, BMODE_DESC_EOF, NULL, 0, 0);
+}
+
+
+/******************************************************************************
+ * bmode_send_stage - see bmode.h
+ *****************************************************************************/
+void bmode_send_stage (bmode_send_t *bs, pipe_stage_t *stage)
+{
+  pipe_stage_init (stage, "block-send", send_push, send_finish, bs);
+}
+
+
+/******************************************************************************
+ * bmode_send_all - see bmode.h
+ *****************************************************************************/
+int bmode_send_all (int sfd, const uint8_t *data, size_t len)
+{
+  bmode_send_t bs;
+
+  bmode_send_start (&bs, sfd, 0);
+  if (bmode_send (&bs, data, len) == -1)
+    return -1;
+
+  return bmode_send_eof (&bs);
+}
+
+
+/******************************************************************************
+ * bmode_recv_start - see bmode.h
+ *****************************************************************************/
+void bmode_recv_start (bmode_recv_t *br, int csfd, long long offset)
+{
+  memset (br, 0, sizeof (*br));
+  br->csfd = csfd;
+  br->offset = offset;
+}
+
+
+/******************************************************************************
+ * bmode_recv_stage - see bmode.h
+ *****************************************************************************/
+void bmode_recv_stage (bmode_recv_t *br, pipe_stage_t *stage)
+{
+  pipe_stage_init (stage, "block-recv", recv_push, NULL, br);
+}
+
+
+/******************************************************************************
+ * The stage that removes the block framing from received data.
+ *****************************************************************************/
+static int recv_push (pipe_stage_t *stage, const uint8_t *data, size_t len)
+{
+  bmode_recv_t *br = stage->state;
+  size_t take;
+
+  while (len > 0) {
+    if (br->eof) {
+      fprintf (stderr, "%s: data received after the end of file block\n",
+	       __FUNCTION__);
+      return -1;
+    }
+
+    //Collect the header of the next block.
+    if (br->headerLen < BMODE_HEADER_LEN) {
+      take = BMODE_HEADER_LEN - br->headerLen;
+      if (take > len)
+	take = len;
+      memcpy (&br->header[br->headerLen], data, take);
+      br->headerLen += take;
+      data += take;
+      len -= take;
+
+      if (br->headerLen < BMODE_HEADER_LEN)
+	break;
+
+      br->desc = br->header[0];
+      br->remaining = ((size_t)br->header[1] << 8) | br->header[2];
+      br->markerLen = 0;
+    }
+
+    //The data of the block, or the part of it that has arrived.
+    take = (br->remaining > len) ? len : br->remaining;
+    if (br->desc & BMODE_DESC_RESTART) {
+      if (br->markerLen + take > BMODE_MARKER_MAX) {
+	fprintf (stderr, "%s: restart marker is too long\n", __FUNCTION__);
+	return -1;
+      }
+      memcpy (&br->marker[br->markerLen], data, take);
+      br->markerLen += take;
+    } else if (take > 0 && pipe_next (stage, data, take) == -1) {
+      return -1;
+    }
+    data += take;
+    len -= take;
+    br->remaining -= take;
+
+    /* At the end of the block, act on its descriptor. The data before a
+     * restart marker has been stored by the time the marker ends, so the
+     * sink has counted it, after any translation. */
+    if (br->remaining == 0) {
+      if (br->desc & BMODE_DESC_RESTART) {
+	br->marker[br->markerLen] = '\0';
+	send_mesg_110 (br->csfd, br->marker,
+		       br->offset + pipe_delivered (stage->pl));
+      }
+      if (br->desc & BMODE_DESC_EOF)
+	br->eof = true;
+      br->headerLen = 0;
+    }
+  }
+
+  return 0;
+}
+
+
+/******************************************************************************
+ * Send one block, a header followed by its data. The header is sent on its
+ * own when 'data' is NULL.
+ *
+ * Arguments:
+ *     sfd - The data connection socket.
+ *    desc - The block descriptor.
+ *    data - The block data, or NULL.
+ *     len - The size of the block, at most BMODE_MAX_BLOCK.
+ *   flags - Flags for send() when sending the header.
+ *
+ * Return values:
+ *   0    success
+ *  -1    error
+ *****************************************************************************/
+static int send_block (int sfd, uint8_t desc, const uint8_t *data, size_t len,
+		       int flags)
+{
+  uint8_t header[BMODE_HEADER_LEN];
+  size_t sent = 0;
+  ssize_t nsent;
+
+  header[0] = desc;
+  header[1] = (len >> 8) & 0xFF;
+  header[2] = len & 0xFF;
+
+  //Send the header with MSG_MORE so that it shares a segment with the data.
+  if (data != NULL && len > 0)
+    flags |= MSG_MORE;
+
+  /* A socket encrypted in user space is written through its TLS session,
+   * where the header becomes a record of its own. */
+  if (!tls_kernel_send (sfd)) {
+    if (send_all (sfd, header, BMODE_HEADER_LEN) == -1)
+      return -1;
+    sent = BMODE_HEADER_LEN;
+  }
+
+  while (sent < BMODE_HEADER_LEN) {
+    if ((nsent = send (sfd, &header[sent], BMODE_HEADER_LEN - sent,
+		       flags)) == -1) {
+      if (errno == EINTR)
+	continue;
+      fprintf (stderr, "%s: send: %s\n", __FUNCTION__, strerror (errno));
+      return -1;
+    }
+    sent += nsent;
+  }
+
+  if (data != NULL && len > 0)
+    return send_all (sfd, (uint8_t *)data, len);
+
+  return 0;
+}
+
+
+/******************************************************************************
+ * Send a restart marker when the transfer has passed the next marker offset.
+ * The marker is the decimal offset of the next byte of the file.
+ *****************************************************************************/
+static int send_marker_if_due (bmode_send_t *bs)
+{
+  char marker[BMODE_MARKER_MAX + 1];
+
+  if (bs->offset < bs->nextMarker)
+    return 0;
+
+  sprintf (marker, "%lld", bs->offset);
+  if (send_block (bs->sfd, BMODE_DESC_RESTART, (uint8_t *)marker,
+		  strlen (marker), 0) == -1)
+    return -1;
+
+  bs->nextMarker = bs->offset + BMODE_MARKER_INTERVAL;
+  return 0;
+}
+
+
+/******************************************************************************
+ * The sink that sends data in blocks.
+ *****************************************************************************/
+static int send_push (pipe_stage_t *stage, const uint8_t *data, size_t len)
+{
+  return bmode_send (stage->state, data, len);
+}
+
+
+/******************************************************************************
+ * End the file with the EOF block.
+ *****************************************************************************/
+static int send_finish (pipe_stage_t *stage)
+{
+  return bmode_send_eof (stage->state);
+}
@@ -0,0 +1,154 @@
+/******************************************************************************
+ * FTP-Server
+ * Author: Evan Myers
+ * Date: October 2026
+ *
+ * Description:
+ *   Block framing for the MODE B transfer mode (RFC 959 section 3.4.2). Each
+ *   block is a one byte descriptor, a two byte count in network byte order,
+ *   and 'count' bytes of data. The end of the file is marked by a descriptor
+ *   bit rather than by closing the connection, so the data connection can be
+ *   kept for the next transfer of the session.
+ *
+ *   Restart markers are sent in their own blocks. The marker text is the
+ *   byte offset in the file, which can be given to REST to resume a transfer.
+ *****************************************************************************/
+#ifndef __BMODE_H__
+#define __BMODE_H__
+
+
+#include <stdbool.h>  //Required for 'bool' in structure.
+#include <stddef.h>   //Required for 'size_t' in function prototype.
+#include <stdint.h>   //Required for 'uint8_t' in structure.
+#include "pipeline.h" //Required for 'pipe_stage_t' in function prototype.
+
+
+//Block descriptor codes.
+#define BMODE_DESC_EOR     0x80  //End of data block is EOR.
+#define BMODE_DESC_EOF     0x40  //End of data block is EOF.
+#define BMODE_DESC_ERRORS  0x20  //Suspected errors in data block.
+#define BMODE_DESC_RESTART 0x10  //Data block is a restart marker.
+
+//The size of a block header, and the largest block that can be described.
+#define BMODE_HEADER_LEN 3
+#define BMODE_MAX_BLOCK  0xFFFF
+
+//The longest restart marker accepted from a client.
+#define BMODE_MARKER_MAX 64
+
+
+/******************************************************************************
+ * The state of one block mode transfer that is being sent.
+ *****************************************************************************/
+typedef struct {
+  int sfd;                  //The data connection socket.
+  long long offset;         //The file offset of the next byte sent.
+  long long nextMarker;     //Send a restart marker at or after this offset.
+} bmode_send_t;
+
+
+/******************************************************************************
+ * The state of one block mode transfer that is being received. The received
+ * data does not arrive aligned to blocks, so a partial header or restart
+ * marker is held here until the rest of it arrives.
+ *****************************************************************************/
+typedef struct {
+  int csfd;                         //Restart markers are replied to here.
+  long long offset;                 //The file offset the transfer starts at.
+  uint8_t header[BMODE_HEADER_LEN];
+  size_t headerLen;                 //Header bytes received so far.
+  uint8_t desc;                     //The descriptor of the current block.
+  size_t remaining;                 //Data bytes left in the current block.
+  char marker[BMODE_MARKER_MAX + 1];
+  size_t markerLen;
+  bool eof;                         //The EOF block has been received.
+} bmode_recv_t;
+
+
+/******************************************************************************
+ * Prepare to send a file in blocks.
+ *
+ * Arguments:
+ *       bs - The state to initialize.
+ *      sfd - The data connection socket.
+ *   offset - The file offset the transfer starts at, eg. a REST marker.
+ *****************************************************************************/
+void bmode_send_start (bmode_send_t *bs, int sfd, long long offset);
+
+
+/******************************************************************************
+ * Send data in as many blocks as it takes. A restart marker is sent first
+ * when one is due.
+ *
+ * Return values:
+ *   0    success
+ *  -1    error
+ *****************************************************************************/
+int bmode_send (bmode_send_t *bs, const uint8_t *data, size_t len);
+
+
+/******************************************************************************
+ * Send the header of a data block whose contents the caller will send itself,
+ * eg. with sendfile(). A restart marker is sent first when one is due. The
+ * caller must send exactly 'len' bytes before the next block.
+ *
+ * Arguments:
+ *    bs - The send state.
+ *   len - The size of the block, at most BMODE_MAX_BLOCK.
+ *
+ * Return values:
+ *   0    success
+ *  -1    error
+ *****************************************************************************/
+int bmode_send_header (bmode_send_t *bs, size_t len);
+
+
+/******************************************************************************
+ * Send the empty block that marks the end of the file.
+ *
+ * Return values:
+ *   0    success
+ *  -1    error
+ *****************************************************************************/
+int bmode_send_eof (bmode_send_t *bs);
+
+
+/******************************************************************************
+ * Prepare a pipeline sink that sends data in blocks, like bmode_send(), and
+ * sends the EOF block when it is finished.
+ *****************************************************************************/
+void bmode_send_stage (bmode_send_t *bs, pipe_stage_t *stage);
+
+
+/******************************************************************************
+ * Send a complete buffer as one block mode transfer, eg. a directory listing.
+ *
+ * Return values:
+ *   0    success
+ *  -1    error
+ *****************************************************************************/
+int bmode_send_all (int sfd, const uint8_t *data, size_t len);
+
+
+/******************************************************************************
+ * Prepare to receive a file in blocks.
+ *
+ * Arguments:
+ *       br - The state to initialize.
+ *     csfd - The control connection, for restart marker replies.
+ *   offset - The file offset the transfer starts at, eg. a REST marker.
+ *****************************************************************************/
+void bmode_recv_start (bmode_recv_t *br, int csfd, long long offset);
+
+
+/******************************************************************************
+ * Prepare a pipeline stage that removes the block framing from data received
+ * on the data connection, and passes the file data on. Each restart marker
+ * received is answered with a 110 reply that pairs it with the matching
+ * offset in the stored file. Once the EOF block has been received br->eof is
+ * set, and any more data is an error.
+ *****************************************************************************/
+void bmode_recv_stage (bmode_recv_t *br, pipe_stage_t *stage);
+
+
+#endif //__BMODE_H__
@@ -0,0 +1,364 @@
+/******************************************************************************
+ * FTP-Server
+ * Author: Evan Myers
+ * Date: October 2026
+ *
+ * Description:
+ *   File checksums. See checksum.h for an overview.
+ *
+ *   Each algorithm keeps its digest in its own extended attribute, eg.
+ *   "user.ftpd.md5", as "<size> <mtime seconds>.<nanoseconds> <hex digest>".
+ *   CRC-32 and Adler-32 come from zlib, which the server already links for
+ *   MODE Z, and are much cheaper to compute than MD5.
+ *****************************************************************************/
+#include <ctype.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <sys/stat.h>
+#include <sys/xattr.h>
+#include <unistd.h>
+#include <zlib.h>
+#include "checksum.h"
+#include "config.h"
+
+
+//The number of supported algorithms.
+#define NUM_ALGS 3
+
+//The length of a CRC-32 or Adler-32 in hex.
+#define SUM32_HEX_LEN 8
+
+//The prefix of the extended attribute of each algorithm.
+#define XATTR_PREFIX "user.ftpd."
+
+//The longest stored value, and the longest attribute name.
+#define XATTR_VALUE_SZ 96
+#define XATTR_NAME_SZ  32
+
+//The size of the buffer a file is read into when it has to be hashed.
+#define READ_BUFFER_SIZE 262144
+
+
+//The names of the algorithms, indexed by CHECKSUM_*.
+static const char *algNames[NUM_ALGS] = { "CRC32", "ADLER32", "MD5" };
+
+
+//Local function prototypes.
+static int checksum_push (pipe_stage_t *stage, const uint8_t *data, size_t len);
+static bool lookup (int fd, int alg, const struct stat *fileStat, char *hex);
+static void xattr_name (int alg, char *name);
+static void stamp (const struct stat *fileStat, const char *hex, char *value);
+
+
+//Written once by checksum_load_config() before any thread is created.
+static int transferAlg = CHECKSUM_NONE;
+
+
+/******************************************************************************
+ * checksum_load_config - see checksum.h
+ *****************************************************************************/
+void checksum_load_config (void)
+{
+  char *name;
+
+  if ((name = get_config_value ("CHECKSUM_CONFIG", FTP_CONFIG_FILE)) == NULL)
+    return;
+  transferAlg = checksum_find (name);
+  free (name);
+}
+
+
+/******************************************************************************
+ * checksum_transfer_alg - see checksum.h
+ *****************************************************************************/
+int checksum_transfer_alg (void)
+{
+  return transferAlg;
+}
+
+
+/******************************************************************************
+ * checksum_find - see checksum.h
+ *****************************************************************************/
+int checksum_find (const char *name)
+{
+  int alg;
+
+  for (alg = 0; alg < NUM_ALGS; alg++) {
+    if (strcasecmp (name, algNames[alg]) == 0)
+      return alg;
+  }
+
+  //"CRC" and "CRC-32" are common spellings of the same algorithm.
+  if (strcasecmp (name, "CRC") == 0 || strcasecmp (name, "CRC-32") == 0)
+    return CHECKSUM_CRC32;
+
+  return CHECKSUM_NONE;
+}
+
+
+/******************************************************************************
+ * checksum_name - see checksum.h
+ *****************************************************************************/
+const char *checksum_name (int alg)
+{
+  if (alg < 0 || alg >= NUM_ALGS)
+    return "NONE";
+  return algNames[alg];
+}
+
+
+/******************************************************************************
+ * checksum_start - see checksum.h
+ *****************************************************************************/
+void checksum_start (checksum_t *cs, int alg)
+{
+  cs->alg = alg;
+  cs->bytes = 0;
+
+  if (alg == CHECKSUM_CRC32)
+    cs->sum = crc32 (0L, Z_NULL, 0);
+  else if (alg == CHECKSUM_ADLER32)
+    cs->sum = adler32 (0L, Z_NULL, 0);
+  else
+    md5Start (&cs->md5);
+}
+
+
+/******************************************************************************
+ * checksum_add - see checksum.h
+ *****************************************************************************/
+void checksum_add (checksum_t *cs, const uint8_t *data, size_t len)
+{
+  size_t part;
+
+  cs->bytes += len;
+
+  //zlib takes the length as a uInt, feed it a gigabyte at a time.
+  while (len > 0) {
+    part = (len > 1073741824) ? 1073741824 : len;
+    if (cs->alg == CHECKSUM_CRC32)
+      cs->sum = crc32 (cs->sum, data, part);
+    else if (cs->alg == CHECKSUM_ADLER32)
+      cs->sum = adler32 (cs->sum, data, part);
+    else
+      md5Add (&cs->md5, data, part);
+    data += part;
+    len -= part;
+  }
+}
+
+
+/******************************************************************************
+ * checksum_end - see checksum.h
+ *****************************************************************************/
+void checksum_end (checksum_t *cs, char *hex)
+{
+  byte_t digest[MD5_DIGEST_BYTES];
+  int i;
+
+  if (cs->alg != CHECKSUM_MD5) {
+    sprintf (hex, "%08lx", cs->sum & 0xffffffffUL);
+    return;
+  }
+
+  md5End (&cs->md5, digest);
+  for (i = 0; i < MD5_DIGEST_BYTES; i++)
+    sprintf (&hex[i * 2], "%02x", (unsigned int)digest[i]);
+}
+
+
+/******************************************************************************
+ * checksum_stage - see checksum.h
+ *****************************************************************************/
+void checksum_stage (checksum_t *cs, pipe_stage_t *stage)
+{
+  pipe_stage_init (stage, "checksum", checksum_push, NULL, cs);
+}
+
+
+/******************************************************************************
+ * checksum_save - see checksum.h
+ *****************************************************************************/
+int checksum_save (checksum_t *cs, int fd)
+{
+  struct stat fileStat;
+  char hex[CHECKSUM_HEX_SZ];
+  char name[XATTR_NAME_SZ];
+  char value[XATTR_VALUE_SZ];
+
+  checksum_end (cs, hex);
+
+  if (fstat (fd, &fileStat) == -1 || fileStat.st_size != cs->bytes)
+    return -1;
+
+  xattr_name (cs->alg, name);
+  stamp (&fileStat, hex, value);
+  if (fsetxattr (fd, name, value, strlen (value), 0) == -1) {
+    if (errno != ENOTSUP)
+      fprintf (stderr, "%s: fsetxattr: %s\n", __FUNCTION__, strerror (errno));
+    return -1;
+  }
+
+  return 0;
+}
+
+
+/******************************************************************************
+ * checksum_forget - see checksum.h
+ *****************************************************************************/
+void checksum_forget (int fd)
+{
+  char name[XATTR_NAME_SZ];
+  int alg;
+
+  for (alg = 0; alg < NUM_ALGS; alg++) {
+    xattr_name (alg, name);
+    fremovexattr (fd, name);
+  }
+}
+
+
+/******************************************************************************
+ * checksum_stored - see checksum.h
+ *****************************************************************************/
+bool checksum_stored (int fd, int alg)
+{
+  struct stat fileStat;
+  char hex[CHECKSUM_HEX_SZ];
+
+  if (fstat (fd, &fileStat) == -1)
+    return false;
+  return lookup (fd, alg, &fileStat, hex);
+}
+
+
+/******************************************************************************
+ * checksum_file - see checksum.h
+ *****************************************************************************/
+long long checksum_file (int fd, int alg, char *hex)
+{
+  struct stat fileStat;
+  checksum_t cs;
+  char name[XATTR_NAME_SZ];
+  char value[XATTR_VALUE_SZ];
+  uint8_t *buffer;
+  ssize_t len;
+  off_t offset = 0;
+
+  if (fstat (fd, &fileStat) == -1) {
+    fprintf (stderr, "%s: fstat: %s\n", __FUNCTION__, strerror (errno));
+    return -1;
+  }
+
+  //A stored digest is used if the file is unchanged since it was stored.
+  if (lookup (fd, alg, &fileStat, hex))
+    return fileStat.st_size;
+
+  //Read the whole file, and keep its digest for the next time.
+  if ((buffer = malloc (READ_BUFFER_SIZE)) == NULL) {
+    fprintf (stderr, "%s: malloc: %s\n", __FUNCTION__, strerror (errno));
+    return -1;
+  }
+  posix_fadvise (fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+
+  checksum_start (&cs, alg);
+  while ((len = pread (fd, buffer, READ_BUFFER_SIZE, offset)) != 0) {
+    if (len == -1) {
+      if (errno == EINTR)
+	continue;
+      fprintf (stderr, "%s: pread: %s\n", __FUNCTION__, strerror (errno));
+      free (buffer);
+      return -1;
+    }
+    checksum_add (&cs, buffer, len);
+    offset += len;
+  }
+  free (buffer);
+
+  checksum_end (&cs, hex);
+  xattr_name (alg, name);
+  stamp (&fileStat, hex, value);
+  if (cs.bytes == fileStat.st_size)
+    fsetxattr (fd, name, value, strlen (value), 0);
+
+  return cs.bytes;
+}
+
+
+/******************************************************************************
+ * Add the data passing through a stage to its digest.
+ *****************************************************************************/
+static int checksum_push (pipe_stage_t *stage, const uint8_t *data, size_t len)
+{
+  checksum_add (stage->state, data, len);
+  return pipe_next (stage, data, len);
+}
+
+
+/******************************************************************************
+ * Get the stored digest of a file, if it was stored since the file was last
+ * modified.
+ *
+ * Arguments:
+ *         fd - The file.
+ *        alg - The algorithm.
+ *   fileStat - The current status of the file.
+ *        hex - Set to the digest.
+ *
+ * Returns:
+ *   True if a current digest was found.
+ *****************************************************************************/
+static bool lookup (int fd, int alg, const struct stat *fileStat, char *hex)
+{
+  char name[XATTR_NAME_SZ];
+  char value[XATTR_VALUE_SZ];
+  char current[XATTR_VALUE_SZ];
+  size_t hexLen = (alg == CHECKSUM_MD5) ? CHECKSUM_HEX_LEN : SUM32_HEX_LEN;
+  ssize_t len;
+
+  xattr_name (alg, name);
+  if ((len = fgetxattr (fd, name, value, sizeof (value) - 1)) <= 0)
+    return false;
+  value[len] = '\0';
+
+  stamp (fileStat, "", current);
+  if (strncmp (value, current, strlen (current)) != 0 ||
+      strlen (value) != strlen (current) + hexLen)
+    return false;
+
+  strcpy (hex, value + strlen (current));
+  return true;
+}
+
+
+/******************************************************************************
+ * Get the name of the extended attribute of an algorithm.
+ *****************************************************************************/
+static void xattr_name (int alg, char *name)
+{
+  const char *alias = checksum_name (alg);
+  size_t len = strlen (XATTR_PREFIX);
+  int i;
+
+  strcpy (name, XATTR_PREFIX);
+  for (i = 0; alias[i] != '\0' && len + i < XATTR_NAME_SZ - 1; i++)
+    name[len + i] = tolower (alias[i]);
+  name[len + i] = '\0';
+}
+
+
+/******************************************************************************
+ * Format the value stored for a digest, stamped with the size and
+ * modification time of the file.
+ *****************************************************************************/
+static void stamp (const struct stat *fileStat, const char *hex, char *value)
+{
+  snprintf (value, XATTR_VALUE_SZ, "%lld %lld.%09ld %s",
+	    (long long)fileStat->st_size, (long long)fileStat->st_mtim.tv_sec,
+	    fileStat->st_mtim.tv_nsec, hex);
+}
@@ -0,0 +1,156 @@
+/******************************************************************************
+ * FTP-Server
+ * Author: Evan Myers
+ * Date: October 2026
+ *
+ * Description:
+ *   File checksums. The digest of an upload is computed while it streams
+ *   through its pipeline to the disk, and is stored with the file in an
+ *   extended attribute. HASH and XMD5 then answer from the stored digest,
+ *   so that a client can verify an upload without the server reading the
+ *   file again.
+ *
+ *   A stored digest is stamped with the size and modification time of the
+ *   file. A file that has changed since is hashed again when it is asked for.
+ *****************************************************************************/
+#ifndef __CHECKSUM_H__
+#define __CHECKSUM_H__
+
+
+#include <stdbool.h>  //Required for 'bool' in function prototype.
+#include <stddef.h>   //Required for 'size_t' in function prototype.
+#include <stdint.h>   //Required for 'uint8_t' in structure.
+#include "md5.h"      //Required for 'struct md5CTX' in structure.
+#include "pipeline.h" //Required for 'pipe_stage_t' in function prototype.
+
+
+//The supported algorithms.
+#define CHECKSUM_NONE    -1
+#define CHECKSUM_CRC32   0
+#define CHECKSUM_ADLER32 1
+#define CHECKSUM_MD5     2
+
+//The longest digest in hex, and the length of a buffer that holds it.
+#define CHECKSUM_HEX_LEN (MD5_DIGEST_BYTES * 2)
+#define CHECKSUM_HEX_SZ  (CHECKSUM_HEX_LEN + 1)
+
+
+/******************************************************************************
+ * The running digest of a file.
+ *****************************************************************************/
+typedef struct {
+  int alg;                //One of the CHECKSUM_* algorithms.
+  unsigned long sum;      //The running CRC-32 or Adler-32.
+  struct md5CTX md5;      //The running MD5.
+  long long bytes;        //The bytes added so far.
+} checksum_t;
+
+
+/******************************************************************************
+ * Read the checksum settings from the server configuration file. This
+ * function should be called once, by main(), before any client connects.
+ *
+ * Settings (ftp.conf):
+ *   CHECKSUM_CONFIG - The algorithm computed while files are transferred,
+ *                     MD5, CRC32 or ADLER32, or NONE.
+ *****************************************************************************/
+void checksum_load_config (void);
+
+
+/******************************************************************************
+ * Get the algorithm computed while files are transferred, CHECKSUM_NONE if
+ * checksums are not computed during transfers.
+ *****************************************************************************/
+int checksum_transfer_alg (void);
+
+
+/******************************************************************************
+ * Look up an algorithm by name, case insensitive.
+ *
+ * Returns:
+ *   The algorithm, or CHECKSUM_NONE if the name is not supported.
+ *****************************************************************************/
+int checksum_find (const char *name);
+
+
+/******************************************************************************
+ * Get the name of an algorithm, as it is sent to clients.
+ *****************************************************************************/
+const char *checksum_name (int alg);
+
+
+/******************************************************************************
+ * Start a digest.
+ *****************************************************************************/
+void checksum_start (checksum_t *cs, int alg);
+
+
+/******************************************************************************
+ * Add data to a digest.
+ *****************************************************************************/
+void checksum_add (checksum_t *cs, const uint8_t *data, size_t len);
+
+
+/******************************************************************************
+ * Finish a digest, and write it in lower case hex.
+ *
+ * Arguments:
+ *    cs - The digest.
+ *   hex - Set to the digest, at least CHECKSUM_HEX_SZ bytes.
+ *****************************************************************************/
+void checksum_end (checksum_t *cs, char *hex);
+
+
+/******************************************************************************
+ * Prepare a pipeline stage that adds the data passing through it to a
+ * digest, and passes it on unchanged.
+ *****************************************************************************/
+void checksum_stage (checksum_t *cs, pipe_stage_t *stage);
+
+
+/******************************************************************************
+ * Finish a digest of a whole file, and store it with the file, stamped with
+ * the current size and modification time of the file. The digest is only
+ * stored if it covers the whole file.
+ *
+ * Arguments:
+ *   cs - The digest of every byte of the file.
+ *   fd - The file, open for reading or writing.
+ *
+ * Return values:
+ *   0    The digest was stored.
+ *  -1    The digest does not match the size of the file, or the file system
+ *        does not support extended attributes.
+ *****************************************************************************/
+int checksum_save (checksum_t *cs, int fd);
+
+
+/******************************************************************************
+ * Remove the stored digests of a file that is about to be modified in place.
+ *****************************************************************************/
+void checksum_forget (int fd);
+
+
+/******************************************************************************
+ * Determine if a file has a current stored digest of an algorithm.
+ *****************************************************************************/
+bool checksum_stored (int fd, int alg);
+
+
+/******************************************************************************
+ * Get the digest of a file. A stored digest is used if it is still current,
+ * otherwise the file is read, and the new digest is stored.
+ *
+ * Arguments:
+ *    fd - The file, open for reading.
+ *   alg - The algorithm.
+ *   hex - Set to the digest, at least CHECKSUM_HEX_SZ bytes.
+ *
+ * Return values:
+ *  >=0   The size of the file.
+ *   -1   Error, the file could not be read.
+ *****************************************************************************/
+long long checksum_file (int fd, int alg, char *hex);
+
+
+#endif //__CHECKSUM_H__
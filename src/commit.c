@@ -0,0 +1,388 @@
+/******************************************************************************
+ * FTP-Server
+ * Author: Evan Myers
+ * Date: October 2026
+ *
+ * Description:
+ *   Completion of uploads. See commit.h for an overview.
+ *
+ *   A flush is requested by adding an entry to the queue of the next batch.
+ *   When no thread is leading a batch, the requesting thread becomes the
+ *   leader: it waits for the window, takes every queued entry, and flushes
+ *   them together. Threads that request a flush while the leader is busy
+ *   wait, and form the next batch.
+ *
+ *   The writeback of every file of a batch is started before any of them is
+ *   waited for, so the disk sees the writes of the whole batch at once, and
+ *   the journal commits of their fdatasync() calls are merged by the file
+ *   system. A directory is flushed once per batch however many uploads were
+ *   renamed into it. syncfs() instead flushes each file system of a batch
+ *   once, with every other dirty file on it, and is only used on request.
+ *****************************************************************************/
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/random.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+#include "commit.h"
+#include "config.h"
+
+
+//The defaults of the ftp.conf settings.
+#define DEFAULT_ATOMIC 1
+#define DEFAULT_SYNC 0
+#define DEFAULT_WINDOW_USEC 2000
+
+//The values of STOR_SYNC_CONFIG.
+#define SYNC_NONE  0  //Uploads are not flushed.
+#define SYNC_FILES 1  //Each file of a batch is flushed.
+#define SYNC_FS    2  //Each file system of a batch is flushed.
+
+/* The hidden name of an upload in progress, "dir/.name.XXXXXX.part". The X's
+ * are random, so that uploads of the same file at once never share one. */
+#define PART_SUFFIX ".part"
+#define PART_RANDOM 6
+#define PART_CHARS \
+  "abcdefghijklmnopqrstuvwxyzABCDEFGHIJKLMNOPQRSTUVWXYZ0123456789"
+
+//The names tried before creating a temporary file fails.
+#define PART_TRIES 100
+
+
+/******************************************************************************
+ * A flush request. Each entry lives on the stack of the waiting thread, and
+ * is only changed by the leader while the thread waits.
+ *****************************************************************************/
+struct sync_req {
+  int fd;
+  dev_t dev;             //The file system of the file.
+  ino_t ino;
+  int error;             //The errno of the failed flush, or 0.
+  bool done;
+  struct sync_req *next;
+};
+
+
+//Local function prototypes.
+static int group_sync (int fd);
+static int sync_dir (const char *path);
+static void sync_batch (struct sync_req *batch);
+
+
+/* The settings are written once by commit_load_config() before any thread is
+ * created. The queue and the statistics are protected by syncMutex. */
+static bool atomicStor = DEFAULT_ATOMIC;
+static int syncMode = DEFAULT_SYNC;
+static long long windowUsec = DEFAULT_WINDOW_USEC;
+static struct sync_req *queue = NULL;
+static bool leading = false;
+static long long requests = 0;
+static long long flushes = 0;
+static long long batches = 0;
+static long long maxBatch = 0;
+static pthread_mutex_t syncMutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t syncCond = PTHREAD_COND_INITIALIZER;
+
+
+/******************************************************************************
+ * commit_load_config - see commit.h
+ *****************************************************************************/
+void commit_load_config (void)
+{
+  atomicStor = get_config_number ("STOR_ATOMIC_CONFIG", FTP_CONFIG_FILE,
+				  DEFAULT_ATOMIC) != 0;
+  syncMode = get_config_number ("STOR_SYNC_CONFIG", FTP_CONFIG_FILE,
+				DEFAULT_SYNC);
+  if (syncMode != SYNC_FILES && syncMode != SYNC_FS)
+    syncMode = SYNC_NONE;
+  windowUsec = get_config_number ("STOR_SYNC_WINDOW_CONFIG", FTP_CONFIG_FILE,
+				  DEFAULT_WINDOW_USEC);
+}
+
+
+/******************************************************************************
+ * commit_part_open - see commit.h
+ *****************************************************************************/
+int commit_part_open (const char *path, int flags, mode_t mode,
+		      char **partpath)
+{
+  int fd;
+
+  if (atomicStor)
+    return commit_temp_open (path, mode, partpath);
+
+  *partpath = NULL;
+  if ((fd = open (path, flags, mode)) == -1)
+    fprintf (stderr, "%s: open: %s\n", __FUNCTION__, strerror (errno));
+  return fd;
+}
+
+
+/******************************************************************************
+ * commit_temp_open - see commit.h
+ *****************************************************************************/
+int commit_temp_open (const char *path, mode_t mode, char **partpath)
+{
+  const char *base;
+  char *name;
+  char *suffix;      //The random part of the name.
+  unsigned char bytes[PART_RANDOM];
+  size_t dirLen;
+  int fd;
+  int tries;
+  int i;
+
+  *partpath = NULL;
+
+  //Insert a '.' before the filename to hide it.
+  base = strrchr (path, '/');
+  base = (base == NULL) ? path : base + 1;
+  dirLen = base - path;
+
+  if ((name = malloc (strlen (path) + PART_RANDOM + sizeof (PART_SUFFIX) + 2))
+      == NULL) {
+    fprintf (stderr, "%s: malloc: %s\n", __FUNCTION__, strerror (errno));
+    return -1;
+  }
+  memcpy (name, path, dirLen);
+  sprintf (name + dirLen, ".%s.", base);
+  suffix = name + strlen (name);
+
+  //O_EXCL makes the name ours alone, another upload picks another one.
+  for (tries = 0; tries < PART_TRIES; tries++) {
+    if (getrandom (bytes, sizeof (bytes), 0) != sizeof (bytes))
+      break;
+    for (i = 0; i < PART_RANDOM; i++)
+      suffix[i] = PART_CHARS[bytes[i] % (sizeof (PART_CHARS) - 1)];
+    strcpy (suffix + PART_RANDOM, PART_SUFFIX);
+
+    if ((fd = open (name, O_WRONLY | O_CREAT | O_EXCL, mode)) != -1) {
+      *partpath = name;
+      return fd;
+    }
+    if (errno != EEXIST)
+      break;
+  }
+
+  fprintf (stderr, "%s: open: %s\n", __FUNCTION__, strerror (errno));
+  free (name);
+  return -1;
+}
+
+
+/******************************************************************************
+ * commit_upload - see commit.h
+ *****************************************************************************/
+int commit_upload (int fd, const char *partpath, const char *path)
+{
+  //The data must be on the disk before the new name may point to it.
+  if (syncMode != SYNC_NONE && group_sync (fd) == -1)
+    return -1;
+
+  if (partpath == NULL)
+    return 0;
+
+  if (rename (partpath, path) == -1) {
+    fprintf (stderr, "%s: rename: %s\n", __FUNCTION__, strerror (errno));
+    return -1;
+  }
+
+  //Flush the directory for the new name, its file system for SYNC_FS.
+  if (syncMode == SYNC_FILES && sync_dir (path) == -1)
+    return -1;
+  if (syncMode == SYNC_FS && group_sync (fd) == -1)
+    return -1;
+
+  return 0;
+}
+
+/******************************************************************************
+ * commit_discard - see commit.h
+ *****************************************************************************/
+void commit_discard (char *path, char *partpath)
+{
+  if (partpath != NULL && unlink (partpath) == -1)
+    fprintf (stderr, "%s: unlink: %s\n", __FUNCTION__, strerror (errno));
+
+  free (partpath);
+  free (path);
+}
+
+
+/******************************************************************************
+ * commit_print_stats - see commit.h
+ *****************************************************************************/
+void commit_print_stats (void)
+{
+  pthread_mutex_lock (&syncMutex);
+  printf ("Uploads are %s, and %s.\n",
+	  atomicStor ? "renamed into place" : "written in place",
+	  (syncMode == SYNC_FILES) ? "flushed before they are acknowledged" :
+	  (syncMode == SYNC_FS) ? "flushed with their file systems" :
+	  "not flushed");
+  printf ("%lld flush requests in %lld batches, %lld %s flushes, "
+	  "largest batch %lld.\n", requests, batches, flushes,
+	  (syncMode == SYNC_FS) ? "file system" : "file", maxBatch);
+  pthread_mutex_unlock (&syncMutex);
+}
+
+
+/******************************************************************************
+ * Flush a file or a directory to the disk, together with the flushes
+ * requested by other uploads. Under SYNC_FS, its whole file system is
+ * flushed.
+ *
+ * Return values:
+ *   0    success
+ *  -1    error
+ *****************************************************************************/
+static int group_sync (int fd)
+{
+  struct sync_req req;
+  struct sync_req *batch;
+  struct timespec window;
+  struct stat st;
+
+  if (fstat (fd, &st) == -1) {
+    fprintf (stderr, "%s: fstat: %s\n", __FUNCTION__, strerror (errno));
+    return -1;
+  }
+
+  req.fd = fd;
+  req.dev = st.st_dev;
+  req.ino = st.st_ino;
+  req.error = 0;
+  req.done = false;
+
+  pthread_mutex_lock (&syncMutex);
+  req.next = queue;
+  queue = &req;
+  ++requests;
+
+  while (!req.done) {
+    if (leading) {
+      pthread_cond_wait (&syncCond, &syncMutex);
+      continue;
+    }
+
+    //Lead the next batch, give other uploads the window to join it.
+    leading = true;
+    pthread_mutex_unlock (&syncMutex);
+    if (windowUsec > 0) {
+      window.tv_sec = windowUsec / 1000000;
+      window.tv_nsec = (windowUsec % 1000000) * 1000;
+      nanosleep (&window, NULL);
+    }
+
+    pthread_mutex_lock (&syncMutex);
+    batch = queue;
+    queue = NULL;
+    pthread_mutex_unlock (&syncMutex);
+
+    sync_batch (batch);
+
+    pthread_mutex_lock (&syncMutex);
+    for (; batch != NULL; batch = batch->next)
+      batch->done = true;
+    leading = false;
+    pthread_cond_broadcast (&syncCond);
+  }
+  pthread_mutex_unlock (&syncMutex);
+
+  if (req.error != 0) {
+    fprintf (stderr, "%s: %s: %s\n", __FUNCTION__,
+	     (syncMode == SYNC_FS) ? "syncfs" : "fdatasync",
+	     strerror (req.error));
+    return -1;
+  }
+
+  return 0;
+}
+
+
+/******************************************************************************
+ * Flush the directory of a file, for the name the file was renamed to.
+ *
+ * Return values:
+ *   0    success
+ *  -1    error
+ *****************************************************************************/
+static int sync_dir (const char *path)
+{
+  const char *base;
+  char *dir;
+  int fd;
+  int retVal;
+
+  base = strrchr (path, '/');
+  if (base == NULL) {
+    dir = strdup (".");
+  } else if ((dir = strndup (path, (base == path) ? 1 : base - path)) == NULL) {
+    fprintf (stderr, "%s: strndup: %s\n", __FUNCTION__, strerror (errno));
+    return -1;
+  }
+
+  if (dir == NULL || (fd = open (dir, O_RDONLY | O_DIRECTORY)) == -1) {
+    fprintf (stderr, "%s: open: %s\n", __FUNCTION__, strerror (errno));
+    free (dir);
+    return -1;
+  }
+  free (dir);
+
+  retVal = group_sync (fd);
+  close (fd);
+  return retVal;
+}
+
+
+/******************************************************************************
+ * Flush each file or directory of a batch once, or each file system under
+ * SYNC_FS, and set the result of every request. Called by the leader without
+ * syncMutex held.
+ *****************************************************************************/
+static void sync_batch (struct sync_req *batch)
+{
+  struct sync_req *req, *prev;
+  long long size = 0;
+  long long synced = 0;
+
+  //Start writing out every file, the flushes below then wait for them.
+  if (syncMode == SYNC_FILES) {
+    for (req = batch; req != NULL; req = req->next)
+      sync_file_range (req->fd, 0, 0, SYNC_FILE_RANGE_WRITE);
+  }
+
+  for (req = batch; req != NULL; req = req->next) {
+    ++size;
+
+    //An earlier request for the same file or file system has been flushed.
+    for (prev = batch; prev != req; prev = prev->next) {
+      if (prev->dev == req->dev &&
+	  (syncMode == SYNC_FS || prev->ino == req->ino))
+	break;
+    }
+    if (prev != req) {
+      req->error = prev->error;
+      continue;
+    }
+
+    if (syncMode == SYNC_FS)
+      req->error = (syncfs (req->fd) == -1) ? errno : 0;
+    else
+      req->error = (fdatasync (req->fd) == -1) ? errno : 0;
+    ++synced;
+  }
+
+  pthread_mutex_lock (&syncMutex);
+  ++batches;
+  flushes += synced;
+  if (size > maxBatch)
+    maxBatch = size;
+  pthread_mutex_unlock (&syncMutex);
+}
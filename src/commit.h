@@ -0,0 +1,120 @@
+/******************************************************************************
+ * FTP-Server
+ * Author: Evan Myers
+ * Date: October 2026
+ *
+ * Description:
+ *   Completion of uploads. A new or replaced file is received under a hidden
+ *   temporary name in its directory, and renamed over the final name only
+ *   once the whole file has been received. A reader sees either the old file
+ *   or the new one, never part of an upload. Each upload has a temporary
+ *   name of its own, so uploads of the same file at once do not mix, and the
+ *   last to complete replaces the others.
+ *
+ *   Uploads may also be made durable before they are acknowledged. The
+ *   flushes of uploads that complete at about the same time are combined
+ *   (group commit): the first upload to complete waits a short window, then
+ *   flushes every upload that has joined it together.
+ *****************************************************************************/
+#ifndef __COMMIT_H__
+#define __COMMIT_H__
+
+
+#include <sys/types.h>  //Required for 'mode_t' in function prototype.
+
+
+/******************************************************************************
+ * Read the upload completion settings from the server configuration file.
+ * This function should be called once, by main(), before any client
+ * connects.
+ *
+ * Settings (ftp.conf):
+ *   STOR_ATOMIC_CONFIG      - 1 to receive uploads under a temporary name,
+ *                             0 to write them in place.
+ *   STOR_SYNC_CONFIG        - 1 to flush an upload to the disk before it is
+ *                             acknowledged, 2 to flush its whole file system
+ *                             with syncfs() instead, 0 to leave it to the
+ *                             kernel.
+ *   STOR_SYNC_WINDOW_CONFIG - The microseconds to wait for other uploads to
+ *                             join a flush.
+ *****************************************************************************/
+void commit_load_config (void);
+
+
+/******************************************************************************
+ * Create the file to receive an upload in. When uploads are renamed into
+ * place, a new hidden file is created in the same directory as the file it
+ * replaces, "dir/.name.XXXXXX.part", with a name no other upload uses.
+ * Otherwise the file itself is opened with the given flags.
+ *
+ * Arguments:
+ *       path - The pathname of the uploaded file.
+ *      flags - The open() flags of a file written in place, eg. O_TRUNC.
+ *       mode - The permissions of a new file.
+ *   partpath - Set to the temporary pathname, which the caller must free and
+ *              remove if the upload is not completed, or to NULL if the
+ *              upload is written in place.
+ *
+ * Returns:
+ *   A file descriptor open for writing, or -1 on error.
+ *****************************************************************************/
+int commit_part_open (const char *path, int flags, mode_t mode,
+		      char **partpath);
+
+
+/******************************************************************************
+ * Create the file to receive an upload in under a new temporary name, as
+ * commit_part_open() does when uploads are renamed into place, whatever the
+ * setting. For an upload that is never written in place, eg. a file that is
+ * rebuilt from its old contents.
+ *
+ * Arguments:
+ *       path - The pathname of the uploaded file.
+ *       mode - The permissions of the new file.
+ *   partpath - Set to the temporary pathname, which the caller must free.
+ *
+ * Returns:
+ *   A file descriptor open for writing, or -1 on error.
+ *****************************************************************************/
+int commit_temp_open (const char *path, mode_t mode, char **partpath);
+
+
+/******************************************************************************
+ * Complete a received upload. The file is flushed to the disk if required,
+ * then renamed from its temporary name, and the new name is flushed as well.
+ * The calling thread waits for the flushes, which may be shared with other
+ * uploads.
+ *
+ * Arguments:
+ *         fd - The uploaded file.
+ *   partpath - The temporary pathname of the file, or NULL if it was written
+ *              in place.
+ *       path - The pathname of the uploaded file.
+ *
+ * Return values:
+ *   0    success
+ *  -1    error
+ *****************************************************************************/
+int commit_upload (int fd, const char *partpath, const char *path);
+
+
+/******************************************************************************
+ * Remove the temporary file of an upload that will not be completed, and
+ * free the pathnames of the upload.
+ *
+ * Arguments:
+ *       path - The pathname of the uploaded file.
+ *   partpath - The temporary pathname of the upload, or NULL if the file is
+ *              written in place. The file is removed.
+ *****************************************************************************/
+void commit_discard (char *path, char *partpath);
+
+
+/******************************************************************************
+ * Print the flush statistics of the group commit to stdout (the server
+ * console).
+ *****************************************************************************/
+void commit_print_stats (void);
+
+
+#endif //__COMMIT_H__
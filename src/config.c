@@ -8,6 +8,7 @@
  *   found in this file.
  *****************************************************************************/
 #include <errno.h>
+#include <stdbool.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -21,8 +22,9 @@
 #define CONFIG_COMMENT '#'
 
 
-//Local function prototype.
+//Local function prototypes.
 static char *search_config (const char *target, const char *pathname);
+static bool is_setting_line (const char *line, const char *target);
 
 
 /******************************************************************************
@@ -51,6 +53,32 @@ char *get_config_value (const char *configSetting, const char *filen)
 }
 
 
+/******************************************************************************
+ * get_config_number - see config.h
+ *****************************************************************************/
+long long get_config_number (const char *configSetting, const char *filename,
+			     long long defaultValue)
+{
+  char *valueStr;
+  char *endPtr;
+  long long value;
+
+  if ((valueStr = get_config_value (configSetting, filename)) == NULL)
+    return defaultValue;
+
+  errno = 0;
+  value = strtoll (valueStr, &endPtr, 10);
+  if (errno != 0 || endPtr == valueStr || *endPtr != '\0' || value < 0) {
+    fprintf (stderr, "%s: '%s' must be a non-negative integer, using %lld\n",
+	     __FUNCTION__, configSetting, defaultValue);
+    value = defaultValue;
+  }
+
+  free (valueStr);
+  return value;
+}
+
+
 /******************************************************************************
  * get_config_path - see config.h
  *****************************************************************************/
@@ -120,6 +148,7 @@ static char *search_config (const char *target, const char *pathname)
 
   char *value;                    //The value of the target setting.
   int valLength; //The length of the value string for the target setting.
+  bool found = false;
 
   //Open the filestream.
   if ((fin = fopen (pathname, "r")) == NULL) {
@@ -135,10 +164,10 @@ static char *search_config (const char *target, const char *pathname)
       continue;
 
     //Move to the next line if this line is not the setting.
-    if (strstr (line, target) == NULL)
-      continue;   //not present, search next line.
-    else
+    if (is_setting_line (line, target)) {
+      found = true;
       break;
+    }
   }
 
   /* The filestream is no longer required after this point, close it. */
@@ -148,7 +177,7 @@ static char *search_config (const char *target, const char *pathname)
   }
 
   //Determine if the target setting was found or the entire file was read.
-  if (strstr (line, target) == NULL) {
+  if (!found) {
     fprintf (stderr, "%s: '%s' setting was not found in file './%s'\n",
 	     __FUNCTION__, target, pathname);
     return NULL;
@@ -202,3 +231,29 @@ static char *search_config (const char *target, const char *pathname)
 
   return value;
 }
+
+
+/******************************************************************************
+ * Determine if a line of the configuration file sets the target setting. The
+ * setting name must match exactly, so that a setting whose name contains the
+ * target (eg. a user named "test" and a user named "tester") is not mistaken
+ * for it.
+ *
+ * Arguments:
+ *     line - A line read from the configuration file.
+ *   target - The name of the setting.
+ *
+ * Returns:
+ *   True if the line begins with the setting name, followed by a space or the
+ *   end of the line.
+ *****************************************************************************/
+static bool is_setting_line (const char *line, const char *target)
+{
+  size_t targetLen = strlen (target);
+
+  if (strncmp (line, target, targetLen) != 0)
+    return false;
+
+  return (line[targetLen] == ' ' || line[targetLen] == '\n' ||
+	  line[targetLen] == '\0');
+}
@@ -62,4 +62,21 @@ char *get_config_value (const char *configSetting, const char *filename);
 char *get_config_path (const char *filename);
 
 
+/******************************************************************************
+ * Retrieve a setting whose value is a non-negative integer, such as a size in
+ * bytes. The default value is returned when the setting is missing from the
+ * configuration file, or when its value is not a non-negative integer.
+ *
+ * Arguments:
+ *   configSetting - Retrieve the value of this setting from the config file.
+ *        filename - The configuration file to search.
+ *    defaultValue - The value to use when the setting cannot be used.
+ *
+ * Returns:
+ *   The value of the setting, or the default value.
+ *****************************************************************************/
+long long get_config_number (const char *configSetting, const char *filename,
+			     long long defaultValue);
+
+
 #endif //__CONFIG_H__
@@ -0,0 +1,469 @@
+/******************************************************************************
+ * FTP-Server
+ * Author: Evan Myers
+ * Date: October 2026
+ *
+ * Description:
+ *   Server-side copies of files. See copy.h for an overview.
+ *****************************************************************************/
+#include <ctype.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <linux/fs.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/ioctl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "commit.h"
+#include "copy.h"
+#include "path.h"
+#include "reply.h"
+
+
+//The bytes copied between checks for an abort.
+#define COPY_CHUNK 8388608
+
+//The buffer of a copy through read() and write().
+#define COPY_BUFFER 262144
+
+//The permissions of a copy, as for STOR.
+#define FILE_MODE (S_IRUSR | S_IWUSR | S_IRGRP | S_IWGRP | S_IROTH | S_IWOTH)
+
+
+//A copy handed to its thread.
+typedef struct {
+  session_info_t *si;
+  int in;            //The file to copy.
+  int out;           //The copy.
+  char *path;        //The pathname of the copy.
+  char *partpath;    //Its temporary pathname, or NULL.
+} copy_job_t;
+
+
+//Local function prototypes.
+static void *copy_thread (void *arg);
+static int copy_data (session_info_t *si, int in, int out,
+		      const char **method);
+static int copy_range (session_info_t *si, int in, int out);
+static int copy_buffered (session_info_t *si, int in, int out);
+static bool copy_moved (session_info_t *si, off_t moved);
+static void join_copy (session_info_t *si);
+
+
+/******************************************************************************
+ * copy_session_start - see copy.h
+ *****************************************************************************/
+void copy_session_start (session_info_t *si)
+{
+  pthread_mutex_init (&si->copyLock, NULL);
+  si->copyThread = 0;
+  si->copyAbort = false;
+  si->copyDone = 0;
+  si->copySize = -1;
+}
+
+
+/******************************************************************************
+ * copy_session_end - see copy.h
+ *****************************************************************************/
+void copy_session_end (session_info_t *si)
+{
+  copy_abort (si);
+  join_copy (si);
+  pthread_mutex_destroy (&si->copyLock);
+}
+
+
+/******************************************************************************
+ * cmd_cpy - see copy.h
+ *****************************************************************************/
+void cmd_cpy (session_info_t *si, char *arg)
+{
+  char *dst;
+  char *srcpath;
+  copy_job_t *job;
+  struct stat srcStat;
+  struct stat dstStat;
+  int pathCheck;
+  int csfd = si->csfd;
+
+  if (si->loggedin == false || strcmp (si->user, "anonymous") == 0) {
+    send_mesg_530 (csfd, REPLY_530_REQUEST);
+    return;
+  }
+
+  //Separate the destination from the source.
+  for (dst = arg; dst != NULL && *dst != '\0' &&
+	 !isspace ((unsigned char) *dst); dst++);
+  if (dst != NULL && *dst != '\0') {
+    *dst++ = '\0';
+    while (isspace ((unsigned char) *dst))
+      dst++;
+  }
+  if (dst == NULL || *dst == '\0') {
+    send_mesg_501 (csfd);
+    return;
+  }
+
+  //One copy runs at a time, the thread of the last one is joined first.
+  if (copy_progress (si, NULL, NULL)) {
+    send_mesg_450 (csfd);
+    return;
+  }
+  join_copy (si);
+
+  //Both pathnames are checked as for RETR and STOR.
+  if (!check_file_exist (si->cwd, arg)) {
+    send_mesg_553 (csfd);
+    return;
+  }
+  if ((pathCheck = check_future_file (si->cwd, dst, false)) == -1) {
+    send_mesg_450 (csfd);
+    return;
+  } else if (pathCheck < 0) {
+    send_mesg_553 (csfd);
+    return;
+  }
+
+  if ((job = malloc (sizeof (*job))) == NULL) {
+    send_mesg_451 (csfd);
+    return;
+  }
+  job->si = si;
+
+  if ((srcpath = merge_paths (si->cwd, arg, NULL)) == NULL) {
+    free (job);
+    send_mesg_451 (csfd);
+    return;
+  }
+  job->in = open (srcpath, O_RDONLY);
+  free (srcpath);
+  if (job->in == -1 || fstat (job->in, &srcStat) == -1 ||
+      !S_ISREG (srcStat.st_mode)) {
+    if (job->in != -1)
+      close (job->in);
+    free (job);
+    send_mesg_450 (csfd);
+    return;
+  }
+
+  if ((job->path = merge_paths (si->cwd, dst, NULL)) == NULL) {
+    close (job->in);
+    free (job);
+    send_mesg_451 (csfd);
+    return;
+  }
+
+  //A file copied onto itself would be truncated before it is read.
+  if (stat (job->path, &dstStat) == 0 && dstStat.st_dev == srcStat.st_dev &&
+      dstStat.st_ino == srcStat.st_ino) {
+    free (job->path);
+    close (job->in);
+    free (job);
+    send_mesg_553 (csfd);
+    return;
+  }
+
+  if ((job->out = commit_part_open (job->path, O_WRONLY | O_CREAT | O_TRUNC,
+				    FILE_MODE, &job->partpath)) == -1) {
+    free (job->path);
+    close (job->in);
+    free (job);
+    send_mesg_451 (csfd);
+    return;
+  }
+
+  /* The client may send STAT for the progress, or ABOR, until the copy ends,
+   * as soon as it has the 150 reply. The copy is running from then on. */
+  pthread_mutex_lock (&si->copyLock);
+  si->copyAbort = false;
+  si->copyDone = 0;
+  si->copySize = srcStat.st_size;
+  pthread_mutex_unlock (&si->copyLock);
+  send_mesg_150 (csfd, arg, REPLY_150_COPY);
+
+  if (pthread_create (&si->copyThread, NULL, &copy_thread, job) != 0) {
+    fprintf (stderr, "%s: pthread_create failed\n", __FUNCTION__);
+    si->copyThread = 0;
+    pthread_mutex_lock (&si->copyLock);
+    si->copySize = -1;
+    pthread_mutex_unlock (&si->copyLock);
+    close (job->in);
+    close (job->out);
+    commit_discard (job->path, job->partpath);
+    free (job);
+    send_mesg_451 (csfd);
+  }
+}
+
+
+/******************************************************************************
+ * copy_progress - see copy.h
+ *****************************************************************************/
+bool copy_progress (session_info_t *si, off_t *done, off_t *size)
+{
+  bool running;
+
+  pthread_mutex_lock (&si->copyLock);
+  running = si->copySize >= 0;
+  if (done != NULL)
+    *done = si->copyDone;
+  if (size != NULL)
+    *size = si->copySize;
+  pthread_mutex_unlock (&si->copyLock);
+  return running;
+}
+
+
+/******************************************************************************
+ * copy_abort - see copy.h
+ *****************************************************************************/
+bool copy_abort (session_info_t *si)
+{
+  bool running;
+
+  pthread_mutex_lock (&si->copyLock);
+  if ((running = si->copySize >= 0))
+    si->copyAbort = true;
+  pthread_mutex_unlock (&si->copyLock);
+  return running;
+}
+
+
+/******************************************************************************
+ * Copy a file, commit the copy and send the final reply of SITE CPY.
+ *
+ * Arguments:
+ *   arg - The copy_job_t of the copy, freed here.
+ *****************************************************************************/
+static void *copy_thread (void *arg)
+{
+  copy_job_t *job = arg;
+  session_info_t *si = job->si;
+  const char *method;
+  off_t done;
+  bool aborted;
+  int retVal;
+  int err;
+
+  retVal = copy_data (si, job->in, job->out, &method);
+  err = errno;
+  close (job->in);
+
+  pthread_mutex_lock (&si->copyLock);
+  aborted = si->copyAbort;
+  done = si->copyDone;
+  pthread_mutex_unlock (&si->copyLock);
+
+  if (retVal == 0 && !aborted &&
+      commit_upload (job->out, job->partpath, job->path) == -1) {
+    err = errno;
+    retVal = -1;
+  }
+  if (retVal == -1 || aborted)
+    commit_discard (job->path, job->partpath);
+  else {
+    free (job->partpath);
+    free (job->path);
+  }
+  if (close (job->out) == -1)
+    fprintf (stderr, "%s: close: %s\n", __FUNCTION__, strerror (errno));
+  free (job);
+
+  //The copy has ended before the reply, so the client may start another.
+  pthread_mutex_lock (&si->copyLock);
+  si->copySize = -1;
+  si->copyAbort = false;
+  pthread_mutex_unlock (&si->copyLock);
+
+  if (retVal == -1) {
+    if (err == ENOSPC || err == EDQUOT || err == EFBIG)
+      send_mesg_452 (si->csfd);
+    else
+      send_mesg_451 (si->csfd);
+  } else if (aborted) {
+    send_mesg_426 (si->csfd);
+  } else {
+    send_mesg_250_copy (si->csfd, done, method);
+  }
+
+  return NULL;
+}
+
+
+/******************************************************************************
+ * Copy the data of a file, by the quickest means the file systems allow.
+ * si->copyDone counts the bytes copied.
+ *
+ * Arguments:
+ *       si - The session information.
+ *       in - The file to copy, read from the start.
+ *      out - The empty copy.
+ *   method - Set to the name of the means of the copy.
+ *
+ * Return values:
+ *   0    The file was copied, or the copy was aborted (see si->copyAbort).
+ *  -1    error, with errno set
+ *****************************************************************************/
+static int copy_data (session_info_t *si, int in, int out,
+		      const char **method)
+{
+  struct stat st;
+
+  //A reflink shares the blocks of the source, nothing is copied at all.
+  if (ioctl (out, FICLONE, in) == 0) {
+    if (fstat (out, &st) == -1)
+      return -1;
+    copy_moved (si, st.st_size);
+    *method = "reflink";
+    return 0;
+  }
+
+  /* The kernel copies within the file system, where it may offload the copy
+   * to the storage. copy_file_range() refuses some pairs of file systems, the
+   * rest of the file is then copied through the server. */
+  *method = "copy_file_range";
+  if (copy_range (si, in, out) == 0)
+    return 0;
+  if (errno != EXDEV && errno != EINVAL && errno != ENOSYS &&
+      errno != EOPNOTSUPP)
+    return -1;
+
+  *method = "read/write";
+  return copy_buffered (si, in, out);
+}
+
+
+/******************************************************************************
+ * Copy the rest of a file with copy_file_range(), from the offset
+ * si->copyDone of both files.
+ *
+ * Return values:
+ *   0    The file was copied, or the copy was aborted (see si->copyAbort).
+ *  -1    error, with errno set
+ *****************************************************************************/
+static int copy_range (session_info_t *si, int in, int out)
+{
+  loff_t inOffset;
+  loff_t outOffset;
+  ssize_t moved = 0;
+  off_t done;
+
+  //Only this thread changes si->copyDone.
+  done = si->copyDone;
+  while (copy_moved (si, moved)) {
+    done += moved;
+    inOffset = outOffset = done;
+    if ((moved = copy_file_range (in, &inOffset, out, &outOffset, COPY_CHUNK,
+				  0)) == -1) {
+      if (errno == EINTR) {
+	moved = 0;
+	continue;
+      }
+      return -1;
+    }
+
+    //The end of the file.
+    if (moved == 0)
+      break;
+  }
+
+  return 0;
+}
+
+
+/******************************************************************************
+ * Copy the rest of a file with read() and write(), from the offset
+ * si->copyDone of both files.
+ *
+ * Return values:
+ *   0    The file was copied, or the copy was aborted (see si->copyAbort).
+ *  -1    error, with errno set
+ *****************************************************************************/
+static int copy_buffered (session_info_t *si, int in, int out)
+{
+  char *buf;
+  ssize_t got = 0;
+  ssize_t put;
+  ssize_t written;
+  off_t done;
+  int err;
+
+  if ((buf = malloc (COPY_BUFFER)) == NULL)
+    return -1;
+
+  //Only this thread changes si->copyDone.
+  done = si->copyDone;
+  while (copy_moved (si, got)) {
+    done += got;
+    if ((got = pread (in, buf, COPY_BUFFER, done)) == -1) {
+      if (errno == EINTR) {
+	got = 0;
+	continue;
+      }
+      err = errno;
+      free (buf);
+      errno = err;
+      return -1;
+    }
+
+    //The end of the file.
+    if (got == 0)
+      break;
+
+    for (written = 0; written < got; written += put) {
+      if ((put = pwrite (out, buf + written, got - written,
+			 done + written)) == -1) {
+	if (errno == EINTR) {
+	  put = 0;
+	  continue;
+	}
+	err = errno;
+	free (buf);
+	errno = err;
+	return -1;
+      }
+    }
+  }
+
+  free (buf);
+  return 0;
+}
+
+
+/******************************************************************************
+ * Count bytes copied in the progress of a copy.
+ *
+ * Arguments:
+ *      si - The session information.
+ *   moved - The bytes copied since the last call.
+ *
+ * Returns:
+ *   True if the copy is to go on, false if it was aborted.
+ *****************************************************************************/
+static bool copy_moved (session_info_t *si, off_t moved)
+{
+  bool aborted;
+
+  pthread_mutex_lock (&si->copyLock);
+  si->copyDone += moved;
+  aborted = si->copyAbort;
+  pthread_mutex_unlock (&si->copyLock);
+  return !aborted;
+}
+
+
+/******************************************************************************
+ * Wait for the thread of the last copy of a session, if it was not joined.
+ *****************************************************************************/
+static void join_copy (session_info_t *si)
+{
+  if (si->copyThread == 0)
+    return;
+  if (pthread_join (si->copyThread, NULL) != 0)
+    fprintf (stderr, "%s: pthread_join failed\n", __FUNCTION__);
+  si->copyThread = 0;
+}
@@ -0,0 +1,78 @@
+/******************************************************************************
+ * FTP-Server
+ * Author: Evan Myers
+ * Date: October 2026
+ *
+ * Description:
+ *   Server-side copies of files, for SITE CPY. A file is duplicated on the
+ *   server without passing through the client.
+ *
+ *   The copy is a reflink (FICLONE) where the file system shares blocks
+ *   between files, which takes no time whatever the size. Otherwise the
+ *   kernel copies the data with copy_file_range(), and read() and write()
+ *   are used where that is not supported, eg. between two file systems.
+ *
+ *   A copy runs in a thread of its own, and the 250 reply is sent when it
+ *   ends. Other commands are run meanwhile, ABOR stops the copy, and STAT
+ *   reports its progress (see session.c). A session runs one copy at a time.
+ *****************************************************************************/
+#ifndef __COPY_H__
+#define __COPY_H__
+
+
+#include <stdbool.h>   //Required for 'bool' in function prototype.
+#include <sys/types.h> //Required for 'off_t' in function prototype.
+#include "session.h"   //Required for 'session_info_t' in function prototype.
+
+
+/******************************************************************************
+ * Set up the SITE CPY state of a new session.
+ *****************************************************************************/
+void copy_session_start (session_info_t *si);
+
+
+/******************************************************************************
+ * Stop the copy of a session that is ending, and wait for its thread.
+ *****************************************************************************/
+void copy_session_end (session_info_t *si);
+
+
+/******************************************************************************
+ * Copy a file on the server (SITE CPY). Both pathnames must be within the
+ * server root directory. The copy is written under a temporary name, and
+ * renamed into place once it is complete, replacing any file of that name.
+ *
+ * The files are checked and opened here, and the copy is started in its own
+ * thread, which sends the final reply.
+ *
+ * Arguments:
+ *    si - The session information.
+ *   arg - The source and destination pathnames, separated by a space.
+ *****************************************************************************/
+void cmd_cpy (session_info_t *si, char *arg);
+
+
+/******************************************************************************
+ * Get the progress of the copy of a session, for STAT.
+ *
+ * Arguments:
+ *     si - The session information.
+ *   done - Set to the bytes copied.
+ *   size - Set to the size of the file being copied.
+ *
+ * Returns:
+ *   True if a copy is running.
+ *****************************************************************************/
+bool copy_progress (session_info_t *si, off_t *done, off_t *size);
+
+
+/******************************************************************************
+ * Stop the copy of a session, for ABOR. The copy thread sends 426.
+ *
+ * Returns:
+ *   True if a copy was running.
+ *****************************************************************************/
+bool copy_abort (session_info_t *si);
+
+
+#endif //__COPY_H__
@@ -17,6 +17,7 @@
 #include "ctrlthread.h"
 #include "reply.h"
 #include "session.h"
+#include "tls.h"
 
 
 /******************************************************************************
@@ -32,6 +33,7 @@ void *control_thread (void *arg) {
   session (*csfd);
 
   //Free all heap memory. Close sockets which are no longer required.
+  tls_end (*csfd);
   close (*csfd);
   free (csfd);
 
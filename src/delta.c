@@ -0,0 +1,870 @@
+/******************************************************************************
+ * FTP-Server
+ * Author: Evan Myers
+ * Date: October 2026
+ *
+ * Description:
+ *   Delta transfers of changed files. See delta.h for an overview and the
+ *   formats of the signature and the delta.
+ *
+ *   The weak checksum is the rolling checksum of rsync: the sum of the bytes
+ *   of the block, and the sum of each byte weighted by its distance from the
+ *   end of the block, each kept to 16 bits. Both sums are updated in constant
+ *   time when the window moves on by a byte. The strong hash is MD5, from
+ *   md5.c, and is only computed for a window whose weak checksum is found.
+ *****************************************************************************/
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "common.h"
+#include "delta.h"
+
+
+//The operations of a delta, and their lengths without their data.
+#define OP_COPY    'C'
+#define OP_LITERAL 'L'
+#define OP_END     'E'
+#define OP_COPY_LEN    9
+#define OP_LITERAL_LEN 5
+#define OP_END_LEN     (1 + MD5_DIGEST_BYTES)
+
+//The header of a delta, the block size.
+#define DELTA_HEADER 4
+
+//The window of the new file that is read at a time.
+#define ENC_WINDOW 4194304
+
+//The buffer of the blocks copied from the basis.
+#define DEC_BUFFER 1048576
+
+/* The most blocks with the weak checksum of a window whose strong hashes are
+ * compared, so that a basis of many alike blocks does not slow the search. */
+#define MAX_PROBES 64
+
+//The weak checksum of a block, from its two sums.
+#define WEAK_SUM(s1, s2) (((s1) & 0xffff) | ((s2) << 16))
+
+
+//Local function prototypes.
+static void weak_start (const uint8_t *data, size_t len, uint32_t *s1,
+			uint32_t *s2);
+static uint32_t bucket (const delta_sig_t *sig, uint32_t weak);
+static size_t block_len (const delta_sig_t *sig, uint32_t block);
+static int sig_push (pipe_stage_t *stage, const uint8_t *data, size_t len);
+static int sig_finish (pipe_stage_t *stage);
+static int sig_start (delta_sig_t *sig);
+static long find_block (delta_enc_t *enc);
+static long find_tail (delta_enc_t *enc, size_t len);
+static int enc_match (delta_enc_t *enc, pipeline_t *pl, long block,
+		      size_t len);
+static int enc_refill (delta_enc_t *enc, pipeline_t *pl);
+static int enc_op (delta_enc_t *enc, pipeline_t *pl, const uint8_t *op,
+		   size_t len);
+static int enc_flush_ops (delta_enc_t *enc, pipeline_t *pl);
+static int enc_flush_run (delta_enc_t *enc, pipeline_t *pl);
+static int enc_flush_literal (delta_enc_t *enc, pipeline_t *pl);
+static int dec_push (pipe_stage_t *stage, const uint8_t *data, size_t len);
+static int dec_finish (pipe_stage_t *stage);
+static int dec_op (delta_dec_t *dec);
+static int dec_copy (delta_dec_t *dec, uint32_t block, uint32_t count);
+static int dec_write (delta_dec_t *dec, const uint8_t *data, size_t len);
+
+
+/******************************************************************************
+ * delta_block_size - see delta.h
+ *****************************************************************************/
+uint32_t delta_block_size (off_t size)
+{
+  uint32_t blockSize = DELTA_MIN_BLOCK;
+
+  while (blockSize < DELTA_MAX_BLOCK && (off_t)blockSize * blockSize < size)
+    blockSize *= 2;
+
+  return blockSize;
+}
+
+
+/******************************************************************************
+ * delta_sig_header - see delta.h
+ *****************************************************************************/
+void delta_sig_header (uint8_t *header, uint32_t blockSize, off_t size)
+{
+  putBigEnd32 (header, blockSize);
+  putBigEnd64 (header + 4, size);
+}
+
+
+/******************************************************************************
+ * delta_sig_record - see delta.h
+ *****************************************************************************/
+void delta_sig_record (const uint8_t *data, size_t len, uint8_t *record)
+{
+  struct md5CTX md5;
+  uint32_t s1;
+  uint32_t s2;
+
+  weak_start (data, len, &s1, &s2);
+  putBigEnd32 (record, WEAK_SUM (s1, s2));
+
+  md5Start (&md5);
+  md5Add (&md5, data, len);
+  md5End (&md5, record + 4);
+}
+
+
+/******************************************************************************
+ * delta_sig_stage - see delta.h
+ *****************************************************************************/
+void delta_sig_stage (delta_sig_t *sig, pipe_stage_t *stage)
+{
+  memset (sig, 0, sizeof (*sig));
+  pipe_stage_init (stage, "delta signature", sig_push, sig_finish, sig);
+}
+
+
+/******************************************************************************
+ * delta_sig_free - see delta.h
+ *****************************************************************************/
+void delta_sig_free (delta_sig_t *sig)
+{
+  free (sig->weak);
+  free (sig->strong);
+  free (sig->heads);
+  free (sig->chain);
+  sig->weak = sig->heads = sig->chain = NULL;
+  sig->strong = NULL;
+}
+
+
+/******************************************************************************
+ * delta_enc_start - see delta.h
+ *****************************************************************************/
+int delta_enc_start (delta_enc_t *enc, const delta_sig_t *sig, int fd)
+{
+  memset (enc, 0, sizeof (*enc));
+  enc->sig = sig;
+  enc->fd = fd;
+
+  if ((enc->buf = malloc (ENC_WINDOW)) == NULL) {
+    fprintf (stderr, "%s: malloc: %s\n", __FUNCTION__, strerror (errno));
+    return -1;
+  }
+  md5Start (&enc->md5);
+
+  //The delta starts with the block size it refers to.
+  putBigEnd32 (enc->ops, sig->blockSize);
+  enc->opsLen = DELTA_HEADER;
+  return 0;
+}
+
+
+/******************************************************************************
+ * delta_enc_next - see delta.h
+ *****************************************************************************/
+int delta_enc_next (delta_enc_t *enc, pipeline_t *pl, size_t len)
+{
+  uint32_t blockSize = enc->sig->blockSize;
+  uint8_t op[OP_END_LEN];
+  size_t looked = 0;
+  size_t avail;
+  long block;
+  uint8_t out;
+  uint8_t in;
+
+  while (looked < len) {
+    avail = enc->len - enc->pos;
+
+    //The window is rolled while a byte follows the block.
+    if (avail <= blockSize && !enc->eof) {
+      if (enc_refill (enc, pl) == -1)
+	return -1;
+      continue;
+    }
+
+    //The end of the file.
+    if (avail == 0) {
+      if (enc_flush_literal (enc, pl) == -1 || enc_flush_run (enc, pl) == -1)
+	return -1;
+      op[0] = OP_END;
+      md5End (&enc->md5, op + 1);
+      if (enc_op (enc, pl, op, OP_END_LEN) == -1 ||
+	  enc_flush_ops (enc, pl) == -1)
+	return -1;
+      return 0;
+    }
+
+    //The rest of the file is shorter than a block, it can only be the last.
+    if (avail < blockSize) {
+      if ((block = find_tail (enc, avail)) >= 0) {
+	if (enc_match (enc, pl, block, avail) == -1)
+	  return -1;
+      } else {
+	enc->pos = enc->len;
+      }
+      looked += avail;
+      continue;
+    }
+
+    if (!enc->rolling) {
+      weak_start (enc->buf + enc->pos, blockSize, &enc->s1, &enc->s2);
+      enc->rolling = true;
+    }
+
+    if ((block = find_block (enc)) >= 0) {
+      if (enc_match (enc, pl, block, blockSize) == -1)
+	return -1;
+      looked += blockSize;
+    } else if (enc->pos + blockSize < enc->len) {
+      //Move the window on by a byte, the byte it leaves is literal data.
+      out = enc->buf[enc->pos];
+      in = enc->buf[enc->pos + blockSize];
+      enc->s1 += in - out;
+      enc->s2 += enc->s1 - blockSize * out;
+      enc->pos++;
+      looked++;
+    } else {
+      //The last whole block of the file is not in the basis.
+      enc->pos++;
+      enc->rolling = false;
+      looked++;
+    }
+  }
+
+  /* The literal data looked at is sent now, so that no push is much longer
+   * than len and the transfer still answers ABOR. */
+  if (enc_flush_literal (enc, pl) == -1)
+    return -1;
+  return 1;
+}
+
+
+/******************************************************************************
+ * delta_enc_end - see delta.h
+ *****************************************************************************/
+void delta_enc_end (delta_enc_t *enc)
+{
+  free (enc->buf);
+  enc->buf = NULL;
+}
+
+
+/******************************************************************************
+ * delta_dec_start - see delta.h
+ *****************************************************************************/
+int delta_dec_start (delta_dec_t *dec, pipe_stage_t *stage, int basis,
+		     off_t basisSize, int out)
+{
+  memset (dec, 0, sizeof (*dec));
+  dec->basis = basis;
+  dec->basisSize = basisSize;
+  dec->out = out;
+
+  if ((dec->buf = malloc (DEC_BUFFER)) == NULL) {
+    fprintf (stderr, "%s: malloc: %s\n", __FUNCTION__, strerror (errno));
+    return -1;
+  }
+  md5Start (&dec->md5);
+
+  pipe_stage_init (stage, "delta", dec_push, dec_finish, dec);
+  return 0;
+}
+
+
+/******************************************************************************
+ * delta_dec_end - see delta.h
+ *****************************************************************************/
+void delta_dec_end (delta_dec_t *dec)
+{
+  free (dec->buf);
+  dec->buf = NULL;
+}
+
+
+/******************************************************************************
+ * Compute the two sums of the weak checksum of a block.
+ *****************************************************************************/
+static void weak_start (const uint8_t *data, size_t len, uint32_t *s1,
+			uint32_t *s2)
+{
+  uint32_t a = 0;
+  uint32_t b = 0;
+  size_t i;
+
+  for (i = 0; i < len; i++) {
+    a += data[i];
+    b += (len - i) * data[i];
+  }
+
+  *s1 = a;
+  *s2 = b;
+}
+
+
+/******************************************************************************
+ * Get the hash bucket of a weak checksum.
+ *****************************************************************************/
+static uint32_t bucket (const delta_sig_t *sig, uint32_t weak)
+{
+  uint32_t hash = weak * 2654435761u;
+
+  return (hash ^ (hash >> 16)) & sig->mask;
+}
+
+
+/******************************************************************************
+ * Get the length of a block of a signature, the last may be short.
+ *****************************************************************************/
+static size_t block_len (const delta_sig_t *sig, uint32_t block)
+{
+  off_t offset = (off_t)block * sig->blockSize;
+
+  if (sig->size - offset < sig->blockSize)
+    return sig->size - offset;
+  return sig->blockSize;
+}
+
+
+/******************************************************************************
+ * Read a signature pushed into the sink, the header then each block.
+ *****************************************************************************/
+static int sig_push (pipe_stage_t *stage, const uint8_t *data, size_t len)
+{
+  delta_sig_t *sig = stage->state;
+  size_t need;
+  size_t part;
+
+  while (len > 0) {
+    if (sig->started && sig->received == sig->count)
+      return -1;
+
+    need = sig->started ? DELTA_SIG_RECORD : DELTA_SIG_HEADER;
+    part = (need - sig->partLen < len) ? need - sig->partLen : len;
+    memcpy (sig->part + sig->partLen, data, part);
+    sig->partLen += part;
+    data += part;
+    len -= part;
+    if (sig->partLen < need)
+      break;
+    sig->partLen = 0;
+
+    if (!sig->started) {
+      if (sig_start (sig) == -1)
+	return -1;
+    } else {
+      sig->weak[sig->received] = getBigEnd32 (sig->part);
+      memcpy (sig->strong + (size_t)sig->received * MD5_DIGEST_BYTES,
+	      sig->part + 4, MD5_DIGEST_BYTES);
+      sig->received++;
+    }
+  }
+
+  return 0;
+}
+
+
+/******************************************************************************
+ * Check that the whole signature was received, and index its blocks by
+ * their weak checksums. Each bucket lists its blocks in order.
+ *****************************************************************************/
+static int sig_finish (pipe_stage_t *stage)
+{
+  delta_sig_t *sig = stage->state;
+  uint32_t b;
+  uint32_t i;
+
+  if (!sig->started || sig->received != sig->count || sig->partLen != 0)
+    return -1;
+
+  for (i = sig->count; i > 0; i--) {
+    b = bucket (sig, sig->weak[i - 1]);
+    sig->chain[i - 1] = sig->heads[b];
+    sig->heads[b] = i;
+  }
+
+  return 0;
+}
+
+
+/******************************************************************************
+ * Check the header of a signature, and allocate its blocks.
+ *
+ * Return values:
+ *   0    success
+ *  -1    The header is invalid, or there is not enough memory.
+ *****************************************************************************/
+static int sig_start (delta_sig_t *sig)
+{
+  uint64_t size;
+  uint32_t buckets = 1;
+  size_t count;
+
+  sig->blockSize = getBigEnd32 (sig->part);
+  size = getBigEnd64 (sig->part + 4);
+  if (sig->blockSize < DELTA_MIN_BLOCK || sig->blockSize > DELTA_MAX_BLOCK ||
+      size > (uint64_t)DELTA_MAX_BLOCKS * sig->blockSize)
+    return -1;
+
+  sig->size = size;
+  sig->count = (size + sig->blockSize - 1) / sig->blockSize;
+  sig->started = true;
+
+  //There are about as many buckets as blocks.
+  while (buckets < sig->count)
+    buckets *= 2;
+  sig->mask = buckets - 1;
+
+  //An empty file has no blocks, but the arrays are still allocated.
+  count = (sig->count > 0) ? sig->count : 1;
+  sig->weak = malloc (count * sizeof (uint32_t));
+  sig->strong = malloc (count * MD5_DIGEST_BYTES);
+  sig->chain = malloc (count * sizeof (uint32_t));
+  sig->heads = calloc (buckets, sizeof (uint32_t));
+  if (sig->weak == NULL || sig->strong == NULL || sig->chain == NULL ||
+      sig->heads == NULL) {
+    fprintf (stderr, "%s: malloc: %s\n", __FUNCTION__, strerror (errno));
+    return -1;
+  }
+
+  return 0;
+}
+
+
+/******************************************************************************
+ * Look up the block of the basis that matches the window of the new file.
+ * The block after the last one found is tried first, since the blocks of an
+ * unchanged part of a file follow each other.
+ *
+ * Returns:
+ *   The block of the basis, or -1 if none matches.
+ *****************************************************************************/
+static long find_block (delta_enc_t *enc)
+{
+  const delta_sig_t *sig = enc->sig;
+  const uint8_t *window = enc->buf + enc->pos;
+  uint32_t weak = WEAK_SUM (enc->s1, enc->s2);
+  uint8_t strong[MD5_DIGEST_BYTES];
+  struct md5CTX md5;
+  bool hashed = false;
+  uint32_t next = enc->runBlock + enc->runCount;
+  uint32_t i;
+  int probes = 0;
+
+  if (enc->runCount > 0 && next < sig->count && sig->weak[next] == weak &&
+      block_len (sig, next) == sig->blockSize) {
+    md5Start (&md5);
+    md5Add (&md5, window, sig->blockSize);
+    md5End (&md5, strong);
+    hashed = true;
+    if (memcmp (strong, sig->strong + (size_t)next * MD5_DIGEST_BYTES,
+		MD5_DIGEST_BYTES) == 0)
+      return next;
+  }
+
+  for (i = sig->heads[bucket (sig, weak)]; i != 0 && probes < MAX_PROBES;
+       i = sig->chain[i - 1]) {
+    if (sig->weak[i - 1] != weak ||
+	block_len (sig, i - 1) != sig->blockSize)
+      continue;
+
+    if (!hashed) {
+      md5Start (&md5);
+      md5Add (&md5, window, sig->blockSize);
+      md5End (&md5, strong);
+      hashed = true;
+    }
+    if (memcmp (strong, sig->strong + (size_t)(i - 1) * MD5_DIGEST_BYTES,
+		MD5_DIGEST_BYTES) == 0)
+      return i - 1;
+    probes++;
+  }
+
+  return -1;
+}
+
+
+/******************************************************************************
+ * Determine if the end of the new file, shorter than a block, matches the
+ * last block of the basis.
+ *
+ * Returns:
+ *   The last block of the basis, or -1 if it does not match.
+ *****************************************************************************/
+static long find_tail (delta_enc_t *enc, size_t len)
+{
+  const delta_sig_t *sig = enc->sig;
+  const uint8_t *tail = enc->buf + enc->pos;
+  uint8_t strong[MD5_DIGEST_BYTES];
+  struct md5CTX md5;
+  uint32_t last;
+  uint32_t s1;
+  uint32_t s2;
+
+  if (sig->count == 0)
+    return -1;
+  last = sig->count - 1;
+  if (block_len (sig, last) != len)
+    return -1;
+
+  weak_start (tail, len, &s1, &s2);
+  if (sig->weak[last] != WEAK_SUM (s1, s2))
+    return -1;
+
+  md5Start (&md5);
+  md5Add (&md5, tail, len);
+  md5End (&md5, strong);
+  if (memcmp (strong, sig->strong + (size_t)last * MD5_DIGEST_BYTES,
+	      MD5_DIGEST_BYTES) != 0)
+    return -1;
+
+  return last;
+}
+
+
+/******************************************************************************
+ * Record a block of the basis found at the window. The literal data before
+ * it is sent, and the block joins the copy of the blocks before it if it
+ * follows them in the basis.
+ *
+ * Return values:
+ *   0    success
+ *  -1    error
+ *****************************************************************************/
+static int enc_match (delta_enc_t *enc, pipeline_t *pl, long block,
+		      size_t len)
+{
+  if (enc_flush_literal (enc, pl) == -1)
+    return -1;
+
+  if (enc->runCount > 0 && block == enc->runBlock + enc->runCount) {
+    enc->runCount++;
+  } else {
+    if (enc_flush_run (enc, pl) == -1)
+      return -1;
+    enc->runBlock = block;
+    enc->runCount = 1;
+  }
+
+  enc->pos += len;
+  enc->lit = enc->pos;
+  enc->rolling = false;
+  enc->matched += len;
+  return 0;
+}
+
+
+/******************************************************************************
+ * Read more of the new file into the window. The literal data before the
+ * block being looked up is sent first, then the block is moved to the start
+ * of the window.
+ *
+ * Return values:
+ *   0    success
+ *  -1    error
+ *****************************************************************************/
+static int enc_refill (delta_enc_t *enc, pipeline_t *pl)
+{
+  ssize_t nread;
+
+  if (enc_flush_literal (enc, pl) == -1)
+    return -1;
+
+  memmove (enc->buf, enc->buf + enc->pos, enc->len - enc->pos);
+  enc->len -= enc->pos;
+  enc->pos = enc->lit = 0;
+
+  while (enc->len < ENC_WINDOW) {
+    if ((nread = pread (enc->fd, enc->buf + enc->len, ENC_WINDOW - enc->len,
+			enc->readOffset)) == -1) {
+      if (errno == EINTR)
+	continue;
+      fprintf (stderr, "%s: pread: %s\n", __FUNCTION__, strerror (errno));
+      return -1;
+    } else if (nread == 0) {
+      enc->eof = true;
+      break;
+    }
+
+    //The new file is hashed as it is read, for the end of the delta.
+    md5Add (&enc->md5, enc->buf + enc->len, nread);
+    enc->len += nread;
+    enc->readOffset += nread;
+  }
+
+  return 0;
+}
+
+
+/******************************************************************************
+ * Add an operation to those waiting to be sent.
+ *
+ * Return values:
+ *   0    success
+ *  -1    error
+ *****************************************************************************/
+static int enc_op (delta_enc_t *enc, pipeline_t *pl, const uint8_t *op,
+		   size_t len)
+{
+  if (enc->opsLen + len > sizeof (enc->ops) && enc_flush_ops (enc, pl) == -1)
+    return -1;
+
+  memcpy (enc->ops + enc->opsLen, op, len);
+  enc->opsLen += len;
+  return 0;
+}
+
+
+/******************************************************************************
+ * Send the operations waiting to be sent.
+ *
+ * Return values:
+ *   0    success
+ *  -1    error
+ *****************************************************************************/
+static int enc_flush_ops (delta_enc_t *enc, pipeline_t *pl)
+{
+  if (enc->opsLen > 0 && pipe_push (pl, enc->ops, enc->opsLen) == -1)
+    return -1;
+
+  enc->opsLen = 0;
+  return 0;
+}
+
+
+/******************************************************************************
+ * Add the copy of the blocks found so far to the operations.
+ *
+ * Return values:
+ *   0    success
+ *  -1    error
+ *****************************************************************************/
+static int enc_flush_run (delta_enc_t *enc, pipeline_t *pl)
+{
+  uint8_t op[OP_COPY_LEN];
+
+  if (enc->runCount == 0)
+    return 0;
+
+  op[0] = OP_COPY;
+  putBigEnd32 (op + 1, enc->runBlock);
+  putBigEnd32 (op + 5, enc->runCount);
+  enc->runCount = 0;
+  return enc_op (enc, pl, op, OP_COPY_LEN);
+}
+
+
+/******************************************************************************
+ * Send the literal data before the window, after the operations before it.
+ * The data is pushed from the window itself.
+ *
+ * Return values:
+ *   0    success
+ *  -1    error
+ *****************************************************************************/
+static int enc_flush_literal (delta_enc_t *enc, pipeline_t *pl)
+{
+  uint8_t op[OP_LITERAL_LEN];
+  size_t len = enc->pos - enc->lit;
+
+  if (len == 0)
+    return 0;
+
+  op[0] = OP_LITERAL;
+  putBigEnd32 (op + 1, len);
+  if (enc_flush_run (enc, pl) == -1 || enc_op (enc, pl, op, OP_LITERAL_LEN) == -1
+      || enc_flush_ops (enc, pl) == -1 ||
+      pipe_push (pl, enc->buf + enc->lit, len) == -1)
+    return -1;
+
+  enc->literal += len;
+  enc->lit = enc->pos;
+  return 0;
+}
+
+
+/******************************************************************************
+ * Apply a delta pushed into the sink. The header and each operation are
+ * gathered, literal data is written as it arrives.
+ *****************************************************************************/
+static int dec_push (pipe_stage_t *stage, const uint8_t *data, size_t len)
+{
+  delta_dec_t *dec = stage->state;
+  size_t need;
+  size_t part;
+
+  while (len > 0) {
+    //Nothing may follow the end of the delta.
+    if (dec->done)
+      return -1;
+
+    if (dec->inLiteral) {
+      part = (dec->left < len) ? dec->left : len;
+      if (dec_write (dec, data, part) == -1)
+	return -1;
+      dec->literal += part;
+      dec->left -= part;
+      dec->inLiteral = (dec->left > 0);
+      data += part;
+      len -= part;
+      continue;
+    }
+
+    //The length of an operation is known from its first byte.
+    if (!dec->started) {
+      need = DELTA_HEADER;
+    } else {
+      if (dec->partLen == 0) {
+	dec->part[dec->partLen++] = *data++;
+	len--;
+      }
+      if (dec->part[0] == OP_COPY)
+	need = OP_COPY_LEN;
+      else if (dec->part[0] == OP_LITERAL)
+	need = OP_LITERAL_LEN;
+      else if (dec->part[0] == OP_END)
+	need = OP_END_LEN;
+      else
+	return -1;
+    }
+
+    part = (need - dec->partLen < len) ? need - dec->partLen : len;
+    memcpy (dec->part + dec->partLen, data, part);
+    dec->partLen += part;
+    data += part;
+    len -= part;
+    if (dec->partLen < need)
+      break;
+    dec->partLen = 0;
+
+    if (dec_op (dec) == -1)
+      return -1;
+  }
+
+  return 0;
+}
+
+
+/******************************************************************************
+ * Fail a delta that ended before its end operation.
+ *****************************************************************************/
+static int dec_finish (pipe_stage_t *stage)
+{
+  delta_dec_t *dec = stage->state;
+
+  return dec->done ? 0 : -1;
+}
+
+
+/******************************************************************************
+ * Carry out the header or the operation that was gathered.
+ *
+ * Return values:
+ *   0    success
+ *  -1    The operation is invalid, the new file does not match the delta, or
+ *        there was an error.
+ *****************************************************************************/
+static int dec_op (delta_dec_t *dec)
+{
+  uint8_t digest[MD5_DIGEST_BYTES];
+
+  if (!dec->started) {
+    dec->blockSize = getBigEnd32 (dec->part);
+    if (dec->blockSize < DELTA_MIN_BLOCK || dec->blockSize > DELTA_MAX_BLOCK)
+      return -1;
+    dec->started = true;
+    return 0;
+  }
+
+  switch (dec->part[0]) {
+  case OP_COPY:
+    return dec_copy (dec, getBigEnd32 (dec->part + 1),
+		     getBigEnd32 (dec->part + 5));
+
+  case OP_LITERAL:
+    dec->left = getBigEnd32 (dec->part + 1);
+    dec->inLiteral = (dec->left > 0);
+    return 0;
+
+  default:
+    md5End (&dec->md5, digest);
+    if (memcmp (digest, dec->part + 1, MD5_DIGEST_BYTES) != 0) {
+      fprintf (stderr, "%s: the new file does not match the delta\n",
+	       __FUNCTION__);
+      return -1;
+    }
+    dec->done = true;
+    return 0;
+  }
+}
+
+
+/******************************************************************************
+ * Copy blocks of the basis to the new file.
+ *
+ * Return values:
+ *   0    success
+ *  -1    The blocks are not in the basis, or there was an error.
+ *****************************************************************************/
+static int dec_copy (delta_dec_t *dec, uint32_t block, uint32_t count)
+{
+  off_t blocks = (dec->basisSize + dec->blockSize - 1) / dec->blockSize;
+  off_t offset = (off_t)block * dec->blockSize;
+  off_t end = (off_t)(block + (off_t)count) * dec->blockSize;
+  ssize_t nread;
+  size_t len;
+
+  if (count == 0 || block >= blocks || count > blocks - block)
+    return -1;
+  if (end > dec->basisSize)
+    end = dec->basisSize;
+
+  while (offset < end) {
+    len = (end - offset < DEC_BUFFER) ? end - offset : DEC_BUFFER;
+    if ((nread = pread (dec->basis, dec->buf, len, offset)) == -1) {
+      if (errno == EINTR)
+	continue;
+      fprintf (stderr, "%s: pread: %s\n", __FUNCTION__, strerror (errno));
+      return -1;
+    } else if (nread == 0) {
+      //The basis has shrunk.
+      return -1;
+    }
+
+    if (dec_write (dec, dec->buf, nread) == -1)
+      return -1;
+    dec->matched += nread;
+    offset += nread;
+  }
+
+  return 0;
+}
+
+
+/******************************************************************************
+ * Append data to the new file, and add it to its MD5.
+ *
+ * Return values:
+ *   0    success
+ *  -1    error
+ *****************************************************************************/
+static int dec_write (delta_dec_t *dec, const uint8_t *data, size_t len)
+{
+  ssize_t written;
+
+  md5Add (&dec->md5, data, len);
+
+  while (len > 0) {
+    if ((written = pwrite (dec->out, data, len, dec->outOffset)) == -1) {
+      if (errno == EINTR)
+	continue;
+      fprintf (stderr, "%s: pwrite: %s\n", __FUNCTION__, strerror (errno));
+      return -1;
+    }
+    data += written;
+    len -= written;
+    dec->outOffset += written;
+  }
+
+  return 0;
+}
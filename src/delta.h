@@ -0,0 +1,239 @@
+/******************************************************************************
+ * FTP-Server
+ * Author: Evan Myers
+ * Date: October 2026
+ *
+ * Description:
+ *   Delta transfers of changed files, in the manner of rsync. Only the parts
+ *   of a file that differ from the copy at the other end are sent.
+ *
+ *   The side that holds the old copy of a file (the basis) sends the
+ *   signature of it: the file is cut into blocks, and each block is described
+ *   by a weak rolling checksum and a strong hash (MD5). The side that holds
+ *   the new file slides a window over it, looking up the rolling checksum of
+ *   the window at every byte, and sends a delta: the blocks of the basis that
+ *   are found again, and the data in between. The receiver builds the new
+ *   file from its basis and the delta, and checks it against the MD5 of the
+ *   whole file that ends the delta.
+ *
+ *   An upload is SITE DSIG (the server sends the signature of its copy) then
+ *   SITE DSTOR (the client sends the delta). A download is SITE DBASE (the
+ *   client sends the signature of its copy) then SITE DRETR (the server sends
+ *   the delta). Each is an ordinary transfer on the data connection, in the
+ *   transfer mode of the session, and always binary.
+ *
+ *   All numbers are big-endian.
+ *
+ *   Signature:
+ *     u32 block size, u64 file size, then for each block (the last may be
+ *     short): u32 weak checksum, MD5 of the block (16 bytes).
+ *
+ *   Delta:
+ *     u32 block size, then the operations, each starting with a byte:
+ *       'C' u32 block, u32 count - copy count blocks of the basis.
+ *       'L' u32 length, data     - literal data.
+ *       'E' MD5 of the new file  - the end of the delta.
+ *****************************************************************************/
+#ifndef __DELTA_H__
+#define __DELTA_H__
+
+
+#include <stdbool.h>     //Required for 'bool' in structure.
+#include <stddef.h>      //Required for 'size_t' in structure.
+#include <stdint.h>      //Required for 'uint32_t' in structure.
+#include <sys/types.h>   //Required for 'off_t' in structure.
+#include "md5.h"         //Required for 'struct md5CTX' in structure.
+#include "pipeline.h"    //Required for 'pipe_stage_t' in function prototype.
+
+
+//The limits of the block size of a signature.
+#define DELTA_MIN_BLOCK 1024
+#define DELTA_MAX_BLOCK 131072
+
+//The most blocks of a signature that is received.
+#define DELTA_MAX_BLOCKS 1048576
+
+//The lengths of the signature header and of each of its blocks.
+#define DELTA_SIG_HEADER 12
+#define DELTA_SIG_RECORD (4 + MD5_DIGEST_BYTES)
+
+//The longest operation of a delta, without its data.
+#define DELTA_OP_MAX (1 + MD5_DIGEST_BYTES)
+
+
+/******************************************************************************
+ * The signature of a basis, received from the client for SITE DRETR. The
+ * blocks are indexed by their weak checksums.
+ *****************************************************************************/
+typedef struct delta_sig {
+  uint32_t blockSize;
+  off_t size;                //The size of the basis.
+  uint32_t count;            //The blocks of the basis.
+  uint32_t *weak;            //The weak checksum of each block.
+  uint8_t *strong;           //The MD5 of each block.
+  uint32_t *heads;           //The first block of each hash bucket, plus one.
+  uint32_t *chain;           //The next block of the same bucket, plus one.
+  uint32_t mask;             //The hash buckets, less one.
+  uint8_t part[DELTA_SIG_RECORD];  //A header or block being gathered.
+  size_t partLen;
+  uint32_t received;         //The blocks received so far.
+  bool started;              //The header was received.
+} delta_sig_t;
+
+
+/******************************************************************************
+ * The generation of a delta against a signature, for SITE DRETR.
+ *****************************************************************************/
+typedef struct {
+  const delta_sig_t *sig;
+  int fd;                    //The new file.
+  off_t readOffset;          //The offset of the next read from the file.
+  bool eof;
+  uint8_t *buf;              //A window of the new file.
+  size_t len;                //The bytes of the window.
+  size_t pos;                //The start of the block being looked up.
+  size_t lit;                //The start of the literal data not yet sent.
+  bool rolling;              //The checksum of the block at pos is current.
+  uint32_t s1;               //The parts of the rolling checksum.
+  uint32_t s2;
+  uint32_t runBlock;         //The basis blocks of a copy not yet sent.
+  uint32_t runCount;
+  uint8_t ops[65536];        //Operations gathered to be sent together.
+  size_t opsLen;
+  struct md5CTX md5;         //The MD5 of the new file.
+  long long literal;         //The bytes sent as literal data.
+  long long matched;         //The bytes found in the basis.
+} delta_enc_t;
+
+
+/******************************************************************************
+ * The reconstruction of a file from a basis and a delta, for SITE DSTOR.
+ *****************************************************************************/
+typedef struct {
+  int basis;                 //The old file.
+  off_t basisSize;
+  int out;                   //The new file.
+  off_t outOffset;
+  uint32_t blockSize;
+  uint8_t part[DELTA_OP_MAX];  //The header or an operation being gathered.
+  size_t partLen;
+  uint32_t left;             //The literal data still to come.
+  bool inLiteral;
+  bool started;              //The header was received.
+  bool done;                 //The end of the delta was received.
+  uint8_t *buf;              //Blocks copied from the basis.
+  struct md5CTX md5;         //The MD5 of the new file.
+  long long literal;         //The bytes received as literal data.
+  long long matched;         //The bytes copied from the basis.
+} delta_dec_t;
+
+
+/******************************************************************************
+ * Choose the block size of the signature of a file. Larger files have larger
+ * blocks, about the square root of the size, so the signature stays small.
+ *****************************************************************************/
+uint32_t delta_block_size (off_t size);
+
+
+/******************************************************************************
+ * Fill in the header of a signature.
+ *
+ * Arguments:
+ *      header - A buffer of DELTA_SIG_HEADER bytes.
+ *   blockSize - The block size of the signature.
+ *        size - The size of the file.
+ *****************************************************************************/
+void delta_sig_header (uint8_t *header, uint32_t blockSize, off_t size);
+
+
+/******************************************************************************
+ * Fill in the signature of one block.
+ *
+ * Arguments:
+ *     data - The data of the block.
+ *      len - The length of the block.
+ *   record - A buffer of DELTA_SIG_RECORD bytes.
+ *****************************************************************************/
+void delta_sig_record (const uint8_t *data, size_t len, uint8_t *record);
+
+
+/******************************************************************************
+ * Prepare a pipeline sink that reads a signature into sig. Its finish
+ * function fails if the signature is incomplete. The signature must be freed
+ * with delta_sig_free(), whether or not it was received.
+ *****************************************************************************/
+void delta_sig_stage (delta_sig_t *sig, pipe_stage_t *stage);
+
+
+/******************************************************************************
+ * Free the memory of a signature.
+ *****************************************************************************/
+void delta_sig_free (delta_sig_t *sig);
+
+
+/******************************************************************************
+ * Prepare the delta of a file against a signature.
+ *
+ * Arguments:
+ *   enc - The generation state to initialize.
+ *   sig - The signature of the basis.
+ *    fd - The new file, open for reading.
+ *
+ * Return values:
+ *   0    success
+ *  -1    error
+ *****************************************************************************/
+int delta_enc_start (delta_enc_t *enc, const delta_sig_t *sig, int fd);
+
+
+/******************************************************************************
+ * Push the next part of a delta through a pipeline.
+ *
+ * Arguments:
+ *   enc - The generation state.
+ *    pl - The pipeline of the transfer.
+ *   len - The bytes of the new file to look at before returning. About as
+ *         many bytes of the delta are pushed at most.
+ *
+ * Return values:
+ *   1    There is more to send.
+ *   0    The delta is complete, the pipeline is not finished.
+ *  -1    error
+ *****************************************************************************/
+int delta_enc_next (delta_enc_t *enc, pipeline_t *pl, size_t len);
+
+
+/******************************************************************************
+ * Free the generation state of a delta. The counts remain valid.
+ *****************************************************************************/
+void delta_enc_end (delta_enc_t *enc);
+
+
+/******************************************************************************
+ * Prepare the reconstruction of a file, and a pipeline sink that applies
+ * the delta pushed into it. Its finish function fails if the delta is
+ * incomplete. A delta whose new file does not match its MD5 fails at its
+ * end.
+ *
+ * Arguments:
+ *         dec - The reconstruction state to initialize.
+ *       stage - The sink to prepare.
+ *       basis - The old file, open for reading.
+ *   basisSize - Its size.
+ *         out - The new file, empty and open for writing.
+ *
+ * Return values:
+ *   0    success
+ *  -1    error
+ *****************************************************************************/
+int delta_dec_start (delta_dec_t *dec, pipe_stage_t *stage, int basis,
+		     off_t basisSize, int out);
+
+
+/******************************************************************************
+ * Free the reconstruction state of a file. The counts remain valid.
+ *****************************************************************************/
+void delta_dec_end (delta_dec_t *dec);
+
+
+#endif //__DELTA_H__
@@ -17,11 +17,14 @@
 #include <unistd.h>
 #include <inttypes.h>
 #include <time.h>
+#include "bmode.h"
 #include "directory.h"
 #include "net.h"
 #include "path.h"
 #include "reply.h"
 #include "session.h"
+#include "tls.h"
+#include "zmode.h"
 
 
 #define MAX_FDATSZ 4096  //TODO integrate into standard buffer size with an
@@ -68,11 +71,14 @@ void cmd_list_nlst (session_info_t *si, char *arg, bool detail)
     return;
   }
 
+  //Secure the data connection under PROT P.
+  if (tls_data_start (si) == -1)
+    return;
+
   //Create a single pathname to the directory from the pathname fragments.
   if ((fullpath = merge_paths (si->cwd, arg, NULL)) == NULL) {
     send_mesg_451 (csfd);
-    close (si->dsfd);
-    si->dsfd = 0;
+    end_data_conn (si, false);
     return;
   }
 
@@ -108,8 +114,7 @@ static void list_directory (session_info_t *si, char * fullpath, bool detail)
   if ((dp = opendir (fullpath)) == NULL) {
     fprintf (stderr, "%s: opendir: %s\n", __FUNCTION__, strerror (errno));
     send_mesg_451 (csfd);
-    close (si->dsfd);
-    si->dsfd = 0;
+    end_data_conn (si, false);
     return;
   }
 
@@ -118,8 +123,7 @@ static void list_directory (session_info_t *si, char * fullpath, bool detail)
   if(output == NULL){
     fprintf (stderr, "%s: calloc of %d bytes failed\n", __FUNCTION__, outSize);
     send_mesg_451 (csfd);
-    close (si->dsfd);
-    si->dsfd = 0;
+    end_data_conn (si, false);
     return;
   }
 
@@ -143,8 +147,7 @@ static void list_directory (session_info_t *si, char * fullpath, bool detail)
 	  fprintf (stderr, "%s: realloc of %d bytes failed\n",
 		   __FUNCTION__, outSize);
 	  send_mesg_451 (csfd);
-	  close (si->dsfd);
-	  si->dsfd = 0;
+	  end_data_conn (si, false);
 	  return;
 	}
       }
@@ -157,31 +160,36 @@ static void list_directory (session_info_t *si, char * fullpath, bool detail)
     if (errno) {
       fprintf (stderr, "%s: readdir: %s\n", __FUNCTION__, strerror (errno));
       send_mesg_451 (csfd);
-      close (si->dsfd);
-      si->dsfd = 0;
+      end_data_conn (si, false);
       closedir (dp);
       return;
     }
   }
 
   //Send the directory listing.
-  send_all (si->dsfd, (uint8_t*)output, strlen (output));
+  if (si->mode == 'z') {
+    zmode_send_all (si->dsfd, (uint8_t*)output, strlen (output), si->zlevel);
+  } else if (si->mode == 'b') {
+    //A partly sent listing leaves the connection unusable, report an abort.
+    if (bmode_send_all (si->dsfd, (uint8_t*)output, strlen (output)) == -1)
+      si->cmdAbort = true;
+  } else {
+    send_all (si->dsfd, (uint8_t*)output, strlen (output));
+  }
   free (output);
 
+  //Clean up before replying, block mode may keep the data connection open.
+  if (closedir (dp) == -1)
+    fprintf (stderr, "%s: closedir: %s\n", __FUNCTION__, strerror (errno));
+  end_data_conn (si, si->cmdAbort == false);
+
   //Send the appropriate message if the command was aborted.
   if (si->cmdAbort == true) {
     send_mesg_426 (csfd);
     si->cmdAbort = false;
   } else {
-    send_mesg_226 (csfd, REPLY_226_SUCCESS);
+    send_mesg_226 (csfd, (si->dsfd != 0) ? REPLY_226_KEEP : REPLY_226_SUCCESS);
   }
-
-  //Clean up before returning.
-  if (closedir (dp) == -1)
-    fprintf (stderr, "%s: closedir: %s\n", __FUNCTION__, strerror (errno));
-
-  close (si->dsfd);
-  si->dsfd = 0;
   return;
 }
 
@@ -276,23 +284,20 @@ void cmd_mkd (session_info_t *si, char * filepath)
   // new directory as well as the user is NOT anonymous.
   if (si->loggedin == false || strcmp (si->user, "anonymous") == 0) {
     send_mesg_530 (csfd, REPLY_530_REQUEST);
-    close (si->dsfd);
-    si->dsfd = 0;
+    end_data_conn (si, false);
     return;
   }
 
   if ((filepath = merge_paths (si->cwd, filepath, NULL)) == NULL) {
     fprintf (stderr, "%s: merge_paths: filepath merge error\n", __FUNCTION__);
-    close (si->dsfd);
-    si->dsfd = 0;
+    end_data_conn (si, false);
     return;
   }
 
   if (mkdir (filepath, permissions) == -1) {
     fprintf (stderr, "%s: mkdir: %s\n", __FUNCTION__, strerror (errno));
     send_mesg_550_process_error (csfd);
-    close (si->dsfd);
-    si->dsfd = 0;
+    end_data_conn (si, false);
     free (filepath);
     return;
   }
@@ -0,0 +1,343 @@
+/******************************************************************************
+ * FTP-Server
+ * Author: Evan Myers
+ * Date: October 2026
+ *
+ * Description:
+ *   Deficit round robin scheduling of the chunks of data transfers. See
+ *   fairsched.h for an overview.
+ *
+ *   The transfers waiting for a grant are kept in a singly linked list in
+ *   round robin order. Whenever a slot is free the transfer at the head of the
+ *   list is visited: it is granted if it has earned the size of its chunk,
+ *   otherwise it earns another quantum and moves to the tail. A transfer keeps
+ *   what it has earned between its chunks, since it is still backlogged.
+ *
+ *   A transfer holds on to its grant after a chunk, and joins the tail of the
+ *   list before giving it up for the next chunk. Were the grant given up as
+ *   soon as the chunk was moved, the slot would always go to whichever
+ *   transfer happened to be waiting, and the weights would have no effect.
+ *****************************************************************************/
+#include <errno.h>
+#include <stdio.h>
+#include <string.h>
+#include "config.h"
+#include "fairsched.h"
+#include "session.h"
+
+
+#define NSEC_PER_SEC 1000000000LL
+
+//The longest a transfer waits for a grant before it checks for an abort.
+#define MAX_WAIT_NS (COM_THREAD_ABORT_TIMEOUT_SEC * NSEC_PER_SEC + \
+		     COM_THREAD_ABORT_TIMEOUT_USEC * 1000LL)
+
+//The defaults of the ftp.conf settings.
+#define DEFAULT_QUANTUM 65536
+#define DEFAULT_SMALL 1048576
+
+//The longest user.conf setting name, "WEIGHT_" and the username.
+#define USER_SETTING_LEN (sizeof ("WEIGHT_") + USER_STRLEN)
+
+
+//The statistics of one class of transfers.
+struct sched_class {
+  const char *name;
+  long long transfers;         //Transfers that completed.
+  long long failed;            //Transfers that were aborted or failed.
+  long long bytes;             //Bytes moved by completed transfers.
+  long long totalNs;           //The sum of the durations of completed transfers.
+  long long maxNs;             //The longest completed transfer.
+  long long waitNs;            //Time completed transfers waited for grants.
+};
+
+
+//Local function prototypes.
+static void dispatch (void);
+static void unlink_flow (sched_flow_t *flow);
+static long long elapsed_ns (const struct timespec *start,
+			     const struct timespec *end);
+static void print_class (const struct sched_class *c);
+
+
+/* The settings are written once by sched_load_config() before any thread is
+ * created. Everything else is protected by schedMutex. */
+static long long slots, quantum, smallSize;
+static long long inFlight = 0;
+static sched_flow_t *head = NULL, *tail = NULL;
+static struct sched_class classes[2] = { { .name = "small" },
+					 { .name = "bulk" } };
+static pthread_mutex_t schedMutex = PTHREAD_MUTEX_INITIALIZER;
+
+
+/******************************************************************************
+ * sched_load_config - see fairsched.h
+ *****************************************************************************/
+void sched_load_config (void)
+{
+  slots = get_config_number ("SCHED_SLOTS_CONFIG", FTP_CONFIG_FILE, 0);
+  quantum = get_config_number ("SCHED_QUANTUM_CONFIG", FTP_CONFIG_FILE,
+			       DEFAULT_QUANTUM);
+  smallSize = get_config_number ("SCHED_SMALL_CONFIG", FTP_CONFIG_FILE,
+				 DEFAULT_SMALL);
+
+  if (quantum <= 0)
+    quantum = DEFAULT_QUANTUM;
+}
+
+
+/******************************************************************************
+ * sched_user_weight - see fairsched.h
+ *****************************************************************************/
+int sched_user_weight (const char *username)
+{
+  char setting[USER_SETTING_LEN];
+  long long weight;
+
+  snprintf (setting, sizeof (setting), "WEIGHT_%s", username);
+  weight = get_config_number (setting, USER_CONFIG_FILE, SCHED_DEFAULT_WEIGHT);
+
+  //A weight of 0 would never be granted.
+  if (weight < 1)
+    return SCHED_DEFAULT_WEIGHT;
+  return (weight > 1000) ? 1000 : (int)weight;
+}
+
+
+/******************************************************************************
+ * sched_start - see fairsched.h
+ *****************************************************************************/
+void sched_start (sched_flow_t *flow, int weight)
+{
+  flow->weight = weight;
+  flow->deficit = 0;
+  flow->want = 0;
+  flow->waiting = false;
+  flow->granted = false;
+  pthread_cond_init (&flow->cond, NULL);
+  flow->next = NULL;
+  clock_gettime (CLOCK_MONOTONIC, &flow->start);
+  flow->bytes = 0;
+  flow->waitNs = 0;
+}
+
+
+/******************************************************************************
+ * sched_acquire - see fairsched.h
+ *****************************************************************************/
+bool sched_acquire (sched_flow_t *flow, size_t chunk, volatile bool *abort)
+{
+  struct timespec begin, end, deadline;
+
+  if (slots <= 0)
+    return true;
+
+  clock_gettime (CLOCK_MONOTONIC, &begin);
+  pthread_mutex_lock (&schedMutex);
+
+  flow->want = chunk;
+  flow->waiting = true;
+  if (tail != NULL)
+    tail->next = flow;
+  else
+    head = flow;
+  tail = flow;
+
+  if (flow->granted) {
+    flow->granted = false;
+    --inFlight;
+  }
+  dispatch ();
+
+  //The condition variable uses the real time clock.
+  while (!flow->granted && *abort == false) {
+    clock_gettime (CLOCK_REALTIME, &deadline);
+    deadline.tv_nsec += MAX_WAIT_NS;
+    deadline.tv_sec += deadline.tv_nsec / NSEC_PER_SEC;
+    deadline.tv_nsec %= NSEC_PER_SEC;
+    pthread_cond_timedwait (&flow->cond, &schedMutex, &deadline);
+  }
+
+  //An aborted transfer gives up its place in line.
+  if (!flow->granted && flow->waiting) {
+    unlink_flow (flow);
+    dispatch ();
+  }
+
+  pthread_mutex_unlock (&schedMutex);
+  clock_gettime (CLOCK_MONOTONIC, &end);
+  flow->waitNs += elapsed_ns (&begin, &end);
+
+  return flow->granted;
+}
+
+
+/******************************************************************************
+ * sched_charge - see fairsched.h
+ *****************************************************************************/
+void sched_charge (sched_flow_t *flow, size_t moved)
+{
+  flow->bytes += moved;
+}
+
+
+/******************************************************************************
+ * sched_release - see fairsched.h
+ *****************************************************************************/
+void sched_release (sched_flow_t *flow)
+{
+  if (!flow->granted)
+    return;
+
+  pthread_mutex_lock (&schedMutex);
+  flow->granted = false;
+  --inFlight;
+  dispatch ();
+  pthread_mutex_unlock (&schedMutex);
+}
+
+
+/******************************************************************************
+ * sched_end - see fairsched.h
+ *****************************************************************************/
+void sched_end (sched_flow_t *flow, bool complete)
+{
+  struct sched_class *c;
+  struct timespec now;
+  long long duration;
+
+  sched_release (flow);
+  clock_gettime (CLOCK_MONOTONIC, &now);
+  duration = elapsed_ns (&flow->start, &now);
+  c = &classes[(flow->bytes < smallSize) ? 0 : 1];
+
+  pthread_mutex_lock (&schedMutex);
+  if (complete) {
+    ++c->transfers;
+    c->bytes += flow->bytes;
+    c->totalNs += duration;
+    c->waitNs += flow->waitNs;
+    if (duration > c->maxNs)
+      c->maxNs = duration;
+  } else {
+    ++c->failed;
+  }
+  pthread_mutex_unlock (&schedMutex);
+
+  pthread_cond_destroy (&flow->cond);
+}
+
+
+/******************************************************************************
+ * sched_print_stats - see fairsched.h
+ *****************************************************************************/
+void sched_print_stats (void)
+{
+  pthread_mutex_lock (&schedMutex);
+  printf ("%-6s %10s %8s %14s %11s %11s %11s %12s\n", "Class", "Transfers",
+	  "Failed", "Bytes", "Avg time", "Max time", "Avg wait", "Avg B/s");
+  print_class (&classes[0]);
+  print_class (&classes[1]);
+  if (slots > 0) {
+    printf ("%lld of %lld slots in use, quantum %lld bytes, small transfers "
+	    "are under %lld bytes.\n", inFlight, slots, quantum, smallSize);
+  } else {
+    printf ("The scheduler is disabled (SCHED_SLOTS_CONFIG 0).\n");
+  }
+  pthread_mutex_unlock (&schedMutex);
+}
+
+
+/******************************************************************************
+ * Grant waiting transfers in deficit round robin order until the slots are
+ * used up or no transfer is waiting. The caller holds schedMutex.
+ *
+ * Each visit either grants the transfer or adds at least one quantum to its
+ * deficit, so a transfer is granted after at most want / quantum visits.
+ *****************************************************************************/
+static void dispatch (void)
+{
+  sched_flow_t *flow;
+
+  while (inFlight < slots && head != NULL) {
+    flow = head;
+    head = flow->next;
+    flow->next = NULL;
+    if (head == NULL)
+      tail = NULL;
+
+    //Not earned yet, earn a quantum and wait for the next round.
+    if (flow->deficit < (long long)flow->want) {
+      flow->deficit += quantum * flow->weight;
+      if (tail != NULL)
+	tail->next = flow;
+      else
+	head = flow;
+      tail = flow;
+      continue;
+    }
+
+    flow->deficit -= flow->want;
+    flow->waiting = false;
+    flow->granted = true;
+    ++inFlight;
+    pthread_cond_signal (&flow->cond);
+  }
+}
+
+
+/******************************************************************************
+ * Remove a transfer from the round robin list. The caller holds schedMutex.
+ *****************************************************************************/
+static void unlink_flow (sched_flow_t *flow)
+{
+  sched_flow_t *prev = NULL;
+  sched_flow_t *cur;
+
+  for (cur = head; cur != NULL && cur != flow; cur = cur->next)
+    prev = cur;
+  if (cur == NULL)
+    return;
+
+  if (prev != NULL)
+    prev->next = flow->next;
+  else
+    head = flow->next;
+  if (tail == flow)
+    tail = prev;
+
+  flow->next = NULL;
+  flow->waiting = false;
+}
+
+
+/******************************************************************************
+ * The number of nanoseconds from 'start' to 'end'.
+ *****************************************************************************/
+static long long elapsed_ns (const struct timespec *start,
+			     const struct timespec *end)
+{
+  return (end->tv_sec - start->tv_sec) * NSEC_PER_SEC +
+    (end->tv_nsec - start->tv_nsec);
+}
+
+
+/******************************************************************************
+ * Print one line of statistics for a class of transfers. The caller holds
+ * schedMutex.
+ *****************************************************************************/
+static void print_class (const struct sched_class *c)
+{
+  double avg = 0, wait = 0, rate = 0;
+
+  if (c->transfers > 0) {
+    avg = c->totalNs / (double)c->transfers / NSEC_PER_SEC;
+    wait = c->waitNs / (double)c->transfers / NSEC_PER_SEC;
+  }
+  if (c->totalNs > 0)
+    rate = c->bytes / (c->totalNs / (double)NSEC_PER_SEC);
+
+  printf ("%-6s %10lld %8lld %14lld %10.3fs %10.3fs %10.3fs %12.0f\n",
+	  c->name, c->transfers, c->failed, c->bytes, avg,
+	  c->maxNs / (double)NSEC_PER_SEC, wait, rate);
+}
@@ -0,0 +1,146 @@
+/******************************************************************************
+ * FTP-Server
+ * Author: Evan Myers
+ * Date: October 2026
+ *
+ * Description:
+ *   A weighted fair scheduler for data transfers. Each command thread still
+ *   moves the data of its own transfer, but before each chunk it asks the
+ *   scheduler for a grant. Only a limited number of chunks are in flight at
+ *   once, and waiting transfers are granted in deficit round robin order: on
+ *   each round a transfer earns a quantum of bytes times the weight of its
+ *   user, and it is granted once it has earned the size of its chunk.
+ *
+ *   A small transfer therefore waits at most about one round for each of its
+ *   few chunks, instead of waiting behind the chunks of every large transfer
+ *   that started before it.
+ *
+ *   Completed transfers are counted in a class by their size, so that the
+ *   latency and throughput of small and bulk transfers can be compared.
+ *****************************************************************************/
+#ifndef __FAIRSCHED_H__
+#define __FAIRSCHED_H__
+
+
+#include <pthread.h>  //Required for 'pthread_cond_t' in structure.
+#include <stdbool.h>  //Required for 'bool' in structure.
+#include <stddef.h>   //Required for 'size_t' in structure.
+#include <time.h>     //Required for 'struct timespec' in structure.
+
+
+//The default weight of a user.
+#define SCHED_DEFAULT_WEIGHT 1
+
+
+/******************************************************************************
+ * The scheduling state of one transfer.
+ *****************************************************************************/
+typedef struct sched_flow {
+  int weight;                  //The weight of the user of the transfer.
+  long long deficit;           //Bytes earned but not yet granted.
+  size_t want;                 //The size of the chunk waiting for a grant.
+  bool waiting;                //In the round robin list.
+  bool granted;                //Holds a grant.
+  pthread_cond_t cond;         //Signalled when the chunk is granted.
+  struct sched_flow *next;     //The next transfer in the round robin list.
+  struct timespec start;       //When the transfer started.
+  long long bytes;             //Bytes moved by the transfer.
+  long long waitNs;            //Time spent waiting for grants.
+} sched_flow_t;
+
+
+/******************************************************************************
+ * Read the scheduler settings from the server configuration file. This
+ * function should be called once, by main(), before any client connects.
+ *
+ * Settings (ftp.conf):
+ *   SCHED_SLOTS_CONFIG   - The number of chunks that may be in flight at
+ *                          once. 0 disables the scheduler, but statistics are
+ *                          still collected.
+ *   SCHED_QUANTUM_CONFIG - The bytes earned on each round by a transfer of
+ *                          weight 1.
+ *   SCHED_SMALL_CONFIG   - Transfers of fewer bytes are in the small class.
+ *
+ * Settings (user.conf):
+ *   WEIGHT_<username>    - The weight of the transfers of one user.
+ *****************************************************************************/
+void sched_load_config (void);
+
+
+/******************************************************************************
+ * Look up the weight of a user. Called when the user logs in.
+ *
+ * Returns:
+ *   The weight of the user, SCHED_DEFAULT_WEIGHT unless set in user.conf.
+ *****************************************************************************/
+int sched_user_weight (const char *username);
+
+
+/******************************************************************************
+ * Begin scheduling a transfer.
+ *
+ * Arguments:
+ *     flow - The scheduling state of the transfer.
+ *   weight - The weight of the user of the transfer.
+ *****************************************************************************/
+void sched_start (sched_flow_t *flow, int weight);
+
+
+/******************************************************************************
+ * Wait for a grant to move the next chunk of a transfer. A grant still held
+ * from the last chunk is given up only after the transfer is back in line, so
+ * that it competes for the slot with the transfers that are waiting.
+ *
+ * Arguments:
+ *    flow - The scheduling state of the transfer.
+ *   chunk - The size of the chunk.
+ *   abort - The abort flag of the session, checked while waiting.
+ *
+ * Return values:
+ *   true   The chunk may be moved.
+ *   false  The transfer was aborted while waiting.
+ *****************************************************************************/
+bool sched_acquire (sched_flow_t *flow, size_t chunk, volatile bool *abort);
+
+
+/******************************************************************************
+ * Count the bytes of a chunk that has been moved. The grant is kept until the
+ * next call to sched_acquire() or sched_release().
+ *
+ * Arguments:
+ *    flow - The scheduling state of the transfer.
+ *   moved - The number of bytes that were moved.
+ *****************************************************************************/
+void sched_charge (sched_flow_t *flow, size_t moved);
+
+
+/******************************************************************************
+ * Release a grant held by a transfer, if any. Called before a transfer
+ * blocks for some other reason, so that its slot is not held idle.
+ *
+ * Arguments:
+ *   flow - The scheduling state of the transfer.
+ *****************************************************************************/
+void sched_release (sched_flow_t *flow);
+
+
+/******************************************************************************
+ * Finish scheduling a transfer, release any grant it holds, and add it to the
+ * statistics of its class.
+ *
+ * Arguments:
+ *       flow - The scheduling state of the transfer.
+ *   complete - True if the transfer completed, aborted and failed transfers
+ *              are only counted.
+ *****************************************************************************/
+void sched_end (sched_flow_t *flow, bool complete);
+
+
+/******************************************************************************
+ * Print the latency and throughput of each class of transfer to standard
+ * output.
+ *****************************************************************************/
+void sched_print_stats (void);
+
+
+#endif //__FAIRSCHED_H__
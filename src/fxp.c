@@ -0,0 +1,162 @@
+/******************************************************************************
+ * FTP-Server
+ * Author: Evan Myers
+ * Date: October 2026
+ *
+ * Description:
+ *   Server-to-server transfers (FXP). See fxp.h for an overview.
+ *****************************************************************************/
+#include <arpa/inet.h>
+#include <errno.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include "config.h"
+#include "fxp.h"
+
+
+//The most peers FXP_ALLOW_CONFIG may list.
+#define MAX_PEERS 32
+
+
+//An allowed peer network, in network byte order.
+struct fxp_peer {
+  uint32_t addr;
+  uint32_t mask;
+};
+
+
+//Local function prototypes.
+static int parse_peer (char *entry, struct fxp_peer *peer);
+static void count (long long *counter);
+
+
+//Written once by fxp_load_config() before any thread is created.
+static struct fxp_peer peers[MAX_PEERS];
+static int numPeers = 0;
+
+//The totals for "fxpstats", protected by statsMutex.
+static long long peerConns = 0;
+static long long refused = 0;
+static pthread_mutex_t statsMutex = PTHREAD_MUTEX_INITIALIZER;
+
+
+/******************************************************************************
+ * fxp_load_config - see fxp.h
+ *****************************************************************************/
+void fxp_load_config (void)
+{
+  char *value;
+  char *entry;
+  char *save;
+
+  if ((value = get_config_value ("FXP_ALLOW_CONFIG", FTP_CONFIG_FILE)) == NULL)
+    return;
+
+  for (entry = strtok_r (value, " \t", &save); entry != NULL;
+       entry = strtok_r (NULL, " \t", &save)) {
+    if (numPeers == MAX_PEERS) {
+      fprintf (stderr, "%s: more than %d peers, '%s' and later are ignored\n",
+	       __FUNCTION__, MAX_PEERS, entry);
+      break;
+    }
+    if (parse_peer (entry, &peers[numPeers]) == -1) {
+      fprintf (stderr, "%s: '%s' is not an IPv4 address or network\n",
+	       __FUNCTION__, entry);
+      continue;
+    }
+    numPeers++;
+  }
+
+  free (value);
+}
+
+
+/******************************************************************************
+ * fxp_allowed - see fxp.h
+ *****************************************************************************/
+bool fxp_allowed (int csfd, const struct in_addr *peer)
+{
+  struct sockaddr_in client;
+  socklen_t len = sizeof (client);
+  char addr[INET_ADDRSTRLEN];
+  int i;
+
+  //The client itself is always allowed.
+  if (getpeername (csfd, (struct sockaddr *)&client, &len) == -1) {
+    fprintf (stderr, "%s: getpeername: %s\n", __FUNCTION__, strerror (errno));
+  } else if (client.sin_family == AF_INET &&
+	     client.sin_addr.s_addr == peer->s_addr) {
+    return true;
+  }
+
+  for (i = 0; i < numPeers; i++) {
+    if ((peer->s_addr & peers[i].mask) == peers[i].addr) {
+      count (&peerConns);
+      return true;
+    }
+  }
+
+  inet_ntop (AF_INET, peer, addr, sizeof (addr));
+  fprintf (stderr, "%s: refused a data connection with %s\n", __FUNCTION__,
+	   addr);
+  count (&refused);
+  return false;
+}
+
+
+/******************************************************************************
+ * fxp_print_stats - see fxp.h
+ *****************************************************************************/
+void fxp_print_stats (void)
+{
+  pthread_mutex_lock (&statsMutex);
+  printf ("FXP: %d allowed peer networks, %lld peer data connections, "
+	  "%lld refused.\n", numPeers, peerConns, refused);
+  pthread_mutex_unlock (&statsMutex);
+}
+
+
+/******************************************************************************
+ * Parse an entry of FXP_ALLOW_CONFIG, an address or a network "a.b.c.d/n".
+ *
+ * Return values:
+ *   0    The peer is set.
+ *  -1    The entry is not valid.
+ *****************************************************************************/
+static int parse_peer (char *entry, struct fxp_peer *peer)
+{
+  struct in_addr addr;
+  char *slash;
+  char *end;
+  long bits = 32;
+
+  if ((slash = strchr (entry, '/')) != NULL) {
+    *slash = '\0';
+    bits = strtol (slash + 1, &end, 10);
+    if (end == slash + 1 || *end != '\0' || bits < 0 || bits > 32)
+      return -1;
+  }
+
+  if (inet_pton (AF_INET, entry, &addr) != 1)
+    return -1;
+
+  //A shift by 32 is undefined, /0 matches every address.
+  peer->mask = (bits == 0) ? 0 : htonl (0xffffffffUL << (32 - bits));
+  peer->addr = addr.s_addr & peer->mask;
+  return 0;
+}
+
+
+/******************************************************************************
+ * Increment a statistics counter.
+ *****************************************************************************/
+static void count (long long *counter)
+{
+  pthread_mutex_lock (&statsMutex);
+  ++*counter;
+  pthread_mutex_unlock (&statsMutex);
+}
@@ -0,0 +1,62 @@
+/******************************************************************************
+ * FTP-Server
+ * Author: Evan Myers
+ * Date: October 2026
+ *
+ * Description:
+ *   Server-to-server transfers (FXP). A client opens control connections to
+ *   two servers, puts one in PASV and gives its address to the other with
+ *   PORT, then starts STOR on one and RETR on the other. The file then
+ *   flows directly between the servers instead of through the client.
+ *
+ *   Without FXP a data connection may only be made with the host of the
+ *   control connection: PORT may not point elsewhere, and a PASV socket
+ *   turns away connections from other hosts. This stops a client from using
+ *   the server to reach third hosts (the FTP bounce attack), and stops a
+ *   third host from stealing a passive data connection. The peers listed in
+ *   FXP_ALLOW_CONFIG are trusted servers that a data connection may also be
+ *   made with.
+ *****************************************************************************/
+#ifndef __FXP_H__
+#define __FXP_H__
+
+
+#include <netinet/in.h> //Required for 'struct in_addr' in function prototype.
+#include <stdbool.h>    //Required for 'bool' in function prototype.
+
+
+/******************************************************************************
+ * Read the FXP settings from the server configuration file. This function
+ * should be called once, by main(), before any client connects.
+ *
+ * Settings (ftp.conf):
+ *   FXP_ALLOW_CONFIG - The peers a data connection may be made with besides
+ *                      the client, as IPv4 addresses or networks in CIDR
+ *                      notation separated by spaces, eg. "10.0.0.7
+ *                      192.168.4.0/24". Empty to allow only the client.
+ *****************************************************************************/
+void fxp_load_config (void);
+
+
+/******************************************************************************
+ * Determine if a data connection may be made with a host.
+ *
+ * Arguments:
+ *   csfd - The control connection of the session.
+ *   peer - The address of the other end of the data connection.
+ *
+ * Returns:
+ *   True if the host is the client of the control connection, or an allowed
+ *   FXP peer.
+ *****************************************************************************/
+bool fxp_allowed (int csfd, const struct in_addr *peer);
+
+
+/******************************************************************************
+ * Print the counts of data connections made with FXP peers, and of those
+ * refused, to stdout.
+ *****************************************************************************/
+void fxp_print_stats (void);
+
+
+#endif //__FXP_H__
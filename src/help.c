@@ -74,10 +74,18 @@ void cmd_help (session_info_t *si, char *arg)
     send_mesg_214_specific (csfd, "To use: MODE <SP> <mode-code> <CRLF>\n",
 			    "\tSet file transfer mode\n");
 
+    /* OPTS <SP> <command-name> [<SP> <command-options>] <CRLF> */
+  } else if (strcmp (arg, "OPTS") == 0) {
+    send_mesg_214_specific (csfd, "To use: OPTS <SP> <command-name> "
+			    "[<SP> <command-options>] <CRLF>\n",
+			    "\tSet command options, eg. OPTS MODE Z LEVEL 9 or "
+			    "OPTS HASH MD5\n");
+
     /* RETR <SP> <pathname> <CRLF> */
   } else if (strcmp (arg, "RETR") == 0) {
     send_mesg_214_specific (csfd, "To use: RETR <SP> <pathname> <CRLF>\n",
-			    "\tRetrieve a file from the remote host\n");
+			    "\tRetrieve a file from the remote host. \"dir.tar\" "
+			    "retrieves\n\tthe directory \"dir\" as a tar archive\n");
 
     /* STOR <SP> <pathname> <CRLF> */
   } else if (strcmp (arg, "STOR") == 0) {
@@ -156,6 +164,40 @@ void cmd_help (session_info_t *si, char *arg)
     send_mesg_214_specific (csfd, "To use: REST <SP> <marker> <CRLF>\n",
 			    "\tRestart transfer at bytecount marker\n");
 
+    /* RANG <SP> <start-point> <SP> <end-point> <CRLF> */
+  } else if (strcmp (arg, "RANG") == 0) {
+    send_mesg_214_specific (csfd, "To use: RANG <SP> <start-point> "
+			    "<SP> <end-point> <CRLF>\n",
+			    "\tRetrieve only a byte range of the next file\n");
+
+    /* HASH <SP> <pathname> <CRLF> */
+  } else if (strcmp (arg, "HASH") == 0) {
+    send_mesg_214_specific (csfd, "To use: HASH <SP> <pathname> <CRLF>\n",
+			    "\tGet the checksum of a remote file, the algorithm "
+			    "is set with OPTS HASH\n");
+
+    /* XMD5 <SP> <pathname> <CRLF> */
+  } else if (strcmp (arg, "XMD5") == 0) {
+    send_mesg_214_specific (csfd, "To use: XMD5 <SP> <pathname> <CRLF>\n",
+			    "\tGet the MD5 digest of a remote file\n");
+
+    /* AUTH <SP> <mechanism-name> <CRLF> */
+  } else if (strcmp (arg, "AUTH") == 0) {
+    send_mesg_214_specific (csfd, "To use: AUTH <SP> TLS <CRLF>\n",
+			    "\tSecure the control connection with TLS\n");
+
+    /* PBSZ <SP> <decimal-integer> <CRLF> */
+  } else if (strcmp (arg, "PBSZ") == 0) {
+    send_mesg_214_specific (csfd, "To use: PBSZ <SP> 0 <CRLF>\n",
+			    "\tSet the protection buffer size, required "
+			    "before PROT\n");
+
+    /* PROT <SP> <prot-code> <CRLF> */
+  } else if (strcmp (arg, "PROT") == 0) {
+    send_mesg_214_specific (csfd, "To use: PROT <SP> <prot-code> <CRLF>\n",
+			    "\tSet the data protection level, C (clear) or "
+			    "P (private)\n");
+
     /* RNFR <SP> <pathname> <CRLF> */
   } else if (strcmp (arg, "RNFR") == 0) {
     send_mesg_214_specific (csfd, "To use: RNFR <SP> <pathname> <CRLF>\n",
@@ -174,12 +216,19 @@ void cmd_help (session_info_t *si, char *arg)
     /* SITE <SP> <string> <CRLF> */
   } else if (strcmp (arg, "SITE") == 0) {
     send_mesg_214_specific (csfd, "To use: SITE <SP> <string> <CRLF>\n",
-			    "\tSend site specific command to the remote server\n");
+			    "\tSend site specific command to the remote server:\n"
+			    "\tCPY <SP> <pathname> <SP> <pathname> copies a file on\n"
+			    "\tthe server, DSIG and DSTOR <SP> <pathname> store a\n"
+			    "\tchanged file as a delta, DBASE then DRETR <SP> <pathname>\n"
+			    "\tretrieve one, MRETR <SP> <pathname> [<SP> <pathname> ...]\n"
+			    "\tretrieves several files over one data connection, UNTAR\n"
+			    "\t<SP> <pathname> extracts a tar archive into a directory\n");
 
     /* STAT [<SP> <pathname>] <CRLF> */
   } else if (strcmp (arg, "STAT") == 0) {
     send_mesg_214_specific (csfd, "To use: STAT [<SP> <pathname>] <CRLF>\n",
-			    "\tReturn current server status\n");
+			    "\tReturn current server status, or the progress of a\n"
+			    "\tSITE CPY while it runs\n");
 
     /* CWD <SP> <pathname> <CRLF> */
   }else if (strcmp (arg, "CWD") == 0) {
@@ -27,10 +27,22 @@
 #include <stdlib.h>
 #include <string.h>
 #include <unistd.h>
+#include "checksum.h"
+#include "commit.h"
 #include "config.h"
 #include "ctrlthread.h"
+#include "fairsched.h"
+#include "fxp.h"
 #include "net.h"
+#include "ratelimit.h"
+#include "readhint.h"
 #include "servercmd.h"
+#include "sparse.h"
+#include "tcptune.h"
+#include "tls.h"
+#include "untar.h"
+#include "writebehind.h"
+#include "zcache.h"
 
 
 /******************************************************************************
@@ -118,6 +130,42 @@ int main (int argc, char *argv[])
   }
   free (rootTemp);
 
+  //Read the transfer sizing settings before any transfer can start.
+  tune_load_config ();
+
+  //Read the upload write-behind settings before any upload can start.
+  wb_load_config ();
+
+  //Read the upload completion settings before any upload can start.
+  commit_load_config ();
+
+  //Read the download page cache hint settings before any download can start.
+  rh_load_config ();
+
+  //Read the checksum settings before any transfer can start.
+  checksum_load_config ();
+
+  //Read the archive extraction settings before any upload can start.
+  untar_load_config ();
+
+  //Read the sparse file settings before any upload can start.
+  sparse_load_config ();
+
+  //Read the bandwidth limits before any transfer can start.
+  rate_load_config ();
+
+  //Read the transfer scheduler settings before any transfer can start.
+  sched_load_config ();
+
+  //Read the FXP peers before any data connection can be made.
+  fxp_load_config ();
+
+  //Load the TLS certificate before any client can connect.
+  tls_load_config ();
+
+  //Index the compressed file cache before any transfer can use it.
+  zcache_init ();
+
   //Initialize the pthread attributes.
   if (pthread_attr_init (&attr) != 0) {
     fprintf (stderr, "%s: pthread_attr_init: %s\n", __FUNCTION__, strerror (errno));
@@ -8,16 +8,27 @@
  *   time.
  *****************************************************************************/
 #include <ctype.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
 #include <strings.h>
 #include <string.h>
+#include <unistd.h>
+#include "checksum.h"
 #include "misc.h"
 #include "net.h"
+#include "path.h"
 #include "reply.h"
 #include "session.h"
+#include "zmode.h"
 
 
 #define MAX_NUM_ARGS 1
 
+//The longest keyword accepted in an OPTS argument, and its scanf() width.
+#define OPTS_TOKEN_LEN 15
+#define OPTS_TOKEN_FMT "15"
+
 
 /******************************************************************************
  * cmd_type - see "misc.h"
@@ -77,8 +88,17 @@ void cmd_mode (session_info_t *si, char *arg)
     if (strlen (arg) == 1) {
       arg[0] = tolower (arg[0]); //change arg to lowercase
       if (arg[0] == 's') {
+	si->mode = 's';
 	send_mesg_200 (csfd, REPLY_200_STREAM);
 	return;	
+      } else if (arg[0] == 'z') {
+	si->mode = 'z';
+	send_mesg_200 (csfd, REPLY_200_DEFLATE);
+	return;
+      } else if (arg[0] == 'b') {
+	si->mode = 'b';
+	send_mesg_200 (csfd, REPLY_200_BLOCK);
+	return;
       }
     }
   }
@@ -88,6 +108,117 @@ void cmd_mode (session_info_t *si, char *arg)
 }
 
 
+/******************************************************************************
+ * cmd_opts - see "misc.h"
+ *****************************************************************************/
+void cmd_opts (session_info_t *si, char *arg)
+{
+  char cmd[OPTS_TOKEN_LEN + 1];
+  char mode[OPTS_TOKEN_LEN + 1];
+  char option[OPTS_TOKEN_LEN + 1];
+  int level;
+  char extra;
+  int numTokens;
+  int alg;
+  int csfd = si->csfd;
+
+  if (!arg) {
+    send_mesg_501 (csfd);
+    return;
+  }
+
+  //OPTS HASH [<algorithm>]
+  numTokens = sscanf (arg, "%"OPTS_TOKEN_FMT"s %"OPTS_TOKEN_FMT"s %c",
+		      cmd, option, &extra);
+  if (numTokens >= 1 && strcasecmp (cmd, "HASH") == 0) {
+    if (numTokens == 3) {
+      send_mesg_501 (csfd);
+      return;
+    }
+    if (numTokens == 2) {
+      if ((alg = checksum_find (option)) == CHECKSUM_NONE) {
+	send_mesg_504 (csfd);
+	return;
+      }
+      si->hashAlg = alg;
+    }
+    send_mesg_200_hash (csfd, checksum_name (si->hashAlg));
+    return;
+  }
+
+  //OPTS MODE Z LEVEL <level>
+  if (sscanf (arg, "%"OPTS_TOKEN_FMT"s %"OPTS_TOKEN_FMT"s %"OPTS_TOKEN_FMT"s %d %c",
+	      cmd, mode, option, &level, &extra) == 4 &&
+      strcasecmp (cmd, "MODE") == 0 && strcasecmp (mode, "Z") == 0 &&
+      strcasecmp (option, "LEVEL") == 0) {
+    if (level < Z_NO_COMPRESSION || level > Z_BEST_COMPRESSION) {
+      send_mesg_501 (csfd);
+      return;
+    }
+    si->zlevel = level;
+    send_mesg_200 (csfd, REPLY_200_OPTS);
+    return;
+  }
+
+  send_mesg_501 (csfd);
+  return;
+}
+
+
+/******************************************************************************
+ * cmd_hash - see "misc.h"
+ *****************************************************************************/
+void cmd_hash (session_info_t *si, char *arg, bool md5)
+{
+  char hex[CHECKSUM_HEX_SZ];
+  char *fullpath;
+  long long size;
+  int fd;
+  int alg = md5 ? CHECKSUM_MD5 : si->hashAlg;
+  int csfd = si->csfd;
+
+  if (!si->loggedin) {
+    send_mesg_530 (csfd, REPLY_530_REQUEST);
+    return;
+  }
+
+  if (!arg) {
+    send_mesg_501 (csfd);
+    return;
+  }
+
+  if (!check_file_exist (si->cwd, arg)) {
+    send_mesg_553 (csfd);
+    return;
+  }
+
+  if ((fullpath = merge_paths (si->cwd, arg, NULL)) == NULL) {
+    send_mesg_451 (csfd);
+    return;
+  }
+
+  if ((fd = open (fullpath, O_RDONLY)) == -1) {
+    free (fullpath);
+    send_mesg_550_unavailable (csfd);
+    return;
+  }
+  free (fullpath);
+
+  //An uploaded file answers from the digest computed while it was stored.
+  size = checksum_file (fd, alg, hex);
+  close (fd);
+  if (size == -1) {
+    send_mesg_451 (csfd);
+    return;
+  }
+
+  if (md5)
+    send_mesg_250_hash (csfd, hex);
+  else
+    send_mesg_213_hash (csfd, checksum_name (alg), size, hex, arg);
+}
+
+
 /******************************************************************************
  * cmd_syst - see "misc.h"
  *****************************************************************************/
@@ -11,6 +11,7 @@
 #define __MISC_H__
 
 
+#include <stdbool.h> //Required for 'bool' in function prototype.
 #include "session.h" //Required for session_info_t in function parameters.
 
 
@@ -25,7 +26,7 @@ void cmd_type (session_info_t *si, char *arg);
 
 
 /******************************************************************************
- * Changes Mode. Only valid mode is stream.
+ * Changes Mode. Valid modes are stream and deflate (MODE Z).
  *
  * Arguments:
  *   arg - current command with parameter
@@ -33,6 +34,35 @@ void cmd_type (session_info_t *si, char *arg);
 void cmd_mode (session_info_t *si, char *arg);
 
 
+/******************************************************************************
+ * Set options for a command. The supported options are:
+ *
+ *   OPTS MODE Z LEVEL <level> - The compression level (0-9) used by MODE Z.
+ *   OPTS HASH [<algorithm>]   - The checksum algorithm used by HASH, MD5,
+ *                               CRC32 or ADLER32. Without an algorithm, the
+ *                               current one is named.
+ *
+ * Arguments:
+ *    si - The control thread session information.
+ *   arg - The argument received with the OPTS command.
+ *****************************************************************************/
+void cmd_opts (session_info_t *si, char *arg);
+
+
+/******************************************************************************
+ * Send the checksum of a file on the control connection (HASH and XMD5). The
+ * digest stored when the file was uploaded is used while it is current, so
+ * the file is usually not read.
+ *
+ * Arguments:
+ *    si - The control thread session information.
+ *   arg - The pathname of the file.
+ *   md5 - True for XMD5, which always uses MD5. HASH uses the algorithm set
+ *         by OPTS HASH.
+ *****************************************************************************/
+void cmd_hash (session_info_t *si, char *arg, bool md5);
+
+
 /******************************************************************************
  * Send the system type on the control connection.
  *
@@ -14,6 +14,8 @@
 #include <ifaddrs.h>
 #include <inttypes.h>
 #include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
 #include <stdbool.h>
 #include <stdio.h>
 #include <stdlib.h>
@@ -23,9 +25,11 @@
 #include <sys/types.h>
 #include <unistd.h>
 #include "config.h"
+#include "fxp.h"
 #include "net.h"
 #include "reply.h"
 #include "session.h"
+#include "tls.h"
 
 
 /******************************************************************************
@@ -127,12 +131,15 @@ int accept_connection (int listenSfd, int mode, session_info_t *si)
   fd_set rfds;       //select() read file descriptor set.
   int stdinFd;       //store the fileno of stdin.
   int acceptedSfd;   //The socket returned by accept().
+  struct sockaddr_in peer;  //The address of the accepted connection.
+  socklen_t peerLen;
 
 
   //Used to check if the thread should return, for ACCEPT_PASV
   struct timeval timeout;
   struct timeval *timeoutPtr;
   int nready;                    //Used to check for select() timeout.
+  int optval;                    //The value of TCP_NODELAY.
 
 
   //Ensure the listening socket is not the result of a previous error.
@@ -221,16 +228,35 @@ int accept_connection (int listenSfd, int mode, session_info_t *si)
     
     //Attempt to accept a connection with the named socket.
     if (FD_ISSET (listenSfd, &rfds)) {
-      if ((acceptedSfd = accept (listenSfd, NULL, NULL)) == -1) {
+      peerLen = sizeof (peer);
+      if ((acceptedSfd = accept (listenSfd, (struct sockaddr *)&peer,
+				 &peerLen)) == -1) {
 	if (errno == EINTR)
 	  continue;
 	fprintf (stderr, "%s: accept: %s\n", __FUNCTION__, strerror (errno));
 	return -1;
       }
+
+      /* A data connection is only taken from the client or an FXP peer, a
+       * connection from anyone else is dropped and the wait goes on. */
+      if (mode == ACCEPT_PASV && !fxp_allowed (si->csfd, &peer.sin_addr)) {
+	close (acceptedSfd);
+	continue;
+      }
       break; //A connection has been established, break the while loop.
     }
   }
 
+  /* A reply is often sent in pieces. Nagle's algorithm would hold back each
+   * piece after the first until the client acknowledges the last, which the
+   * client may delay by 40 ms or more. */
+  if (mode == ACCEPT_CONTROL) {
+    optval = 1;
+    if (setsockopt (acceptedSfd, IPPROTO_TCP, TCP_NODELAY, &optval,
+		    sizeof (optval)) == -1)
+      fprintf (stderr, "%s: setsockopt: %s\n", __FUNCTION__, strerror (errno));
+  }
+
   /* In this server implementation, the socket created with the PASV command is
    * intended to accept only one data connection. After a connection has been
    * accepted, close the listening socket. */
@@ -266,11 +292,8 @@ int cmd_pasv (session_info_t *si)
   /* The server "MUST" close the data connection port when:
    * "The port specification is changed by a command from the user".
    * Source: RFC 959 page 19 */
-  if (si->dsfd > 0) {
-    if (close (si->dsfd) == -1)
-      fprintf (stderr, "%s: close: %s\n", __FUNCTION__, strerror (errno));
-    si->dsfd = 0;
-  }
+  if (si->dsfd > 0)
+    end_data_conn (si, false);
 
   //Read the config file to find which interface to use to make the socket.
   if ((interfaceResult = get_config_value (interfaceSetting,
@@ -441,6 +464,7 @@ int cmd_port (session_info_t *si, char *cmdStr)
   //The data connection address to connect to.
   char hostname[INET_ADDRSTRLEN];  //Maximum size of an IPv4 dot notation addr.
   char service[MAX_PORT_STR];
+  struct in_addr peerAddr;
 
   //The port command must have an argument.
   if (cmdStr == NULL) {
@@ -457,11 +481,8 @@ int cmd_port (session_info_t *si, char *cmdStr)
   /* The server "MUST" close the data connection port when: 
    * "The port specification is changed by a command from the user".
    * Source: RFC 959 page 19 */
-  if (si->dsfd > 0) {
-    if (close (si->dsfd) == -1)
-      fprintf (stderr, "%s: close: %s\n", __FUNCTION__, strerror (errno));
-    si->dsfd = 0;
-  }
+  if (si->dsfd > 0)
+    end_data_conn (si, false);
 
   /* Filter invalid PORT arguments by comparing the length of the argument. Too
    * many or too little number of characters in the string means that the
@@ -481,6 +502,14 @@ int cmd_port (session_info_t *si, char *cmdStr)
     return -1;
   }
 
+  /* Only the client or an FXP peer may be connected to, so the server cannot
+   * be used to reach other hosts (the FTP bounce attack). */
+  if (inet_pton (AF_INET, hostname, &peerAddr) != 1 ||
+      !fxp_allowed (csfd, &peerAddr)) {
+    send_mesg_504_port (csfd);
+    return -1;
+  }
+
   //Create a data connection to the hostname and service provided by the client.
   if ((si->dsfd = port_connect (hostname, service)) == -1) {
     return -1;
@@ -694,24 +723,56 @@ int port_connect (char *hostname, char *service)
 }
 
 
+/******************************************************************************
+ * end_data_conn - see "net.h"
+ *****************************************************************************/
+void end_data_conn (session_info_t *si, bool complete)
+{
+  if (si->dsfd == 0 || (complete && si->mode == 'b'))
+    return;
+
+  tls_end (si->dsfd);
+  if (close (si->dsfd) == -1)
+    fprintf (stderr, "%s: close: %s\n", __FUNCTION__, strerror (errno));
+  si->dsfd = 0;
+}
+
+
 /******************************************************************************
  * send_all - see net.h
  *****************************************************************************/
 int send_all (int sfd, uint8_t *mesg, int toSend)
 {
   int nsent = 0; 
+  bool secured = tls_active (sfd); //Written through its TLS session.
 
   while (toSend > 0) {
-    if ((nsent = send (sfd, mesg, toSend, 0)) == -1) {
+    if (secured)
+      nsent = tls_send (sfd, mesg, toSend);
+    else
+      nsent = send (sfd, mesg, toSend, MSG_NOSIGNAL); //A gone client is EPIPE.
+    if (nsent == -1) {
       if (errno == EINTR)
 	continue;
       fprintf (stderr, "%s: %s\n", __FUNCTION__, strerror (errno));
       return -1;
     }
-    //Update the number of bytes to send to the socket.
+    //Update the number of bytes, and the position, left to send.
     toSend -= nsent;
+    mesg += nsent;
     nsent = 0;
   }
 
   return 0;
 }
+
+
+/******************************************************************************
+ * recv_some - see net.h
+ *****************************************************************************/
+ssize_t recv_some (int sfd, void *buf, size_t len)
+{
+  if (tls_active (sfd))
+    return tls_recv (sfd, buf, len);
+  return recv (sfd, buf, len, 0);
+}
@@ -16,6 +16,7 @@
 #include <arpa/inet.h> //required for the INETADDR_STRLEN in function prototype
 #include <stdbool.h>   //required for 'bool' in function prototype
 #include <stdint.h>    //required for 'uint8_t' in function prototype
+#include <sys/types.h> //required for 'ssize_t' in function prototype
 #include "session.h"   //required for 'session_info_t' in function prototype
 
 
@@ -167,6 +168,19 @@ int get_interface_address (const char *interface,
 int cmd_port (session_info_t *session, char *cmdStr);
 
 
+/******************************************************************************
+ * Finish with the data connection at the end of a transfer. In block mode the
+ * end of the file is marked in the data, so after a complete transfer the
+ * connection is kept open for the next transfer of the session. Otherwise the
+ * connection is closed.
+ *
+ * Arguments:
+ *         si - Info for the current session.
+ *   complete - True if the transfer completed, and was not aborted.
+ *****************************************************************************/
+void end_data_conn (session_info_t *si, bool complete);
+
+
 /******************************************************************************
  * Send the entire message found in the second argument to the socket passed
  * in the first argument. This function was created to handle partial sends.
@@ -183,4 +197,17 @@ int cmd_port (session_info_t *session, char *cmdStr);
 int send_all (int sfd, uint8_t *mesg, int toSend);
 
 
+/******************************************************************************
+ * Receive what is available from a socket, at most len bytes, decrypting it
+ * if the socket is secured with TLS. Behaves as recv() without flags.
+ *
+ * Return values:
+ *   >0   The number of bytes received.
+ *    0   The peer closed the connection.
+ *   -1   Error, errno is set. EAGAIN if a secured socket is waiting for the
+ *        rest of a record (see tls_recv()), the call may be made again.
+ *****************************************************************************/
+ssize_t recv_some (int sfd, void *buf, size_t len);
+
+
 #endif //__NET_H__
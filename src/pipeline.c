@@ -0,0 +1,299 @@
+/******************************************************************************
+ * FTP-Server
+ * Author: Evan Myers
+ * Date: October 2026
+ *
+ * Description:
+ *   The transfer pipeline. See pipeline.h for an overview.
+ *
+ *   A stage passes its output on from inside its own push function, so the
+ *   time measured around a push includes the stages after it. The pipeline
+ *   keeps the time of those inner calls, and each stage is charged only the
+ *   difference. The clock is the CPU time of the thread, so the system calls
+ *   of a sink are counted, but the time it spends blocked is not.
+ *****************************************************************************/
+#include <pthread.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include "net.h"
+#include "pipeline.h"
+
+
+//The most kinds of stages that are kept apart in the server totals.
+#define MAX_STAGE_KINDS 16
+
+
+//The server totals of one kind of stage.
+struct stage_stats {
+  const char *name;
+  long long runs;
+  long long bytes;
+  long long cpuNsec;
+};
+
+
+//Local function prototypes.
+static int run_push (pipe_stage_t *stage, const uint8_t *data, size_t len);
+static int run_finish (pipe_stage_t *stage);
+static long long cpu_nsec (void);
+static int socket_push (pipe_stage_t *stage, const uint8_t *data, size_t len);
+static int file_push (pipe_stage_t *stage, const uint8_t *data, size_t len);
+
+
+//The totals are protected by statsMutex.
+static struct stage_stats stats[MAX_STAGE_KINDS];
+static int numStats = 0;
+static pthread_mutex_t statsMutex = PTHREAD_MUTEX_INITIALIZER;
+
+
+/******************************************************************************
+ * pipe_stage_init - see pipeline.h
+ *****************************************************************************/
+void pipe_stage_init (pipe_stage_t *stage, const char *name,
+		      pipe_push_fn_t push, pipe_finish_fn_t finish, void *state)
+{
+  stage->name = name;
+  stage->push = push;
+  stage->finish = finish;
+  stage->state = state;
+  stage->next = NULL;
+  stage->pl = NULL;
+  stage->bytes = 0;
+  stage->cpuNsec = 0;
+}
+
+
+/******************************************************************************
+ * pipe_start - see pipeline.h
+ *****************************************************************************/
+void pipe_start (pipeline_t *pl, pipe_stage_t *sink)
+{
+  pl->head = sink;
+  pl->sink = sink;
+  pl->last = NULL;
+  pl->innerNsec = 0;
+
+  sink->next = NULL;
+  sink->pl = pl;
+}
+
+
+/******************************************************************************
+ * pipe_add - see pipeline.h
+ *****************************************************************************/
+void pipe_add (pipeline_t *pl, pipe_stage_t *stage)
+{
+  stage->next = pl->sink;
+  stage->pl = pl;
+
+  if (pl->last == NULL)
+    pl->head = stage;
+  else
+    pl->last->next = stage;
+  pl->last = stage;
+}
+
+
+/******************************************************************************
+ * pipe_zero_copy - see pipeline.h
+ *****************************************************************************/
+bool pipe_zero_copy (const pipeline_t *pl)
+{
+  return pl->head == pl->sink;
+}
+
+
+/******************************************************************************
+ * pipe_push - see pipeline.h
+ *****************************************************************************/
+int pipe_push (pipeline_t *pl, const uint8_t *data, size_t len)
+{
+  return run_push (pl->head, data, len);
+}
+
+
+/******************************************************************************
+ * pipe_next - see pipeline.h
+ *****************************************************************************/
+int pipe_next (pipe_stage_t *stage, const uint8_t *data, size_t len)
+{
+  return run_push (stage->next, data, len);
+}
+
+
+/******************************************************************************
+ * pipe_finish - see pipeline.h
+ *****************************************************************************/
+int pipe_finish (pipeline_t *pl)
+{
+  pipe_stage_t *stage;
+
+  for (stage = pl->head; stage != NULL; stage = stage->next) {
+    if (stage->finish != NULL && run_finish (stage) == -1)
+      return -1;
+  }
+
+  return 0;
+}
+
+
+/******************************************************************************
+ * pipe_delivered - see pipeline.h
+ *****************************************************************************/
+long long pipe_delivered (const pipeline_t *pl)
+{
+  return pl->sink->bytes;
+}
+
+
+/******************************************************************************
+ * pipe_end - see pipeline.h
+ *****************************************************************************/
+void pipe_end (pipeline_t *pl)
+{
+  pipe_stage_t *stage;
+  int i;
+
+  pthread_mutex_lock (&statsMutex);
+  for (stage = pl->head; stage != NULL; stage = stage->next) {
+    //A zero copy transfer bypasses its pipeline, it is not counted.
+    if (stage->bytes == 0 && stage->cpuNsec == 0)
+      continue;
+
+    for (i = 0; i < numStats; i++) {
+      if (strcmp (stats[i].name, stage->name) == 0)
+	break;
+    }
+    if (i == numStats) {
+      if (numStats == MAX_STAGE_KINDS)
+	continue;
+      stats[numStats++].name = stage->name;
+    }
+
+    ++stats[i].runs;
+    stats[i].bytes += stage->bytes;
+    stats[i].cpuNsec += stage->cpuNsec;
+  }
+  pthread_mutex_unlock (&statsMutex);
+}
+
+
+/******************************************************************************
+ * pipe_socket_sink - see pipeline.h
+ *****************************************************************************/
+void pipe_socket_sink (pipe_stage_t *stage, int *sfd)
+{
+  pipe_stage_init (stage, "socket", socket_push, NULL, sfd);
+}
+
+
+/******************************************************************************
+ * pipe_file_sink - see pipeline.h
+ *****************************************************************************/
+void pipe_file_sink (pipe_stage_t *stage, write_behind_t *wb)
+{
+  pipe_stage_init (stage, "file", file_push, NULL, wb);
+}
+
+
+/******************************************************************************
+ * pipe_print_stats - see pipeline.h
+ *****************************************************************************/
+void pipe_print_stats (void)
+{
+  double seconds;
+  int i;
+
+  pthread_mutex_lock (&statsMutex);
+  if (numStats == 0)
+    printf ("No transfer has passed through a pipeline.\n");
+  for (i = 0; i < numStats; i++) {
+    seconds = stats[i].cpuNsec / 1e9;
+    printf ("%-14s %lld transfers, %lld bytes, %.3f CPU seconds",
+	    stats[i].name, stats[i].runs, stats[i].bytes, seconds);
+    if (seconds > 0)
+      printf (", %.1f MB per CPU second", stats[i].bytes / seconds / 1e6);
+    printf ("\n");
+  }
+  pthread_mutex_unlock (&statsMutex);
+}
+
+
+/******************************************************************************
+ * Give data to a stage, and charge the stage for its CPU time.
+ *****************************************************************************/
+static int run_push (pipe_stage_t *stage, const uint8_t *data, size_t len)
+{
+  pipeline_t *pl = stage->pl;
+  long long outer = pl->innerNsec;
+  long long start, elapsed;
+  int retVal;
+
+  if (len == 0)
+    return 0;
+
+  pl->innerNsec = 0;
+  start = cpu_nsec ();
+  retVal = stage->push (stage, data, len);
+  elapsed = cpu_nsec () - start;
+
+  stage->bytes += len;
+  stage->cpuNsec += elapsed - pl->innerNsec;
+  pl->innerNsec = outer + elapsed;
+  return retVal;
+}
+
+
+/******************************************************************************
+ * Finish a stage, and charge the stage for its CPU time.
+ *****************************************************************************/
+static int run_finish (pipe_stage_t *stage)
+{
+  pipeline_t *pl = stage->pl;
+  long long outer = pl->innerNsec;
+  long long start, elapsed;
+  int retVal;
+
+  pl->innerNsec = 0;
+  start = cpu_nsec ();
+  retVal = stage->finish (stage);
+  elapsed = cpu_nsec () - start;
+
+  stage->cpuNsec += elapsed - pl->innerNsec;
+  pl->innerNsec = outer + elapsed;
+  return retVal;
+}
+
+
+/******************************************************************************
+ * Get the CPU time used by the calling thread, in nanoseconds.
+ *****************************************************************************/
+static long long cpu_nsec (void)
+{
+  struct timespec now;
+
+  if (clock_gettime (CLOCK_THREAD_CPUTIME_ID, &now) == -1)
+    return 0;
+  return now.tv_sec * 1000000000LL + now.tv_nsec;
+}
+
+
+/******************************************************************************
+ * The sink of a socket, the state is a pointer to the socket.
+ *****************************************************************************/
+static int socket_push (pipe_stage_t *stage, const uint8_t *data, size_t len)
+{
+  int *sfd = stage->state;
+
+  return send_all (*sfd, (uint8_t *)data, len);
+}
+
+
+/******************************************************************************
+ * The sink of a file, the state is its write-behind state.
+ *****************************************************************************/
+static int file_push (pipe_stage_t *stage, const uint8_t *data, size_t len)
+{
+  return wb_write (stage->state, data, len);
+}
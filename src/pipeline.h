@@ -0,0 +1,186 @@
+/******************************************************************************
+ * FTP-Server
+ * Author: Evan Myers
+ * Date: October 2026
+ *
+ * Description:
+ *   The transfer pipeline. The data of a transfer passes from its source (the
+ *   file of a RETR, the data connection of a STOR) through a chain of stages
+ *   to a sink (the data connection, or the file). A stage transforms the data
+ *   it is given, eg. ASCII translation or compression, and passes its output
+ *   on to the next stage. Data is passed by reference: a stage that does not
+ *   change a buffer hands the same buffer on, so only a transforming stage
+ *   makes a copy, into a buffer of its own.
+ *
+ *   A pipeline without stages moves the file unchanged, so the transfer can
+ *   use the zero copy path (sendfile() or splice()) and skip the pipeline.
+ *
+ *   The CPU time of each stage is measured, not counting the time of the
+ *   stages it passes data on to, and is added to per-stage totals for the
+ *   "pipestats" server command.
+ *****************************************************************************/
+#ifndef __PIPELINE_H__
+#define __PIPELINE_H__
+
+
+#include <stdbool.h>     //Required for 'bool' in function prototype.
+#include <stddef.h>      //Required for 'size_t' in structure.
+#include <stdint.h>      //Required for 'uint8_t' in structure.
+#include "writebehind.h" //Required for 'write_behind_t' in function prototype.
+
+
+struct pipe_stage;
+struct pipeline;
+
+
+/******************************************************************************
+ * Give data to a stage. The data is only valid for the duration of the call,
+ * a stage that holds data back must copy it.
+ *
+ * Return values:
+ *   0    success
+ *  -1    error, the transfer fails.
+ *****************************************************************************/
+typedef int (*pipe_push_fn_t) (struct pipe_stage *stage, const uint8_t *data,
+			       size_t len);
+
+
+/******************************************************************************
+ * Tell a stage that all of the data has been given to it, so that it passes
+ * on any data it holds back and checks that its input was complete.
+ *
+ * Return values:
+ *   0    success
+ *  -1    error, the transfer fails.
+ *****************************************************************************/
+typedef int (*pipe_finish_fn_t) (struct pipe_stage *stage);
+
+
+/******************************************************************************
+ * A stage of a pipeline. The module of a stage fills in the name, functions
+ * and state with pipe_stage_init(), the rest is kept by the pipeline. Stages
+ * are owned by the caller, usually on the stack of the command thread.
+ *****************************************************************************/
+typedef struct pipe_stage {
+  const char *name;         //Names the stage in "pipestats".
+  pipe_push_fn_t push;
+  pipe_finish_fn_t finish;  //NULL if the stage holds nothing back.
+  void *state;              //The transfer state of the module of the stage.
+  struct pipe_stage *next;  //The next stage, NULL for the sink.
+  struct pipeline *pl;
+  long long bytes;          //The bytes given to the stage.
+  long long cpuNsec;        //The CPU time of the stage alone.
+} pipe_stage_t;
+
+
+/******************************************************************************
+ * A pipeline, from its first stage to its sink.
+ *****************************************************************************/
+typedef struct pipeline {
+  pipe_stage_t *head;       //The first stage, or the sink.
+  pipe_stage_t *sink;
+  pipe_stage_t *last;       //The stage before the sink, or NULL.
+  long long innerNsec;      //The CPU time of the stages called by a stage.
+} pipeline_t;
+
+
+/******************************************************************************
+ * Prepare a stage.
+ *
+ * Arguments:
+ *    stage - The stage to initialize.
+ *     name - The name of the stage, a string constant.
+ *     push - Called with the data given to the stage.
+ *   finish - Called at the end of the data, or NULL.
+ *    state - The state the functions of the stage work on.
+ *****************************************************************************/
+void pipe_stage_init (pipe_stage_t *stage, const char *name,
+		      pipe_push_fn_t push, pipe_finish_fn_t finish, void *state);
+
+
+/******************************************************************************
+ * Prepare a pipeline that ends in a sink, with no stages.
+ *****************************************************************************/
+void pipe_start (pipeline_t *pl, pipe_stage_t *sink);
+
+
+/******************************************************************************
+ * Add a stage to the end of a pipeline, before the sink. Stages are added in
+ * the order the data flows through them.
+ *****************************************************************************/
+void pipe_add (pipeline_t *pl, pipe_stage_t *stage);
+
+
+/******************************************************************************
+ * Determine if a pipeline passes the data to its sink unchanged, so the
+ * transfer may move the data with sendfile() or splice() instead.
+ *****************************************************************************/
+bool pipe_zero_copy (const pipeline_t *pl);
+
+
+/******************************************************************************
+ * Give data to the first stage of a pipeline.
+ *
+ * Return values:
+ *   0    success
+ *  -1    error
+ *****************************************************************************/
+int pipe_push (pipeline_t *pl, const uint8_t *data, size_t len);
+
+
+/******************************************************************************
+ * Pass the output of a stage on to the next stage. Called by the push and
+ * finish functions of a stage.
+ *
+ * Return values:
+ *   0    success
+ *  -1    error
+ *****************************************************************************/
+int pipe_next (pipe_stage_t *stage, const uint8_t *data, size_t len);
+
+
+/******************************************************************************
+ * Finish each stage of a pipeline in turn, then the sink. Call this once all
+ * of the data has been given to the pipeline, but not for an aborted
+ * transfer.
+ *
+ * Return values:
+ *   0    success
+ *  -1    error
+ *****************************************************************************/
+int pipe_finish (pipeline_t *pl);
+
+
+/******************************************************************************
+ * Get the number of bytes that have reached the sink of a pipeline.
+ *****************************************************************************/
+long long pipe_delivered (const pipeline_t *pl);
+
+
+/******************************************************************************
+ * Add the CPU time of each stage of a finished or abandoned pipeline to the
+ * server totals.
+ *****************************************************************************/
+void pipe_end (pipeline_t *pl);
+
+
+/******************************************************************************
+ * Prepare a sink that sends data on a socket. The socket is read through the
+ * pointer on each send.
+ *****************************************************************************/
+void pipe_socket_sink (pipe_stage_t *stage, int *sfd);
+
+
+/******************************************************************************
+ * Prepare a sink that writes data to a file through write-behind.
+ *****************************************************************************/
+void pipe_file_sink (pipe_stage_t *stage, write_behind_t *wb);
+
+
+/******************************************************************************
+ * Print the CPU time and throughput of each kind of stage to stdout.
+ *****************************************************************************/
+void pipe_print_stats (void);
+
+
+#endif //__PIPELINE_H__
@@ -0,0 +1,335 @@
+/******************************************************************************
+ * FTP-Server
+ * Author: Evan Myers
+ * Date: October 2026
+ *
+ * Description:
+ *   Bandwidth shaping of file transfers with token buckets. See ratelimit.h
+ *   for an overview.
+ *
+ *   A transfer is charged after it has moved a chunk, and a bucket may go
+ *   into debt. The transfer then sleeps until the debt has been repaid. This
+ *   needs one lock of each bucket per chunk, and no waiting in line for
+ *   tokens, which keeps the overhead low when the limits are not reached.
+ *****************************************************************************/
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "config.h"
+#include "ratelimit.h"
+#include "session.h"
+
+
+//The smallest burst of a bucket, so no chunk is clamped below it.
+#define MIN_RATE_CHUNK 4096
+
+//The longest a transfer sleeps before it checks for an abort.
+#define NSEC_PER_SEC 1000000000LL
+#define MAX_SLEEP_NS (COM_THREAD_ABORT_TIMEOUT_SEC * NSEC_PER_SEC + \
+		      COM_THREAD_ABORT_TIMEOUT_USEC * 1000LL)
+
+//The longest user.conf setting name, "RATE_LIMIT_" and the username.
+#define USER_SETTING_LEN (sizeof ("RATE_LIMIT_") + USER_STRLEN)
+
+
+//The buckets of one user, shared by all of the user's sessions.
+struct rate_user {
+  char name[USER_STRLEN];
+  rate_bucket_t bucket;
+  int sessions;              //The number of sessions logged in as the user.
+  struct rate_user *next;
+};
+
+
+//Local function prototypes.
+static void bucket_init (rate_bucket_t *b, long long rate, long long burst);
+static long long bucket_charge (rate_bucket_t *b, size_t bytes,
+				const struct timespec *now);
+static void print_bucket (const char *name, rate_bucket_t *b);
+
+
+/* The server wide bucket, the default limits, and the list of users that have
+ * logged in. The limits are written once by rate_load_config() before any
+ * thread is created. The user list is protected by usersMutex, each bucket by
+ * its own lock. */
+static rate_bucket_t serverBucket;
+static long long userRate, userBurst;
+static long long sessionRate, sessionBurst;
+static struct rate_user *users = NULL;
+static pthread_mutex_t usersMutex = PTHREAD_MUTEX_INITIALIZER;
+
+
+/******************************************************************************
+ * rate_load_config - see ratelimit.h
+ *****************************************************************************/
+void rate_load_config (void)
+{
+  bucket_init (&serverBucket,
+	       get_config_number ("RATE_LIMIT_CONFIG", FTP_CONFIG_FILE, 0),
+	       get_config_number ("RATE_BURST_CONFIG", FTP_CONFIG_FILE, 0));
+
+  userRate = get_config_number ("USER_RATE_LIMIT_CONFIG", FTP_CONFIG_FILE, 0);
+  userBurst = get_config_number ("USER_RATE_BURST_CONFIG", FTP_CONFIG_FILE, 0);
+
+  sessionRate = get_config_number ("SESSION_RATE_LIMIT_CONFIG",
+				   FTP_CONFIG_FILE, 0);
+  sessionBurst = get_config_number ("SESSION_RATE_BURST_CONFIG",
+				    FTP_CONFIG_FILE, 0);
+}
+
+
+/******************************************************************************
+ * rate_session_start - see ratelimit.h
+ *****************************************************************************/
+void rate_session_start (rate_session_t *rs)
+{
+  bucket_init (&rs->bucket, sessionRate, sessionBurst);
+  rs->user = NULL;
+}
+
+
+/******************************************************************************
+ * rate_session_login - see ratelimit.h
+ *****************************************************************************/
+void rate_session_login (rate_session_t *rs, const char *username)
+{
+  struct rate_user *user;
+  char setting[USER_SETTING_LEN];
+  long long rate, burst;
+
+  rate_session_end (rs);
+
+  pthread_mutex_lock (&usersMutex);
+  for (user = users; user != NULL; user = user->next) {
+    if (strcmp (user->name, username) == 0)
+      break;
+  }
+
+  /* Create the buckets of a user on the first login. The limits in user.conf
+   * replace the default limits. */
+  if (user == NULL && (user = malloc (sizeof (*user))) != NULL) {
+    snprintf (setting, sizeof (setting), "RATE_LIMIT_%s", username);
+    rate = get_config_number (setting, USER_CONFIG_FILE, userRate);
+    snprintf (setting, sizeof (setting), "RATE_BURST_%s", username);
+    burst = get_config_number (setting, USER_CONFIG_FILE, userBurst);
+
+    snprintf (user->name, sizeof (user->name), "%s", username);
+    bucket_init (&user->bucket, rate, burst);
+    user->sessions = 0;
+    user->next = users;
+    users = user;
+  }
+
+  if (user != NULL)
+    ++user->sessions;
+  rs->user = user;
+  pthread_mutex_unlock (&usersMutex);
+}
+
+
+/******************************************************************************
+ * rate_session_end - see ratelimit.h
+ *
+ * The buckets of a user are kept after the last session ends, so that the
+ * statistics of the user are not lost.
+ *****************************************************************************/
+void rate_session_end (rate_session_t *rs)
+{
+  if (rs->user == NULL)
+    return;
+
+  pthread_mutex_lock (&usersMutex);
+  --rs->user->sessions;
+  pthread_mutex_unlock (&usersMutex);
+  rs->user = NULL;
+}
+
+
+/******************************************************************************
+ * rate_clamp - see ratelimit.h
+ *****************************************************************************/
+size_t rate_clamp (rate_session_t *rs, size_t chunk)
+{
+  rate_bucket_t *levels[3] = { &serverBucket, NULL, &rs->bucket };
+  int i;
+
+  if (rs->user != NULL)
+    levels[1] = &rs->user->bucket;
+
+  //The rate and burst never change after the bucket is set up, no lock.
+  for (i = 0; i < 3; ++i) {
+    if (levels[i] != NULL && levels[i]->rate > 0 &&
+	(long long)chunk > levels[i]->burst)
+      chunk = levels[i]->burst;
+  }
+
+  return chunk;
+}
+
+
+/******************************************************************************
+ * rate_limited - see ratelimit.h
+ *****************************************************************************/
+bool rate_limited (rate_session_t *rs)
+{
+  //The rates never change after the buckets are set up, no lock.
+  return serverBucket.rate > 0 || rs->bucket.rate > 0 ||
+    (rs->user != NULL && rs->user->bucket.rate > 0);
+}
+
+
+/******************************************************************************
+ * rate_charge - see ratelimit.h
+ *****************************************************************************/
+void rate_charge (rate_session_t *rs, size_t bytes, volatile bool *abort)
+{
+  rate_bucket_t *levels[3] = { &serverBucket, NULL, &rs->bucket };
+  rate_bucket_t *slowest = NULL;
+  struct timespec now, pause;
+  long long delay = 0;
+  long long levelDelay;
+  int i;
+
+  if (rs->user != NULL)
+    levels[1] = &rs->user->bucket;
+
+  clock_gettime (CLOCK_MONOTONIC, &now);
+  for (i = 0; i < 3; ++i) {
+    if (levels[i] == NULL)
+      continue;
+    if ((levelDelay = bucket_charge (levels[i], bytes, &now)) > delay) {
+      delay = levelDelay;
+      slowest = levels[i];
+    }
+  }
+
+  if (slowest == NULL)
+    return;
+
+  //Blame the delay on the level that imposed it.
+  pthread_mutex_lock (&slowest->lock);
+  slowest->delayedNs += delay;
+  pthread_mutex_unlock (&slowest->lock);
+
+  //Sleep in short steps, so that an abort is not held up.
+  while (delay > 0 && *abort == false) {
+    levelDelay = (delay > MAX_SLEEP_NS) ? MAX_SLEEP_NS : delay;
+    pause.tv_sec = levelDelay / NSEC_PER_SEC;
+    pause.tv_nsec = levelDelay % NSEC_PER_SEC;
+    if (nanosleep (&pause, NULL) == -1 && errno != EINTR) {
+      fprintf (stderr, "%s: nanosleep: %s\n", __FUNCTION__, strerror (errno));
+      return;
+    }
+    delay -= levelDelay;
+  }
+}
+
+
+/******************************************************************************
+ * rate_print_stats - see ratelimit.h
+ *****************************************************************************/
+void rate_print_stats (void)
+{
+  struct rate_user *user;
+  char name[USER_STRLEN + sizeof ("user  (000000 sessions)")];
+
+  printf ("%-32s %12s %12s %14s %10s\n", "Bucket", "Rate (B/s)",
+	  "Burst (B)", "Bytes", "Delayed");
+  print_bucket ("server", &serverBucket);
+
+  pthread_mutex_lock (&usersMutex);
+  for (user = users; user != NULL; user = user->next) {
+    snprintf (name, sizeof (name), "user %s (%d sessions)", user->name,
+	      user->sessions);
+    print_bucket (name, &user->bucket);
+  }
+  pthread_mutex_unlock (&usersMutex);
+
+  printf ("Each session is limited to %lld B/s (0 is unlimited).\n",
+	  sessionRate);
+}
+
+
+/******************************************************************************
+ * Set up a bucket. The bucket starts full. A missing burst size defaults to
+ * one second of transfer at the rate. The burst of a limited bucket is at
+ * least MIN_RATE_CHUNK.
+ *
+ * Arguments:
+ *       b - The bucket.
+ *    rate - Bytes per second, 0 for unlimited.
+ *   burst - The depth of the bucket in bytes, 0 for the default.
+ *****************************************************************************/
+static void bucket_init (rate_bucket_t *b, long long rate, long long burst)
+{
+  pthread_mutex_init (&b->lock, NULL);
+  b->rate = rate;
+  b->burst = (burst > 0) ? burst : rate;
+  if (rate > 0 && b->burst < MIN_RATE_CHUNK)
+    b->burst = MIN_RATE_CHUNK;
+  b->tokens = b->burst;
+  clock_gettime (CLOCK_MONOTONIC, &b->last);
+  b->bytes = 0;
+  b->delayedNs = 0;
+}
+
+
+/******************************************************************************
+ * Refill a bucket for the time since it was last charged, and take tokens for
+ * the bytes moved.
+ *
+ * Arguments:
+ *       b - The bucket.
+ *   bytes - The number of bytes moved.
+ *     now - The current time.
+ *
+ * Returns:
+ *   The number of nanoseconds until the bucket is out of debt, 0 if it is not
+ *   in debt or if it is unlimited.
+ *****************************************************************************/
+static long long bucket_charge (rate_bucket_t *b, size_t bytes,
+				const struct timespec *now)
+{
+  double elapsed;
+  long long delay = 0;
+
+  pthread_mutex_lock (&b->lock);
+  b->bytes += bytes;
+
+  if (b->rate > 0) {
+    elapsed = (now->tv_sec - b->last.tv_sec) +
+      (now->tv_nsec - b->last.tv_nsec) / (double)NSEC_PER_SEC;
+    //Another thread may have charged the bucket with a later time.
+    if (elapsed > 0) {
+      b->tokens += elapsed * b->rate;
+      if (b->tokens > b->burst)
+	b->tokens = b->burst;
+      b->last = *now;
+    }
+
+    b->tokens -= bytes;
+    if (b->tokens < 0)
+      delay = (long long)(-b->tokens / b->rate * NSEC_PER_SEC);
+  }
+
+  pthread_mutex_unlock (&b->lock);
+  return delay;
+}
+
+
+/******************************************************************************
+ * Print one line of statistics for a bucket.
+ *****************************************************************************/
+static void print_bucket (const char *name, rate_bucket_t *b)
+{
+  long long bytes, delayedNs;
+
+  pthread_mutex_lock (&b->lock);
+  bytes = b->bytes;
+  delayedNs = b->delayedNs;
+  pthread_mutex_unlock (&b->lock);
+
+  printf ("%-32s %12lld %12lld %14lld %9.1fs\n", name, b->rate, b->burst,
+	  bytes, delayedNs / (double)NSEC_PER_SEC);
+}
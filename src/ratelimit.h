@@ -0,0 +1,145 @@
+/******************************************************************************
+ * FTP-Server
+ * Author: Evan Myers
+ * Date: October 2026
+ *
+ * Description:
+ *   Bandwidth shaping of file transfers with token buckets. Every byte moved
+ *   on a data connection is charged to three buckets: one for the whole
+ *   server, one shared by all sessions of the logged in user, and one for the
+ *   session itself. A transfer that overdraws any of its buckets sleeps until
+ *   the most overdrawn one has refilled, so the tightest limit applies.
+ *
+ *   Each bucket has a rate in bytes per second and a burst size in bytes, the
+ *   most that may be sent at once after the transfer has been idle. A rate of
+ *   0 leaves that level unlimited.
+ *****************************************************************************/
+#ifndef __RATELIMIT_H__
+#define __RATELIMIT_H__
+
+
+#include <pthread.h>  //Required for 'pthread_mutex_t' in structure.
+#include <stdbool.h>  //Required for 'bool' in function prototype.
+#include <stddef.h>   //Required for 'size_t' in function prototype.
+#include <time.h>     //Required for 'struct timespec' in structure.
+
+
+/******************************************************************************
+ * One token bucket, and the statistics of the transfers charged to it.
+ *****************************************************************************/
+typedef struct {
+  pthread_mutex_t lock;
+  long long rate;          //Bytes per second, 0 for unlimited.
+  long long burst;         //The depth of the bucket in bytes.
+  double tokens;           //May be negative while a transfer is sleeping.
+  struct timespec last;    //The time the tokens were last refilled.
+  long long bytes;         //Total bytes charged.
+  long long delayedNs;     //Total time transfers slept for this bucket.
+} rate_bucket_t;
+
+
+//The buckets shared by all sessions of one user (see ratelimit.c).
+struct rate_user;
+
+
+/******************************************************************************
+ * The rate limiting state of a session. One of these is held in the session
+ * information of each control connection.
+ *****************************************************************************/
+typedef struct {
+  rate_bucket_t bucket;      //The session level bucket.
+  struct rate_user *user;    //The user level bucket, NULL before login.
+} rate_session_t;
+
+
+/******************************************************************************
+ * Read the server wide and default limits from the server configuration file,
+ * and set up the server wide bucket. This function should be called once, by
+ * main(), before any client connects.
+ *
+ * Settings (ftp.conf, bytes per second and bytes):
+ *   RATE_LIMIT_CONFIG, RATE_BURST_CONFIG
+ *     The limit of all transfers of the server.
+ *   USER_RATE_LIMIT_CONFIG, USER_RATE_BURST_CONFIG
+ *     The default limit of all transfers of one user.
+ *   SESSION_RATE_LIMIT_CONFIG, SESSION_RATE_BURST_CONFIG
+ *     The limit of the transfers of one session.
+ *
+ * Settings (user.conf):
+ *   RATE_LIMIT_<username>, RATE_BURST_<username>
+ *     Replace the default user limit for one user.
+ *****************************************************************************/
+void rate_load_config (void);
+
+
+/******************************************************************************
+ * Set up the rate limiting state of a new session.
+ *****************************************************************************/
+void rate_session_start (rate_session_t *rs);
+
+
+/******************************************************************************
+ * Charge the transfers of a session to the buckets of a user. Called when the
+ * user logs in. The user's buckets are created on the first login.
+ *
+ * Arguments:
+ *         rs - The rate limiting state of the session.
+ *   username - The user that logged in.
+ *****************************************************************************/
+void rate_session_login (rate_session_t *rs, const char *username);
+
+
+/******************************************************************************
+ * Release the rate limiting state of a session when it ends.
+ *****************************************************************************/
+void rate_session_end (rate_session_t *rs);
+
+
+/******************************************************************************
+ * Limit the number of bytes a transfer moves at once, so that one chunk does
+ * not overdraw a bucket by more than its burst size.
+ *
+ * Arguments:
+ *      rs - The rate limiting state of the session.
+ *   chunk - The chunk size the transfer would use.
+ *
+ * Returns:
+ *   The chunk size to use.
+ *****************************************************************************/
+size_t rate_clamp (rate_session_t *rs, size_t chunk);
+
+
+/******************************************************************************
+ * Determine if any bandwidth limit applies to the transfers of a session.
+ *
+ * Arguments:
+ *   rs - The limits of the session.
+ *
+ * Return values:
+ *   true   A transfer of the session may be made to wait by rate_charge().
+ *   false  The transfers of the session are unlimited.
+ *****************************************************************************/
+bool rate_limited (rate_session_t *rs);
+
+
+/******************************************************************************
+ * Charge the bytes a transfer has moved to the buckets of its session, and
+ * sleep while any of the buckets is overdrawn. The sleep ends early when the
+ * transfer is aborted.
+ *
+ * Arguments:
+ *      rs - The rate limiting state of the session.
+ *   bytes - The number of bytes moved.
+ *   abort - The abort flag of the session, checked while sleeping.
+ *****************************************************************************/
+void rate_charge (rate_session_t *rs, size_t bytes, volatile bool *abort);
+
+
+/******************************************************************************
+ * Print the limits and statistics of the server wide bucket, and of each
+ * user's buckets, to standard output.
+ *****************************************************************************/
+void rate_print_stats (void);
+
+
+#endif //__RATELIMIT_H__
@@ -0,0 +1,133 @@
+/******************************************************************************
+ * FTP-Server
+ * Author: Evan Myers
+ * Date: October 2026
+ *
+ * Description:
+ *   Page cache hints for downloads. See readhint.h for an overview.
+ *
+ *   POSIX_FADV_SEQUENTIAL doubles the readahead window of the kernel for the
+ *   file. On top of that, POSIX_FADV_WILLNEED starts the reads of the next
+ *   window whenever the transfer has used up half of the last one, so the
+ *   disk works ahead of the network instead of in step with it. Drop-behind
+ *   uses POSIX_FADV_DONTNEED, in steps of half a window. It trails the
+ *   transfer by a window, the pages of data that is still in the socket
+ *   buffers are in use and would not be dropped.
+ *****************************************************************************/
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/stat.h>
+#include "config.h"
+#include "readhint.h"
+
+
+//Dropped ranges start and end on a page.
+#define RH_PAGE 4096
+
+//The defaults of the ftp.conf settings.
+#define DEFAULT_READAHEAD 8388608
+#define DEFAULT_DROP_BEHIND 1073741824
+
+
+/* The settings are written once by rh_load_config() before any thread is
+ * created. */
+static off_t window = DEFAULT_READAHEAD;
+static off_t dropSize = DEFAULT_DROP_BEHIND;
+static off_t dropStep = DEFAULT_READAHEAD / 2;
+static off_t dropLag = DEFAULT_READAHEAD;
+
+
+/******************************************************************************
+ * rh_load_config - see readhint.h
+ *****************************************************************************/
+void rh_load_config (void)
+{
+  window = get_config_number ("READAHEAD_CONFIG", FTP_CONFIG_FILE,
+			      DEFAULT_READAHEAD);
+  dropSize = get_config_number ("DROP_BEHIND_CONFIG", FTP_CONFIG_FILE,
+				DEFAULT_DROP_BEHIND);
+
+  //Drop in steps of half a window, like the readahead.
+  dropLag = (window > 0) ? window : DEFAULT_READAHEAD;
+  dropStep = dropLag / 2;
+}
+
+
+/******************************************************************************
+ * rh_start - see readhint.h
+ *****************************************************************************/
+void rh_start (read_hint_t *rh, int fd, off_t offset, off_t left,
+	       bool prefetch)
+{
+  struct stat fileStat;
+  int err;
+
+  rh->fd = fd;
+  rh->sent = offset;
+  rh->ahead = offset;
+  rh->dropped = offset / RH_PAGE * RH_PAGE;
+  rh->dropBehind = false;
+
+  if (fstat (fd, &fileStat) == -1) {
+    fprintf (stderr, "%s: fstat: %s\n", __FUNCTION__, strerror (errno));
+    rh->end = offset;
+    return;
+  }
+  rh->end = fileStat.st_size;
+  if (left >= 0 && offset + left < rh->end)
+    rh->end = offset + left;
+
+  rh->dropBehind = (dropSize > 0 && fileStat.st_size >= dropSize);
+
+  if (window > 0) {
+    //posix_fadvise() returns the error rather than setting errno.
+    if ((err = posix_fadvise (fd, 0, 0, POSIX_FADV_SEQUENTIAL)) != 0)
+      fprintf (stderr, "%s: posix_fadvise: %s\n", __FUNCTION__, strerror (err));
+    if (prefetch)
+      rh_advance (rh, offset);
+  }
+}
+
+
+/******************************************************************************
+ * rh_advance - see readhint.h
+ *****************************************************************************/
+void rh_advance (read_hint_t *rh, off_t offset)
+{
+  off_t to;
+
+  rh->sent = offset;
+
+  //Request the next window once half of the last one has been used.
+  if (window > 0 && rh->ahead < rh->end && rh->ahead - offset <= window / 2) {
+    if (rh->ahead < offset)
+      rh->ahead = offset;
+    to = (offset + window < rh->end) ? offset + window : rh->end;
+    posix_fadvise (rh->fd, rh->ahead, to - rh->ahead, POSIX_FADV_WILLNEED);
+    rh->ahead = to;
+  }
+
+  //Only whole pages that were sent a window ago are dropped.
+  if (rh->dropBehind) {
+    to = (offset - dropLag) / RH_PAGE * RH_PAGE;
+    if (to - rh->dropped >= dropStep) {
+      posix_fadvise (rh->fd, rh->dropped, to - rh->dropped,
+		     POSIX_FADV_DONTNEED);
+      rh->dropped = to;
+    }
+  }
+}
+
+
+/******************************************************************************
+ * rh_end - see readhint.h
+ *****************************************************************************/
+void rh_end (read_hint_t *rh)
+{
+  off_t to = (rh->ahead > rh->sent) ? rh->ahead : rh->sent;
+
+  if (rh->dropBehind && to > rh->dropped)
+    posix_fadvise (rh->fd, rh->dropped, to - rh->dropped, POSIX_FADV_DONTNEED);
+}
@@ -0,0 +1,87 @@
+/******************************************************************************
+ * FTP-Server
+ * Author: Evan Myers
+ * Date: October 2026
+ *
+ * Description:
+ *   Page cache hints for downloads. A download is read sequentially, so the
+ *   kernel is told to read ahead aggressively, and the next part of the file
+ *   is requested before the transfer reaches it. The pages of a very large
+ *   file are dropped once they have been sent (drop-behind), so that a
+ *   one-off download of a large file does not evict the small files that
+ *   are downloaded all the time.
+ *****************************************************************************/
+#ifndef __READHINT_H__
+#define __READHINT_H__
+
+
+#include <stdbool.h>   //Required for 'bool' in structure.
+#include <sys/types.h> //Required for 'off_t' in structure.
+
+
+/******************************************************************************
+ * The page cache hint state of a single download. One of these structures is
+ * created by the command thread for each download, and is only used by that
+ * thread.
+ *****************************************************************************/
+typedef struct {
+  int fd;              //The file being sent.
+  off_t end;           //The end of the part of the file being sent.
+  off_t sent;          //The transfer has sent the file up to this offset.
+  off_t ahead;         //Readahead has been requested up to this offset.
+  off_t dropped;       //The pages before this offset have been dropped.
+  bool dropBehind;     //True for a file of at least DROP_BEHIND_CONFIG bytes.
+} read_hint_t;
+
+
+/******************************************************************************
+ * Read the page cache hint settings from the server configuration file. This
+ * function should be called once, by main(), before any client connects.
+ *
+ * Settings (ftp.conf):
+ *   READAHEAD_CONFIG   - The bytes of a download to request from the disk
+ *                        ahead of the transfer. 0 leaves readahead to the
+ *                        kernel.
+ *   DROP_BEHIND_CONFIG - The size of the smallest file whose pages are
+ *                        dropped from the page cache once they are sent. 0
+ *                        keeps the pages of every file.
+ *****************************************************************************/
+void rh_load_config (void);
+
+
+/******************************************************************************
+ * Prepare the page cache hints of a download.
+ *
+ * Arguments:
+ *         rh - The hint state to initialize.
+ *         fd - The file to send, open for reading.
+ *     offset - The first byte of the file to send.
+ *       left - The number of bytes to send, -1 to send to the end of the file.
+ *   prefetch - True to request the start of the file now. Otherwise the
+ *              first call to rh_advance() requests it.
+ *****************************************************************************/
+void rh_start (read_hint_t *rh, int fd, off_t offset, off_t left,
+	       bool prefetch);
+
+
+/******************************************************************************
+ * Report the progress of a download. The readahead is kept one window ahead
+ * of 'offset', and the pages before 'offset' are dropped if the file is
+ * large enough.
+ *
+ * Arguments:
+ *       rh - The hint state of the download.
+ *   offset - The next byte of the file to send.
+ *****************************************************************************/
+void rh_advance (read_hint_t *rh, off_t offset);
+
+
+/******************************************************************************
+ * End the page cache hints of a download. The remaining pages read for a
+ * drop-behind download are dropped, including readahead an aborted download
+ * did not send.
+ *****************************************************************************/
+void rh_end (read_hint_t *rh);
+
+
+#endif //__READHINT_H__
@@ -13,6 +13,7 @@
  *****************************************************************************/
 #include <string.h>
 #include <stdio.h>
+#include "bmode.h"
 #include "net.h"
 #include "reply.h"
 
@@ -22,6 +23,24 @@
 #define STD_TERM_SZ 80  //Use for one line replies where length is not known.
 
 
+/******************************************************************************
+ * send_mesg_110 - see "reply.h"
+ *****************************************************************************/
+int send_mesg_110 (int csfd, const char *marker, long long offset)
+{
+  uint8_t mesg[STD_TERM_SZ + BMODE_MARKER_MAX];
+  int mesgLen;
+
+  sprintf ((char*)mesg, "110 MARK %s = %lld\n", marker, offset);
+
+  mesgLen = strlen ((char*)mesg);
+  if (send_all (csfd, mesg, mesgLen) == -1) {
+    return -1;
+  }
+  return 0;
+}
+
+
 /******************************************************************************
  * send_mesg_150 - see "reply.h"
  *****************************************************************************/
@@ -34,6 +53,8 @@ int send_mesg_150 (int csfd, const char *filename, char option)
     reply = "150 Opening ASCII mode data connection for ";
   } else if (option == REPLY_150_BINARY) {
     reply = "150 Opening BINARY mode data connection for ";
+  } else if (option == REPLY_150_COPY) {
+    reply = "150 Copying ";
   }
 
   mesgLen = strlen (reply);
@@ -69,8 +90,20 @@ int send_mesg_200 (int csfd, char option)
     reply = "200 Switching to Image mode.\n";
   } else if (option == REPLY_200_STREAM) {
     reply = "200 Switching to stream mode.\n";
+  } else if (option == REPLY_200_DEFLATE) {
+    reply = "200 Switching to deflate mode.\n";
+  } else if (option == REPLY_200_BLOCK) {
+    reply = "200 Switching to block mode.\n";
+  } else if (option == REPLY_200_OPTS) {
+    reply = "200 Command options changed.\n";
   } else if (option == REPLY_200_FSTRU) {
     reply = "200 Switching to File Structure.\n";
+  } else if (option == REPLY_200_ALLO) {
+    reply = "200 ALLO command successful; space will be reserved.\n";
+  } else if (option == REPLY_200_PBSZ) {
+    reply = "200 PBSZ=0\n";
+  } else if (option == REPLY_200_PROT) {
+    reply = "200 Protection level set.\n";
   }
 
   mesgLen = strlen (reply);
@@ -81,6 +114,73 @@ int send_mesg_200 (int csfd, char option)
 }
 
 
+/******************************************************************************
+ * send_mesg_200_hash - see "reply.h"
+ *****************************************************************************/
+int send_mesg_200_hash (int csfd, const char *alg)
+{
+  uint8_t mesg[STD_TERM_SZ];
+  int mesgLen;
+
+  sprintf ((char*)mesg, "200 %s\n", alg);
+
+  mesgLen = strlen ((char*)mesg);
+  if (send_all (csfd, mesg, mesgLen) == -1) {
+    return -1;
+  }
+  return 0;
+}
+
+
+/******************************************************************************
+ * send_mesg_213_hash - see "reply.h"
+ *****************************************************************************/
+int send_mesg_213_hash (int csfd, const char *alg, long long size,
+			const char *hex, const char *path)
+{
+  uint8_t mesgStart[STD_TERM_SZ];
+  uint8_t mesgEnd[] = "\n";
+  int mesgLen;
+
+  sprintf ((char*)mesgStart, "213 %s 0-%lld %s ", alg, size, hex);
+
+  mesgLen = strlen ((char*)mesgStart);
+  if (send_all (csfd, mesgStart, mesgLen) == -1) {
+    return -1;
+  }
+
+  mesgLen = strlen (path);
+  if (send_all (csfd, (uint8_t*)path, mesgLen) == -1) {
+    return -1;
+  }
+
+  mesgLen = strlen ((char*)mesgEnd);
+  if (send_all (csfd, mesgEnd, mesgLen) == -1) {
+    return -1;
+  }
+  return 0;
+}
+
+
+/******************************************************************************
+ * send_mesg_213_copy - see "reply.h"
+ *****************************************************************************/
+int send_mesg_213_copy (int csfd, long long done, long long size)
+{
+  uint8_t mesg[STD_TERM_SZ];
+  int mesgLen;
+
+  sprintf ((char*)mesg, "213 Copied %lld of %lld bytes (%lld%%).\n", done,
+	   size, (size > 0) ? done * 100 / size : 100);
+
+  mesgLen = strlen ((char*)mesg);
+  if (send_all (csfd, mesg, mesgLen) == -1) {
+    return -1;
+  }
+  return 0;
+}
+
+
 /******************************************************************************
  * send_mesg_215 - see "reply.h"
  *****************************************************************************/
@@ -120,8 +220,9 @@ int send_mesg_214_general (int csfd)
   int mesgLen;
   uint8_t mesg[] =
     "214-The following commands are recognized.\n"
-    " APPE CDUP CWD  HELP LIST MKD  MODE NLST PASS PASV PORT PWD  QUIT RETR\n"
-    " STOR STOU STRU SYST TYPE USER\n"
+    " APPE AUTH CDUP CWD  HASH HELP LIST MKD  MODE NLST OPTS PASS PASV PBSZ\n"
+    " PORT PROT PWD  QUIT RANG REST RETR SITE STOR STOU STRU SYST TYPE USER\n"
+    " XMD5\n"
     "214 Help OK.\n";
 
   mesgLen = strlen ((char*)mesg);
@@ -188,6 +289,8 @@ int send_mesg_226 (int csfd, char option)
     reply = "226 Abort successful.\n";
   } else if (option == REPLY_226_SUCCESS) {
     reply = "226 Closing data connection; requested file action successful.\n";
+  } else if (option == REPLY_226_KEEP) {
+    reply = "226 Requested file action successful; data connection kept open.\n";
   }
 
   mesgLen = strlen (reply);  
@@ -198,6 +301,66 @@ int send_mesg_226 (int csfd, char option)
 }
 
 
+/******************************************************************************
+ * send_mesg_226_batch - see "reply.h"
+ *****************************************************************************/
+int send_mesg_226_batch (int csfd, const char *status, char option)
+{
+  char *reply;
+  int mesgLen;
+
+  reply = "226-The status of each file follows.\n";
+  mesgLen = strlen (reply);
+  if (send_all (csfd, (uint8_t*)reply, mesgLen) == -1)
+    return -1;
+
+  //Each status line starts with a space, so it cannot end the reply.
+  mesgLen = strlen (status);
+  if (send_all (csfd, (uint8_t*)status, mesgLen) == -1)
+    return -1;
+
+  return send_mesg_226 (csfd, option);
+}
+
+
+/******************************************************************************
+ * send_mesg_226_untar - see "reply.h"
+ *****************************************************************************/
+int send_mesg_226_untar (int csfd, long files, long dirs, long skipped,
+			 char option)
+{
+  char mesg[STD_TERM_SZ * 2];
+  int mesgLen;
+
+  mesgLen = snprintf (mesg, sizeof (mesg), "226-Extracted %ld files and %ld "
+		      "directories, skipped %ld entries.\n", files, dirs,
+		      skipped);
+  if (send_all (csfd, (uint8_t*)mesg, mesgLen) == -1)
+    return -1;
+
+  return send_mesg_226 (csfd, option);
+}
+
+
+/******************************************************************************
+ * send_mesg_226_delta - see "reply.h"
+ *****************************************************************************/
+int send_mesg_226_delta (int csfd, const char *verb, long long literal,
+			 long long matched, char option)
+{
+  char mesg[STD_TERM_SZ * 2];
+  int mesgLen;
+
+  mesgLen = snprintf (mesg, sizeof (mesg), "226-%s %lld bytes of literal "
+		      "data, %lld bytes were matched.\n", verb, literal,
+		      matched);
+  if (send_all (csfd, (uint8_t*)mesg, mesgLen) == -1)
+    return -1;
+
+  return send_mesg_226 (csfd, option);
+}
+
+
 /******************************************************************************
  * send_mesg_227 - see "reply.h"
  *****************************************************************************/
@@ -283,6 +446,22 @@ int send_mesg_230 (int csfd, char option)
 }
 
 
+/******************************************************************************
+ * send_mesg_234 - see "reply.h"
+ *****************************************************************************/
+int send_mesg_234 (int csfd)
+{
+  uint8_t mesg[] = "234 Proceed with negotiation.\n";
+  int mesgLen;
+
+  mesgLen = strlen ((char*)mesg);
+  if (send_all (csfd, mesg, mesgLen) == -1) {
+    return -1;
+  }
+  return 0;
+}
+
+
 /******************************************************************************
  * send_mesg_250 - see "reply.h"
  *****************************************************************************/
@@ -299,6 +478,42 @@ int send_mesg_250 (int csfd)
 }
 
 
+/******************************************************************************
+ * send_mesg_250_hash - see "reply.h"
+ *****************************************************************************/
+int send_mesg_250_hash (int csfd, const char *hex)
+{
+  uint8_t mesg[STD_TERM_SZ];
+  int mesgLen;
+
+  sprintf ((char*)mesg, "250 %s\n", hex);
+
+  mesgLen = strlen ((char*)mesg);
+  if (send_all (csfd, mesg, mesgLen) == -1) {
+    return -1;
+  }
+  return 0;
+}
+
+
+/******************************************************************************
+ * send_mesg_250_copy - see "reply.h"
+ *****************************************************************************/
+int send_mesg_250_copy (int csfd, long long size, const char *method)
+{
+  uint8_t mesg[STD_TERM_SZ];
+  int mesgLen;
+
+  sprintf ((char*)mesg, "250 Copied %lld bytes by %s.\n", size, method);
+
+  mesgLen = strlen ((char*)mesg);
+  if (send_all (csfd, mesg, mesgLen) == -1) {
+    return -1;
+  }
+  return 0;
+}
+
+
 /******************************************************************************
  * send_mesg_257 - see "reply.h"
  *****************************************************************************/
@@ -342,6 +557,48 @@ int send_mesg_331 (int csfd)
 }
 
 
+/******************************************************************************
+ * send_mesg_350 - see "reply.h"
+ *****************************************************************************/
+int send_mesg_350 (int csfd, long long offset)
+{
+  uint8_t mesg[STD_TERM_SZ];
+  int mesgLen;
+
+  sprintf ((char*)mesg, "350 Restarting at %lld. Send STOR or RETR to "
+	   "resume.\n", offset);
+
+  mesgLen = strlen ((char*)mesg);
+  if (send_all (csfd, mesg, mesgLen) == -1) {
+    return -1;
+  }
+  return 0;
+}
+
+
+/******************************************************************************
+ * send_mesg_350_range - see "reply.h"
+ *****************************************************************************/
+int send_mesg_350_range (int csfd, long long start, long long end)
+{
+  uint8_t mesg[STD_TERM_SZ];
+  int mesgLen;
+
+  if (end < 0) {
+    sprintf ((char*)mesg, "350 Byte range reset.\n");
+  } else {
+    sprintf ((char*)mesg, "350 Restarting at %lld. End byte range at %lld.\n",
+	     start, end);
+  }
+
+  mesgLen = strlen ((char*)mesg);
+  if (send_all (csfd, mesg, mesgLen) == -1) {
+    return -1;
+  }
+  return 0;
+}
+
+
 /******************************************************************************
  * send_mesg_425 - see "reply.h"
  *****************************************************************************/
@@ -374,6 +631,22 @@ int send_mesg_426 (int csfd)
   return 0;
 }
 
+/******************************************************************************
+ * send_mesg_431 - see "reply.h"
+ *****************************************************************************/
+int send_mesg_431 (int csfd)
+{
+  uint8_t mesg[] = "431 TLS is not available; the server has no certificate.\n";
+  int mesgLen;
+
+  mesgLen = strlen ((char*)mesg);
+  if (send_all (csfd, mesg, mesgLen) == -1) {
+    return -1;
+  }
+  return 0;
+}
+
+
 /******************************************************************************
  * send_mesg_450 - see "reply.h"
  *****************************************************************************/
@@ -406,6 +679,23 @@ int send_mesg_451 (int csfd)
 }
 
 
+/******************************************************************************
+ * send_mesg_452 - see "reply.h"
+ *****************************************************************************/
+int send_mesg_452 (int csfd)
+{
+  uint8_t mesg[] = "452 Requested action not taken; insufficient storage "
+                   "space in system.\n";
+  int mesgLen;
+
+  mesgLen = strlen ((char*)mesg);
+  if (send_all (csfd, mesg, mesgLen) == -1) {
+    return -1;
+  }
+  return 0;
+}
+
+
 /******************************************************************************
  * send_mesg_500 - see "reply.h"
  *****************************************************************************/
@@ -454,6 +744,54 @@ int send_mesg_503 (int csfd)
 }
 
 
+/******************************************************************************
+ * send_mesg_503_tls - see "reply.h"
+ *****************************************************************************/
+int send_mesg_503_tls (int csfd)
+{
+  uint8_t mesg[] = "503 Bad sequence of commands; see AUTH TLS, PBSZ and PROT.\n";
+  int mesgLen;
+
+  mesgLen = strlen ((char*)mesg);
+  if (send_all (csfd, mesg, mesgLen) == -1) {
+    return -1;
+  }
+  return 0;
+}
+
+
+/******************************************************************************
+ * send_mesg_503_delta - see "reply.h"
+ *****************************************************************************/
+int send_mesg_503_delta (int csfd)
+{
+  uint8_t mesg[] = "503 Bad sequence of commands; send SITE DBASE first.\n";
+  int mesgLen;
+
+  mesgLen = strlen ((char*)mesg);
+  if (send_all (csfd, mesg, mesgLen) == -1) {
+    return -1;
+  }
+  return 0;
+}
+
+
+/******************************************************************************
+ * send_mesg_503_auth - see "reply.h"
+ *****************************************************************************/
+int send_mesg_503_auth (int csfd)
+{
+  uint8_t mesg[] = "503 Bad sequence of commands; AUTH may not be pipelined.\n";
+  int mesgLen;
+
+  mesgLen = strlen ((char*)mesg);
+  if (send_all (csfd, mesg, mesgLen) == -1) {
+    return -1;
+  }
+  return 0;
+}
+
+
 /******************************************************************************
  * send_mesg_504 - see "reply.h"
  *****************************************************************************/
@@ -470,6 +808,39 @@ int send_mesg_504 (int csfd)
 }
 
 
+/******************************************************************************
+ * send_mesg_504_port - see "reply.h"
+ *****************************************************************************/
+int send_mesg_504_port (int csfd)
+{
+  uint8_t mesg[] = "504 PORT must be the address of the client or an allowed "
+                   "FXP peer.\n";
+  int mesgLen;
+
+  mesgLen = strlen ((char*)mesg);
+  if (send_all (csfd, mesg, mesgLen) == -1) {
+    return -1;
+  }
+  return 0;
+}
+
+
+/******************************************************************************
+ * send_mesg_522 - see "reply.h"
+ *****************************************************************************/
+int send_mesg_522 (int csfd)
+{
+  uint8_t mesg[] = "522 Data connections must be encrypted; use PROT P.\n";
+  int mesgLen;
+
+  mesgLen = strlen ((char*)mesg);
+  if (send_all (csfd, mesg, mesgLen) == -1) {
+    return -1;
+  }
+  return 0;
+}
+
+
 /******************************************************************************
  * send_mesg_530 - see "reply.h"
  *****************************************************************************/
@@ -493,6 +864,38 @@ int send_mesg_530 (int csfd, char option)
 }
 
 
+/******************************************************************************
+ * send_mesg_534 - see "reply.h"
+ *****************************************************************************/
+int send_mesg_534 (int csfd)
+{
+  uint8_t mesg[] = "534 Request denied for policy reasons; use AUTH TLS.\n";
+  int mesgLen;
+
+  mesgLen = strlen ((char*)mesg);
+  if (send_all (csfd, mesg, mesgLen) == -1) {
+    return -1;
+  }
+  return 0;
+}
+
+
+/******************************************************************************
+ * send_mesg_536 - see "reply.h"
+ *****************************************************************************/
+int send_mesg_536 (int csfd)
+{
+  uint8_t mesg[] = "536 Protection level not supported; use PROT C or PROT P.\n";
+  int mesgLen;
+
+  mesgLen = strlen ((char*)mesg);
+  if (send_all (csfd, mesg, mesgLen) == -1) {
+    return -1;
+  }
+  return 0;
+}
+
+
 /******************************************************************************
  * send_mesg_550_no_argument - see "reply.h"
  *****************************************************************************/
@@ -571,3 +974,19 @@ int send_mesg_553 (int csfd)
   }
   return 0;
 }
+
+
+/******************************************************************************
+ * send_mesg_554_rest - see "reply.h"
+ *****************************************************************************/
+int send_mesg_554_rest (int csfd)
+{
+  uint8_t mesg[] = "554 Requested action not taken; invalid REST parameter.\n";
+  int mesgLen;
+
+  mesgLen = strlen ((char*)mesg);
+  if (send_all (csfd, mesg, mesgLen) == -1) {
+    return -1;
+  }
+  return 0;
+}
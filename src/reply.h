@@ -30,15 +30,23 @@
 
 #define REPLY_150_ASCII   'a'
 #define REPLY_150_BINARY  'b'
+#define REPLY_150_COPY    'c'
 
 #define REPLY_200_PORT    'p'
 #define REPLY_200_ASCII   'a'
 #define REPLY_200_IMAGE   'i'
 #define REPLY_200_STREAM  's'
+#define REPLY_200_DEFLATE 'z'
+#define REPLY_200_BLOCK   'b'
+#define REPLY_200_OPTS    'o'
 #define REPLY_200_FSTRU   'f'
+#define REPLY_200_ALLO    'l'
+#define REPLY_200_PBSZ    'u'
+#define REPLY_200_PROT    'r'
 
 #define REPLY_226_ABORT   'a'
 #define REPLY_226_SUCCESS 's'
+#define REPLY_226_KEEP    'k'
 
 #define REPLY_230_NONEED  'n'
 #define REPLY_230_SUCCESS 's'
@@ -47,9 +55,26 @@
 #define REPLY_530_FAIL    'f'
 
 
+/******************************************************************************
+ * A restart marker reply, sent for each restart marker received in a block
+ * mode upload. The client's marker is paired with the server's marker, which
+ * is the offset in the stored file that REST will resume at.
+ *
+ * Arguments:
+ *       csfd - The control socket file descriptor to send the message to.
+ *     marker - The restart marker received from the client.
+ *     offset - The matching offset in the stored file.
+ *****************************************************************************/
+int send_mesg_110 (int csfd, const char *marker, long long offset);
+
+
 /******************************************************************************
  * A positive message including the type of transfer (BINARY or ASCII), and the
  * name of the file being transferred.
+ *
+ * option: REPLY_150_ASCII  - opening an ASCII mode data connection
+ *         REPLY_150_BINARY - opening a BINARY mode data connection
+ *         REPLY_150_COPY   - a server-side copy of the file is starting
  *****************************************************************************/
 int send_mesg_150 (int csfd, const char *filename, char option);
 
@@ -62,11 +87,49 @@ int send_mesg_150 (int csfd, const char *filename, char option);
  *         REPLY_200_ASCII  - switching to ascii mode
  *         REPLY_200_IMAGE  - switching to image mode
  *         REPLY_200_STREAM - switching to stream mode
+ *         REPLY_200_DEFLATE - switching to deflate mode
+ *         REPLY_200_BLOCK  - switching to block mode
+ *         REPLY_200_OPTS   - command options were changed
  *         REPLY_200_FSTRU  - switching to File structure
+ *         REPLY_200_ALLO   - space will be reserved for the next upload
+ *         REPLY_200_PBSZ   - the protection buffer size is 0
+ *         REPLY_200_PROT   - the data protection level was changed
  *****************************************************************************/
 int send_mesg_200 (int csfd, char option);
 
 
+/******************************************************************************
+ * A positive response to OPTS HASH, naming the checksum algorithm that HASH
+ * will use.
+ *****************************************************************************/
+int send_mesg_200_hash (int csfd, const char *alg);
+
+
+/******************************************************************************
+ * A positive response to the HASH command.
+ *
+ * Arguments:
+ *   csfd - The control socket file descriptor to send the message to.
+ *    alg - The name of the checksum algorithm.
+ *   size - The size of the file, the digest covers bytes 0 to size.
+ *    hex - The digest, in hex.
+ *   path - The pathname the client sent.
+ *****************************************************************************/
+int send_mesg_213_hash (int csfd, const char *alg, long long size,
+			const char *hex, const char *path);
+
+
+/******************************************************************************
+ * The reply to STAT while a SITE CPY is running, with its progress.
+ *
+ * Arguments:
+ *   csfd - The control socket file descriptor to send the message to.
+ *   done - The bytes copied so far.
+ *   size - The size of the file being copied.
+ *****************************************************************************/
+int send_mesg_213_copy (int csfd, long long done, long long size);
+
+
 /******************************************************************************
  * Send the welcome message.
  *****************************************************************************/
@@ -108,10 +171,52 @@ int send_mesg_221 (int csfd);
  *
  * option: REPLY_226_ABORT   - abort successful
  *         REPLY_226_SUCCESS - closing data connection, file action successful
+ *         REPLY_226_KEEP    - file action successful, the block mode data
+ *                             connection is kept open
  *****************************************************************************/
 int send_mesg_226 (int csfd, char option);
 
 
+/******************************************************************************
+ * A positive response to a batch transfer, with the status of each file.
+ *
+ * Arguments:
+ *     csfd - The control socket file descriptor to send the message to.
+ *   status - Lines of " <code> <pathname>\n", one for each file.
+ *   option - As for send_mesg_226().
+ *****************************************************************************/
+int send_mesg_226_batch (int csfd, const char *status, char option);
+
+
+/******************************************************************************
+ * A positive response to SITE UNTAR, with the counts of the extraction.
+ *
+ * Arguments:
+ *      csfd - The control socket file descriptor to send the message to.
+ *     files - The files extracted.
+ *      dirs - The directories created.
+ *   skipped - The entries that were not extracted.
+ *    option - As for send_mesg_226().
+ *****************************************************************************/
+int send_mesg_226_untar (int csfd, long files, long dirs, long skipped,
+			 char option);
+
+
+/******************************************************************************
+ * A positive response to a delta transfer (SITE DSTOR or DRETR), with the
+ * bytes that crossed the data connection and those that did not need to.
+ *
+ * Arguments:
+ *      csfd - The control socket file descriptor to send the message to.
+ *      verb - "Sent" or "Received".
+ *   literal - The bytes of literal data in the delta.
+ *   matched - The bytes of the file found in the old copy.
+ *    option - As for send_mesg_226().
+ *****************************************************************************/
+int send_mesg_226_delta (int csfd, const char *verb, long long literal,
+			 long long matched, char option);
+
+
 /******************************************************************************
  * Generates a positive response message for the PASV command as specified in
  * 'RFC 959'.
@@ -147,12 +252,31 @@ int send_mesg_227 (int csfd, int dsfd);
 int send_mesg_230 (int csfd, char option);
 
 
+/******************************************************************************
+ * A positive response to AUTH TLS. The TLS handshake follows.
+ *****************************************************************************/
+int send_mesg_234 (int csfd);
+
+
 /******************************************************************************
  * A positive response for when a directory change was successful.
  *****************************************************************************/
 int send_mesg_250 (int csfd);
 
 
+/******************************************************************************
+ * A positive response to the XMD5 command, with the digest in hex.
+ *****************************************************************************/
+int send_mesg_250_hash (int csfd, const char *hex);
+
+
+/******************************************************************************
+ * A positive response to SITE CPY, with the size of the copy and the means
+ * it was copied by.
+ *****************************************************************************/
+int send_mesg_250_copy (int csfd, long long size, const char *method);
+
+
 /******************************************************************************
  * A positive response message displaying a directory name. To be used with
  * the MKD and PWD commands.
@@ -167,6 +291,29 @@ int send_mesg_257 (int csfd, const char *mesg);
 int send_mesg_331 (int csfd);
 
 
+/******************************************************************************
+ * A positive intermediate response to the REST command. The next RETR or STOR
+ * command will begin at the given offset.
+ *
+ * Arguments:
+ *     csfd - The control socket file descriptor to send the message to.
+ *   offset - The restart marker that was accepted.
+ *****************************************************************************/
+int send_mesg_350 (int csfd, long long offset);
+
+
+/******************************************************************************
+ * A positive intermediate response to the RANG command. The next RETR command
+ * will send the given range of the file.
+ *
+ * Arguments:
+ *    csfd - The control socket file descriptor to send the message to.
+ *   start - The first byte of the range.
+ *     end - The last byte of the range, or -1 if the range was reset.
+ *****************************************************************************/
+int send_mesg_350_range (int csfd, long long start, long long end);
+
+
 /******************************************************************************
  * A temporary negative response. The data connection cannot be established.
  *****************************************************************************/
@@ -179,6 +326,13 @@ int send_mesg_425 (int csfd);
 int send_mesg_426 (int csfd);
 
 
+/******************************************************************************
+ * A temporary negative response to AUTH TLS when the server has no
+ * certificate.
+ *****************************************************************************/
+int send_mesg_431 (int csfd);
+
+
 /******************************************************************************
  * A permanent negative response. Action not taken because the file is
  * unavailable.
@@ -192,6 +346,12 @@ int send_mesg_450 (int csfd);
 int send_mesg_451 (int csfd);
 
 
+/******************************************************************************
+ * A negative response sent when there is not enough storage space for a file.
+ *****************************************************************************/
+int send_mesg_452 (int csfd);
+
+
 /******************************************************************************
  * Generates a negative response message for when the command was not found.
  *****************************************************************************/
@@ -212,6 +372,25 @@ int send_mesg_501 (int csfd);
 int send_mesg_503 (int csfd);
 
 
+/******************************************************************************
+ * Negative response to AUTH TLS on a secured connection, and to PBSZ and PROT
+ * given out of order.
+ *****************************************************************************/
+int send_mesg_503_tls (int csfd);
+
+
+/******************************************************************************
+ * Negative response to SITE DRETR when no signature was sent by SITE DBASE.
+ *****************************************************************************/
+int send_mesg_503_delta (int csfd);
+
+
+/******************************************************************************
+ * Negative response to AUTH sent with other commands behind it.
+ *****************************************************************************/
+int send_mesg_503_auth (int csfd);
+
+
 /******************************************************************************
  * Generates a negative response message for when a command has not been
  * implemented.
@@ -219,6 +398,13 @@ int send_mesg_503 (int csfd);
 int send_mesg_504 (int csfd);
 
 
+/******************************************************************************
+ * A negative response to PORT with the address of a host that is neither the
+ * client nor an allowed FXP peer.
+ *****************************************************************************/
+int send_mesg_504_port (int csfd);
+
+
 /******************************************************************************
  * Generates a negative response message for when the client has entered a
  * command which requires the client to be logged in, but this requirement has
@@ -230,6 +416,27 @@ int send_mesg_504 (int csfd);
 int send_mesg_530 (int csfd, char option);
 
 
+/******************************************************************************
+ * A permanent negative response for when a transfer is started on a clear
+ * data connection while the server requires PROT P.
+ *****************************************************************************/
+int send_mesg_522 (int csfd);
+
+
+/******************************************************************************
+ * A permanent negative response for when the server requires TLS, eg. USER
+ * before AUTH TLS.
+ *****************************************************************************/
+int send_mesg_534 (int csfd);
+
+
+/******************************************************************************
+ * A permanent negative response to PROT S and PROT E, which TLS does not
+ * support.
+ *****************************************************************************/
+int send_mesg_536 (int csfd);
+
+
 /******************************************************************************
  * Generates a permanent negative response for when a user gives an argument
  * to a command which accepts no arguments.
@@ -264,4 +471,11 @@ int send_mesg_550_unavailable (int csfd);
 int send_mesg_553 (int csfd);
 
 
+/******************************************************************************
+ * A permanent negative response. The restart marker sent with the REST command
+ * cannot be used for the requested file (eg. it is past the end of the file).
+ *****************************************************************************/
+int send_mesg_554_rest (int csfd);
+
+
 #endif //__REPLY_H__
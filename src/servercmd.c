@@ -10,10 +10,16 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include "commit.h"
 #include "config.h"
 #include "ctrlthread.h"
+#include "fairsched.h"
+#include "fxp.h"
 #include "net.h"
+#include "pipeline.h"
+#include "ratelimit.h"
 #include "servercmd.h"
+#include "tls.h"
 
 
 #define MAX_SERVER_CMD_SZ 80 //Standard terminal window size.
@@ -110,6 +116,24 @@ int read_server_cmd (void)
   } else if (strcmp (cmd, "clients\n") == 0) {
     printf ("Current number of clients: %d\n", get_cthread_count());
 
+  } else if (strcmp (cmd, "commitstats\n") == 0) {
+    commit_print_stats ();
+
+  } else if (strcmp (cmd, "fxpstats\n") == 0) {
+    fxp_print_stats ();
+
+  } else if (strcmp (cmd, "pipestats\n") == 0) {
+    pipe_print_stats ();
+
+  } else if (strcmp (cmd, "ratestats\n") == 0) {
+    rate_print_stats ();
+
+  } else if (strcmp (cmd, "schedstats\n") == 0) {
+    sched_print_stats ();
+
+  } else if (strcmp (cmd, "tlsstats\n") == 0) {
+    tls_print_stats ();
+
   } else {
     printf ("Command not recognized, enter \"help\" for a list of commands.\n");
   }
@@ -125,8 +149,14 @@ static void print_help (void)
 {
   printf ("The current commands are:\n");
   printf ("\tclients\n");
+  printf ("\tcommitstats\n");
+  printf ("\tfxpstats\n");
   printf ("\thelp\n");
+  printf ("\tpipestats\n");
+  printf ("\tratestats\n");
+  printf ("\tschedstats\n");
   printf ("\tserverinfo\n");
   printf ("\tshutdown\n");
+  printf ("\ttlsstats\n");
   return;
 }
@@ -9,24 +9,39 @@
  *   a time. Handles the abort.
  *****************************************************************************/
 #include <errno.h>
+#include <fcntl.h>
 #include <pthread.h>
 #include <stdbool.h>
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 #include <sys/select.h>
 #include <sys/socket.h>
 #include <sys/types.h>
 #include <unistd.h>
+#include "checksum.h"
+#include "copy.h"
+#include "delta.h"
+#include "log.h"
 #include "net.h"
+#include "parser.h"
+#include "ratelimit.h"
 #include "reply.h"
 #include "session.h"
 #include "switch.h"
+#include "tls.h"
 #include "queue.h"
+#include "zmode.h"
 
 
 extern int shutdownServer; //Defined in the file "main.c"
 
 
+//Local function prototypes.
+static bool run_auth (session_info_t *si, queue **cmdQueuePtr);
+static bool is_stat (const char *cmd);
+
+
 /******************************************************************************
  * session - see "session.h"
  *****************************************************************************/
@@ -39,7 +54,19 @@ int session (int csfd)
   char commandstr[CMD_STRLEN];
   struct timeval timeout;
   fd_set rfds;
+  char drain[16];
+  bool pending;
+  int cmdLen;
+  off_t copyDone;
+  off_t copySize;
+  int result = 0;
   
+  //The command thread wakes select() below through this pipe once it is done.
+  if (pipe2 (sessioninfo.wakeFd, O_NONBLOCK | O_CLOEXEC) == -1) {
+    fprintf (stderr, "%s: pipe2: %s\n", __FUNCTION__, strerror (errno));
+    return -1;
+  }
+
   pthread_attr_init (&attr);
 
   //init sessioninfo
@@ -51,7 +78,23 @@ int session (int csfd)
   sessioninfo.cmdComplete = false;
   sessioninfo.user[0] = '\0';
   sessioninfo.cmdString[0] = '\0';
+  sessioninfo.cmdBufLen = 0;
+  sessioninfo.cmdDiscard = false;
   sessioninfo.type = 'a';
+  sessioninfo.restOffset = 0;
+  sessioninfo.rangeEnd = -1;
+  sessioninfo.alloSize = 0;
+  sessioninfo.mode = 's';
+  sessioninfo.zlevel = ZMODE_DEFAULT_LEVEL;
+  rate_session_start (&sessioninfo.rate);
+  sessioninfo.weight = SCHED_DEFAULT_WEIGHT;
+  sessioninfo.directIO = false;
+  sessioninfo.hashAlg = (checksum_transfer_alg () != CHECKSUM_NONE) ?
+    checksum_transfer_alg () : CHECKSUM_MD5;
+  sessioninfo.pbsz = false;
+  sessioninfo.prot = 'C';
+  copy_session_start (&sessioninfo);
+  sessioninfo.deltaBase = NULL;
   strcpy (sessioninfo.cwd, "/");
   
   commandstr[0] = '\0';
@@ -62,31 +105,63 @@ int session (int csfd)
   while (!shutdownServer && !sessioninfo.cmdQuit) {
     FD_ZERO (&rfds);
     FD_SET (csfd, &rfds);
+    FD_SET (sessioninfo.wakeFd[0], &rfds);
     timeout.tv_sec = SERVER_SHUTDOWN_TIMEOUT_SEC;
     timeout.tv_usec = SERVER_SHUTDOWN_TIMEOUT_USEC;
+
+    //A command may be buffered by read_cmd(), or a secured connection may
+    //hold a decrypted one, where select() cannot see it.
+    pending = memchr (sessioninfo.cmdBuf, '\n', sessioninfo.cmdBufLen) ||
+      tls_pending (csfd);
+    //Nor does a queued command wait, once its thread is free or can be joined.
+    if (pending || (cmdQueuePtr != NULL &&
+		    (commandThread == 0 || sessioninfo.cmdComplete)))
+      timeout.tv_sec = timeout.tv_usec = 0;
     
     //read from socket with timeout
-    if (select (csfd+1, &rfds, NULL, NULL, &timeout) == -1) {
+    if (select ((csfd > sessioninfo.wakeFd[0] ? csfd : sessioninfo.wakeFd[0]) + 1,
+		&rfds, NULL, NULL, &timeout) == -1) {
       if (errno == EINTR)
 	continue;
       fprintf (stderr, "%s: select: %s\n", __FUNCTION__, strerror (errno));
-      free_queue (cmdQueuePtr);
-      return -1;
+      result = -1;
+      break;
     }
     
+    if (FD_ISSET (sessioninfo.wakeFd[0], &rfds))
+      while (read (sessioninfo.wakeFd[0], drain, sizeof (drain)) > 0);
+
     //if there's anything to read on the control socket, do so.
-    if (FD_ISSET (csfd, &rfds)) {
-      if (read_cmd (commandstr, csfd, &sessioninfo) == -1) {
-	free_queue (cmdQueuePtr);
-	return -1;
+    if (pending || FD_ISSET (csfd, &rfds)) {
+      //The threads of the session are still stopped and joined below.
+      if ((cmdLen = read_cmd (commandstr, csfd, &sessioninfo)) == -1) {
+	result = -1;
+	break;
       }
+
+      //The connection was closed, or a whole line did not come in time.
+      if (cmdLen == 0)
+	continue;
       
-      cmdQueuePtr = add_to_queue (commandstr, cmdQueuePtr);
+      //STAT during a copy reports its progress, rather than wait for it.
+      if (is_stat (commandstr) &&
+	  copy_progress (&sessioninfo, &copyDone, &copySize)) {
+	send_mesg_213_copy (csfd, copyDone, copySize);
+	commandstr[0] = '\0';
+	continue;
+      }
+
+      //ABOR is answered below, a command thread would only refuse it again.
+      if (strncasecmp (commandstr, "ABOR", 4) != 0)
+	cmdQueuePtr = add_to_queue (commandstr, cmdQueuePtr);
     }
     
     //if command is abort (ABOR) let the current thread know
     if (strncasecmp (commandstr, "ABOR", 4) == 0) {
-      sessioninfo.cmdAbort = true;
+      //A copy is stopped alone, when no command thread is left to clear the
+      //abort.
+      if (!copy_abort (&sessioninfo) || commandThread != 0)
+	sessioninfo.cmdAbort = true;
       commandstr[0] = '\0';
       send_mesg_226 (csfd, REPLY_226_ABORT);
     }
@@ -101,18 +176,27 @@ int session (int csfd)
       
       strcpy (sessioninfo.cmdString, commandstr);
       commandstr[0] = '\0';
-      if (pthread_create (&commandThread, &attr, &command_switch, (void*) &sessioninfo) == -1) {
+
+      //AUTH is run here, since no other thread may read the connection
+      //during the handshake.
+      if (run_auth (&sessioninfo, &cmdQueuePtr))
+	continue;
+
+      if ((errno = pthread_create (&commandThread, &attr, &command_switch,
+				   (void*) &sessioninfo)) != 0) {
 	fprintf (stderr, "%s: pthread_create: %s\n", __FUNCTION__, strerror (errno));
-	free_queue (cmdQueuePtr);
-	return -1;
+	commandThread = 0;
+	result = -1;
+	break;
       }
 
       //check if the command thread is done, if so, join
     } else if (sessioninfo.cmdComplete) {
-      if (pthread_join (commandThread, NULL) == -1) {
+      if ((errno = pthread_join (commandThread, NULL)) != 0) {
 	fprintf (stderr, "%s: pthread_join: %s\n", __FUNCTION__, strerror (errno));
-	free_queue (cmdQueuePtr);
-	return -1;
+	commandThread = 0;
+	result = -1;
+	break;
       }
       commandThread = 0;
       sessioninfo.cmdString[0] = '\0';
@@ -122,25 +206,36 @@ int session (int csfd)
     //else
     //cmd_queue_ptr = addToQueue(commandstr, cmd_queue_ptr);
   }
-  //if shutdown or quit was given, abort the current thread if running
+  /* If shutdown or quit was given, abort the current thread if running. The
+   * session is cleaned up below on every way out of the loop, since the copy
+   * thread still uses it. */
   sessioninfo.cmdAbort = true;
   if (commandThread) {
-    if (pthread_join (commandThread, NULL) == -1) {
+    if ((errno = pthread_join (commandThread, NULL)) != 0) {
       fprintf (stderr, "%s: pthread_join: %s\n", __FUNCTION__, strerror (errno));
-      free_queue (cmdQueuePtr);
-      return -1;
+      result = -1;
     }
   }
   
+  //The copy thread may still send its reply on the control connection.
+  copy_session_end (&sessioninfo);
+
   //Close the data connection socket.
-  if (sessioninfo.dsfd > 0) {
-    if (close (sessioninfo.dsfd) == -1)
-      fprintf (stderr, "%s: close: %s\n", __FUNCTION__, strerror (errno));
-  }
+  if (sessioninfo.dsfd > 0)
+    end_data_conn (&sessioninfo, false);
   
+  //Free the signature of a delta download that was never made.
+  if (sessioninfo.deltaBase != NULL) {
+    delta_sig_free (sessioninfo.deltaBase);
+    free (sessioninfo.deltaBase);
+  }
+
+  rate_session_end (&sessioninfo.rate);
   free_queue (cmdQueuePtr);
   pthread_attr_destroy (&attr);
-  return 0;
+  close (sessioninfo.wakeFd[0]);
+  close (sessioninfo.wakeFd[1]);
+  return result;
 }
 
 
@@ -149,30 +244,125 @@ int session (int csfd)
  *****************************************************************************/
 int read_cmd (char *str, int sock, session_info_t *si)
 {
+  char *end;
   int rt = 0;
   int len = 0;
   
-  //keep adding rxed chars to str until \n rxed
+  //keep receiving until a whole line is buffered
   while (1) {
-    if ((rt = recv (sock, str+len, 1, 0)) == -1) {
+    end = memchr (si->cmdBuf, '\n', si->cmdBufLen);
+    if (si->cmdDiscard) {
+      //The rest of a line too long for a command is dropped up to its end,
+      //and the line is read as an empty command, which is refused.
+      if (end != NULL) {
+	si->cmdDiscard = false;
+	len = end - si->cmdBuf + 1;
+	si->cmdBufLen -= len;
+	memmove (si->cmdBuf, si->cmdBuf + len, si->cmdBufLen);
+	str[0] = '\0';
+	return len;
+      }
+      si->cmdBufLen = 0;
+    } else if (end != NULL) {
+      break;
+    } else if (si->cmdBufLen == CMD_STRLEN - 1) {
+      //No part of an over-long line is run, the tail could be any command.
+      si->cmdDiscard = true;
+      continue;
+    }
+
+    if ((rt = recv_some (sock, si->cmdBuf + si->cmdBufLen,
+			 CMD_STRLEN - 1 - si->cmdBufLen)) == -1) {
       if (errno == EINTR)
 	continue;
+      //A secured connection is waiting for the rest of a record.
+      if (errno == EAGAIN) {
+	str[0] = '\0';
+	return 0;
+      }
       fprintf (stderr, "%s: recv: %s\n", __FUNCTION__, strerror (errno));
       return -1;
     }
 
-    if (rt > 0) {      
-      len += rt;
-      if (str[len-1] == '\n') {
-	str[len-1] = '\0'; //null terminate string
-	break;
-      }
-    } else if (rt == 0) {
+    if (rt == 0) {
       si->cmdAbort = true;
       si->cmdQuit = true;
-      break;
+      str[0] = '\0';
+      return 0;
     }
+    si->cmdBufLen += rt;
   }
+
+  //copy out the line without the \n, and keep the rest for the next call
+  len = end - si->cmdBuf;
+  memcpy (str, si->cmdBuf, len);
+  str[len] = '\0'; //null terminate string
+  len++;
+  si->cmdBufLen -= len;
+  memmove (si->cmdBuf, si->cmdBuf + len, si->cmdBufLen);
   
   return len;
 }
+
+
+/******************************************************************************
+ * Run the command of the session if it is AUTH.
+ *
+ * Commands sent in plaintext after AUTH would otherwise be run as if they came
+ * over the secured connection, so AUTH is refused while any are waiting, and
+ * anything left unread is dropped once the connection is secured.
+ *
+ * Arguments:
+ *            si - The session.
+ *   cmdQueuePtr - The commands waiting to be run.
+ *
+ * Returns:
+ *   True if the command was AUTH, and has been run.
+ *****************************************************************************/
+static bool run_auth (session_info_t *si, queue **cmdQueuePtr)
+{
+  char cmdLine[CMD_STRLEN];
+  char *cmd = cmdLine;
+  char *arg;
+  int numArgs;
+
+  //The line is parsed in a copy, the command thread parses any other command.
+  strcpy (cmdLine, si->cmdString);
+  if ((numArgs = get_arg_count (cmdLine)) < 1)
+    return false;
+  arg = separate_cmd_from_args (&cmd, numArgs);
+  if (strcmp (cmd, "AUTH") != 0)
+    return false;
+
+  log_received_cmd (si->user, cmd, arg, numArgs);
+  si->cmdString[0] = '\0';
+  if (*cmdQueuePtr != NULL || si->cmdBufLen > 0) {
+    send_mesg_503_auth (si->csfd);
+    return true;
+  }
+
+  cmd_auth (si, arg);
+  if (tls_active (si->csfd)) {
+    free_queue (*cmdQueuePtr);
+    *cmdQueuePtr = NULL;
+    si->cmdBufLen = 0;
+    si->cmdDiscard = false;
+  }
+  return true;
+}
+
+
+/******************************************************************************
+ * Determine if a command line is STAT without an argument.
+ *****************************************************************************/
+static bool is_stat (const char *cmd)
+{
+  char cmdLine[CMD_STRLEN];
+  char *name = cmdLine;
+
+  strcpy (cmdLine, cmd);
+  if (get_arg_count (cmdLine) != 1)
+    return false;
+  separate_cmd_from_args (&name, 1);
+  return strcmp (name, "STAT") == 0;
+}
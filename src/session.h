@@ -12,7 +12,11 @@
 #define __SESSION_H__
 
 
+#include <pthread.h>  //Required for 'pthread_t' in structure.
 #include <stdbool.h>  //Required for 'bool' in structure.
+#include <sys/types.h> //Required for 'off_t' in structure.
+#include "fairsched.h" //Required for 'sched_flow_t' in structure.
+#include "ratelimit.h" //Required for 'rate_session_t' in structure.
 
 
 //TODO update these random, arbitrary values.
@@ -21,6 +25,9 @@
 #define ABORT_STRLEN 5
 
 
+struct delta_sig;
+
+
 /******************************************************************************
  * Timeout values for the control thread and command thread.
  *****************************************************************************/
@@ -52,10 +59,32 @@ typedef struct {
   char user[USER_STRLEN];	//username
   bool loggedin;		//whether user is logged in
   bool cmdComplete;		//command thread is complete
+  int wakeFd[2];		//pipe written when the command thread completes
   bool cmdAbort;		//command to abort
   bool cmdQuit;	         	//command to quit has been given
   char cmdString[CMD_STRLEN];	//command string for current command
+  char cmdBuf[CMD_STRLEN];	//received, not yet read by read_cmd()
+  int cmdBufLen;		//number of bytes in cmdBuf
+  bool cmdDiscard;		//the rest of an over-long line is being dropped
   char type;
+  off_t restOffset;		//REST marker for the next RETR or STOR
+  off_t rangeEnd;		//last byte of the RANG for the next RETR, or -1
+  off_t alloSize;		//ALLO size for the next STOR, APPE or STOU
+  char mode;			//transfer mode, 's'tream, 'b'lock or 'z' (deflate)
+  int zlevel;			//compression level used in MODE Z
+  rate_session_t rate;		//bandwidth limits of the session's transfers
+  int weight;			//scheduler weight of the logged in user
+  sched_flow_t flow;		//scheduling state of the current transfer
+  bool directIO;		//uploads of the logged in user bypass the page cache
+  int hashAlg;			//checksum algorithm of HASH, set by OPTS HASH
+  bool pbsz;			//PBSZ was given on the secured control connection
+  char prot;			//data protection level, 'C'lear or 'P'rivate
+  pthread_mutex_t copyLock;	//held while the SITE CPY fields below are used
+  pthread_t copyThread;		//thread of the last SITE CPY, or 0 once joined
+  bool copyAbort;		//the running SITE CPY is to stop
+  off_t copyDone;		//bytes copied by the running SITE CPY
+  off_t copySize;		//size of the file SITE CPY copies, or -1
+  struct delta_sig *deltaBase;	//signature sent by SITE DBASE, or NULL
 } session_info_t;
 
 
@@ -74,7 +103,9 @@ typedef struct {
  * has not yet been joined (terminated), any command that is not immediately
  * required to be handled will be added to a command queue. The commands quit
  * and abort are processed immediately (by changing a variable that the
- * command thread checks periodically, and terminating if appropriate).
+ * command thread checks periodically, and terminating if appropriate). A
+ * SITE CPY runs beside the command threads, ABOR also stops it, and STAT is
+ * answered immediately with its progress.
  *
  * session() monitors a global variable that is set by main to determine if the
  * program should terminate. When this variable (shutdown) has been set,
@@ -93,7 +124,10 @@ int session (int csfd);
 
 
 /******************************************************************************
- * Read a command from the control connection.
+ * Read a command from the control connection. The socket is read as much as
+ * it holds, and the lines after the first are kept in the session for the
+ * next call. A line longer than CMD_STRLEN is dropped up to its end, and read
+ * as an empty command, which is refused with 500.
  *
  * Arguments:
  *    str - A string to be set to the received command.
@@ -101,7 +135,9 @@ int session (int csfd);
  *     si - The control thread session information.
  *
  * Return values:
- *    0   success
+ *   >0   The length of the line read, with its \n.
+ *    0   The connection was closed (si->cmdQuit is set), or a secured
+ *        connection did not send the rest of a record in time. str is empty.
  *   -1   error
  *****************************************************************************/
 int read_cmd (char *str, int sock, session_info_t *si);
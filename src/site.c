@@ -0,0 +1,73 @@
+/******************************************************************************
+ * FTP-Server
+ * Author: Evan Myers
+ * Date: October 2026
+ *
+ * Description:
+ *   The SITE command. See site.h for the extensions it carries.
+ *****************************************************************************/
+#include <ctype.h>
+#include <stdio.h>
+#include <strings.h>
+#include "copy.h"
+#include "reply.h"
+#include "session.h"
+#include "site.h"
+#include "transfer.h"
+
+
+/******************************************************************************
+ * cmd_site - see site.h
+ *****************************************************************************/
+void cmd_site (session_info_t *si, char *arg)
+{
+  char *rest;
+
+  if (arg == NULL) {
+    send_mesg_501 (si->csfd);
+    return;
+  }
+
+  //Separate the name of the extension from its own argument.
+  for (rest = arg; *rest != '\0' && !isspace ((unsigned char) *rest);
+       rest++);
+  if (*rest != '\0') {
+    *rest++ = '\0';
+    while (isspace ((unsigned char) *rest))
+      rest++;
+  }
+  if (*rest == '\0')
+    rest = NULL;
+
+  //SITE CPY <SP> <pathname> <SP> <pathname> <CRLF>
+  if (strcasecmp (arg, "CPY") == 0) {
+    cmd_cpy (si, rest);
+
+    //SITE DBASE <CRLF>
+  } else if (strcasecmp (arg, "DBASE") == 0) {
+    cmd_dbase (si, rest);
+
+    //SITE DRETR <SP> <pathname> <CRLF>
+  } else if (strcasecmp (arg, "DRETR") == 0) {
+    cmd_dretr (si, rest);
+
+    //SITE DSIG <SP> <pathname> <CRLF>
+  } else if (strcasecmp (arg, "DSIG") == 0) {
+    cmd_dsig (si, rest);
+
+    //SITE DSTOR <SP> <pathname> <CRLF>
+  } else if (strcasecmp (arg, "DSTOR") == 0) {
+    cmd_dstor (si, rest);
+
+    //SITE MRETR <SP> <pathname> [<SP> <pathname> ...] <CRLF>
+  } else if (strcasecmp (arg, "MRETR") == 0) {
+    cmd_mretr (si, rest);
+
+    //SITE UNTAR <SP> <pathname> <CRLF>
+  } else if (strcasecmp (arg, "UNTAR") == 0) {
+    cmd_untar (si, rest);
+
+  } else {
+    send_mesg_504 (si->csfd);
+  }
+}
@@ -0,0 +1,53 @@
+/******************************************************************************
+ * FTP-Server
+ * Author: Evan Myers
+ * Date: October 2026
+ *
+ * Description:
+ *   The SITE command, which carries the extensions of this server. The first
+ *   word of the argument names the extension, and the rest of the argument is
+ *   given to it:
+ *
+ *     SITE CPY <SP> <pathname> <SP> <pathname>
+ *       Copy a file on the server, from the first pathname to the second
+ *       (see copy.h).
+ *
+ *     SITE DBASE
+ *       Receive the signature of the client's copy of a file, for DRETR.
+ *
+ *     SITE DRETR <SP> <pathname>
+ *       Retrieve a file as a delta against the signature sent by DBASE.
+ *
+ *     SITE DSIG <SP> <pathname>
+ *       Retrieve the signature of a file, for DSTOR.
+ *
+ *     SITE DSTOR <SP> <pathname>
+ *       Store a file as a delta against the server's copy of it (see
+ *       delta.h).
+ *
+ *     SITE MRETR <SP> <pathname> [<SP> <pathname> ...]
+ *       Retrieve a batch of files over one data connection (see cmd_mretr()
+ *       in transfer.h).
+ *
+ *     SITE UNTAR <SP> <pathname>
+ *       Extract a tar archive sent on the data connection under a directory
+ *       (see untar.h).
+ *****************************************************************************/
+#ifndef __SITE_H__
+#define __SITE_H__
+
+
+#include "session.h" //Required for 'session_info_t' in function prototype.
+
+
+/******************************************************************************
+ * Run a SITE command. An unknown extension is answered with 504.
+ *
+ * Arguments:
+ *    si - The session information.
+ *   arg - The argument of SITE, or NULL.
+ *****************************************************************************/
+void cmd_site (session_info_t *si, char *arg);
+
+
+#endif //__SITE_H__
@@ -0,0 +1,203 @@
+/******************************************************************************
+ * FTP-Server
+ * Author: Evan Myers
+ * Date: October 2026
+ *
+ * Description:
+ *   Support for sparse files. See sparse.h for an overview.
+ *
+ *   Each zero detection kernel ORs the block together a vector at a time, and
+ *   tests the result once per 256 bytes, so that a block of data is rejected
+ *   early while a block of zeros is scanned at the speed of memory. The
+ *   kernel is chosen once, from the features of the processor the server is
+ *   running on.
+ *****************************************************************************/
+#include <errno.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "config.h"
+#include "sparse.h"
+
+/* The vector kernels are compiled with per-function target attributes, so
+ * the server still runs on processors without AVX2. */
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define SPARSE_X86_SIMD
+#include <immintrin.h>
+#endif
+
+
+//The size of the buffer of zeros that holes are sent from.
+#define ZEROS_SIZE 1048576
+
+
+//Test a block of data for zeros.
+typedef bool (*zero_fn_t) (const uint8_t *data, size_t len);
+
+
+//Local function prototypes.
+static bool zero_scalar (const uint8_t *data, size_t len);
+#ifdef SPARSE_X86_SIMD
+static bool zero_sse2 (const uint8_t *data, size_t len);
+static bool zero_avx2 (const uint8_t *data, size_t len);
+#endif
+
+
+/* The setting and the kernel are written once by sparse_load_config() before
+ * any thread is created. The buffer of zeros is never written, so its pages
+ * all map the zero page of the kernel and take no memory. */
+static bool sparseStor = false;
+static zero_fn_t is_zero = zero_scalar;
+static uint8_t zeros[ZEROS_SIZE];
+
+
+/******************************************************************************
+ * sparse_load_config - see sparse.h
+ *****************************************************************************/
+void sparse_load_config (void)
+{
+  sparseStor = get_config_number ("SPARSE_STOR_CONFIG", FTP_CONFIG_FILE, 0) != 0;
+
+#ifdef SPARSE_X86_SIMD
+  __builtin_cpu_init ();
+  if (__builtin_cpu_supports ("avx2"))
+    is_zero = zero_avx2;
+  else if (__builtin_cpu_supports ("sse2"))
+    is_zero = zero_sse2;
+#endif
+}
+
+
+/******************************************************************************
+ * sparse_stor - see sparse.h
+ *****************************************************************************/
+bool sparse_stor (void)
+{
+  return sparseStor;
+}
+
+
+/******************************************************************************
+ * sparse_is_zero - see sparse.h
+ *****************************************************************************/
+bool sparse_is_zero (const uint8_t *data, size_t len)
+{
+  return is_zero (data, len);
+}
+
+
+/******************************************************************************
+ * sparse_extent - see sparse.h
+ *****************************************************************************/
+off_t sparse_extent (int fd, off_t offset, bool *hole)
+{
+  struct stat fileStat;
+  off_t data, end;
+
+  *hole = false;
+
+  if ((data = lseek (fd, offset, SEEK_DATA)) == -1) {
+    //There is no data after the offset, the rest of the file is a hole.
+    if (errno == ENXIO && fstat (fd, &fileStat) == 0 &&
+	offset < fileStat.st_size) {
+      *hole = true;
+      return fileStat.st_size;
+    }
+    return SPARSE_NO_HOLES;
+  }
+
+  if (data > offset) {
+    *hole = true;
+    return data;
+  }
+
+  //The end of the file counts as a hole.
+  if ((end = lseek (fd, offset, SEEK_HOLE)) == -1)
+    return SPARSE_NO_HOLES;
+  return end;
+}
+
+
+/******************************************************************************
+ * sparse_zeros - see sparse.h
+ *****************************************************************************/
+const uint8_t *sparse_zeros (size_t *len)
+{
+  if (len != NULL)
+    *len = sizeof (zeros);
+  return zeros;
+}
+
+
+/******************************************************************************
+ * The portable kernel, 8 bytes at a time.
+ *****************************************************************************/
+static bool zero_scalar (const uint8_t *data, size_t len)
+{
+  uint64_t acc = 0;
+  uint64_t word;
+  size_t i = 0;
+
+  for (; i + 8 <= len; i += 8) {
+    memcpy (&word, data + i, 8);
+    acc |= word;
+    if ((i & 255) == 248 && acc != 0)
+      return false;
+  }
+  for (; i < len; i++)
+    acc |= data[i];
+
+  return acc == 0;
+}
+
+
+#ifdef SPARSE_X86_SIMD
+/******************************************************************************
+ * The SSE2 kernel, 64 bytes at a time.
+ *****************************************************************************/
+__attribute__ ((target ("sse2")))
+static bool zero_sse2 (const uint8_t *data, size_t len)
+{
+  __m128i acc = _mm_setzero_si128 ();
+  size_t i = 0;
+
+  for (; i + 64 <= len; i += 64) {
+    acc = _mm_or_si128 (acc, _mm_loadu_si128 ((const __m128i *)(data + i)));
+    acc = _mm_or_si128 (acc, _mm_loadu_si128 ((const __m128i *)(data + i + 16)));
+    acc = _mm_or_si128 (acc, _mm_loadu_si128 ((const __m128i *)(data + i + 32)));
+    acc = _mm_or_si128 (acc, _mm_loadu_si128 ((const __m128i *)(data + i + 48)));
+    if ((i & 255) == 192 &&
+	_mm_movemask_epi8 (_mm_cmpeq_epi8 (acc, _mm_setzero_si128 ())) != 0xffff)
+      return false;
+  }
+  if (_mm_movemask_epi8 (_mm_cmpeq_epi8 (acc, _mm_setzero_si128 ())) != 0xffff)
+    return false;
+
+  return zero_scalar (data + i, len - i);
+}
+
+
+/******************************************************************************
+ * The AVX2 kernel, 128 bytes at a time.
+ *****************************************************************************/
+__attribute__ ((target ("avx2")))
+static bool zero_avx2 (const uint8_t *data, size_t len)
+{
+  __m256i acc = _mm256_setzero_si256 ();
+  size_t i = 0;
+
+  for (; i + 128 <= len; i += 128) {
+    acc = _mm256_or_si256 (acc, _mm256_loadu_si256 ((const __m256i *)(data + i)));
+    acc = _mm256_or_si256 (acc, _mm256_loadu_si256 ((const __m256i *)(data + i + 32)));
+    acc = _mm256_or_si256 (acc, _mm256_loadu_si256 ((const __m256i *)(data + i + 64)));
+    acc = _mm256_or_si256 (acc, _mm256_loadu_si256 ((const __m256i *)(data + i + 96)));
+    if ((i & 255) == 128 && !_mm256_testz_si256 (acc, acc))
+      return false;
+  }
+  if (!_mm256_testz_si256 (acc, acc))
+    return false;
+
+  return zero_scalar (data + i, len - i);
+}
+#endif
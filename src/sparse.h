@@ -0,0 +1,81 @@
+/******************************************************************************
+ * FTP-Server
+ * Author: Evan Myers
+ * Date: October 2026
+ *
+ * Description:
+ *   Support for sparse files, such as virtual machine images and database
+ *   dumps that are mostly zeros. An upload may leave its blocks of zeros as
+ *   holes in the stored file instead of writing them to the disk, and a
+ *   download sends the holes of a file from memory instead of reading them.
+ *****************************************************************************/
+#ifndef __SPARSE_H__
+#define __SPARSE_H__
+
+
+#include <stdbool.h>   //Required for 'bool' in function prototype.
+#include <stddef.h>    //Required for 'size_t' in function prototype.
+#include <stdint.h>    //Required for 'uint8_t' in function prototype.
+#include <sys/types.h> //Required for 'off_t' in function prototype.
+
+
+//The size of a block of zeros that is left as a hole, aligned in the file.
+#define SPARSE_BLOCK 4096
+
+//Returned by sparse_extent() when the file has no holes that can be found.
+#define SPARSE_NO_HOLES ((off_t)INT64_MAX)
+
+
+/******************************************************************************
+ * Read the sparse file settings from the server configuration file, and
+ * select the zero detection kernel for the processor. This function should
+ * be called once, by main(), before any client connects.
+ *
+ * Settings (ftp.conf):
+ *   SPARSE_STOR_CONFIG - 1 to leave the blocks of zeros of an upload as
+ *                        holes, 0 to write every byte.
+ *****************************************************************************/
+void sparse_load_config (void);
+
+
+/******************************************************************************
+ * Determine if uploads leave their blocks of zeros as holes.
+ *****************************************************************************/
+bool sparse_stor (void);
+
+
+/******************************************************************************
+ * Determine if a block of data is all zeros.
+ *****************************************************************************/
+bool sparse_is_zero (const uint8_t *data, size_t len);
+
+
+/******************************************************************************
+ * Find the extent of data or of a hole that an offset of a file lies in.
+ *
+ * Arguments:
+ *       fd - The file, open for reading. Its file offset is changed.
+ *   offset - The offset to look up.
+ *     hole - Set to true if the offset lies in a hole.
+ *
+ * Returns:
+ *   The end of the extent. SPARSE_NO_HOLES when the file system cannot find
+ *   holes, or the offset is at or past the end of the file; the offset is
+ *   then treated as data.
+ *****************************************************************************/
+off_t sparse_extent (int fd, off_t offset, bool *hole);
+
+
+/******************************************************************************
+ * Get a buffer of zeros, to send the holes of a file from.
+ *
+ * Arguments:
+ *   len - Set to the size of the buffer, unless it is NULL.
+ *
+ * Returns:
+ *   The buffer, which must not be written.
+ *****************************************************************************/
+const uint8_t *sparse_zeros (size_t *len);
+
+
+#endif //__SPARSE_H__
@@ -8,11 +8,13 @@
  *   invoked by the client and performs an appropriately related action.
  *****************************************************************************/
 #include <ctype.h>
+#include <errno.h>
 #include <stdbool.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <time.h>
+#include <unistd.h>
 #include "help.h"
 #include "misc.h"
 #include "transfer.h"
@@ -23,6 +25,8 @@
 #include "net.h"
 #include "reply.h"
 #include "session.h"
+#include "site.h"
+#include "tls.h"
 #include "user.h"
 
 
@@ -30,6 +34,10 @@
 #define MIN_NUM_ARGS 1    //Minimum allowed number of arguments.
 
 
+//Local function prototypes.
+static void command_done (session_info_t *si);
+
+
 /******************************************************************************
  * command_switch - see "switch.h"
  *****************************************************************************/
@@ -49,7 +57,7 @@ void *command_switch (void *param) {
   if (numArgs < MIN_NUM_ARGS) {
     log_received_cmd (si->user, NULL, NULL, 0);
     send_mesg_500 (csfd);
-    si->cmdComplete = true;
+    command_done (si);
     return NULL;
   }
 
@@ -69,6 +77,10 @@ void *command_switch (void *param) {
   } else if (strcmp (cmd, "CWD") == 0) {
     cmd_cwd (si, arg);
 
+    //HASH <SP> <pathname> <CRLF>
+  } else if (strcmp (cmd, "HASH") == 0) {
+    cmd_hash (si, arg, false);
+
     //HELP [<SP> <string>] <CRLF>
   } else if (strcmp (cmd, "HELP") == 0) {
     if (arg != NULL)
@@ -91,6 +103,10 @@ void *command_switch (void *param) {
   } else if (strcmp (cmd, "NLST") == 0) {
     cmd_list_nlst (si, arg, false);
 
+    //OPTS <SP> <command-name> [<SP> <command-options>] <CRLF>
+  } else if (strcmp (cmd, "OPTS") == 0) {
+    cmd_opts (si, arg);
+
     //PASS <SP> <password> <CRLF>
   } else if (strcmp (cmd, "PASS") == 0) {
     cmd_pass (si, arg);
@@ -99,10 +115,18 @@ void *command_switch (void *param) {
   } else if (strcmp (cmd, "PASV") == 0) {
     cmd_pasv (si);
 
+    //PBSZ <SP> <decimal-integer> <CRLF>
+  } else if (strcmp (cmd, "PBSZ") == 0) {
+    cmd_pbsz (si, arg);
+
     //PORT <SP> <host-port> <CRLF>
   } else if (strcmp (cmd, "PORT") == 0) {
     cmd_port (si, arg);
 
+    //PROT <SP> <prot-code> <CRLF>
+  } else if (strcmp (cmd, "PROT") == 0) {
+    cmd_prot (si, arg);
+
     //PWD <CRLF>
   } else if (strcmp (cmd, "PWD") == 0) {
     cmd_pwd (si);
@@ -111,10 +135,22 @@ void *command_switch (void *param) {
   } else if (strcmp (cmd, "QUIT") == 0) {
     cmd_quit (si);
 
+    //RANG <SP> <start-point> <SP> <end-point> <CRLF>
+  } else if (strcmp (cmd, "RANG") == 0) {
+    cmd_rang (si, arg);
+
+    //REST <SP> <marker> <CRLF>
+  } else if (strcmp (cmd, "REST") == 0) {
+    cmd_rest (si, arg);
+
     //RETR <SP> <pathname> <CRLF>
   } else if (strcmp (cmd, "RETR") == 0) {
     cmd_retr (si, arg);
 
+    //SITE <SP> <string> <CRLF>
+  } else if (strcmp (cmd, "SITE") == 0) {
+    cmd_site (si, arg);
+
     //STOR <SP> <pathname> <CRLF>
   } else if (strcmp (cmd, "STOR") == 0) {
     cmd_stor (si, arg);
@@ -139,6 +175,10 @@ void *command_switch (void *param) {
   } else if (strcmp (cmd, "USER") == 0) {
     cmd_user (si, arg);
 
+    //XMD5 <SP> <pathname> <CRLF>
+  } else if (strcmp (cmd, "XMD5") == 0) {
+    cmd_hash (si, arg, true);
+
     //ABOR <CRLF>
   } else if (strcmp (cmd, "ABOR") == 0) {
     send_mesg_504 (csfd);
@@ -149,7 +189,7 @@ void *command_switch (void *param) {
 
     //ALLO <SP> <decimal-integer> [<SP> R <SP> <decimal-integer>] <CRLF>
   } else if (strcmp (cmd, "ALLO") == 0) {
-    send_mesg_504 (csfd);
+    cmd_allo (si, arg);
 
     //DELE <SP> <pathname> <CRLF>
   } else if (strcmp (cmd, "DELE") == 0) {
@@ -163,10 +203,6 @@ void *command_switch (void *param) {
   } else if (strcmp (cmd, "REIN") == 0) {
     send_mesg_504 (csfd);
 
-    //REST <SP> <marker> <CRLF>
-  } else if (strcmp (cmd, "REST") == 0) {
-    send_mesg_504 (csfd);
-
     //RMD <SP> <pathname> <CRLF>
   } else if (strcmp (cmd, "RMD") == 0) {
     send_mesg_504 (csfd);
@@ -179,10 +215,6 @@ void *command_switch (void *param) {
   } else if (strcmp (cmd, "RNTO") == 0) {
     send_mesg_504 (csfd);
 
-    //SITE <SP> <string> <CRLF>
-  } else if (strcmp (cmd, "SITE") == 0) {
-    send_mesg_504 (csfd);
-
     //SMNT <SP> <pathname> <CRLF>
   } else if (strcmp (cmd, "SMNT") == 0) {
     send_mesg_504 (csfd);
@@ -195,6 +227,17 @@ void *command_switch (void *param) {
     send_mesg_500 (csfd);
   }
 
-  si->cmdComplete = true;
+  command_done (si);
   return NULL;
 }
+
+
+/******************************************************************************
+ * Mark the command thread complete, and wake session() to join it.
+ *****************************************************************************/
+static void command_done (session_info_t *si)
+{
+  si->cmdComplete = true;
+  if (write (si->wakeFd[1], "", 1) == -1 && errno != EAGAIN)
+    fprintf (stderr, "%s: write: %s\n", __FUNCTION__, strerror (errno));
+}
@@ -0,0 +1,571 @@
+/******************************************************************************
+ * FTP-Server
+ * Author: Evan Myers
+ * Date: October 2026
+ *
+ * Description:
+ *   Tar archives of directories. See tarstream.h for an overview.
+ *
+ *   Entries are written in the POSIX ustar format. A name that does not fit
+ *   the 100 + 155 bytes of a ustar header is written in a GNU long name
+ *   entry first, and a size of 8 GiB or more in the GNU base-256 encoding,
+ *   both of which GNU tar, bsdtar and Python's tarfile read.
+ *
+ *   The same formats are read, along with the name and size records of POSIX
+ *   extended headers, which bsdtar and Python write for long names.
+ *****************************************************************************/
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "tarstream.h"
+
+
+//The fields of a ustar header, in bytes.
+#define NAME_LEN     100
+#define PREFIX_LEN   155
+#define NUMBER_LEN   12   //The size and mtime fields.
+#define ID_LEN       8    //The mode, uid, gid and checksum fields.
+
+//The offsets of the fields of a ustar header.
+#define OFF_NAME     0
+#define OFF_MODE     100
+#define OFF_UID      108
+#define OFF_GID      116
+#define OFF_SIZE     124
+#define OFF_MTIME    136
+#define OFF_CHKSUM   148
+#define OFF_TYPE     156
+#define OFF_MAGIC    257
+#define OFF_VERSION  263
+#define OFF_PREFIX   345
+
+//The old type of a plain file, and the type of a contiguous file.
+#define TYPE_OLDFILE  '\0'
+#define TYPE_CONTIG   '7'
+
+//The name of a GNU long name entry.
+#define LONGNAME_NAME "././@LongLink"
+
+
+//Local function prototypes.
+static int make_entry (tar_walk_t *tw, const struct stat *st, int fd,
+		       tar_entry_t *entry);
+static size_t write_header (uint8_t *header, const char *name,
+			    const struct stat *st, char type, off_t size);
+static bool split_name (const char *name, size_t *split);
+static void put_number (uint8_t *field, size_t len, unsigned long long value);
+static int get_number (const uint8_t *field, size_t len,
+		       unsigned long long *value);
+static int open_dir (tar_walk_t *tw, int fd);
+static void close_file (tar_walk_t *tw);
+
+
+//Two zero blocks end an archive, and fill the last block of a file.
+static const uint8_t zeros[TAR_BLOCK * 2];
+
+
+/******************************************************************************
+ * tar_dir_name - see tarstream.h
+ *****************************************************************************/
+bool tar_dir_name (const char *path, char *dir)
+{
+  size_t len = strlen (path);
+  size_t suffixLen = strlen (TAR_SUFFIX);
+
+  if (len <= suffixLen || len - suffixLen >= PATH_MAX ||
+      strcmp (path + len - suffixLen, TAR_SUFFIX) != 0)
+    return false;
+
+  //"/.tar" has no name before the suffix.
+  if (path[len - suffixLen - 1] == '/')
+    return false;
+
+  memcpy (dir, path, len - suffixLen);
+  dir[len - suffixLen] = '\0';
+  return true;
+}
+
+
+/******************************************************************************
+ * tar_walk_start - see tarstream.h
+ *****************************************************************************/
+int tar_walk_start (tar_walk_t *tw, const char *dirpath)
+{
+  char *base;
+  int fd;
+
+  tw->depth = 0;
+  tw->fd = -1;
+  tw->started = false;
+
+  /* The directory was checked to be within the root directory, and may be
+   * reached through a link. Nothing below it is. */
+  if (realpath (dirpath, tw->path) == NULL) {
+    fprintf (stderr, "%s: realpath: %s\n", __FUNCTION__, strerror (errno));
+    return -1;
+  }
+  tw->rootLen = strlen (tw->path);
+
+  //The archive is named after the directory, as "tar cf dir.tar dir" would.
+  base = strrchr (tw->path, '/');
+  base = (base != NULL && base[1] != '\0') ? base + 1 : "root";
+  snprintf (tw->name, sizeof (tw->name), "%s", base);
+
+  if ((fd = open (tw->path, O_RDONLY | O_DIRECTORY)) == -1) {
+    fprintf (stderr, "%s: open: %s\n", __FUNCTION__, strerror (errno));
+    return -1;
+  }
+  return open_dir (tw, fd);
+}
+
+
+/******************************************************************************
+ * tar_walk_next - see tarstream.h
+ *****************************************************************************/
+int tar_walk_next (tar_walk_t *tw, tar_entry_t *entry)
+{
+  struct dirent *ep;
+  struct stat st;
+  DIR *dp;
+  size_t len;
+  int fd;
+
+  close_file (tw);
+
+  //The directory itself comes first.
+  if (!tw->started) {
+    tw->started = true;
+    if (fstat (dirfd (tw->dirs[0]), &st) == -1) {
+      fprintf (stderr, "%s: fstat: %s\n", __FUNCTION__, strerror (errno));
+      return -1;
+    }
+    return make_entry (tw, &st, -1, entry);
+  }
+
+  while (tw->depth > 0) {
+    dp = tw->dirs[tw->depth - 1];
+    len = tw->pathLens[tw->depth - 1];
+
+    errno = 0;
+    if ((ep = readdir (dp)) == NULL) {
+      if (errno != 0)
+	fprintf (stderr, "%s: readdir: %s\n", __FUNCTION__, strerror (errno));
+      closedir (dp);
+      tw->depth--;
+      continue;
+    }
+
+    //Hidden files are not listed, nor archived.
+    if (ep->d_name[0] == '.')
+      continue;
+
+    if (len + 1 + strlen (ep->d_name) >= sizeof (tw->path)) {
+      fprintf (stderr, "%s: pathname too long, '%s' skipped\n", __FUNCTION__,
+	       ep->d_name);
+      continue;
+    }
+    tw->path[len] = '/';
+    strcpy (tw->path + len + 1, ep->d_name);
+
+    /* The entry is opened in its directory without following a link, and
+     * the header is made from the status of what was opened, so the entry
+     * cannot be swapped for a link to a file outside the directory. */
+    if ((fd = openat (dirfd (dp), ep->d_name,
+		      O_RDONLY | O_NOFOLLOW | O_NONBLOCK)) == -1) {
+      if (errno != ELOOP)
+	fprintf (stderr, "%s: open: %s\n", __FUNCTION__, strerror (errno));
+      continue;
+    }
+    if (fstat (fd, &st) == -1) {
+      fprintf (stderr, "%s: fstat: %s\n", __FUNCTION__, strerror (errno));
+      close (fd);
+      continue;
+    }
+
+    if (S_ISREG (st.st_mode)) {
+      //The file is read blocking from here on.
+      fcntl (fd, F_SETFL, fcntl (fd, F_GETFL) & ~O_NONBLOCK);
+      return make_entry (tw, &st, fd, entry);
+    }
+
+    if (S_ISDIR (st.st_mode)) {
+      if (tw->depth == TAR_MAX_DEPTH) {
+	fprintf (stderr, "%s: '%s' is nested too deep, skipped\n",
+		 __FUNCTION__, tw->path);
+	close (fd);
+	continue;
+      }
+      if (open_dir (tw, fd) == -1)
+	continue;
+      return make_entry (tw, &st, -1, entry);
+    }
+    close (fd);
+  }
+
+  return 0;
+}
+
+
+/******************************************************************************
+ * tar_walk_end - see tarstream.h
+ *****************************************************************************/
+void tar_walk_end (tar_walk_t *tw)
+{
+  close_file (tw);
+  while (tw->depth > 0)
+    closedir (tw->dirs[--tw->depth]);
+}
+
+
+/******************************************************************************
+ * tar_padding - see tarstream.h
+ *****************************************************************************/
+size_t tar_padding (off_t size)
+{
+  return (TAR_BLOCK - size % TAR_BLOCK) % TAR_BLOCK;
+}
+
+
+/******************************************************************************
+ * tar_trailer - see tarstream.h
+ *****************************************************************************/
+const uint8_t *tar_trailer (size_t *len)
+{
+  *len = sizeof (zeros);
+  return zeros;
+}
+
+
+/******************************************************************************
+ * tar_read_header - see tarstream.h
+ *****************************************************************************/
+int tar_read_header (const uint8_t *block, tar_header_t *hdr)
+{
+  unsigned long long value;
+  unsigned int sum = 0;
+  size_t len;
+  size_t i;
+
+  if (memcmp (block, zeros, TAR_BLOCK) == 0)
+    return 0;
+
+  //The checksum is computed with its own field read as spaces.
+  for (i = 0; i < TAR_BLOCK; i++)
+    sum += (i >= OFF_CHKSUM && i < OFF_CHKSUM + ID_LEN) ? ' ' : block[i];
+  if (get_number (block + OFF_CHKSUM, ID_LEN, &value) == -1 || value != sum)
+    return -1;
+
+  if (get_number (block + OFF_SIZE, NUMBER_LEN, &value) == -1 ||
+      value > (unsigned long long)INT64_MAX)
+    return -1;
+  hdr->size = value;
+  if (get_number (block + OFF_MTIME, NUMBER_LEN, &value) == -1)
+    value = 0;
+  hdr->mtime = value;
+
+  hdr->type = block[OFF_TYPE];
+  if (hdr->type == TYPE_OLDFILE || hdr->type == TYPE_CONTIG)
+    hdr->type = TAR_TYPE_FILE;
+
+  /* Only a POSIX header has a prefix field, a GNU header keeps other fields
+   * in the same place. */
+  hdr->name[0] = '\0';
+  if (memcmp (block + OFF_MAGIC, "ustar", 6) == 0 &&
+      block[OFF_PREFIX] != '\0') {
+    len = strnlen ((char *)block + OFF_PREFIX, PREFIX_LEN);
+    memcpy (hdr->name, block + OFF_PREFIX, len);
+    hdr->name[len++] = '/';
+    hdr->name[len] = '\0';
+  }
+  len = strlen (hdr->name);
+  memcpy (hdr->name + len, block + OFF_NAME,
+	  strnlen ((char *)block + OFF_NAME, NAME_LEN));
+  hdr->name[len + strnlen ((char *)block + OFF_NAME, NAME_LEN)] = '\0';
+
+  return 1;
+}
+
+
+/******************************************************************************
+ * tar_read_pax - see tarstream.h
+ *****************************************************************************/
+int tar_read_pax (const char *data, size_t len, char *name, off_t *size)
+{
+  const char *end = data + len;
+  const char *key;
+  const char *value;
+  const char *eq;
+  unsigned long long number;
+  size_t recLen;
+  size_t valueLen;
+  char *numEnd;
+
+  *size = -1;
+
+  //Each record is "<length> <key>=<value>\n", the length counts the record.
+  while (data < end && *data != '\0') {
+    errno = 0;
+    recLen = strtoul (data, &numEnd, 10);
+    if (errno != 0 || numEnd == data || *numEnd != ' ' || recLen == 0 ||
+	recLen > (size_t)(end - data) || data[recLen - 1] != '\n')
+      return -1;
+
+    key = numEnd + 1;
+    if ((eq = memchr (key, '=', data + recLen - 1 - key)) == NULL)
+      return -1;
+    value = eq + 1;
+    valueLen = data + recLen - 1 - value;
+
+    if (eq - key == 4 && memcmp (key, "path", 4) == 0) {
+      if (valueLen >= PATH_MAX || memchr (value, '\0', valueLen) != NULL)
+	return -1;
+      memcpy (name, value, valueLen);
+      name[valueLen] = '\0';
+    } else if (eq - key == 4 && memcmp (key, "size", 4) == 0) {
+      errno = 0;
+      number = strtoull (value, &numEnd, 10);
+      if (errno != 0 || numEnd != value + valueLen ||
+	  number > (unsigned long long)INT64_MAX)
+	return -1;
+      *size = number;
+    }
+
+    data += recLen;
+  }
+
+  return 0;
+}
+
+
+/******************************************************************************
+ * Make the entry of the current pathname of the walk.
+ *
+ * Arguments:
+ *      tw - The walk state, 'path' is the pathname of the entry.
+ *      st - The status of the entry.
+ *      fd - The open regular file, or -1 for a directory.
+ *   entry - Set to the entry.
+ *
+ * Returns:
+ *   1, as tar_walk_next().
+ *****************************************************************************/
+static int make_entry (tar_walk_t *tw, const struct stat *st, int fd,
+		       tar_entry_t *entry)
+{
+  char name[PATH_MAX + NAME_LEN];
+  size_t len;
+
+  //The name in the archive is relative to the parent of the directory.
+  snprintf (name, sizeof (name), "%s%s%s", tw->name, tw->path + tw->rootLen,
+	    (fd == -1) ? "/" : "");
+  len = write_header (tw->header, name, st,
+		      (fd == -1) ? TAR_TYPE_DIR : TAR_TYPE_FILE,
+		      (fd == -1) ? 0 : st->st_size);
+
+  tw->fd = fd;
+  entry->header = tw->header;
+  entry->headerLen = len;
+  entry->fd = fd;
+  entry->size = (fd == -1) ? 0 : st->st_size;
+  return 1;
+}
+
+
+/******************************************************************************
+ * Write the header of an entry, preceded by a long name entry if the name
+ * does not fit a ustar header.
+ *
+ * Returns:
+ *   The length of the header, whole blocks.
+ *****************************************************************************/
+static size_t write_header (uint8_t *header, const char *name,
+			    const struct stat *st, char type, off_t size)
+{
+  uint8_t *block = header;
+  size_t nameLen = strlen (name);
+  size_t split = 0;
+  bool fits;
+  unsigned int sum = 0;
+  size_t i;
+
+  fits = split_name (name, &split);
+  if (!fits) {
+    //The long name entry, whose data is the whole name and its terminator.
+    if (nameLen >= PATH_MAX)
+      nameLen = PATH_MAX - 1;
+    write_header (block, LONGNAME_NAME, st, TAR_TYPE_LONGNAME, nameLen + 1);
+    block += TAR_BLOCK;
+    memset (block, 0, nameLen + 1 + tar_padding (nameLen + 1));
+    memcpy (block, name, nameLen);
+    block += nameLen + 1 + tar_padding (nameLen + 1);
+  }
+
+  memset (block, 0, TAR_BLOCK);
+  if (fits && split > 0) {
+    memcpy (block + OFF_PREFIX, name, split);
+    memcpy (block + OFF_NAME, name + split + 1, nameLen - split - 1);
+  } else {
+    memcpy (block + OFF_NAME, name, (nameLen > NAME_LEN) ? NAME_LEN : nameLen);
+  }
+
+  put_number (block + OFF_MODE, ID_LEN, st->st_mode & 07777);
+  put_number (block + OFF_UID, ID_LEN, st->st_uid);
+  put_number (block + OFF_GID, ID_LEN, st->st_gid);
+  put_number (block + OFF_SIZE, NUMBER_LEN, size);
+  put_number (block + OFF_MTIME, NUMBER_LEN,
+	      (st->st_mtime > 0) ? st->st_mtime : 0);
+  block[OFF_TYPE] = type;
+  memcpy (block + OFF_MAGIC, "ustar", 6);
+  memcpy (block + OFF_VERSION, "00", 2);
+
+  //The checksum is computed with its own field filled with spaces.
+  memset (block + OFF_CHKSUM, ' ', ID_LEN);
+  for (i = 0; i < TAR_BLOCK; i++)
+    sum += block[i];
+  snprintf ((char *)block + OFF_CHKSUM, ID_LEN, "%06o", sum);
+  block[OFF_CHKSUM + 7] = ' ';
+
+  return block + TAR_BLOCK - header;
+}
+
+
+/******************************************************************************
+ * Find where to split a name between the prefix and name fields of a ustar
+ * header. The split is at a '/', which is left out of both fields.
+ *
+ * Arguments:
+ *    name - The name of the entry.
+ *   split - Set to the length of the prefix, 0 when the name fits alone.
+ *
+ * Returns:
+ *   True if the name fits a ustar header.
+ *****************************************************************************/
+static bool split_name (const char *name, size_t *split)
+{
+  size_t len = strlen (name);
+  size_t i;
+
+  *split = 0;
+  if (len <= NAME_LEN)
+    return true;
+
+  //The prefix is as long as it can be, so the rest fits the name field.
+  for (i = (len - 1 < PREFIX_LEN) ? len - 1 : PREFIX_LEN; i > 0; i--) {
+    if (name[i] == '/' && len - i - 1 <= NAME_LEN && len - i - 1 > 0) {
+      *split = i;
+      return true;
+    }
+  }
+
+  return false;
+}
+
+
+/******************************************************************************
+ * Write a number into a header field in octal, with a terminator. A number
+ * too large for the field is written in base 256, marked by the high bit of
+ * the first byte (a GNU extension).
+ *****************************************************************************/
+static void put_number (uint8_t *field, size_t len, unsigned long long value)
+{
+  size_t i;
+
+  if (len - 1 >= sizeof (value) * 3 || value < (1ULL << (3 * (len - 1)))) {
+    snprintf ((char *)field, len, "%0*llo", (int)(len - 1), value);
+    return;
+  }
+
+  for (i = len; i > 1; i--) {
+    field[i - 1] = value & 0xFF;
+    value >>= 8;
+  }
+  field[0] = 0x80;
+}
+
+
+/******************************************************************************
+ * Read a number from a header field, in octal or in base 256.
+ *
+ * Return values:
+ *   0    The value is set.
+ *  -1    The field does not hold a number.
+ *****************************************************************************/
+static int get_number (const uint8_t *field, size_t len,
+		       unsigned long long *value)
+{
+  size_t i = 0;
+
+  *value = 0;
+
+  //A negative base-256 number is not a valid size or time here.
+  if (field[0] & 0x80) {
+    if (field[0] & 0x40)
+      return -1;
+    for (i = 1; i < len; i++) {
+      if (*value >> 56)
+	return -1;
+      *value = (*value << 8) | field[i];
+    }
+    return 0;
+  }
+
+  //Octal digits, which may be padded with spaces, ended by a space or NUL.
+  while (i < len && field[i] == ' ')
+    i++;
+  if (i == len || field[i] < '0' || field[i] > '7')
+    return -1;
+  for (; i < len && field[i] >= '0' && field[i] <= '7'; i++) {
+    if (*value >> 60)
+      return -1;
+    *value = (*value << 3) | (field[i] - '0');
+  }
+  if (i < len && field[i] != ' ' && field[i] != '\0')
+    return -1;
+
+  return 0;
+}
+
+
+/******************************************************************************
+ * Make an open directory, at the current pathname of the walk, the directory
+ * the walk reads next.
+ *
+ * Arguments:
+ *   tw - The walk state.
+ *   fd - The directory, closed on error.
+ *
+ * Return values:
+ *   0    success
+ *  -1    error
+ *****************************************************************************/
+static int open_dir (tar_walk_t *tw, int fd)
+{
+  DIR *dp;
+
+  if ((dp = fdopendir (fd)) == NULL) {
+    fprintf (stderr, "%s: fdopendir: %s\n", __FUNCTION__, strerror (errno));
+    close (fd);
+    return -1;
+  }
+
+  tw->dirs[tw->depth] = dp;
+  tw->pathLens[tw->depth] = strlen (tw->path);
+  tw->depth++;
+  return 0;
+}
+
+
+/******************************************************************************
+ * Close the file of the previous entry, if it has one.
+ *****************************************************************************/
+static void close_file (tar_walk_t *tw)
+{
+  if (tw->fd != -1) {
+    close (tw->fd);
+    tw->fd = -1;
+  }
+}
@@ -0,0 +1,191 @@
+/******************************************************************************
+ * FTP-Server
+ * Author: Evan Myers
+ * Date: October 2026
+ *
+ * Description:
+ *   Tar archives of directories, generated while they are sent. RETR of
+ *   "dir.tar", where no such file exists but the directory "dir" does, sends
+ *   the tree of "dir" as one ustar archive over one data connection. The
+ *   archive is never stored: the tree is walked as the transfer goes, and
+ *   each file is sent from its own descriptor, so that the transfer code can
+ *   still move the file bodies with sendfile().
+ *
+ *   Only directories and regular files are archived. Symbolic links are not
+ *   followed, so the walk cannot leave the directory, and hidden files are
+ *   skipped as they are by LIST, which also keeps out uploads in progress.
+ *
+ *   The headers of an uploaded archive are read here as well, for SITE
+ *   UNTAR (see untar.h).
+ *****************************************************************************/
+#ifndef __TARSTREAM_H__
+#define __TARSTREAM_H__
+
+
+#include <dirent.h>    //Required for 'DIR' in structure.
+#include <limits.h>    //Required for 'PATH_MAX' in structure.
+#include <stdbool.h>   //Required for 'bool' in function prototype.
+#include <stddef.h>    //Required for 'size_t' in structure.
+#include <stdint.h>    //Required for 'uint8_t' in structure.
+#include <sys/types.h> //Required for 'off_t' in structure.
+#include <time.h>      //Required for 'time_t' in structure.
+
+
+//The size of a tar block. Headers and file bodies fill whole blocks.
+#define TAR_BLOCK 512
+
+//The extension of the name that asks for the archive of a directory.
+#define TAR_SUFFIX ".tar"
+
+//The deepest directory archived, deeper directories are skipped.
+#define TAR_MAX_DEPTH 64
+
+//The entry types that are written or extracted.
+#define TAR_TYPE_FILE     '0'
+#define TAR_TYPE_DIR      '5'
+#define TAR_TYPE_LONGNAME 'L'  //GNU: the data is the name of the next entry.
+#define TAR_TYPE_PAX      'x'  //POSIX: the data holds records for the next entry.
+
+/* The largest header of one entry: a GNU long name entry with its name,
+ * followed by the ustar header. */
+#define TAR_HEADER_SZ (TAR_BLOCK * 2 + PATH_MAX)
+
+
+/******************************************************************************
+ * One entry of an archive, as returned by tar_walk_next().
+ *****************************************************************************/
+typedef struct {
+  const uint8_t *header;  //The header of the entry, whole blocks.
+  size_t headerLen;
+  int fd;                 //The file to send after the header, or -1.
+  off_t size;             //The bytes of the file announced in the header.
+} tar_entry_t;
+
+
+/******************************************************************************
+ * The header of an entry of an uploaded archive, as read by
+ * tar_read_header().
+ *****************************************************************************/
+typedef struct {
+  char name[PATH_MAX];  //The name of the entry, the prefix field included.
+  char type;            //The entry type, a plain file is always TAR_TYPE_FILE.
+  off_t size;           //The bytes of data that follow the header.
+  time_t mtime;
+} tar_header_t;
+
+
+/******************************************************************************
+ * The state of the walk of a directory tree. One of these structures is
+ * created by the command thread for each archive, and is only used by that
+ * thread.
+ *****************************************************************************/
+typedef struct {
+  DIR *dirs[TAR_MAX_DEPTH];        //The open directories, outermost first.
+  size_t pathLens[TAR_MAX_DEPTH];  //The length of 'path' at each directory.
+  int depth;                       //The number of open directories.
+  int fd;                          //The file of the last entry, or -1.
+  char path[PATH_MAX];             //The pathname of the current entry.
+  size_t rootLen;                  //The length of the archived directory.
+  char name[PATH_MAX];             //The name of the directory in the archive.
+  bool started;                    //The entry of the directory was returned.
+  uint8_t header[TAR_HEADER_SZ];
+} tar_walk_t;
+
+
+/******************************************************************************
+ * Determine if a RETR pathname asks for the archive of a directory, and get
+ * the pathname of the directory.
+ *
+ * Arguments:
+ *   path - The pathname argument of RETR.
+ *    dir - Set to the pathname without TAR_SUFFIX, at least PATH_MAX bytes.
+ *
+ * Returns:
+ *   True if the pathname ends in TAR_SUFFIX after a name.
+ *****************************************************************************/
+bool tar_dir_name (const char *path, char *dir);
+
+
+/******************************************************************************
+ * Start the walk of a directory, which must be within the root directory.
+ *
+ * Arguments:
+ *        tw - The walk state to initialize.
+ *   dirpath - The pathname of the directory on the server.
+ *
+ * Return values:
+ *   0    success
+ *  -1    error, the directory cannot be read.
+ *****************************************************************************/
+int tar_walk_start (tar_walk_t *tw, const char *dirpath);
+
+
+/******************************************************************************
+ * Get the next entry of the archive. The directory itself is the first
+ * entry, and the walk is depth first. Entries that cannot be read are
+ * skipped. The file of an entry is closed by the next call.
+ *
+ * Return values:
+ *   1    The entry is set.
+ *   0    There are no more entries.
+ *  -1    error
+ *****************************************************************************/
+int tar_walk_next (tar_walk_t *tw, tar_entry_t *entry);
+
+
+/******************************************************************************
+ * Close the walk, and the file of its last entry.
+ *****************************************************************************/
+void tar_walk_end (tar_walk_t *tw);
+
+
+/******************************************************************************
+ * Get the number of zero bytes that follow a file body of a given size, to
+ * fill its last block.
+ *****************************************************************************/
+size_t tar_padding (off_t size);
+
+
+/******************************************************************************
+ * Get the zero blocks that end an archive.
+ *
+ * Arguments:
+ *   len - Set to the length of the trailer.
+ *****************************************************************************/
+const uint8_t *tar_trailer (size_t *len);
+
+
+/******************************************************************************
+ * Read the header block of an entry of an archive.
+ *
+ * Arguments:
+ *   block - A block of TAR_BLOCK bytes.
+ *     hdr - Set to the header.
+ *
+ * Return values:
+ *   1    The header is set.
+ *   0    The block is zeros, which ends an archive.
+ *  -1    The block is not a valid header.
+ *****************************************************************************/
+int tar_read_header (const uint8_t *block, tar_header_t *hdr);
+
+
+/******************************************************************************
+ * Read the records of a POSIX extended header (TAR_TYPE_PAX), and keep the
+ * ones that apply to extraction: the name and the size of the next entry.
+ *
+ * Arguments:
+ *   data - The data of the extended header.
+ *    len - The length of the data.
+ *   name - Set to the "path" record, at least PATH_MAX bytes. Not changed
+ *          if there is none.
+ *   size - Set to the "size" record, or -1 if there is none.
+ *
+ * Return values:
+ *   0    success
+ *  -1    The records are not valid.
+ *****************************************************************************/
+int tar_read_pax (const char *data, size_t len, char *name, off_t *size);
+
+
+#endif //__TARSTREAM_H__
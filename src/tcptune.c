@@ -0,0 +1,268 @@
+/******************************************************************************
+ * FTP-Server
+ * Author: Evan Myers
+ * Date: October 2026
+ *
+ * Description:
+ *   Adaptive sizing of the transfer chunk and the data connection socket
+ *   buffers. The TCP state of the data connection (TCP_INFO) is sampled
+ *   periodically during a transfer, and the chunk and socket buffers are
+ *   resized to cover the bandwidth-delay product of the connection.
+ *****************************************************************************/
+#include <errno.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <linux/tcp.h>   //Newer than <netinet/tcp.h>, has tcpi_delivery_rate.
+#include "config.h"
+#include "tcptune.h"
+
+
+//The default values of the ftp.conf settings.
+#define DEFAULT_CHUNK       (256 * 1024)
+#define DEFAULT_CHUNK_LIMIT (4 * 1024 * 1024)
+
+//A chunk is never made smaller than this, regardless of the connection.
+#define MIN_CHUNK (64 * 1024)
+
+//The time between samples of TCP_INFO, in milliseconds.
+#define SAMPLE_INTERVAL_MSEC 200
+
+/* The socket buffer should hold twice the bandwidth-delay product, so that the
+ * pipe stays full while the application refills the buffer. */
+#define SOCKBUF_BDP_FACTOR 2
+
+
+//Local function prototypes.
+static size_t estimate_bdp (int sfd, bool sending);
+static size_t round_chunk (size_t bytes);
+static void resize_sockbuf (tcp_tune_t *tune, size_t bdp);
+static long elapsed_msec (const struct timespec *since,
+			  const struct timespec *now);
+
+
+/* The settings are read once by main() before any thread is created, and are
+ * only read afterwards. */
+static size_t startChunk = DEFAULT_CHUNK;
+static size_t chunkLimit = DEFAULT_CHUNK_LIMIT;
+
+
+/******************************************************************************
+ * tune_load_config - see tcptune.h
+ *****************************************************************************/
+void tune_load_config (void)
+{
+  chunkLimit = get_config_number ("TRANSFER_CHUNK_LIMIT_CONFIG",
+				  FTP_CONFIG_FILE, DEFAULT_CHUNK_LIMIT);
+  if (chunkLimit < MIN_CHUNK)
+    chunkLimit = MIN_CHUNK;
+
+  startChunk = get_config_number ("TRANSFER_CHUNK_CONFIG", FTP_CONFIG_FILE,
+				  DEFAULT_CHUNK);
+  startChunk = round_chunk (startChunk);
+}
+
+
+/******************************************************************************
+ * tune_start - see tcptune.h
+ *****************************************************************************/
+void tune_start (tcp_tune_t *tune, int sfd, bool sending)
+{
+  tune->sfd = sfd;
+  tune->sending = sending;
+  tune->chunk = startChunk;
+  tune->sockBuf = 0;
+  tune->buffer = NULL;
+  tune->bufferSize = 0;
+  clock_gettime (CLOCK_MONOTONIC, &tune->lastSample);
+}
+
+
+/******************************************************************************
+ * tune_update - see tcptune.h
+ *****************************************************************************/
+size_t tune_update (tcp_tune_t *tune)
+{
+  struct timespec now;
+  size_t bdp;
+
+  clock_gettime (CLOCK_MONOTONIC, &now);
+  if (elapsed_msec (&tune->lastSample, &now) < SAMPLE_INTERVAL_MSEC)
+    return tune->chunk;
+  tune->lastSample = now;
+
+  //Keep the current sizes if the connection could not be measured.
+  if ((bdp = estimate_bdp (tune->sfd, tune->sending)) == 0)
+    return tune->chunk;
+
+  tune->chunk = round_chunk (bdp);
+  resize_sockbuf (tune, bdp);
+
+  return tune->chunk;
+}
+
+
+/******************************************************************************
+ * tune_buffer - see tcptune.h
+ *****************************************************************************/
+char *tune_buffer (tcp_tune_t *tune)
+{
+  char *newBuffer;
+
+  /* Only reallocate when growing, or when the chunk has shrunk to a quarter of
+   * the buffer, so that a chunk size that moves back and forth does not
+   * reallocate on every sample. */
+  if (tune->buffer != NULL && tune->chunk <= tune->bufferSize &&
+      tune->chunk > tune->bufferSize / 4)
+    return tune->buffer;
+
+  if ((newBuffer = realloc (tune->buffer, tune->chunk)) == NULL) {
+    fprintf (stderr, "%s: realloc of %zu bytes failed\n", __FUNCTION__,
+	     tune->chunk);
+    //A smaller chunk still fits in the old buffer.
+    if (tune->buffer != NULL)
+      tune->chunk = tune->bufferSize;
+    return tune->buffer;
+  }
+
+  tune->buffer = newBuffer;
+  tune->bufferSize = tune->chunk;
+  return tune->buffer;
+}
+
+
+/******************************************************************************
+ * tune_finish - see tcptune.h
+ *****************************************************************************/
+void tune_finish (tcp_tune_t *tune)
+{
+  free (tune->buffer);
+  tune->buffer = NULL;
+  tune->bufferSize = 0;
+}
+
+
+/******************************************************************************
+ * Estimate the bandwidth-delay product of a connection from TCP_INFO.
+ *
+ * When sending, the delivery rate multiplied by the smoothed round trip time
+ * is used. Kernels that do not report a delivery rate fall back to the size
+ * of the congestion window. When receiving, the kernel's own estimate of the
+ * amount of data the sender delivers in one round trip is used.
+ *
+ * Arguments:
+ *       sfd - The connected TCP socket.
+ *   sending - True to estimate for sending, false for receiving.
+ *
+ * Returns:
+ *   The estimate in bytes, or 0 if the connection could not be measured.
+ *****************************************************************************/
+static size_t estimate_bdp (int sfd, bool sending)
+{
+  struct tcp_info info;
+  socklen_t infoLen = sizeof (info);
+  uint64_t bdp;
+
+  memset (&info, 0, sizeof (info));
+  if (getsockopt (sfd, IPPROTO_TCP, TCP_INFO, &info, &infoLen) == -1) {
+    fprintf (stderr, "%s: getsockopt: %s\n", __FUNCTION__, strerror (errno));
+    return 0;
+  }
+
+  if (!sending)
+    return info.tcpi_rcv_space;
+
+  //tcpi_delivery_rate is only reported by newer kernels.
+  if (infoLen >= offsetof (struct tcp_info, tcpi_delivery_rate) +
+      sizeof (info.tcpi_delivery_rate) && info.tcpi_delivery_rate > 0) {
+    //The rate is in bytes per second, the round trip time in microseconds.
+    bdp = info.tcpi_delivery_rate * info.tcpi_rtt / 1000000;
+  } else {
+    bdp = (uint64_t)info.tcpi_snd_cwnd * info.tcpi_snd_mss;
+  }
+
+  return (bdp > SIZE_MAX) ? SIZE_MAX : bdp;
+}
+
+
+/******************************************************************************
+ * Round a number of bytes up to a power of two, within the chunk limits. A
+ * power of two keeps the chunk aligned with pages, and stops the chunk from
+ * changing on every sample as the estimate fluctuates.
+ *
+ * Arguments:
+ *   bytes - The requested size.
+ *
+ * Returns:
+ *   The chunk size to use.
+ *****************************************************************************/
+static size_t round_chunk (size_t bytes)
+{
+  size_t chunk = MIN_CHUNK;
+
+  while (chunk < bytes && chunk < chunkLimit)
+    chunk *= 2;
+
+  return (chunk > chunkLimit) ? chunkLimit : chunk;
+}
+
+
+/******************************************************************************
+ * Resize the send or receive buffer of the socket to hold SOCKBUF_BDP_FACTOR
+ * times the bandwidth-delay product.
+ *
+ * Setting a buffer size turns off the kernel's automatic buffer tuning for the
+ * socket, so the buffer is left alone until the kernel's choice is too small.
+ * Once set, it is grown or shrunk only when it is off by more than a factor of
+ * two.
+ *
+ * Arguments:
+ *   tune - The tuning state of the transfer.
+ *    bdp - The estimated bandwidth-delay product in bytes.
+ *****************************************************************************/
+static void resize_sockbuf (tcp_tune_t *tune, size_t bdp)
+{
+  int option = tune->sending ? SO_SNDBUF : SO_RCVBUF;
+  size_t target;
+  int current;
+  int value;
+  socklen_t len = sizeof (current);
+
+  target = bdp * SOCKBUF_BDP_FACTOR;
+  if (target > chunkLimit)
+    target = chunkLimit;
+  if (target < MIN_CHUNK)
+    target = MIN_CHUNK;
+
+  if (tune->sockBuf == 0) {
+    //The kernel reports twice the usable size (see socket(7)).
+    if (getsockopt (tune->sfd, SOL_SOCKET, option, &current, &len) == -1)
+      return;
+    if (target <= (size_t)current / 2)
+      return;
+  } else if (target <= tune->sockBuf * 2 && target >= tune->sockBuf / 2) {
+    return;
+  }
+
+  value = target;
+  if (setsockopt (tune->sfd, SOL_SOCKET, option, &value, sizeof (value)) == -1) {
+    fprintf (stderr, "%s: setsockopt: %s\n", __FUNCTION__, strerror (errno));
+    return;
+  }
+  tune->sockBuf = target;
+}
+
+
+/******************************************************************************
+ * Calculate the number of milliseconds between two times.
+ *****************************************************************************/
+static long elapsed_msec (const struct timespec *since,
+			  const struct timespec *now)
+{
+  return (now->tv_sec - since->tv_sec) * 1000 +
+    (now->tv_nsec - since->tv_nsec) / 1000000;
+}
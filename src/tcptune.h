@@ -0,0 +1,99 @@
+/******************************************************************************
+ * FTP-Server
+ * Author: Evan Myers
+ * Date: October 2026
+ *
+ * Description:
+ *   Adaptive sizing of the transfer chunk and the data connection socket
+ *   buffers. The TCP state of the data connection (TCP_INFO) is sampled
+ *   periodically during a transfer, and the chunk and socket buffers are
+ *   resized to cover the bandwidth-delay product of the connection.
+ *****************************************************************************/
+#ifndef __TCPTUNE_H__
+#define __TCPTUNE_H__
+
+
+#include <stdbool.h>  //Required for 'bool' in structure.
+#include <stddef.h>   //Required for 'size_t' in structure.
+#include <time.h>     //Required for 'struct timespec' in structure.
+
+
+/******************************************************************************
+ * The tuning state of a single transfer. One of these structures is created
+ * by the command thread for each transfer, and is only used by that thread.
+ *
+ * The members of this structure should only be accessed by the functions
+ * declared in this file, with the exception of 'chunk', which may be read.
+ *****************************************************************************/
+typedef struct {
+  int sfd;                    //The data connection socket.
+  bool sending;               //The server is sending (RETR) or receiving.
+  size_t chunk;               //The current transfer chunk size in bytes.
+  size_t sockBuf;             //The socket buffer size set by us, 0 if unset.
+  char *buffer;               //A user space buffer of 'bufferSize' bytes.
+  size_t bufferSize;
+  struct timespec lastSample; //When TCP_INFO was last sampled.
+} tcp_tune_t;
+
+
+/******************************************************************************
+ * Read the transfer sizing settings from the server configuration file. This
+ * function should be called once, by main(), before any client connects.
+ *
+ * Settings (ftp.conf):
+ *   TRANSFER_CHUNK_CONFIG       - The chunk size each transfer starts with.
+ *   TRANSFER_CHUNK_LIMIT_CONFIG - The largest chunk or socket buffer that a
+ *                                 single transfer may use.
+ *****************************************************************************/
+void tune_load_config (void);
+
+
+/******************************************************************************
+ * Prepare the tuning state for a new transfer on a data connection.
+ *
+ * Arguments:
+ *      tune - The tuning state to initialize.
+ *       sfd - The data connection socket.
+ *   sending - True when the server sends on the socket, false when it
+ *             receives.
+ *****************************************************************************/
+void tune_start (tcp_tune_t *tune, int sfd, bool sending);
+
+
+/******************************************************************************
+ * Resize the transfer chunk and socket buffers if the sampling interval has
+ * passed since the last sample. This function is cheap to call between every
+ * chunk of a transfer, TCP_INFO is only read once per interval.
+ *
+ * Arguments:
+ *   tune - The tuning state of the transfer.
+ *
+ * Returns:
+ *   The chunk size to use for the next read, write, or splice.
+ *****************************************************************************/
+size_t tune_update (tcp_tune_t *tune);
+
+
+/******************************************************************************
+ * Get a user space buffer that can hold at least one chunk. The buffer is
+ * owned by the tuning state, and may move when the chunk size changes.
+ *
+ * Arguments:
+ *   tune - The tuning state of the transfer.
+ *
+ * Returns:
+ *   A pointer to the buffer, or NULL if memory could not be allocated.
+ *****************************************************************************/
+char *tune_buffer (tcp_tune_t *tune);
+
+
+/******************************************************************************
+ * Release the memory held by the tuning state of a finished transfer.
+ *
+ * Arguments:
+ *   tune - The tuning state of the transfer.
+ *****************************************************************************/
+void tune_finish (tcp_tune_t *tune);
+
+
+#endif //__TCPTUNE_H__
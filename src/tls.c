@@ -0,0 +1,761 @@
+/******************************************************************************
+ * FTP-Server
+ * Author: Evan Myers
+ * Date: October 2026
+ *
+ * Description:
+ *   FTP over TLS. See tls.h for an overview.
+ *
+ *   OpenSSL sets up kTLS itself during the handshake when SSL_OP_ENABLE_KTLS
+ *   is set and the kernel has the "tls" module and the negotiated cipher.
+ *   SSL_write() and SSL_read() on such a session are plain system calls, and
+ *   the socket may also be written with sendfile() and read with splice().
+ *
+ *   An SSL object must not be used by two threads at once. The control
+ *   connection is read by the session thread and written by command threads,
+ *   so each session is used under its own lock. A read does not block with
+ *   the lock held, so a reply can be sent while the rest of a record is
+ *   waited for.
+ *****************************************************************************/
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <poll.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <openssl/err.h>
+#include <openssl/ssl.h>
+#include "config.h"
+#include "net.h"
+#include "reply.h"
+#include "tls.h"
+
+
+//The longest a handshake or a close_notify may take, in seconds.
+#define TLS_HANDSHAKE_TIMEOUT_SEC 30
+#define TLS_SHUTDOWN_TIMEOUT_SEC  2
+
+//The longest tls_recv() waits for the rest of a record, in milliseconds.
+#define TLS_RECV_TIMEOUT_MSEC (SERVER_SHUTDOWN_TIMEOUT_SEC * 1000 + \
+			       SERVER_SHUTDOWN_TIMEOUT_USEC / 1000)
+
+//Names the sessions of this server in the session cache.
+#define TLS_SESSION_CONTEXT "ftpd"
+
+//The length of an OpenSSL error string.
+#define TLS_ERROR_LEN 256
+
+
+/* The TLS session of a socket. It is freed once it is no longer in the table
+ * and no thread uses it, so that a session ended by one thread, eg. the data
+ * connection closed by the session thread, stays valid for a command thread
+ * that is sending or receiving on it. */
+typedef struct {
+  SSL *ssl;
+  pthread_mutex_t lock;  //Held while the session is used.
+  int refs;              //The table and the users, protected by tableMutex.
+  bool kernelSend;       //The kernel encrypts what is written to the socket.
+  bool kernelRecv;       //The kernel decrypts what is read from the socket.
+} tls_conn_t;
+
+
+//Local function prototypes.
+static int handshake (int sfd, int csfd);
+static bool same_session (SSL *ssl, int csfd);
+static tls_conn_t *find_conn (int sfd);
+static void put_conn (tls_conn_t *conn);
+static int add_conn (int sfd, tls_conn_t *conn);
+static tls_conn_t *remove_conn (int sfd);
+static void set_timeout (int sfd, int seconds);
+static void print_ssl_error (const char *function, const char *call);
+
+
+/* The context and settings are written once by tls_load_config() before any
+ * thread is created. The context is NULL when TLS is not available. */
+static SSL_CTX *ctx = NULL;
+static bool tlsRequired = false;
+static bool reuseRequired = false;
+
+//The sessions of the secured sockets, indexed by socket. See tableMutex.
+static tls_conn_t **conns = NULL;
+static int numConns = 0;
+static pthread_mutex_t tableMutex = PTHREAD_MUTEX_INITIALIZER;
+
+//The totals for "tlsstats", protected by tableMutex.
+static long long handshakes = 0;
+static long long failures = 0;
+static long long resumed = 0;
+static long long kernelSends = 0;
+static long long kernelRecvs = 0;
+
+
+/******************************************************************************
+ * tls_load_config - see tls.h
+ *****************************************************************************/
+void tls_load_config (void)
+{
+  char *certPath;
+  char *keyPath;
+  long options;
+
+  tlsRequired = get_config_number ("TLS_REQUIRE_CONFIG", FTP_CONFIG_FILE, 0) != 0;
+  reuseRequired = get_config_number ("TLS_REUSE_CONFIG", FTP_CONFIG_FILE, 0) != 0;
+
+  certPath = get_config_value ("TLS_CERT_CONFIG", FTP_CONFIG_FILE);
+  keyPath = get_config_value ("TLS_KEY_CONFIG", FTP_CONFIG_FILE);
+  if (certPath == NULL || keyPath == NULL || certPath[0] == '\0' ||
+      keyPath[0] == '\0') {
+    free (certPath);
+    free (keyPath);
+    return;
+  }
+
+  if ((ctx = SSL_CTX_new (TLS_server_method ())) == NULL) {
+    print_ssl_error (__FUNCTION__, "SSL_CTX_new");
+    free (certPath);
+    free (keyPath);
+    return;
+  }
+
+  /* A peer that closes the connection without close_notify ends the data as
+   * a plain FTP connection would. Renegotiation is never needed. */
+  options = SSL_OP_IGNORE_UNEXPECTED_EOF | SSL_OP_NO_RENEGOTIATION;
+  if (get_config_number ("TLS_KTLS_CONFIG", FTP_CONFIG_FILE, 1) != 0)
+    options |= SSL_OP_ENABLE_KTLS;
+  SSL_CTX_set_options (ctx, options);
+  SSL_CTX_set_min_proto_version (ctx, TLS1_2_VERSION);
+
+  /* Data connections resume the session of the control connection. The
+   * sessions are kept in the cache of the server rather than in tickets, and
+   * a control connection is given one ticket (TLS 1.3), so that a resumed
+   * session has the ID of the session of its control connection. */
+  SSL_CTX_set_session_cache_mode (ctx, SSL_SESS_CACHE_SERVER);
+  SSL_CTX_set_options (ctx, SSL_OP_NO_TICKET);
+  SSL_CTX_set_num_tickets (ctx, 1);
+  SSL_CTX_set_session_id_context (ctx, (const unsigned char *)TLS_SESSION_CONTEXT,
+				  strlen (TLS_SESSION_CONTEXT));
+
+  if (SSL_CTX_use_certificate_chain_file (ctx, certPath) != 1 ||
+      SSL_CTX_use_PrivateKey_file (ctx, keyPath, SSL_FILETYPE_PEM) != 1 ||
+      SSL_CTX_check_private_key (ctx) != 1) {
+    print_ssl_error (__FUNCTION__, certPath);
+    fprintf (stderr, "%s: AUTH TLS is disabled\n", __FUNCTION__);
+    SSL_CTX_free (ctx);
+    ctx = NULL;
+  }
+
+  /* OpenSSL writes to the socket with write(), and sends close_notify to
+   * peers that may already be gone. Such a write must fail with EPIPE rather
+   * than end the server. */
+  if (ctx != NULL)
+    signal (SIGPIPE, SIG_IGN);
+
+  free (certPath);
+  free (keyPath);
+}
+
+
+/******************************************************************************
+ * tls_required - see tls.h
+ *****************************************************************************/
+bool tls_required (void)
+{
+  return tlsRequired;
+}
+
+
+/******************************************************************************
+ * cmd_auth - see tls.h
+ *****************************************************************************/
+void cmd_auth (session_info_t *si, char *arg)
+{
+  int csfd = si->csfd;
+
+  if (arg == NULL) {
+    send_mesg_501 (csfd);
+    return;
+  }
+
+  if (strcasecmp (arg, "TLS") != 0 && strcasecmp (arg, "TLS-C") != 0 &&
+      strcasecmp (arg, "SSL") != 0) {
+    send_mesg_504 (csfd);
+    return;
+  }
+
+  if (ctx == NULL) {
+    send_mesg_431 (csfd);
+    return;
+  }
+
+  if (tls_active (csfd)) {
+    send_mesg_503_tls (csfd);
+    return;
+  }
+
+  //The handshake starts as soon as the client reads the reply.
+  if (send_mesg_234 (csfd) == -1)
+    return;
+
+  //A failed handshake leaves the control connection unusable.
+  if (handshake (csfd, -1) == -1) {
+    si->cmdQuit = true;
+    return;
+  }
+
+  /* The security state is reset, and the user must log in again over the
+   * secured connection (RFC 2228). */
+  si->loggedin = false;
+  si->user[0] = '\0';
+  si->pbsz = false;
+  si->prot = 'C';
+}
+
+
+/******************************************************************************
+ * cmd_pbsz - see tls.h
+ *****************************************************************************/
+void cmd_pbsz (session_info_t *si, char *arg)
+{
+  int csfd = si->csfd;
+
+  if (arg == NULL) {
+    send_mesg_501 (csfd);
+    return;
+  }
+
+  if (!tls_active (csfd)) {
+    send_mesg_503_tls (csfd);
+    return;
+  }
+
+  si->pbsz = true;
+  send_mesg_200 (csfd, REPLY_200_PBSZ);
+}
+
+
+/******************************************************************************
+ * cmd_prot - see tls.h
+ *****************************************************************************/
+void cmd_prot (session_info_t *si, char *arg)
+{
+  int csfd = si->csfd;
+
+  if (arg == NULL || strlen (arg) != 1) {
+    send_mesg_501 (csfd);
+    return;
+  }
+
+  if (!si->pbsz) {
+    send_mesg_503_tls (csfd);
+    return;
+  }
+
+  switch (arg[0]) {
+  case 'C':
+  case 'c':
+    if (tlsRequired) {
+      send_mesg_534 (csfd);
+      return;
+    }
+    si->prot = 'C';
+    break;
+  case 'P':
+  case 'p':
+    si->prot = 'P';
+    break;
+  case 'S':
+  case 's':
+  case 'E':
+  case 'e':
+    send_mesg_536 (csfd);
+    return;
+  default:
+    send_mesg_504 (csfd);
+    return;
+  }
+
+  send_mesg_200 (csfd, REPLY_200_PROT);
+}
+
+
+/******************************************************************************
+ * tls_data_start - see tls.h
+ *****************************************************************************/
+int tls_data_start (session_info_t *si)
+{
+  if (si->prot != 'P') {
+    if (tlsRequired) {
+      send_mesg_522 (si->csfd);
+      end_data_conn (si, false);
+      return -1;
+    }
+    return 0;
+  }
+
+  if (tls_active (si->dsfd))
+    return 0;
+
+  if (handshake (si->dsfd, si->csfd) == -1) {
+    send_mesg_425 (si->csfd);
+    end_data_conn (si, false);
+    return -1;
+  }
+
+  return 0;
+}
+
+
+/******************************************************************************
+ * tls_end - see tls.h
+ *****************************************************************************/
+void tls_end (int sfd)
+{
+  tls_conn_t *conn;
+
+  if ((conn = remove_conn (sfd)) == NULL)
+    return;
+
+  /* Send close_notify, and wait a moment for the peer's, so that a client
+   * that checks for a clean end of the data sees one. A peer that is gone
+   * does not hold up the session. */
+  set_timeout (sfd, TLS_SHUTDOWN_TIMEOUT_SEC);
+  pthread_mutex_lock (&conn->lock);
+  if (SSL_shutdown (conn->ssl) == 0)
+    SSL_shutdown (conn->ssl);
+  pthread_mutex_unlock (&conn->lock);
+
+  put_conn (conn);
+}
+
+
+/******************************************************************************
+ * tls_active - see tls.h
+ *****************************************************************************/
+bool tls_active (int sfd)
+{
+  tls_conn_t *conn = find_conn (sfd);
+
+  put_conn (conn);
+  return conn != NULL;
+}
+
+
+/******************************************************************************
+ * tls_kernel_send - see tls.h
+ *****************************************************************************/
+bool tls_kernel_send (int sfd)
+{
+  tls_conn_t *conn = find_conn (sfd);
+  bool kernel = conn == NULL || conn->kernelSend;
+
+  put_conn (conn);
+  return kernel;
+}
+
+
+/******************************************************************************
+ * tls_kernel_recv - see tls.h
+ *****************************************************************************/
+bool tls_kernel_recv (int sfd)
+{
+  tls_conn_t *conn = find_conn (sfd);
+  bool kernel = conn == NULL || conn->kernelRecv;
+
+  put_conn (conn);
+  return kernel;
+}
+
+
+/******************************************************************************
+ * tls_pending - see tls.h
+ *****************************************************************************/
+bool tls_pending (int sfd)
+{
+  tls_conn_t *conn = find_conn (sfd);
+  int pending;
+
+  if (conn == NULL)
+    return false;
+
+  pthread_mutex_lock (&conn->lock);
+  pending = SSL_pending (conn->ssl);
+  pthread_mutex_unlock (&conn->lock);
+  put_conn (conn);
+  return pending > 0;
+}
+
+
+/******************************************************************************
+ * tls_send - see tls.h
+ *****************************************************************************/
+ssize_t tls_send (int sfd, const void *buf, size_t len)
+{
+  tls_conn_t *conn = find_conn (sfd);
+  int nsent;
+  int error;
+
+  if (conn == NULL) {
+    errno = EBADF;
+    return -1;
+  }
+  if (len > INT_MAX)
+    len = INT_MAX;
+
+  pthread_mutex_lock (&conn->lock);
+  ERR_clear_error ();
+  errno = 0;
+  if ((nsent = SSL_write (conn->ssl, buf, len)) <= 0) {
+    error = SSL_get_error (conn->ssl, nsent);
+    if (error != SSL_ERROR_SYSCALL || errno == 0)
+      errno = EIO;
+    nsent = -1;
+  }
+  pthread_mutex_unlock (&conn->lock);
+  put_conn (conn);
+
+  return nsent;
+}
+
+
+/******************************************************************************
+ * tls_recv - see tls.h
+ *****************************************************************************/
+ssize_t tls_recv (int sfd, void *buf, size_t len)
+{
+  tls_conn_t *conn = find_conn (sfd);
+  struct pollfd pfd;
+  int nrecv;
+  int error;
+  int flags;
+  int ready;
+
+  if (conn == NULL) {
+    errno = EBADF;
+    return -1;
+  }
+  if (len > INT_MAX)
+    len = INT_MAX;
+
+  pthread_mutex_lock (&conn->lock);
+  flags = fcntl (sfd, F_GETFL);
+  while (1) {
+    //The socket is only made non-blocking while the lock is held, since a
+    //blocking SSL_write() of another thread would fail otherwise.
+    fcntl (sfd, F_SETFL, flags | O_NONBLOCK);
+    ERR_clear_error ();
+    errno = 0;
+    nrecv = SSL_read (conn->ssl, buf, len);
+    error = (nrecv > 0) ? SSL_ERROR_NONE : SSL_get_error (conn->ssl, nrecv);
+    fcntl (sfd, F_SETFL, flags);
+    if (error != SSL_ERROR_WANT_READ && error != SSL_ERROR_WANT_WRITE)
+      break;
+
+    /* Wait for the rest of the record without the lock, but no longer than
+     * the session waits for a command, so that the caller sees an abort or
+     * the shutdown of the server. */
+    pthread_mutex_unlock (&conn->lock);
+    pfd.fd = sfd;
+    pfd.events = (error == SSL_ERROR_WANT_READ) ? POLLIN : POLLOUT;
+    if ((ready = poll (&pfd, 1, TLS_RECV_TIMEOUT_MSEC)) == 0)
+      errno = EAGAIN;
+    if (ready == 0 || (ready == -1 && errno != EINTR)) {
+      put_conn (conn);
+      return -1;
+    }
+    pthread_mutex_lock (&conn->lock);
+  }
+  pthread_mutex_unlock (&conn->lock);
+  put_conn (conn);
+
+  if (error == SSL_ERROR_ZERO_RETURN) {
+    nrecv = 0;
+  } else if (error != SSL_ERROR_NONE) {
+    if (error != SSL_ERROR_SYSCALL || errno == 0)
+      errno = EIO;
+    nrecv = -1;
+  }
+
+  return nrecv;
+}
+
+
+/******************************************************************************
+ * tls_print_stats - see tls.h
+ *****************************************************************************/
+void tls_print_stats (void)
+{
+  if (ctx == NULL) {
+    printf ("TLS is not available, see TLS_CERT_CONFIG.\n");
+    return;
+  }
+
+  pthread_mutex_lock (&tableMutex);
+  printf ("TLS handshakes: %lld completed, %lld failed, %lld resumed\n",
+	  handshakes, failures, resumed);
+  printf ("Kernel TLS: %lld encrypt, %lld decrypt\n", kernelSends,
+	  kernelRecvs);
+  pthread_mutex_unlock (&tableMutex);
+}
+
+
+/******************************************************************************
+ * Perform the server side of a TLS handshake on a socket, and record the
+ * session of the socket.
+ *
+ * Arguments:
+ *    sfd - The socket.
+ *   csfd - The control connection of a data connection, which may have to
+ *          resume its session, or -1 for a control connection.
+ *
+ * Return values:
+ *   0    The socket is secured.
+ *  -1    Error
+ *****************************************************************************/
+static int handshake (int sfd, int csfd)
+{
+  tls_conn_t *conn;
+  SSL *ssl;
+  bool reused;
+  bool kernelSend;
+  bool kernelRecv;
+
+  if ((ssl = SSL_new (ctx)) == NULL) {
+    print_ssl_error (__FUNCTION__, "SSL_new");
+    return -1;
+  }
+  SSL_set_fd (ssl, sfd);
+
+  //A data connection keeps the session it resumed, see same_session().
+  if (csfd != -1)
+    SSL_set_num_tickets (ssl, 0);
+
+  //A client that never completes the handshake does not hold the thread.
+  set_timeout (sfd, TLS_HANDSHAKE_TIMEOUT_SEC);
+  ERR_clear_error ();
+  if (SSL_accept (ssl) != 1) {
+    print_ssl_error (__FUNCTION__, "SSL_accept");
+    SSL_free (ssl);
+    pthread_mutex_lock (&tableMutex);
+    ++failures;
+    pthread_mutex_unlock (&tableMutex);
+    return -1;
+  }
+  set_timeout (sfd, 0);
+
+  /* Requiring the data connection to resume the session of its own control
+   * connection shows that it was opened by the client that holds it. Any
+   * other client of the server may hold a session to resume. */
+  reused = SSL_session_reused (ssl);
+  if (csfd != -1 && reuseRequired && (!reused || !same_session (ssl, csfd))) {
+    fprintf (stderr, "%s: the data connection did not resume the session of "
+	     "the control connection\n", __FUNCTION__);
+    SSL_free (ssl);
+    pthread_mutex_lock (&tableMutex);
+    ++failures;
+    pthread_mutex_unlock (&tableMutex);
+    return -1;
+  }
+
+  if ((conn = malloc (sizeof (*conn))) == NULL) {
+    fprintf (stderr, "%s: malloc: %s\n", __FUNCTION__, strerror (errno));
+    SSL_free (ssl);
+    return -1;
+  }
+  conn->ssl = ssl;
+  pthread_mutex_init (&conn->lock, NULL);
+  conn->refs = 1;
+  conn->kernelSend = kernelSend = BIO_get_ktls_send (SSL_get_wbio (ssl));
+  conn->kernelRecv = kernelRecv = BIO_get_ktls_recv (SSL_get_rbio (ssl));
+
+  //Once in the table, the session may be ended by another thread.
+  if (add_conn (sfd, conn) == -1) {
+    SSL_free (ssl);
+    pthread_mutex_destroy (&conn->lock);
+    free (conn);
+    return -1;
+  }
+
+  pthread_mutex_lock (&tableMutex);
+  ++handshakes;
+  if (reused)
+    ++resumed;
+  if (kernelSend)
+    ++kernelSends;
+  if (kernelRecv)
+    ++kernelRecvs;
+  pthread_mutex_unlock (&tableMutex);
+
+  return 0;
+}
+
+
+/******************************************************************************
+ * Determine if a resumed session is the session of a control connection.
+ *****************************************************************************/
+static bool same_session (SSL *ssl, int csfd)
+{
+  const unsigned char *id;
+  const unsigned char *ctrlId;
+  unsigned int len;
+  unsigned int ctrlLen;
+  tls_conn_t *conn;
+  bool same;
+
+  if ((conn = find_conn (csfd)) == NULL)
+    return false;
+
+  id = SSL_SESSION_get_id (SSL_get_session (ssl), &len);
+  pthread_mutex_lock (&conn->lock);
+  ctrlId = SSL_SESSION_get_id (SSL_get_session (conn->ssl), &ctrlLen);
+  same = len > 0 && len == ctrlLen && memcmp (id, ctrlId, len) == 0;
+  pthread_mutex_unlock (&conn->lock);
+  put_conn (conn);
+
+  return same;
+}
+
+
+/******************************************************************************
+ * Look up the session of a socket, and hold it until put_conn().
+ *
+ * Returns:
+ *   The session, or NULL if the socket is not secured.
+ *****************************************************************************/
+static tls_conn_t *find_conn (int sfd)
+{
+  tls_conn_t *conn = NULL;
+
+  //Without a certificate no socket is ever secured.
+  if (ctx == NULL)
+    return NULL;
+
+  pthread_mutex_lock (&tableMutex);
+  if (sfd >= 0 && sfd < numConns && (conn = conns[sfd]) != NULL)
+    ++conn->refs;
+  pthread_mutex_unlock (&tableMutex);
+
+  return conn;
+}
+
+
+/******************************************************************************
+ * Let go of a session held by find_conn() or by the table, and free it if it
+ * was the last hold. Does nothing for NULL. errno is kept for the caller.
+ *****************************************************************************/
+static void put_conn (tls_conn_t *conn)
+{
+  int savedErrno = errno;
+  bool last;
+
+  if (conn == NULL)
+    return;
+
+  pthread_mutex_lock (&tableMutex);
+  last = --conn->refs == 0;
+  pthread_mutex_unlock (&tableMutex);
+
+  if (last) {
+    SSL_free (conn->ssl);
+    pthread_mutex_destroy (&conn->lock);
+    free (conn);
+  }
+  errno = savedErrno;
+}
+
+
+/******************************************************************************
+ * Record the session of a socket, growing the table to fit the socket.
+ *
+ * Return values:
+ *   0    success
+ *  -1    error
+ *****************************************************************************/
+static int add_conn (int sfd, tls_conn_t *conn)
+{
+  tls_conn_t **table;
+  int size;
+
+  pthread_mutex_lock (&tableMutex);
+  if (sfd >= numConns) {
+    size = (numConns > 0) ? numConns : 64;
+    while (size <= sfd)
+      size *= 2;
+    if ((table = realloc (conns, size * sizeof (*table))) == NULL) {
+      fprintf (stderr, "%s: realloc: %s\n", __FUNCTION__, strerror (errno));
+      pthread_mutex_unlock (&tableMutex);
+      return -1;
+    }
+    memset (table + numConns, 0, (size - numConns) * sizeof (*table));
+    conns = table;
+    numConns = size;
+  }
+  conns[sfd] = conn;
+  pthread_mutex_unlock (&tableMutex);
+
+  return 0;
+}
+
+
+/******************************************************************************
+ * Forget the session of a socket. The hold of the table passes to the caller.
+ *
+ * Returns:
+ *   The session, or NULL if the socket was not secured.
+ *****************************************************************************/
+static tls_conn_t *remove_conn (int sfd)
+{
+  tls_conn_t *conn = NULL;
+
+  if (ctx == NULL)
+    return NULL;
+
+  pthread_mutex_lock (&tableMutex);
+  if (sfd >= 0 && sfd < numConns) {
+    conn = conns[sfd];
+    conns[sfd] = NULL;
+  }
+  pthread_mutex_unlock (&tableMutex);
+
+  return conn;
+}
+
+
+/******************************************************************************
+ * Limit how long a blocking send or receive on a socket may wait, 0 for no
+ * limit.
+ *****************************************************************************/
+static void set_timeout (int sfd, int seconds)
+{
+  struct timeval timeout;
+
+  timeout.tv_sec = seconds;
+  timeout.tv_usec = 0;
+  setsockopt (sfd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof (timeout));
+  setsockopt (sfd, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof (timeout));
+}
+
+
+/******************************************************************************
+ * Print the most recent OpenSSL error of the thread to stderr.
+ *****************************************************************************/
+static void print_ssl_error (const char *function, const char *call)
+{
+  char error[TLS_ERROR_LEN];
+  unsigned long code;
+
+  if ((code = ERR_get_error ()) == 0) {
+    fprintf (stderr, "%s: %s: %s\n", function, call,
+	     (errno != 0) ? strerror (errno) : "connection closed");
+    return;
+  }
+
+  ERR_error_string_n (code, error, sizeof (error));
+  fprintf (stderr, "%s: %s: %s\n", function, call, error);
+  ERR_clear_error ();
+}
@@ -0,0 +1,161 @@
+/******************************************************************************
+ * FTP-Server
+ * Author: Evan Myers
+ * Date: October 2026
+ *
+ * Description:
+ *   FTP over TLS (RFC 4217): the AUTH TLS, PBSZ and PROT commands, and the
+ *   TLS sessions of the control and data connections.
+ *
+ *   The session of a socket is looked up by its file descriptor, so that the
+ *   functions that send and receive on a socket (see net.h) encrypt the data
+ *   of a secured socket without their callers knowing. After the handshake
+ *   the session keys are handed to the kernel (kTLS) when it supports them.
+ *   The kernel then encrypts what is written to the socket, so a download is
+ *   still sent with sendfile() and an upload received with splice(). When
+ *   the kernel cannot take the keys, the data is encrypted in user space and
+ *   the transfers are copied instead.
+ *
+ *   Data connections resume the TLS session of the control connection when
+ *   the client offers it, which saves a full handshake per transfer.
+ *****************************************************************************/
+#ifndef __TLS_H__
+#define __TLS_H__
+
+
+#include <stdbool.h>   //Required for 'bool' in function prototype.
+#include <stddef.h>    //Required for 'size_t' in function prototype.
+#include <sys/types.h> //Required for 'ssize_t' in function prototype.
+#include "session.h"   //Required for 'session_info_t' in function prototype.
+
+
+/******************************************************************************
+ * Read the TLS settings from the server configuration file, and load the
+ * certificate of the server. This function should be called once, by main(),
+ * before any client connects. AUTH TLS is refused if the certificate cannot
+ * be loaded.
+ *
+ * Settings (ftp.conf):
+ *   TLS_CERT_CONFIG    - The certificate chain of the server (PEM), relative
+ *                        to the server executable.
+ *   TLS_KEY_CONFIG     - The private key of the certificate (PEM).
+ *   TLS_REQUIRE_CONFIG - 1 to refuse logins before AUTH TLS, and transfers
+ *                        before PROT P.
+ *   TLS_REUSE_CONFIG   - 1 to refuse a data connection that does not resume
+ *                        the TLS session of the control connection.
+ *   TLS_KTLS_CONFIG    - 1 to hand the session keys to the kernel when it
+ *                        supports them, 0 to always encrypt in user space.
+ *****************************************************************************/
+void tls_load_config (void);
+
+
+/******************************************************************************
+ * Determine if clients must secure their connections (TLS_REQUIRE_CONFIG).
+ *****************************************************************************/
+bool tls_required (void);
+
+
+/******************************************************************************
+ * AUTH TLS, secure the control connection. This command is run by the
+ * session thread rather than a command thread, so that the handshake does
+ * not race the reads of the control connection.
+ *
+ * Arguments:
+ *    si - The session information.
+ *   arg - The security mechanism, TLS (or its aliases TLS-C and SSL).
+ *****************************************************************************/
+void cmd_auth (session_info_t *si, char *arg);
+
+
+/******************************************************************************
+ * PBSZ, the protection buffer size. TLS needs no buffer, so only 0 is
+ * meaningful, and the reply is always PBSZ=0.
+ *****************************************************************************/
+void cmd_pbsz (session_info_t *si, char *arg);
+
+
+/******************************************************************************
+ * PROT, the protection level of data connections: C (clear) or P (private).
+ *****************************************************************************/
+void cmd_prot (session_info_t *si, char *arg);
+
+
+/******************************************************************************
+ * Secure the data connection of a transfer if PROT P is set. Call this after
+ * the 150 reply has been sent, since that is when the client starts its
+ * handshake. A block mode connection that is kept open stays secured.
+ *
+ * On failure a reply has been sent and the data connection is closed.
+ *
+ * Return values:
+ *   0    The data connection may be used.
+ *  -1    Error
+ *****************************************************************************/
+int tls_data_start (session_info_t *si);
+
+
+/******************************************************************************
+ * End the TLS session of a socket, sending close_notify, before the socket
+ * is closed. Does nothing for a socket that is not secured. Another thread
+ * that is sending or receiving on the socket sees an error, and the session
+ * is freed once it returns.
+ *****************************************************************************/
+void tls_end (int sfd);
+
+
+/******************************************************************************
+ * Determine if a socket is secured with TLS.
+ *****************************************************************************/
+bool tls_active (int sfd);
+
+
+/******************************************************************************
+ * Determine if data may be written to a socket directly, eg. by sendfile(),
+ * because the socket is not secured or the kernel encrypts it.
+ *****************************************************************************/
+bool tls_kernel_send (int sfd);
+
+
+/******************************************************************************
+ * Determine if data may be read from a socket directly, eg. by splice(),
+ * because the socket is not secured or the kernel decrypts it.
+ *****************************************************************************/
+bool tls_kernel_recv (int sfd);
+
+
+/******************************************************************************
+ * Determine if decrypted data of a socket is waiting in user space, where
+ * select() does not see it.
+ *****************************************************************************/
+bool tls_pending (int sfd);
+
+
+/******************************************************************************
+ * Send data on a secured socket.
+ *
+ * Return values:
+ *   >0   The number of bytes sent.
+ *   -1   Error, errno is set.
+ *****************************************************************************/
+ssize_t tls_send (int sfd, const void *buf, size_t len);
+
+
+/******************************************************************************
+ * Receive data from a secured socket.
+ *
+ * Return values:
+ *   >0   The number of bytes received.
+ *    0   The peer ended the session, or closed the connection.
+ *   -1   Error, errno is set. EAGAIN if the rest of a record did not come
+ *        within SERVER_SHUTDOWN_TIMEOUT, the call may be made again.
+ *****************************************************************************/
+ssize_t tls_recv (int sfd, void *buf, size_t len);
+
+
+/******************************************************************************
+ * Print the handshake, resumption and kernel offload counts to stdout.
+ *****************************************************************************/
+void tls_print_stats (void);
+
+
+#endif //__TLS_H__
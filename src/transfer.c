@@ -12,22 +12,107 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <strings.h>
+#include <sys/sendfile.h>
+#include <sys/stat.h>
 #include <unistd.h>
+#include <fcntl.h>
+#include <limits.h>
 #include <time.h>
 #include "transfer.h"
+#include "ascii.h"
+#include "bmode.h"
+#include "checksum.h"
+#include "commit.h"
+#include "delta.h"
+#include "fairsched.h"
 #include "net.h"
+#include "parser.h"
 #include "path.h"
+#include "pipeline.h"
+#include "ratelimit.h"
+#include "readhint.h"
 #include "reply.h"
 #include "session.h"
+#include "sparse.h"
+#include "tarstream.h"
+#include "tcptune.h"
+#include "tls.h"
+#include "untar.h"
+#include "writebehind.h"
+#include "zcache.h"
+#include "zmode.h"
+
+
+//The part of a file sent by RETR.
+struct file_range {
+  off_t offset;  //The next byte of the file to send.
+  off_t left;    //The bytes left to send, -1 to send to the end of the file.
+  read_hint_t *hint;  //The page cache hints of the file, or NULL.
+  off_t extentEnd;    //The end of the extent of data or hole at 'offset'.
+  bool hole;          //The extent is a hole, which is sent as zeros.
+};
 
 
 //Local function prototypes.
 static int perm_neg_check (session_info_t *si, char *arg);
-static void store (session_info_t *si, char *cmd, char *purp);
+static void store (session_info_t *si, char *cmd, bool append, off_t offset,
+		   off_t allocate);
+static int recv_file_copy (session_info_t *si, tcp_tune_t *tune,
+			   pipeline_t *pl, bmode_recv_t *br);
+static int recv_stream (session_info_t *si, pipe_stage_t *sink);
+static int recv_file_zero_copy (session_info_t *si, write_behind_t *wb,
+				tcp_tune_t *tune, pipeline_t *pl);
+static int drain_pipe (int pipeFd, int fileFd, size_t len, tcp_tune_t *tune);
+static int send_file_copy (session_info_t *si, int fd,
+			   struct file_range *range, tcp_tune_t *tune,
+			   pipeline_t *pl, bmode_send_t *bs);
+static int send_file_zero_copy (session_info_t *si, int fd,
+				struct file_range *range, tcp_tune_t *tune,
+				pipeline_t *pl, bmode_send_t *bs);
+static int copy_to_socket (session_info_t *si, int fd,
+			   struct file_range *range, tcp_tune_t *tune,
+			   size_t len);
+static int send_file_compressed (session_info_t *si, int fd,
+				 struct file_range *range, const char *path,
+				 const char *variant, tcp_tune_t *tune,
+				 pipeline_t *pl, zmode_stream_t *zs);
+static void retr_tar (session_info_t *si, char *path, char *dir, off_t offset,
+		      off_t end);
+static int send_tar (session_info_t *si, tar_walk_t *tw, tcp_tune_t *tune,
+		     pipeline_t *pl);
+static int send_batch (session_info_t *si, char *paths, char *status,
+		       tcp_tune_t *tune, pipeline_t *pl);
+static void retr_delta (session_info_t *si, char *path, bool delta);
+static int send_sig (session_info_t *si, int fd, off_t size, pipeline_t *pl);
+static int send_delta (session_info_t *si, delta_enc_t *enc, tcp_tune_t *tune,
+		       pipeline_t *pl);
+static int send_body (session_info_t *si, int fd, off_t size,
+		      tcp_tune_t *tune, pipeline_t *pl, bool *shrank);
+static int copy_body (session_info_t *si, int fd, struct file_range *range,
+		      tcp_tune_t *tune, pipeline_t *pl);
+static int send_zeros (pipeline_t *pl, size_t len);
+static void end_pipeline (pipeline_t *pl, zmode_stream_t *zs,
+			  ascii_conv_t *ac);
+static size_t range_clamp (const struct file_range *range, size_t len);
+static size_t range_extent (int fd, struct file_range *range, size_t len,
+			    bool *hole);
+static void range_advance (struct file_range *range, size_t len);
+static int wait_data_ready (session_info_t *si, bool forWrite);
+static size_t chunk_start (session_info_t *si, tcp_tune_t *tune);
+static void chunk_end (session_info_t *si, size_t moved);
+
+//The permissions of a newly stored file, before the umask is applied.
+#define STOR_FILE_MODE (S_IRUSR | S_IWUSR | S_IRGRP | S_IWGRP | S_IROTH | S_IWOTH)
+
+//The frame of a file of a batch, without its name: name length and size.
+#define MRETR_HEADER_LEN 10
 
+//The status line of a file of a batch, without its name: " 226 " and "\n".
+#define MRETR_STATUS_LEN 6
 
-//TODO Consolidate and check this (arbitrary?) value.
-#define BUFFSIZE 1000
+//The part of a file read at a time for its signature.
+#define DSIG_PART 1048576
 
 
 /******************************************************************************
@@ -38,13 +123,18 @@ void cmd_stou (session_info_t *si, char *arg)
   int rt;
   char tempname[256];
   char *fullpath;
+  off_t allocate = si->alloSize;
   int csfd = si->csfd;
 
+  //STOU always creates a new file, a restart marker does not apply.
+  si->restOffset = 0;
+  si->rangeEnd = -1;
+  si->alloSize = 0;
+
   //The user must be logged in on, and must not be anonymous.
   if (si->loggedin == false || strcmp (si->user, "anonymous") == 0) {
     send_mesg_530 (csfd, REPLY_530_REQUEST);
-    close (si->dsfd);
-    si->dsfd = 0;
+    end_data_conn (si, false);
     return;
   }
 
@@ -67,7 +157,7 @@ void cmd_stou (session_info_t *si, char *arg)
   } while (rt != -1);
 
   free (fullpath);
-  store (si, tempname, "w");
+  store (si, tempname, false, 0, allocate);
   return;
 }
 
@@ -77,10 +167,18 @@ void cmd_stou (session_info_t *si, char *arg)
  *****************************************************************************/
 void cmd_stor (session_info_t *si, char *cmd)
 {
+  off_t offset = si->restOffset;
+  off_t allocate = si->alloSize;
+
+  //The restart marker and ALLO size only apply to this transfer.
+  si->restOffset = 0;
+  si->rangeEnd = -1;
+  si->alloSize = 0;
+
   if (perm_neg_check (si, cmd) == -1)
     return;
   
-  store (si, cmd, "w");
+  store (si, cmd, false, offset, allocate);
   return;
 }
 
@@ -90,36 +188,67 @@ void cmd_stor (session_info_t *si, char *cmd)
  *****************************************************************************/
 void cmd_appe (session_info_t *si, char *cmd)
 {
+  off_t allocate = si->alloSize;
+
+  //APPE always writes at the end of the file, a restart marker does not apply.
+  si->restOffset = 0;
+  si->rangeEnd = -1;
+  si->alloSize = 0;
+
   if (perm_neg_check (si, cmd) == -1)
     return;
   
-  store (si, cmd, "a");
+  store (si, cmd, true, 0, allocate);
   return;
 }
 
 
 /******************************************************************************
  * Stores or appends a file to the servers file system, which action is
- * performed is determined by the 'purp' argument.
+ * performed is determined by the 'append' argument.
+ *
+ * When a restart offset is given, the first 'offset' bytes of the existing
+ * file are kept and the received data is written after them.
  *
- * Note: The purp argument characters are equivalent to the second argument to
- *       fopen(). See the fopen() manpage for a full list of options. Read
- *       options should not be passed to this function.
+ * A new or replaced file is received under a temporary name, and renamed
+ * into place once it is complete (see commit.h). An append or a restart
+ * writes the existing file in place, its size is what the client resumes
+ * from.
  *
  * Arguments:
- *   cmd - current command with parameter
- *    si - info for current session
- *  purp - "purpose", a character to be used with fopen, write or append.
+ *        si - info for current session
+ *       cmd - current command with parameter
+ *    append - Append to the file when true, otherwise replace its contents.
+ *    offset - The REST marker, 0 to replace the whole file.
+ *  allocate - The size announced by ALLO, 0 if none. The space is reserved
+ *             before the file is received.
  *****************************************************************************/
-static void store (session_info_t *si, char *cmd, char *purp)
+static void store (session_info_t *si, char *cmd, bool append, off_t offset,
+		   off_t allocate)
 {
-  struct timeval timeout;
-  fd_set rfds;
-  int nfds;
-  FILE *storfile;
-  int rv;
-  char buffer[BUFFSIZE];
+  int storFd;
+  int flags;
+  int retVal;
+  int errcode;
+  tcp_tune_t tune;  //Sizes the receive chunk and socket buffer.
+  write_behind_t wb;
+  bool direct;      //The upload bypasses the page cache.
+  bool zeroCopy;    //The upload is moved from the socket to the file by splice().
+  pipeline_t pl;
+  pipe_stage_t fileSink;
+  pipe_stage_t blockStage;
+  pipe_stage_t zlibStage;
+  pipe_stage_t asciiStage;
+  pipe_stage_t sumStage;
+  checksum_t sum;
+  bool hashed = false;  //The digest of the new file is computed.
+  zmode_stream_t zstream;
+  zmode_stream_t *zs = NULL;  //Set for a MODE Z transfer.
+  bmode_recv_t br;
+  ascii_conv_t ascii;
+  ascii_conv_t *ac = NULL;  //Set for an ASCII transfer.
   char *fullpath;   //Used to create the absolute path on the file system.
+  char *partpath;   //The temporary name of the upload, or NULL.
   int csfd = si->csfd;
   
   //Send the positive preliminary response.
@@ -136,242 +265,2379 @@ static void store (session_info_t *si, char *cmd, char *purp)
     send_mesg_425 (csfd);
     return;
   }
+
+  //Secure the data connection under PROT P.
+  if (tls_data_start (si) == -1)
+    return;
   
   /* Merge all pathname fragments to create a single pathname to use with
-   * fopen(). */
+   * open(). */
   if ((fullpath = merge_paths (si->cwd, cmd, NULL)) == NULL) {
-    cleanup_stor_recv (si, NULL, 451);
+    cleanup_stor_recv (si, -1, 451);
     return;
   }
-  
-  if ((storfile = fopen (fullpath, purp)) == NULL) {
-    fprintf (stderr, "%s: fopen: %s\n", __FUNCTION__, strerror (errno));
+
+  /* O_APPEND is not used when appending, splice() refuses to write to a file
+   * opened in append mode. Seek to the end of the file instead. A restarted
+   * upload keeps the bytes before the offset, and overwrites the rest. */
+  flags = O_WRONLY | O_CREAT;
+  partpath = NULL;
+  if (!append && offset == 0) {
+    storFd = commit_part_open (fullpath, flags | O_TRUNC, STOR_FILE_MODE,
+			       &partpath);
+  } else if ((storFd = open (fullpath, flags, STOR_FILE_MODE)) == -1) {
+    fprintf (stderr, "%s: open: %s\n", __FUNCTION__, strerror (errno));
+  }
+
+  if (storFd == -1) {
     free (fullpath);
-    cleanup_stor_recv (si, NULL, 451);
+    cleanup_stor_recv (si, -1, 451);
+    return;
   }
-  free (fullpath);
-  
-  rv = -1;
-  while ((si->cmdAbort == false) && (rv != 0)) {
-    FD_ZERO (&rfds);
-    FD_SET (si->dsfd, &rfds);
-    timeout.tv_sec = COM_THREAD_ABORT_TIMEOUT_SEC;
-    timeout.tv_usec = COM_THREAD_ABORT_TIMEOUT_USEC;
-
-    if ((nfds = select (si->dsfd + 1, &rfds, NULL, NULL, &timeout)) == -1) {
-      if (errno == EINTR)
-	continue;
-      fprintf (stderr, "%s: select: %s\n", __FUNCTION__, strerror (errno));
-      cleanup_stor_recv (si, storfile, 451);
+
+  //The digests stored with a file that is written in place go out of date.
+  if (partpath == NULL)
+    checksum_forget (storFd);
+
+  if (append && lseek (storFd, 0, SEEK_END) == -1) {
+    fprintf (stderr, "%s: lseek: %s\n", __FUNCTION__, strerror (errno));
+    commit_discard (fullpath, partpath);
+    cleanup_stor_recv (si, storFd, 451);
+    return;
+  }
+
+  /* Discard anything after the restart offset, the client is about to send
+   * the remainder of the file. */
+  if (offset > 0) {
+    if (ftruncate (storFd, offset) == -1 ||
+	lseek (storFd, offset, SEEK_SET) == -1) {
+      fprintf (stderr, "%s: restart: %s\n", __FUNCTION__, strerror (errno));
+      commit_discard (fullpath, partpath);
+      cleanup_stor_recv (si, storFd, 451);
       return;
     }
-    //check for timeout.
-    if (nfds == 0)
-      continue;
-    
-    //check if data port has rxed data
-    //TODO: Check for recv errno. Will need to add reply message.
-    if (FD_ISSET (si->dsfd, &rfds)) {
-      if ((rv = recv (si->dsfd, buffer, BUFFSIZE, 0)) > 0)
-	fwrite (buffer, sizeof(char), rv, storfile);
+  }
+
+  /* The received data passes through the stages of the transfer mode and
+   * type on its way to the file. Block framing is removed first, and ASCII
+   * line endings are translated last, so CRLF is stored as LF. */
+  pipe_file_sink (&fileSink, &wb);
+  pipe_start (&pl, &fileSink);
+  if (si->mode == 'b') {
+    bmode_recv_stage (&br, &blockStage);
+    pipe_add (&pl, &blockStage);
+  } else if (si->mode == 'z') {
+    if (zmode_start (&zstream, false, 0) == -1) {
+      commit_discard (fullpath, partpath);
+      cleanup_stor_recv (si, storFd, 451);
+      return;
     }
+    zs = &zstream;
+    zmode_stage (zs, &zlibStage);
+    pipe_add (&pl, &zlibStage);
+  }
+  if (si->type == 'a') {
+    ascii_start (&ascii);
+    ac = &ascii;
+    ascii_stage (ac, &asciiStage, false);
+    pipe_add (&pl, &asciiStage);
+  }
+
+  /* A new file is hashed as it is stored, after every other stage, so that
+   * the digest is of the bytes on the disk. */
+  if (!append && offset == 0 && checksum_transfer_alg () != CHECKSUM_NONE) {
+    checksum_start (&sum, checksum_transfer_alg ());
+    checksum_stage (&sum, &sumStage);
+    pipe_add (&pl, &sumStage);
+    hashed = true;
+  }
+
+  /* Bulk uploads of some users and directories bypass the page cache, so
+   * they do not evict the files being downloaded. */
+  direct = si->directIO || wb_dir_direct (storFd);
+
+  /* Data that passes through no stage is stored exactly as it is received,
+   * so the kernel can move it from the socket to the file without a copy.
+   * The zero copy path writes to the file itself, every other path gathers
+   * the received data into large writes. A sparse upload must see its data
+   * to find the blocks of zeros, and data the kernel does not decrypt must
+   * pass through the TLS session. */
+  zeroCopy = (pipe_zero_copy (&pl) && !direct && !sparse_stor () &&
+	      tls_kernel_recv (si->dsfd));
+  if (wb_start (&wb, storFd, !zeroCopy, direct) == -1) {
+    end_pipeline (&pl, zs, ac);
+    commit_discard (fullpath, partpath);
+    cleanup_stor_recv (si, storFd, 451);
+    return;
+  }
+
+  //Reserve the space announced by ALLO, so the file is laid out in one piece.
+  if (wb_allocate (&wb, allocate) == -1) {
+    errcode = (errno == ENOSPC || errno == EDQUOT || errno == EFBIG) ? 452 : 451;
+    end_pipeline (&pl, zs, ac);
+    //The writer thread must be done with the file before it is closed.
+    wb_end (&wb);
+    commit_discard (fullpath, partpath);
+    cleanup_stor_recv (si, storFd, errcode);
+    return;
+  }
+
+  //Restart markers are answered with offsets in the stored file.
+  if (si->mode == 'b')
+    bmode_recv_start (&br, csfd, wb.offset);
+
+  tune_start (&tune, si->dsfd, false);
+  sched_start (&si->flow, si->weight);
+  if (zeroCopy)
+    retVal = recv_file_zero_copy (si, &wb, &tune, &pl);
+  else
+    retVal = recv_file_copy (si, &tune, &pl, (si->mode == 'b') ? &br : NULL);
+  sched_end (&si->flow, retVal == 0 && si->cmdAbort == false);
+  tune_finish (&tune);
+  end_pipeline (&pl, zs, ac);
+
+  /* Write out the rest of the file. An aborted append or restart is kept for
+   * another restart, an aborted new file is removed. */
+  if (wb_flush (&wb) == -1)
+    retVal = -1;
+  wb_end (&wb);
+
+  if (retVal == -1) {
+    si->cmdAbort = false;
+    commit_discard (fullpath, partpath);
+    cleanup_stor_recv (si, storFd, 451);
+    return;
   }
   
   if (si->cmdAbort) {
     send_mesg_426 (csfd);
     si->cmdAbort = false;
-  } else {
-    send_mesg_226 (csfd, REPLY_226_SUCCESS);
+    commit_discard (fullpath, partpath);
+    cleanup_stor_recv (si, storFd, 0);
+    return;
   }
-  
-  //Close the file and the data connection.
-  cleanup_stor_recv (si, storfile, 0);
+
+  //Keep the digest with the file, it is renamed along with it.
+  if (hashed)
+    checksum_save (&sum, storFd);
+
+  //Rename the complete file into place, flushed to the disk if required.
+  if (commit_upload (storFd, partpath, fullpath) == -1) {
+    commit_discard (fullpath, partpath);
+    cleanup_stor_recv (si, storFd, 451);
+    return;
+  }
+  free (partpath);
+  free (fullpath);
+
+  //Close the file, and the data connection unless block mode keeps it open.
+  if (close (storFd) == -1)
+    fprintf (stderr, "%s: close: %s\n", __FUNCTION__, strerror (errno));
+  end_data_conn (si, true);
+
+  send_mesg_226 (csfd, (si->dsfd != 0) ? REPLY_226_KEEP : REPLY_226_SUCCESS);
   return;
 }
 
 
 /******************************************************************************
- * cmd_retr - see "transfer.h"
+ * cmd_untar - see "transfer.h"
  *****************************************************************************/
-void cmd_retr (session_info_t *si, char *path)
+void cmd_untar (session_info_t *si, char *dir)
 {
-  struct timeval timeout;
-  fd_set wfds;
-  FILE *retrFile;
-  bool fileCheck;
   int retVal;
-  int selVal;
-  char buffer[BUFFSIZE];
+  tcp_tune_t tune;
+  untar_t ut;
+  pipeline_t pl;
+  pipe_stage_t untarSink;
+  pipe_stage_t blockStage;
+  pipe_stage_t zlibStage;
+  zmode_stream_t zstream;
+  zmode_stream_t *zs = NULL;  //Set for a MODE Z transfer.
+  bmode_recv_t br;
   char *fullpath;
+  off_t offset = si->restOffset;
   int csfd = si->csfd;
 
-  if (si->loggedin == false) {
+  //The restart marker and ALLO size only apply to this transfer.
+  si->restOffset = 0;
+  si->rangeEnd = -1;
+  si->alloSize = 0;
+
+  if (si->loggedin == false || strcmp (si->user, "anonymous") == 0) {
     send_mesg_530 (csfd, REPLY_530_REQUEST);
+    end_data_conn (si, false);
     return;
   }
 
-  if (!(fileCheck = check_file_exist(si->cwd, path))) {
-    send_mesg_553 (si->csfd);
+  if (dir == NULL) {
+    send_mesg_501 (csfd);
     return;
   }
 
-  //Send the positive preliminary response.
-  if (si->type == 'a') {
-    send_mesg_150 (csfd, path, REPLY_150_ASCII);
-  } else {
-    send_mesg_150 (csfd, path, REPLY_150_BINARY);
+  //An archive is extracted as it arrives, it cannot be resumed.
+  if (offset > 0) {
+    send_mesg_554_rest (csfd);
+    return;
+  }
+
+  if (!check_dir_exist (si->cwd, dir)) {
+    send_mesg_550_no_dir (csfd);
+    return;
   }
 
+  send_mesg_150 (csfd, dir, REPLY_150_BINARY);
+
   if (si->dsfd == 0) {
     send_mesg_425 (csfd);
     return;
   }
 
-  if ((fullpath = merge_paths (si->cwd, path, NULL)) == NULL) {
-    send_mesg_451 (si->csfd);
-    close (si->dsfd);
-    si->dsfd = 0;
+  //Secure the data connection under PROT P.
+  if (tls_data_start (si) == -1)
     return;
-  }
 
-  if ((retrFile = fopen (fullpath, "r")) == NULL) {
-    fprintf (stderr, "%s: fopen: %s\n", __FUNCTION__, strerror (errno));
+  if ((fullpath = merge_paths (si->cwd, dir, NULL)) == NULL ||
+      untar_start (&ut, fullpath) == -1) {
     free (fullpath);
-    send_mesg_451 (si->csfd);
-    close (si->dsfd);
-    si->dsfd = 0;
+    send_mesg_451 (csfd);
+    end_data_conn (si, false);
+    return;
   }
-
   free (fullpath);
-  retVal = BUFFSIZE;
 
-  while ((si->cmdAbort == false) && (retVal != 0)) {
-    FD_ZERO (&wfds);
-    FD_SET (si->dsfd, &wfds);
-    timeout.tv_sec = COM_THREAD_ABORT_TIMEOUT_SEC;
-    timeout.tv_usec = COM_THREAD_ABORT_TIMEOUT_USEC;
-    selVal = select ((si->dsfd + 1), NULL, &wfds, NULL, &timeout);
+  //The archive is read after the block framing or compression is removed.
+  untar_stage (&ut, &untarSink);
+  pipe_start (&pl, &untarSink);
+  if (si->mode == 'b') {
+    bmode_recv_stage (&br, &blockStage);
+    pipe_add (&pl, &blockStage);
+    bmode_recv_start (&br, csfd, 0);
+  } else if (si->mode == 'z' && zmode_start (&zstream, false, 0) == 0) {
+    zs = &zstream;
+    zmode_stage (zs, &zlibStage);
+    pipe_add (&pl, &zlibStage);
+  }
 
+  tune_start (&tune, si->dsfd, false);
+  sched_start (&si->flow, si->weight);
+  retVal = (si->mode == 'z' && zs == NULL) ? -1 :
+    recv_file_copy (si, &tune, &pl, (si->mode == 'b') ? &br : NULL);
+  sched_end (&si->flow, retVal == 0 && si->cmdAbort == false);
+  tune_finish (&tune);
+  end_pipeline (&pl, zs, NULL);
 
-    if (selVal == -1) {
-      if (errno == EINTR) {
-	continue;
-      }
-      fprintf (stderr, "%s: select: %s\n", __FUNCTION__, strerror (errno));
-      send_mesg_451 (si->csfd);
-      close (si->dsfd);
-      si->dsfd = 0;
-      return;
-    } else if (selVal == 0) {
-      continue;
-    }
+  //Wait for the writers, the reply counts the files they wrote.
+  untar_end (&ut, retVal == 0 && si->cmdAbort == false);
 
-    if (FD_ISSET (si->dsfd, &wfds)) {
-      if ((retVal = fread(buffer, sizeof(*buffer), BUFFSIZE, retrFile)) == 0) {
-	if (ferror (retrFile)) {
-	  fprintf (stderr, "%s: fread: error while processing\n", __FUNCTION__);
-	  send_mesg_451 (si->csfd);
-	  close (si->dsfd);
-	  si->dsfd = 0;
-	  return;
-	} else if (feof (retrFile)) {
-	  break;
-	}
-      }
+  //Block mode keeps the data connection open after a complete transfer.
+  end_data_conn (si, retVal == 0 && si->cmdAbort == false);
 
-      //Send the file over the data connection.
-      if (send_all (si->dsfd, (uint8_t *)buffer, retVal) == -1) {
-	send_mesg_451 (csfd);
-	close (si->dsfd);
-	si->dsfd = 0;
-	return;
-      }
-    }
+  if (retVal == -1 || ut.failed > 0) {
+    send_mesg_451 (csfd);
+    si->cmdAbort = false;
+  } else if (si->cmdAbort == true) {
+    send_mesg_426 (csfd);
+    si->cmdAbort = false;
+  } else {
+    send_mesg_226_untar (csfd, ut.files, ut.dirs, ut.skipped,
+			 (si->dsfd != 0) ? REPLY_226_KEEP : REPLY_226_SUCCESS);
   }
+}
+
+/******************************************************************************
+ * cmd_dstor - see "transfer.h"
+ *****************************************************************************/
+void cmd_dstor (session_info_t *si, char *path)
+{
+  pipe_stage_t deltaSink;
+  delta_dec_t dec;
+  struct stat basisStat;
+  char *fullpath = NULL;
+  char *partpath = NULL;
+  int basis = -1;
+  int out = -1;
+  int retVal;
+  off_t offset = si->restOffset;
+  int csfd = si->csfd;
 
+  //The restart marker and ALLO size only apply to this transfer.
+  si->restOffset = 0;
+  si->rangeEnd = -1;
+  si->alloSize = 0;
 
-  if (fclose (retrFile) == EOF) {
-    fprintf (stderr, "%s: fclose: %s\n", __FUNCTION__, strerror (errno));
+  if (path == NULL) {
+    send_mesg_501 (csfd);
+    return;
   }
- 
-  if (close (si->dsfd) == -1) {
-    fprintf (stderr, "%s: close: %s\n", __FUNCTION__, strerror (errno));
+
+  if (perm_neg_check (si, path) == -1)
+    return;
+
+  //The file is rebuilt from the start, a delta cannot be resumed.
+  if (offset > 0) {
+    send_mesg_554_rest (csfd);
+    return;
   }
-  
-  si->dsfd = 0;
 
-  if (si->cmdAbort == true) {
+  //The old contents of the file are the basis of the delta.
+  if (!check_file_exist (si->cwd, path)) {
+    send_mesg_553 (csfd);
+    return;
+  }
+
+  send_mesg_150 (csfd, path, REPLY_150_BINARY);
+
+  if (si->dsfd == 0) {
+    send_mesg_425 (csfd);
+    return;
+  }
+
+  //Secure the data connection under PROT P.
+  if (tls_data_start (si) == -1)
+    return;
+
+  /* The new file is built beside the old one, even when uploads are written
+   * in place, since the old one is read until the delta ends. */
+  if ((fullpath = merge_paths (si->cwd, path, NULL)) == NULL ||
+      (basis = open (fullpath, O_RDONLY)) == -1 ||
+      fstat (basis, &basisStat) == -1 || !S_ISREG (basisStat.st_mode) ||
+      (out = commit_temp_open (fullpath, STOR_FILE_MODE, &partpath)) == -1 ||
+      delta_dec_start (&dec, &deltaSink, basis, basisStat.st_size,
+		       out) == -1) {
+    if (out != -1) {
+      close (out);
+      commit_discard (fullpath, partpath);
+    } else {
+      free (partpath);
+      free (fullpath);
+    }
+    if (basis != -1)
+      close (basis);
+    cleanup_stor_recv (si, -1, 451);
+    return;
+  }
+
+  retVal = recv_stream (si, &deltaSink);
+  delta_dec_end (&dec);
+  close (basis);
+
+  //Block mode keeps the data connection open after a complete transfer.
+  end_data_conn (si, retVal == 0 && si->cmdAbort == false);
+
+  if (retVal == -1) {
+    send_mesg_451 (csfd);
+    si->cmdAbort = false;
+  } else if (si->cmdAbort == true) {
     send_mesg_426 (csfd);
     si->cmdAbort = false;
+    retVal = -1;
+  } else if (commit_upload (out, partpath, fullpath) == -1) {
+    send_mesg_451 (csfd);
+    retVal = -1;
   } else {
-    send_mesg_226 (csfd, REPLY_226_SUCCESS);
+    send_mesg_226_delta (csfd, "Received", dec.literal, dec.matched,
+			 (si->dsfd != 0) ? REPLY_226_KEEP : REPLY_226_SUCCESS);
   }
 
-  return;
+  if (retVal == -1) {
+    commit_discard (fullpath, partpath);
+  } else {
+    free (partpath);
+    free (fullpath);
+  }
+  if (close (out) == -1)
+    fprintf (stderr, "%s: close: %s\n", __FUNCTION__, strerror (errno));
 }
 
 
 /******************************************************************************
- * Determine if the STOR or APPE filename argument should be permanently
- * rejected.
+ * cmd_dbase - see "transfer.h"
+ *****************************************************************************/
+void cmd_dbase (session_info_t *si, char *arg)
+{
+  pipe_stage_t sigSink;
+  delta_sig_t *sig;
+  int retVal;
+  off_t offset = si->restOffset;
+  int csfd = si->csfd;
+
+  //The restart marker and byte range only apply to this transfer.
+  si->restOffset = 0;
+  si->rangeEnd = -1;
+  si->alloSize = 0;
+
+  if (si->loggedin == false) {
+    send_mesg_530 (csfd, REPLY_530_REQUEST);
+    return;
+  }
+
+  if (offset > 0) {
+    send_mesg_554_rest (csfd);
+    return;
+  }
+
+  send_mesg_150 (csfd, "signature", REPLY_150_BINARY);
+
+  if (si->dsfd == 0) {
+    send_mesg_425 (csfd);
+    return;
+  }
+
+  //Secure the data connection under PROT P.
+  if (tls_data_start (si) == -1)
+    return;
+
+  if ((sig = malloc (sizeof (*sig))) == NULL) {
+    fprintf (stderr, "%s: malloc: %s\n", __FUNCTION__, strerror (errno));
+    cleanup_stor_recv (si, -1, 451);
+    return;
+  }
+  delta_sig_stage (sig, &sigSink);
+
+  retVal = recv_stream (si, &sigSink);
+
+  //Block mode keeps the data connection open after a complete transfer.
+  end_data_conn (si, retVal == 0 && si->cmdAbort == false);
+
+  if (retVal == -1 || si->cmdAbort == true) {
+    if (retVal == -1)
+      send_mesg_451 (csfd);
+    else
+      send_mesg_426 (csfd);
+    si->cmdAbort = false;
+    delta_sig_free (sig);
+    free (sig);
+    return;
+  }
+
+  //The signature replaces one that was not used.
+  if (si->deltaBase != NULL) {
+    delta_sig_free (si->deltaBase);
+    free (si->deltaBase);
+  }
+  si->deltaBase = sig;
+
+  send_mesg_226 (csfd, (si->dsfd != 0) ? REPLY_226_KEEP : REPLY_226_SUCCESS);
+}
+
+
+/******************************************************************************
+ * Receive the data of a SITE command into a sink, through the stages of the
+ * transfer mode, as for STOR. The data connection is left for the caller to
+ * end.
  *
  * Arguments:
- *     si - The control connection information maintained by session().
- *   path - The pathname argument passed to the command function.
+ *     si - The session information.
+ *   sink - The sink the received data is pushed into.
  *
  * Return values:
- *   0    Accept the filename argument.
- *  -1    Reject the filename argument.
+ *   0    The data was received, or the transfer was aborted (see si->cmdAbort).
+ *  -1    Error, or the sink refused the data.
  *****************************************************************************/
-static int perm_neg_check (session_info_t *si, char *arg)
+static int recv_stream (session_info_t *si, pipe_stage_t *sink)
 {
-  int pathCheck;
+  int retVal;
+  tcp_tune_t tune;
+  pipeline_t pl;
+  pipe_stage_t blockStage;
+  pipe_stage_t zlibStage;
+  zmode_stream_t zstream;
+  zmode_stream_t *zs = NULL;  //Set for a MODE Z transfer.
+  bmode_recv_t br;
 
-  /* If the client is anonymous or they haven't logged in, they don't have
-   * permission to run this command. */
-  if (si->loggedin == false || strcmp (si->user, "anonymous") == 0) {
-    send_mesg_530 (si->csfd, REPLY_530_REQUEST);
-    close (si->dsfd);
-    si->dsfd = 0;
-    return -1;
+  pipe_start (&pl, sink);
+  if (si->mode == 'b') {
+    bmode_recv_stage (&br, &blockStage);
+    pipe_add (&pl, &blockStage);
+    bmode_recv_start (&br, si->csfd, 0);
+  } else if (si->mode == 'z' && zmode_start (&zstream, false, 0) == 0) {
+    zs = &zstream;
+    zmode_stage (zs, &zlibStage);
+    pipe_add (&pl, &zlibStage);
   }
-  
-  //Determine if the pathname argument should be accepted.
-  if ((pathCheck = check_future_file (si->cwd, arg, false)) == -1) {
-    cleanup_stor_recv (si, NULL, 450);
-    return -1;
-  } else if (pathCheck == -2) {
-    cleanup_stor_recv (si, NULL, 553);
-    return -1;
-  } else if (pathCheck == -3) {
-    cleanup_stor_recv (si, NULL, 553);
-    return -1;
+
+  tune_start (&tune, si->dsfd, false);
+  sched_start (&si->flow, si->weight);
+  retVal = (si->mode == 'z' && zs == NULL) ? -1 :
+    recv_file_copy (si, &tune, &pl, (si->mode == 'b') ? &br : NULL);
+  sched_end (&si->flow, retVal == 0 && si->cmdAbort == false);
+  tune_finish (&tune);
+  end_pipeline (&pl, zs, NULL);
+
+  return retVal;
+}
+
+
+
+/******************************************************************************
+ * Receive a file from the data connection by copying it through a buffer in
+ * user space, and pushing it through a pipeline to the file. This path is
+ * used when the file may not be stored unmodified.
+ *
+ * Arguments:
+ *     si - The session information.
+ *   tune - The chunk sizing state of the transfer.
+ *     pl - The pipeline of the transfer, which ends at the file.
+ *     br - The MODE B state of the stage that removes the block framing, or
+ *          NULL when the data is not framed. The file ends at the EOF block
+ *          rather than when the connection is closed.
+ *
+ * Return values:
+ *   0    The file was received, or the transfer was aborted (see si->cmdAbort).
+ *  -1    Error
+ *****************************************************************************/
+static int recv_file_copy (session_info_t *si, tcp_tune_t *tune,
+			   pipeline_t *pl, bmode_recv_t *br)
+{
+  char *buffer;
+  size_t chunk;
+  ssize_t nrecv;
+  int ready;
+
+  while (si->cmdAbort == false) {
+    if ((ready = wait_data_ready (si, false)) == -1)
+      return -1;
+    else if (ready == 0)
+      continue;
+
+    if ((chunk = chunk_start (si, tune)) == 0)
+      continue;
+    if ((buffer = tune_buffer (tune)) == NULL)
+      return -1;
+
+    if ((nrecv = recv_some (si->dsfd, buffer, chunk)) == -1) {
+      if (errno == EINTR || errno == EAGAIN)
+	continue;
+      fprintf (stderr, "%s: recv: %s\n", __FUNCTION__, strerror (errno));
+      return -1;
+    } else if (nrecv == 0) {
+      if (br != NULL) {
+	fprintf (stderr, "%s: connection closed before the EOF block\n",
+		 __FUNCTION__);
+	return -1;
+      }
+      break;
+    }
+    chunk_end (si, nrecv);
+
+    if (pipe_push (pl, (uint8_t *)buffer, nrecv) == -1)
+      return -1;
+    if (br != NULL && br->eof)
+      break;
   }
-  
+
+  /* The stages pass on the data they hold back, eg. a CR at the very end of
+   * an ASCII upload, and check that a compressed upload is complete. */
+  if (si->cmdAbort == false && pipe_finish (pl) == -1)
+    return -1;
+
   return 0;
 }
 
 
 /******************************************************************************
- * cleanup_stor_recv - see "transfer.h"
+ * Receive a file from the data connection with splice(). The data is moved
+ * from the socket into a pipe, and from the pipe into the file, so that it is
+ * never copied into user space. At most one chunk is moved at once so that an
+ * abort is detected between chunks.
+ *
+ * Arguments:
+ *     si - The session information.
+ *     wb - The write-behind state of the file to write to. The data is not
+ *          buffered, but its writeback is started as it is written.
+ *   tune - The chunk sizing state of the transfer.
+ *     pl - The pipeline of the transfer, without stages, for the copy path.
+ *
+ * Return values:
+ *   0    The file was received, or the transfer was aborted (see si->cmdAbort).
+ *  -1    Error
  *****************************************************************************/
-void cleanup_stor_recv (session_info_t *si, FILE *fp,  int errcode)
+static int recv_file_zero_copy (session_info_t *si, write_behind_t *wb,
+				tcp_tune_t *tune, pipeline_t *pl)
 {
-  /* Send the appropriate reply to the client on the control connection when
-   * an error has occurred. */
-  if (errcode == 451) {
-    send_mesg_451 (si->csfd);
-  } else if (errcode == 553) {
-    send_mesg_553 (si->csfd);
-  } else if (errcode == 450) {
-    send_mesg_450 (si->csfd);
+  int pipefd[2];
+  int pipeSize;
+  size_t chunk;
+  ssize_t nspliced;
+  int ready;
+  int retVal = 0;
+
+  if (pipe (pipefd) == -1) {
+    fprintf (stderr, "%s: pipe: %s\n", __FUNCTION__, strerror (errno));
+    return recv_file_copy (si, tune, pl, NULL);
   }
-  
-  //Close the filepointer if one is open.
-  if (fp != NULL)
-    fclose (fp);
+  pipeSize = fcntl (pipefd[1], F_GETPIPE_SZ);
 
-  //Reset the data connection socket.
-  close (si->dsfd);
-  si->dsfd = 0;
+  while (si->cmdAbort == false) {
+    if ((ready = wait_data_ready (si, false)) == -1) {
+      retVal = -1;
+      break;
+    } else if (ready == 0) {
+      continue;
+    }
+
+    /* A pipe holds 64 KiB by default. Grow the pipe with the chunk so that each
+     * splice() moves a full chunk, but carry on with the current size if the
+     * request is refused (see /proc/sys/fs/pipe-max-size). */
+    if ((chunk = chunk_start (si, tune)) == 0)
+      continue;
+    if (pipeSize > 0 && chunk > (size_t)pipeSize) {
+      if (fcntl (pipefd[1], F_SETPIPE_SZ, chunk) != -1)
+	pipeSize = fcntl (pipefd[1], F_GETPIPE_SZ);
+    }
+
+    nspliced = splice (si->dsfd, NULL, pipefd[1], NULL, chunk,
+		       SPLICE_F_MOVE | SPLICE_F_NONBLOCK);
+    if (nspliced == -1) {
+      if (errno == EINTR || errno == EAGAIN)
+	continue;
+      //splice() is not supported for this socket, copy the remainder instead.
+      if (errno == EINVAL) {
+	retVal = recv_file_copy (si, tune, pl, NULL);
+	break;
+      }
+      fprintf (stderr, "%s: splice: %s\n", __FUNCTION__, strerror (errno));
+      retVal = -1;
+      break;
+    } else if (nspliced == 0) {
+      break;
+    }
+
+    //Empty the pipe into the file before receiving more data.
+    if (drain_pipe (pipefd[0], wb->fd, nspliced, tune) == -1) {
+      retVal = -1;
+      break;
+    }
+    wb_written (wb, nspliced);
+    chunk_end (si, nspliced);
+  }
+
+  close (pipefd[0]);
+  close (pipefd[1]);
+  return retVal;
+}
+
+
+/******************************************************************************
+ * Move exactly 'len' bytes from the read end of a pipe into a file. splice()
+ * is used when the file system supports it, otherwise the bytes are read from
+ * the pipe and written to the file.
+ *
+ * Arguments:
+ *   pipeFd - The read end of the pipe.
+ *   fileFd - The file to write to.
+ *      len - The number of bytes waiting in the pipe.
+ *     tune - The chunk sizing state of the transfer, which owns the buffer
+ *            used when splice() is not supported.
+ *
+ * Return values:
+ *   0    All bytes were written to the file.
+ *  -1    Error
+ *****************************************************************************/
+static int drain_pipe (int pipeFd, int fileFd, size_t len, tcp_tune_t *tune)
+{
+  char *buffer;
+  ssize_t nmoved;
+
+  while (len > 0) {
+    if ((nmoved = splice (pipeFd, NULL, fileFd, NULL, len, SPLICE_F_MOVE)) == -1) {
+      if (errno == EINTR)
+	continue;
+      if (errno != EINVAL) {
+	fprintf (stderr, "%s: splice: %s\n", __FUNCTION__, strerror (errno));
+	return -1;
+      }
+      //The file system does not support splice(), copy through user space.
+      if ((buffer = tune_buffer (tune)) == NULL)
+	return -1;
+      if ((nmoved = read (pipeFd, buffer,
+			  (len < tune->chunk) ? len : tune->chunk)) == -1) {
+	if (errno == EINTR)
+	  continue;
+	fprintf (stderr, "%s: read: %s\n", __FUNCTION__, strerror (errno));
+	return -1;
+      }
+      if (write_all (fileFd, buffer, nmoved) == -1)
+	return -1;
+    }
+    len -= nmoved;
+  }
+
+  return 0;
+}
+
+
+/******************************************************************************
+ * write_all - see "transfer.h"
+ *****************************************************************************/
+int write_all (int fd, const char *buf, size_t len)
+{
+  ssize_t nwritten;
+
+  while (len > 0) {
+    if ((nwritten = write (fd, buf, len)) == -1) {
+      if (errno == EINTR)
+	continue;
+      fprintf (stderr, "%s: write: %s\n", __FUNCTION__, strerror (errno));
+      return -1;
+    }
+    buf += nwritten;
+    len -= nwritten;
+  }
+
+  return 0;
+}
+
+
+/******************************************************************************
+ * cmd_retr - see "transfer.h"
+ *****************************************************************************/
+void cmd_retr (session_info_t *si, char *path)
+{
+  int retrFd;
+  int retVal;
+  struct stat fileStat;
+  tcp_tune_t tune;  //Sizes the send chunk and socket buffer.
+  pipeline_t pl;
+  pipe_stage_t sink;
+  pipe_stage_t asciiStage;
+  pipe_stage_t zlibStage;
+  pipe_stage_t sumStage;
+  checksum_t sum;
+  bool hashed = false;  //The digest of the file is computed.
+  zmode_stream_t zstream;
+  zmode_stream_t *zs = NULL;  //Set for a MODE Z transfer.
+  bmode_send_t bs;
+  bmode_send_t *bsp = NULL;  //Set for a MODE B transfer.
+  ascii_conv_t ascii;
+  ascii_conv_t *ac = NULL;  //Set for an ASCII transfer.
+  const char *variant = NULL;  //The cached MODE Z stream that matches.
+  char *fullpath;
+  struct file_range range;
+  read_hint_t hint;
+  char dir[PATH_MAX];
+  off_t offset = si->restOffset;
+  off_t end = si->rangeEnd;
+  int csfd = si->csfd;
+
+  //The restart marker and byte range only apply to this transfer.
+  si->restOffset = 0;
+  si->rangeEnd = -1;
+
+  if (si->loggedin == false) {
+    send_mesg_530 (csfd, REPLY_530_REQUEST);
+    return;
+  }
+
+  if (!check_file_exist (si->cwd, path)) {
+    //"dir.tar" asks for an archive of the directory "dir".
+    if (tar_dir_name (path, dir) && check_dir_exist (si->cwd, dir)) {
+      retr_tar (si, path, dir, offset, end);
+      return;
+    }
+    send_mesg_553 (si->csfd);
+    return;
+  }
+
+  //Send the positive preliminary response.
+  if (si->type == 'a') {
+    send_mesg_150 (csfd, path, REPLY_150_ASCII);
+  } else {
+    send_mesg_150 (csfd, path, REPLY_150_BINARY);
+  }
+
+  if (si->dsfd == 0) {
+    send_mesg_425 (csfd);
+    return;
+  }
+
+  //Secure the data connection under PROT P.
+  if (tls_data_start (si) == -1)
+    return;
+
+  if ((fullpath = merge_paths (si->cwd, path, NULL)) == NULL) {
+    send_mesg_451 (si->csfd);
+    end_data_conn (si, false);
+    return;
+  }
+
+  if ((retrFd = open (fullpath, O_RDONLY)) == -1) {
+    fprintf (stderr, "%s: open: %s\n", __FUNCTION__, strerror (errno));
+    free (fullpath);
+    send_mesg_451 (si->csfd);
+    end_data_conn (si, false);
+    return;
+  }
+
+  //Resume the transfer at the restart marker, which must be within the file.
+  if (offset > 0) {
+    if (fstat (retrFd, &fileStat) == -1 || offset > fileStat.st_size) {
+      send_mesg_554_rest (csfd);
+      free (fullpath);
+      close (retrFd);
+      end_data_conn (si, false);
+      return;
+    }
+  }
+
+  /* The file is read at explicit offsets, so that the sessions of a client
+   * that fetches several ranges of one file at once do not share a file
+   * offset. The end of a RANG is inclusive. */
+  range.offset = offset;
+  range.left = (end >= 0) ? end - offset + 1 : -1;
+  range.extentEnd = 0;
+  range.hole = false;
+
+  /* Read the file ahead of the transfer, and drop a large file behind it. A
+   * MODE Z transfer may be sent from the cache, its file is only read ahead
+   * once it is compressed. */
+  rh_start (&hint, retrFd, range.offset, range.left, si->mode != 'z');
+  range.hint = &hint;
+
+  /* The file passes through the stages of the transfer type and mode on its
+   * way to the data connection. An ASCII transfer sends the LF line endings
+   * of the file as CRLF, before compression or block framing. */
+  if (si->mode == 'b') {
+    bmode_send_start (&bs, si->dsfd, offset);
+    bsp = &bs;
+    bmode_send_stage (bsp, &sink);
+  } else {
+    pipe_socket_sink (&sink, &si->dsfd);
+  }
+  pipe_start (&pl, &sink);
+
+  /* A whole file that is copied through the server anyway is hashed on its
+   * way, before any stage changes it, if it has no current digest. A file
+   * that is sent without a copy is left alone, HASH reads it if asked. */
+  if (offset == 0 && end < 0 && (si->type == 'a' || si->mode == 'z') &&
+      checksum_transfer_alg () != CHECKSUM_NONE &&
+      !checksum_stored (retrFd, checksum_transfer_alg ())) {
+    checksum_start (&sum, checksum_transfer_alg ());
+    checksum_stage (&sum, &sumStage);
+    pipe_add (&pl, &sumStage);
+    hashed = true;
+  }
+
+  if (si->type == 'a') {
+    ascii_start (&ascii);
+    ac = &ascii;
+    ascii_stage (ac, &asciiStage, true);
+    pipe_add (&pl, &asciiStage);
+  }
+  if (si->mode == 'z' && zmode_start (&zstream, true, si->zlevel) == 0) {
+    zs = &zstream;
+    zmode_stage (zs, &zlibStage);
+    pipe_add (&pl, &zlibStage);
+
+    /* Only a transfer of the whole file matches a cached stream. ASCII line
+     * endings are translated before compression, cache them apart. */
+    if (offset == 0 && end < 0)
+      variant = (ac != NULL) ? "deflate-crlf" : "deflate";
+  }
+
+  /* A file that passes through no stage is sent exactly as it is stored, so
+   * the kernel can move it from the page cache to the socket without a
+   * copy. */
+  tune_start (&tune, si->dsfd, true);
+  sched_start (&si->flow, si->weight);
+  if (si->mode == 'z') {
+    retVal = (zs == NULL) ? -1 : send_file_compressed (si, retrFd, &range,
+							fullpath, variant,
+							&tune, &pl, zs);
+  } else if (pipe_zero_copy (&pl)) {
+    retVal = send_file_zero_copy (si, retrFd, &range, &tune, &pl, bsp);
+  } else {
+    retVal = send_file_copy (si, retrFd, &range, &tune, &pl, bsp);
+  }
+  sched_end (&si->flow, retVal == 0 && si->cmdAbort == false);
+  tune_finish (&tune);
+  end_pipeline (&pl, zs, ac);
+  rh_end (&hint);
+  free (fullpath);
+
+  /* A MODE Z transfer sent from the cache never read the file, its digest
+   * does not cover the file and is not kept. */
+  if (hashed && retVal == 0 && si->cmdAbort == false)
+    checksum_save (&sum, retrFd);
+
+  if (close (retrFd) == -1) {
+    fprintf (stderr, "%s: close: %s\n", __FUNCTION__, strerror (errno));
+  }
+
+  //Block mode keeps the data connection open after a complete transfer.
+  end_data_conn (si, retVal == 0 && si->cmdAbort == false);
+
+  if (retVal == -1) {
+    send_mesg_451 (csfd);
+    si->cmdAbort = false;
+  } else if (si->cmdAbort == true) {
+    send_mesg_426 (csfd);
+    si->cmdAbort = false;
+  } else {
+    send_mesg_226 (csfd, (si->dsfd != 0) ? REPLY_226_KEEP : REPLY_226_SUCCESS);
+  }
+
+  return;
+}
+
+
+/******************************************************************************
+ * cmd_mretr - see "transfer.h"
+ *****************************************************************************/
+void cmd_mretr (session_info_t *si, char *paths)
+{
+  tcp_tune_t tune;
+  pipeline_t pl;
+  pipe_stage_t sink;
+  pipe_stage_t zlibStage;
+  zmode_stream_t zstream;
+  zmode_stream_t *zs = NULL;
+  bmode_send_t bs;
+  char count[32];
+  char *status;
+  int numPaths;
+  int retVal;
+  off_t offset = si->restOffset;
+  off_t end = si->rangeEnd;
+  int csfd = si->csfd;
+
+  //The restart marker and byte range only apply to this transfer.
+  si->restOffset = 0;
+  si->rangeEnd = -1;
+
+  if (si->loggedin == false) {
+    send_mesg_530 (csfd, REPLY_530_REQUEST);
+    return;
+  }
+
+  if (paths == NULL || (numPaths = get_arg_count (paths)) == 0) {
+    send_mesg_501 (csfd);
+    return;
+  }
+
+  //A restart marker cannot say which file of the batch it applies to.
+  if (offset > 0 || end >= 0) {
+    send_mesg_554_rest (csfd);
+    return;
+  }
+
+  //Each file gets one status line, its reply code and its pathname.
+  if ((status = malloc (strlen (paths) + numPaths * MRETR_STATUS_LEN + 1))
+      == NULL) {
+    fprintf (stderr, "%s: malloc: %s\n", __FUNCTION__, strerror (errno));
+    send_mesg_451 (csfd);
+    return;
+  }
+  status[0] = '\0';
+
+  snprintf (count, sizeof (count), "%d files", numPaths);
+  send_mesg_150 (csfd, count, REPLY_150_BINARY);
+
+  if (si->dsfd == 0) {
+    send_mesg_425 (csfd);
+    free (status);
+    return;
+  }
+
+  //Secure the data connection under PROT P.
+  if (tls_data_start (si) == -1) {
+    free (status);
+    return;
+  }
+
+  if (si->mode == 'b') {
+    bmode_send_start (&bs, si->dsfd, 0);
+    bmode_send_stage (&bs, &sink);
+  } else {
+    pipe_socket_sink (&sink, &si->dsfd);
+  }
+  pipe_start (&pl, &sink);
+
+  if (si->mode == 'z' && zmode_start (&zstream, true, si->zlevel) == 0) {
+    zs = &zstream;
+    zmode_stage (zs, &zlibStage);
+    pipe_add (&pl, &zlibStage);
+  }
+
+  tune_start (&tune, si->dsfd, true);
+  sched_start (&si->flow, si->weight);
+  retVal = (si->mode == 'z' && zs == NULL) ? -1 : send_batch (si, paths,
+							       status, &tune,
+							       &pl);
+  sched_end (&si->flow, retVal == 0 && si->cmdAbort == false);
+  tune_finish (&tune);
+  end_pipeline (&pl, zs, NULL);
+
+  //Block mode keeps the data connection open after a complete transfer.
+  end_data_conn (si, retVal == 0 && si->cmdAbort == false);
+
+  if (retVal == -1) {
+    send_mesg_451 (csfd);
+    si->cmdAbort = false;
+  } else if (si->cmdAbort == true) {
+    send_mesg_426 (csfd);
+    si->cmdAbort = false;
+  } else {
+    send_mesg_226_batch (csfd, status, (si->dsfd != 0) ? REPLY_226_KEEP :
+			 REPLY_226_SUCCESS);
+  }
+
+  free (status);
+}
+
+
+/******************************************************************************
+ * Push the files of a batch through a pipeline, each in its frame, and
+ * record the outcome of each file. A file that cannot be opened is left out
+ * of the data, and only appears in the status.
+ *
+ * Arguments:
+ *       si - The session information.
+ *    paths - The pathnames of the files, separated by spaces. Modified.
+ *   status - Filled with one line for each pathname, " <code> <pathname>\n".
+ *     tune - The chunk sizing state of the transfer.
+ *       pl - The pipeline of the transfer, which ends at the data connection.
+ *
+ * Return values:
+ *   0    The batch was sent, or the transfer was aborted (see si->cmdAbort).
+ *  -1    Error
+ *****************************************************************************/
+static int send_batch (session_info_t *si, char *paths, char *status,
+		       tcp_tune_t *tune, pipeline_t *pl)
+{
+  uint8_t header[MRETR_HEADER_LEN + CMD_STRLEN];
+  struct stat fileStat;
+  const char *code;
+  char *fullpath;
+  char *path;
+  char *save;
+  size_t nameLen;
+  bool shrank;
+  int fd;
+  int i;
+
+  for (path = strtok_r (paths, " ", &save); path != NULL;
+       path = strtok_r (NULL, " ", &save)) {
+    if (si->cmdAbort == true)
+      return 0;
+
+    //The name in the frame and the status is the pathname the client sent.
+    nameLen = strlen (path);
+    header[0] = nameLen >> 8;
+    header[1] = nameLen & 0xff;
+    memcpy (header + 2, path, nameLen);
+
+    code = "226";
+    if (!check_file_exist (si->cwd, path)) {
+      code = "553";
+    } else if ((fullpath = merge_paths (si->cwd, path, NULL)) == NULL) {
+      return -1;
+    } else {
+      fd = open (fullpath, O_RDONLY);
+      free (fullpath);
+
+      if (fd == -1 || fstat (fd, &fileStat) == -1 ||
+	  !S_ISREG (fileStat.st_mode)) {
+	code = "450";
+      } else {
+	for (i = 0; i < 8; i++)
+	  header[2 + nameLen + i] = (uint64_t)fileStat.st_size >> (56 - i * 8);
+
+	if (pipe_push (pl, header, MRETR_HEADER_LEN + nameLen) == -1 ||
+	    send_body (si, fd, fileStat.st_size, tune, pl, &shrank) == -1) {
+	  close (fd);
+	  return -1;
+	}
+
+	//The frame is complete, but its data is not all the file.
+	if (shrank)
+	  code = "451";
+      }
+
+      if (fd != -1)
+	close (fd);
+    }
+
+    sprintf (status + strlen (status), " %s %.*s\n", code, (int)nameLen,
+	     (char *)header + 2);
+  }
+
+  if (si->cmdAbort == true)
+    return 0;
+
+  //A frame without a name ends the batch.
+  memset (header, 0, 2);
+  if (pipe_push (pl, header, 2) == -1)
+    return -1;
+  return pipe_finish (pl);
+}
+
+/******************************************************************************
+ * cmd_dsig - see "transfer.h"
+ *****************************************************************************/
+void cmd_dsig (session_info_t *si, char *path)
+{
+  retr_delta (si, path, false);
+}
+
+
+/******************************************************************************
+ * cmd_dretr - see "transfer.h"
+ *****************************************************************************/
+void cmd_dretr (session_info_t *si, char *path)
+{
+  retr_delta (si, path, true);
+}
+
+
+/******************************************************************************
+ * Send the signature of a file (SITE DSIG), or the delta of a file against
+ * the signature received by DBASE (SITE DRETR). Either is generated as it is
+ * sent, in the transfer mode of the session, and is always binary.
+ *
+ * Arguments:
+ *      si - The session information.
+ *    path - The pathname of the file.
+ *   delta - Send the delta when true, the signature otherwise.
+ *****************************************************************************/
+static void retr_delta (session_info_t *si, char *path, bool delta)
+{
+  struct stat fileStat;
+  delta_enc_t enc;
+  tcp_tune_t tune;
+  pipeline_t pl;
+  pipe_stage_t sink;
+  pipe_stage_t zlibStage;
+  zmode_stream_t zstream;
+  zmode_stream_t *zs = NULL;
+  bmode_send_t bs;
+  char *fullpath;
+  int fd = -1;
+  int retVal;
+  off_t offset = si->restOffset;
+  off_t end = si->rangeEnd;
+  int csfd = si->csfd;
+
+  //The restart marker and byte range only apply to this transfer.
+  si->restOffset = 0;
+  si->rangeEnd = -1;
+
+  if (si->loggedin == false) {
+    send_mesg_530 (csfd, REPLY_530_REQUEST);
+    return;
+  }
+
+  if (path == NULL) {
+    send_mesg_501 (csfd);
+    return;
+  }
+
+  //A delta is sent against the signature of the client's copy.
+  if (delta && si->deltaBase == NULL) {
+    send_mesg_503_delta (csfd);
+    return;
+  }
+
+  //The signature and delta are generated as they are sent.
+  if (offset > 0 || end >= 0) {
+    send_mesg_554_rest (csfd);
+    return;
+  }
+
+  if (!check_file_exist (si->cwd, path)) {
+    send_mesg_553 (csfd);
+    return;
+  }
+
+  send_mesg_150 (csfd, path, REPLY_150_BINARY);
+
+  if (si->dsfd == 0) {
+    send_mesg_425 (csfd);
+    return;
+  }
+
+  //Secure the data connection under PROT P.
+  if (tls_data_start (si) == -1)
+    return;
+
+  if ((fullpath = merge_paths (si->cwd, path, NULL)) == NULL ||
+      (fd = open (fullpath, O_RDONLY)) == -1 ||
+      fstat (fd, &fileStat) == -1 || !S_ISREG (fileStat.st_mode)) {
+    if (fd != -1)
+      close (fd);
+    free (fullpath);
+    send_mesg_451 (csfd);
+    end_data_conn (si, false);
+    return;
+  }
+  free (fullpath);
+
+  if (delta && delta_enc_start (&enc, si->deltaBase, fd) == -1) {
+    delta_enc_end (&enc);
+    close (fd);
+    send_mesg_451 (csfd);
+    end_data_conn (si, false);
+    return;
+  }
+
+  if (si->mode == 'b') {
+    bmode_send_start (&bs, si->dsfd, 0);
+    bmode_send_stage (&bs, &sink);
+  } else {
+    pipe_socket_sink (&sink, &si->dsfd);
+  }
+  pipe_start (&pl, &sink);
+
+  if (si->mode == 'z' && zmode_start (&zstream, true, si->zlevel) == 0) {
+    zs = &zstream;
+    zmode_stage (zs, &zlibStage);
+    pipe_add (&pl, &zlibStage);
+  }
+
+  tune_start (&tune, si->dsfd, true);
+  sched_start (&si->flow, si->weight);
+  if (si->mode == 'z' && zs == NULL)
+    retVal = -1;
+  else if (delta)
+    retVal = send_delta (si, &enc, &tune, &pl);
+  else
+    retVal = send_sig (si, fd, fileStat.st_size, &pl);
+  sched_end (&si->flow, retVal == 0 && si->cmdAbort == false);
+  tune_finish (&tune);
+  end_pipeline (&pl, zs, NULL);
+  close (fd);
+
+  //Block mode keeps the data connection open after a complete transfer.
+  end_data_conn (si, retVal == 0 && si->cmdAbort == false);
+
+  if (retVal == -1) {
+    send_mesg_451 (csfd);
+    si->cmdAbort = false;
+  } else if (si->cmdAbort == true) {
+    send_mesg_426 (csfd);
+    si->cmdAbort = false;
+  } else if (delta) {
+    send_mesg_226_delta (csfd, "Sent", enc.literal, enc.matched,
+			 (si->dsfd != 0) ? REPLY_226_KEEP : REPLY_226_SUCCESS);
+  } else {
+    send_mesg_226 (csfd, (si->dsfd != 0) ? REPLY_226_KEEP : REPLY_226_SUCCESS);
+  }
+
+  //The signature described the client's copy before this transfer.
+  if (delta) {
+    delta_enc_end (&enc);
+    delta_sig_free (si->deltaBase);
+    free (si->deltaBase);
+    si->deltaBase = NULL;
+  }
+}
+
+
+/******************************************************************************
+ * Push the signature of a file through a pipeline. The file is read a part at
+ * a time, and the signatures of the blocks of each part are pushed together.
+ *
+ * Arguments:
+ *     si - The session information.
+ *     fd - The file, open for reading.
+ *   size - The size of the file.
+ *     pl - The pipeline of the transfer, which ends at the data connection.
+ *
+ * Return values:
+ *   0    The signature was sent, or the transfer was aborted (see si->cmdAbort).
+ *  -1    Error, or the file shrank while it was read.
+ *****************************************************************************/
+static int send_sig (session_info_t *si, int fd, off_t size, pipeline_t *pl)
+{
+  uint8_t header[DELTA_SIG_HEADER];
+  uint32_t blockSize = delta_block_size (size);
+  size_t partLen = DSIG_PART - DSIG_PART % blockSize;
+  uint8_t *part;
+  uint8_t *records;
+  size_t numRecords;
+  size_t len;
+  size_t got;
+  ssize_t nread;
+  off_t offset = 0;
+
+  if ((part = malloc (partLen + partLen / blockSize * DELTA_SIG_RECORD))
+      == NULL) {
+    fprintf (stderr, "%s: malloc: %s\n", __FUNCTION__, strerror (errno));
+    return -1;
+  }
+  records = part + partLen;
+
+  delta_sig_header (header, blockSize, size);
+  if (pipe_push (pl, header, DELTA_SIG_HEADER) == -1) {
+    free (part);
+    return -1;
+  }
+
+  while (si->cmdAbort == false && offset < size) {
+    len = (size - offset < (off_t)partLen) ? size - offset : partLen;
+    for (got = 0; got < len; got += nread) {
+      if ((nread = pread (fd, part + got, len - got, offset + got)) == -1) {
+	if (errno == EINTR) {
+	  nread = 0;
+	  continue;
+	}
+	fprintf (stderr, "%s: pread: %s\n", __FUNCTION__, strerror (errno));
+	free (part);
+	return -1;
+      } else if (nread == 0) {
+	free (part);
+	return -1;
+      }
+    }
+
+    for (numRecords = 0; numRecords * blockSize < len; numRecords++) {
+      delta_sig_record (part + numRecords * blockSize,
+			(len - numRecords * blockSize < blockSize) ?
+			len - numRecords * blockSize : blockSize,
+			records + numRecords * DELTA_SIG_RECORD);
+    }
+    if (pipe_push (pl, records, numRecords * DELTA_SIG_RECORD) == -1) {
+      free (part);
+      return -1;
+    }
+    offset += len;
+  }
+
+  free (part);
+  if (si->cmdAbort == true)
+    return 0;
+  return pipe_finish (pl);
+}
+
+
+/******************************************************************************
+ * Push the delta of a file through a pipeline, a chunk of the file at a
+ * time. The scheduler and the bandwidth limit are charged for the bytes of
+ * the delta, not of the file.
+ *
+ * Arguments:
+ *     si - The session information.
+ *    enc - The generation state of the delta.
+ *   tune - The chunk sizing state of the transfer.
+ *     pl - The pipeline of the transfer, which ends at the data connection.
+ *
+ * Return values:
+ *   0    The delta was sent, or the transfer was aborted (see si->cmdAbort).
+ *  -1    Error
+ *****************************************************************************/
+static int send_delta (session_info_t *si, delta_enc_t *enc, tcp_tune_t *tune,
+		       pipeline_t *pl)
+{
+  long long sent;
+  size_t chunk;
+  int retVal = 1;
+  int ready;
+
+  while (si->cmdAbort == false && retVal == 1) {
+    if ((ready = wait_data_ready (si, true)) == -1)
+      return -1;
+    else if (ready == 0)
+      continue;
+
+    if ((chunk = chunk_start (si, tune)) == 0)
+      continue;
+
+    sent = pipe_delivered (pl);
+    if ((retVal = delta_enc_next (enc, pl, chunk)) == -1)
+      return -1;
+    chunk_end (si, pipe_delivered (pl) - sent);
+  }
+
+  if (si->cmdAbort == true)
+    return 0;
+  return pipe_finish (pl);
+}
+
+
+
+/******************************************************************************
+ * Send the tar archive of a directory for RETR. The archive is generated as
+ * it is sent, in the transfer mode of the session, and is always binary.
+ *
+ * Arguments:
+ *       si - The session information.
+ *     path - The pathname argument of RETR, the name of the archive.
+ *      dir - The pathname of the directory, which exists.
+ *   offset - The restart marker of the transfer.
+ *      end - The end of the byte range of the transfer, or -1.
+ *****************************************************************************/
+static void retr_tar (session_info_t *si, char *path, char *dir, off_t offset,
+		      off_t end)
+{
+  tar_walk_t *tw;
+  tcp_tune_t tune;
+  pipeline_t pl;
+  pipe_stage_t sink;
+  pipe_stage_t zlibStage;
+  zmode_stream_t zstream;
+  zmode_stream_t *zs = NULL;
+  bmode_send_t bs;
+  char *fullpath;
+  int retVal;
+  int csfd = si->csfd;
+
+  /* The archive is never stored, an offset in it cannot be found without
+   * generating it again up to that point. */
+  if (offset > 0 || end >= 0) {
+    send_mesg_554_rest (csfd);
+    return;
+  }
+
+  send_mesg_150 (csfd, path, REPLY_150_BINARY);
+
+  if (si->dsfd == 0) {
+    send_mesg_425 (csfd);
+    return;
+  }
+
+  //Secure the data connection under PROT P.
+  if (tls_data_start (si) == -1)
+    return;
+
+  //The walk state holds the headers of the archive, keep it off the stack.
+  if ((tw = malloc (sizeof (*tw))) == NULL) {
+    fprintf (stderr, "%s: malloc: %s\n", __FUNCTION__, strerror (errno));
+    send_mesg_451 (csfd);
+    end_data_conn (si, false);
+    return;
+  }
+
+  if ((fullpath = merge_paths (si->cwd, dir, NULL)) == NULL ||
+      tar_walk_start (tw, fullpath) == -1) {
+    free (fullpath);
+    free (tw);
+    send_mesg_451 (csfd);
+    end_data_conn (si, false);
+    return;
+  }
+  free (fullpath);
+
+  if (si->mode == 'b') {
+    bmode_send_start (&bs, si->dsfd, 0);
+    bmode_send_stage (&bs, &sink);
+  } else {
+    pipe_socket_sink (&sink, &si->dsfd);
+  }
+  pipe_start (&pl, &sink);
+
+  if (si->mode == 'z' && zmode_start (&zstream, true, si->zlevel) == 0) {
+    zs = &zstream;
+    zmode_stage (zs, &zlibStage);
+    pipe_add (&pl, &zlibStage);
+  }
+
+  tune_start (&tune, si->dsfd, true);
+  sched_start (&si->flow, si->weight);
+  retVal = (si->mode == 'z' && zs == NULL) ? -1 : send_tar (si, tw, &tune,
+							       &pl);
+  sched_end (&si->flow, retVal == 0 && si->cmdAbort == false);
+  tune_finish (&tune);
+  end_pipeline (&pl, zs, NULL);
+  tar_walk_end (tw);
+  free (tw);
+
+  //Block mode keeps the data connection open after a complete transfer.
+  end_data_conn (si, retVal == 0 && si->cmdAbort == false);
+
+  if (retVal == -1) {
+    send_mesg_451 (csfd);
+    si->cmdAbort = false;
+  } else if (si->cmdAbort == true) {
+    send_mesg_426 (csfd);
+    si->cmdAbort = false;
+  } else {
+    send_mesg_226 (csfd, (si->dsfd != 0) ? REPLY_226_KEEP : REPLY_226_SUCCESS);
+  }
+}
+
+
+/******************************************************************************
+ * Push the entries of a directory walk through a pipeline as a tar archive.
+ * The headers are pushed from user space, and the file bodies are sent by
+ * send_body().
+ *
+ * Arguments:
+ *     si - The session information.
+ *     tw - The walk of the archived directory.
+ *   tune - The chunk sizing state of the transfer.
+ *     pl - The pipeline of the transfer, which ends at the data connection.
+ *
+ * Return values:
+ *   0    The archive was sent, or the transfer was aborted (see si->cmdAbort).
+ *  -1    Error
+ *****************************************************************************/
+static int send_tar (session_info_t *si, tar_walk_t *tw, tcp_tune_t *tune,
+		     pipeline_t *pl)
+{
+  tar_entry_t entry;
+  const uint8_t *trailer;
+  size_t len;
+  bool shrank;
+  int retVal;
+
+  while (si->cmdAbort == false) {
+    if ((retVal = tar_walk_next (tw, &entry)) == -1)
+      return -1;
+    else if (retVal == 0)
+      break;
+
+    if (pipe_push (pl, entry.header, entry.headerLen) == -1)
+      return -1;
+    if (entry.fd == -1)
+      continue;
+
+    if (send_body (si, entry.fd, entry.size, tune, pl, &shrank) == -1)
+      return -1;
+    if (si->cmdAbort == true)
+      return 0;
+    if (send_zeros (pl, tar_padding (entry.size)) == -1)
+      return -1;
+  }
+
+  if (si->cmdAbort == true)
+    return 0;
+
+  //Terminate the archive, then the compressed stream or block mode file.
+  trailer = tar_trailer (&len);
+  if (pipe_push (pl, trailer, len) == -1)
+    return -1;
+  return pipe_finish (pl);
+}
+
+
+/******************************************************************************
+ * Send a file of known size that is followed by more data on the data
+ * connection, eg. a file of an archive. The file is sent with sendfile()
+ * when the pipeline has no stages and the data connection is not framed, and
+ * is copied through the pipeline otherwise. The pipeline is not finished.
+ *
+ * A file that shrinks while it is sent is padded with zeros to its size, so
+ * that whatever follows it is still found by the client.
+ *
+ * Arguments:
+ *       si - The session information.
+ *       fd - The file to send, open for reading.
+ *     size - The number of bytes to send, as announced to the client.
+ *     tune - The chunk sizing state of the transfer.
+ *       pl - The pipeline of the transfer.
+ *   shrank - Set to true if the file was padded.
+ *
+ * Return values:
+ *   0    The file was sent, or the transfer was aborted (see si->cmdAbort).
+ *  -1    Error
+ *****************************************************************************/
+static int send_body (session_info_t *si, int fd, off_t size,
+		      tcp_tune_t *tune, pipeline_t *pl, bool *shrank)
+{
+  struct file_range range;
+  int retVal;
+
+  range.offset = 0;
+  range.left = size;
+  range.hint = NULL;
+  range.extentEnd = 0;
+  range.hole = false;
+  *shrank = false;
+
+  /* Without stages the pipeline only holds the socket, which keeps nothing
+   * back, so the file may bypass it. */
+  if (si->mode == 's' && pipe_zero_copy (pl))
+    retVal = send_file_zero_copy (si, fd, &range, tune, pl, NULL);
+  else
+    retVal = copy_body (si, fd, &range, tune, pl);
+  if (retVal == -1 || si->cmdAbort == true)
+    return retVal;
+
+  if (range.left > 0) {
+    fprintf (stderr, "%s: a file shrank while it was sent\n", __FUNCTION__);
+    *shrank = true;
+    return send_zeros (pl, range.left);
+  }
+
+  return 0;
+}
+
+
+/******************************************************************************
+ * Copy a range of a file through the pipeline of the transfer. Unlike
+ * send_file_copy(), the pipeline is not finished at the end of the file.
+ *
+ * Arguments:
+ *     si - The session information.
+ *     fd - The file to send, open for reading.
+ *  range - The part of the file to send, advanced as it is sent. It is not
+ *          complete if the file ended early.
+ *   tune - The chunk sizing state of the transfer.
+ *     pl - The pipeline of the transfer.
+ *
+ * Return values:
+ *   0    The range was sent, or the transfer was aborted (see si->cmdAbort).
+ *  -1    Error
+ *****************************************************************************/
+static int copy_body (session_info_t *si, int fd, struct file_range *range,
+		      tcp_tune_t *tune, pipeline_t *pl)
+{
+  char *buffer;
+  size_t chunk;
+  ssize_t nread;
+  long long sent;
+  int ready;
+
+  while (si->cmdAbort == false && range->left > 0) {
+    if ((ready = wait_data_ready (si, true)) == -1)
+      return -1;
+    else if (ready == 0)
+      continue;
+
+    if ((chunk = chunk_start (si, tune)) == 0)
+      continue;
+    if ((buffer = tune_buffer (tune)) == NULL)
+      return -1;
+
+    chunk = range_clamp (range, chunk);
+    if ((nread = pread (fd, buffer, chunk, range->offset)) == -1) {
+      if (errno == EINTR)
+	continue;
+      fprintf (stderr, "%s: pread: %s\n", __FUNCTION__, strerror (errno));
+      return -1;
+    } else if (nread == 0) {
+      break;
+    }
+
+    range_advance (range, nread);
+
+    sent = pipe_delivered (pl);
+    if (pipe_push (pl, (uint8_t *)buffer, nread) == -1)
+      return -1;
+    chunk_end (si, pipe_delivered (pl) - sent);
+  }
+
+  return 0;
+}
+
+
+/******************************************************************************
+ * Push a number of zero bytes through a pipeline, as padding.
+ *
+ * Return values:
+ *   0    success
+ *  -1    error
+ *****************************************************************************/
+static int send_zeros (pipeline_t *pl, size_t len)
+{
+  const uint8_t *zeros;
+  size_t zerosLen;
+  size_t part;
+
+  zeros = sparse_zeros (&zerosLen);
+  while (len > 0) {
+    part = (len > zerosLen) ? zerosLen : len;
+    if (pipe_push (pl, zeros, part) == -1)
+      return -1;
+    len -= part;
+  }
+
+  return 0;
+}
+
+
+/******************************************************************************
+ * Send an open file over the data connection by copying it through a buffer
+ * in user space, and pushing it through a pipeline to the data connection.
+ * This path is used when the file may not be sent unmodified.
+ *
+ * Arguments:
+ *     si - The session information.
+ *     fd - The file to send, open for reading.
+ *  range - The part of the file to send, advanced as it is sent.
+ *   tune - The chunk sizing state of the transfer.
+ *     pl - The pipeline of the transfer, which ends at the data connection.
+ *     bs - The MODE B state of the sink of the pipeline, or NULL when the
+ *          file is not framed.
+ *
+ * Return values:
+ *   0    The file was sent, or the transfer was aborted (see si->cmdAbort).
+ *  -1    Error
+ *****************************************************************************/
+static int send_file_copy (session_info_t *si, int fd,
+			   struct file_range *range, tcp_tune_t *tune,
+			   pipeline_t *pl, bmode_send_t *bs)
+{
+  char *buffer;
+  const uint8_t *zeros;
+  size_t chunk;
+  ssize_t nread;
+  long long sent;
+  bool hole = false;
+  int ready;
+
+  zeros = sparse_zeros (NULL);
+
+  while (si->cmdAbort == false) {
+    if ((ready = wait_data_ready (si, true)) == -1)
+      return -1;
+    else if (ready == 0)
+      continue;
+
+    if ((chunk = chunk_start (si, tune)) == 0)
+      continue;
+    if ((buffer = tune_buffer (tune)) == NULL)
+      return -1;
+
+    //The end of the range is treated as the end of the file.
+    if ((chunk = range_clamp (range, chunk)) == 0) {
+      nread = 0;
+    } else if ((chunk = range_extent (fd, range, chunk, &hole)) > 0 && hole) {
+      //A hole of a sparse file reads as zeros, without touching the disk.
+      nread = chunk;
+    } else if ((nread = pread (fd, buffer, chunk, range->offset)) == -1) {
+      if (errno == EINTR)
+	continue;
+      fprintf (stderr, "%s: pread: %s\n", __FUNCTION__, strerror (errno));
+      return -1;
+    }
+
+    //Terminate a compressed stream or block mode file at the end of the file.
+    if (nread == 0)
+      return pipe_finish (pl);
+
+    range_advance (range, nread);
+
+    //The bytes that reach the data connection are charged to the transfer.
+    sent = pipe_delivered (pl);
+    if (pipe_push (pl, hole ? zeros : (uint8_t *)buffer, nread) == -1)
+      return -1;
+    chunk_end (si, pipe_delivered (pl) - sent);
+
+    //Restart markers are offsets in the file, not in the translated data.
+    if (bs != NULL)
+      bs->offset = range->offset;
+  }
+
+  return 0;
+}
+
+
+/******************************************************************************
+ * Send an open file over the data connection with sendfile(), so the contents
+ * of the file are never copied into user space. The file is sent one chunk at
+ * a time so that an abort is detected between chunks.
+ *
+ * In block mode each block header is sent from user space, and the data of
+ * the block is sent with sendfile(). A header announces the size of its
+ * block, so the size of the file is taken when the transfer starts; a file
+ * that shrinks during the transfer is an error.
+ *
+ * The holes of a sparse file are sent from a buffer of zeros instead.
+ *
+ * Arguments:
+ *     si - The session information.
+ *     fd - The file to send, open for reading.
+ *  range - The part of the file to send, advanced as it is sent.
+ *   tune - The chunk sizing state of the transfer.
+ *     pl - The pipeline of the transfer, without stages. The file is copied
+ *          through it if sendfile() is not supported.
+ *     bs - The MODE B state of the sink of the pipeline, used to frame the
+ *          file in blocks, or NULL when the file is not framed.
+ *
+ * Return values:
+ *   0    The file was sent, or the transfer was aborted (see si->cmdAbort).
+ *  -1    Error
+ *****************************************************************************/
+static int send_file_zero_copy (session_info_t *si, int fd,
+				struct file_range *range, tcp_tune_t *tune,
+				pipeline_t *pl, bmode_send_t *bs)
+{
+  struct stat fileStat;
+  off_t remaining = 0;   //Bytes of the file not yet in a block.
+  size_t blockLeft = 0;  //Bytes of the current block not yet sent.
+  const uint8_t *zeros;
+  size_t len;
+  off_t pos;
+  ssize_t nsent;
+  bool hole;
+  int ready;
+
+  //Data the kernel does not encrypt must pass through the TLS session.
+  if (!tls_kernel_send (si->dsfd))
+    return send_file_copy (si, fd, range, tune, pl, bs);
+
+  zeros = sparse_zeros (NULL);
+
+  if (bs != NULL) {
+    if (fstat (fd, &fileStat) == -1) {
+      fprintf (stderr, "%s: fstat: %s\n", __FUNCTION__, strerror (errno));
+      return -1;
+    }
+    remaining = fileStat.st_size - range->offset;
+    if (range->left >= 0 && remaining > range->left)
+      remaining = range->left;
+  }
+
+  while (si->cmdAbort == false) {
+    if ((ready = wait_data_ready (si, true)) == -1)
+      return -1;
+    else if (ready == 0)
+      continue;
+
+    if ((len = chunk_start (si, tune)) == 0)
+      continue;
+
+    //Start the next block, or end the file when there is no more data.
+    if (bs != NULL && blockLeft == 0) {
+      if (remaining <= 0)
+	return bmode_send_eof (bs);
+
+      blockLeft = (len > BMODE_MAX_BLOCK) ? BMODE_MAX_BLOCK : len;
+      if ((off_t)blockLeft > remaining)
+	blockLeft = remaining;
+      if (bmode_send_header (bs, blockLeft) == -1)
+	return -1;
+      remaining -= blockLeft;
+    }
+    if (bs != NULL)
+      len = blockLeft;
+    else if ((len = range_clamp (range, len)) == 0)
+      break;
+
+    //sendfile() advances 'pos', but not the file offset of 'fd'.
+    pos = range->offset;
+    if ((len = range_extent (fd, range, len, &hole)) > 0 && hole) {
+      if (send_all (si->dsfd, (uint8_t *)zeros, len) == -1)
+	return -1;
+      nsent = len;
+    } else if ((nsent = sendfile (si->dsfd, fd, &pos, len)) == -1) {
+      if (errno == EINTR || errno == EAGAIN)
+	continue;
+      /* Some file systems do not support sendfile(), fall back to copying
+       * the remainder of the file. A block whose header was sent must be
+       * completed first. */
+      if (errno == EINVAL || errno == ENOSYS) {
+	if (blockLeft > 0 &&
+	    copy_to_socket (si, fd, range, tune, blockLeft) == -1)
+	  return -1;
+	return send_file_copy (si, fd, range, tune, pl, bs);
+      }
+      fprintf (stderr, "%s: sendfile: %s\n", __FUNCTION__, strerror (errno));
+      return -1;
+    } else if (nsent == 0) {
+      if (bs != NULL) {
+	fprintf (stderr, "%s: file shrank during the transfer\n", __FUNCTION__);
+	return -1;
+      }
+      break;
+    }
+
+    range_advance (range, nsent);
+    if (bs != NULL)
+      blockLeft -= nsent;
+    chunk_end (si, nsent);
+  }
+
+  return 0;
+}
+
+
+/******************************************************************************
+ * Copy a number of bytes from a file to the data connection through a buffer
+ * in user space.
+ *
+ * Arguments:
+ *     si - The session information.
+ *     fd - The file to copy from, open for reading.
+ *  range - The part of the file being sent, advanced by 'len'.
+ *   tune - The chunk sizing state of the transfer, which owns the buffer.
+ *    len - The number of bytes to copy, within the range.
+ *
+ * Return values:
+ *   0    success
+ *  -1    error, including a file that ends before 'len' bytes.
+ *****************************************************************************/
+static int copy_to_socket (session_info_t *si, int fd,
+			   struct file_range *range, tcp_tune_t *tune,
+			   size_t len)
+{
+  char *buffer;
+  size_t chunk;
+  ssize_t nread;
+
+  chunk = rate_clamp (&si->rate, tune_update (tune));
+  if ((buffer = tune_buffer (tune)) == NULL)
+    return -1;
+
+  while (len > 0) {
+    if ((nread = pread (fd, buffer, (len > chunk) ? chunk : len,
+			range->offset)) == -1) {
+      if (errno == EINTR)
+	continue;
+      fprintf (stderr, "%s: pread: %s\n", __FUNCTION__, strerror (errno));
+      return -1;
+    } else if (nread == 0) {
+      fprintf (stderr, "%s: unexpected end of file\n", __FUNCTION__);
+      return -1;
+    }
+
+    if (send_all (si->dsfd, (uint8_t *)buffer, nread) == -1)
+      return -1;
+    range_advance (range, nread);
+    chunk_end (si, nread);
+    len -= nread;
+  }
+
+  return 0;
+}
+
+
+/******************************************************************************
+ * Send an open file over the data connection in MODE Z. The compressed
+ * variant of the file is sent from the cache when it is there. Otherwise the
+ * file is compressed as it is sent, and the compressed stream is also written
+ * to the cache for the next client, but only if the whole file was sent.
+ *
+ * Arguments:
+ *        si - The session information.
+ *        fd - The file to send, open for reading.
+ *     range - The part of the file to send, advanced as it is sent.
+ *      path - The absolute pathname of the file, used to key the cache.
+ *   variant - The name of the cached variant that matches the stages of the
+ *             pipeline, or NULL to bypass the cache, eg. for a restarted
+ *             transfer. Must be NULL unless the range is the whole file.
+ *      tune - The chunk sizing state of the transfer.
+ *        pl - The pipeline of the transfer, which compresses the file.
+ *        zs - The stream of the compression stage of the pipeline.
+ *
+ * Return values:
+ *   0    The file was sent, or the transfer was aborted (see si->cmdAbort).
+ *  -1    Error
+ *****************************************************************************/
+static int send_file_compressed (session_info_t *si, int fd,
+				 struct file_range *range, const char *path,
+				 const char *variant, tcp_tune_t *tune,
+				 pipeline_t *pl, zmode_stream_t *zs)
+{
+  struct file_range whole = { 0, -1, NULL, 0, false };
+  pipeline_t cached;
+  pipe_stage_t cachedSink;
+  zcache_fill_t fill;
+  int cacheFd = -1;
+  int retVal;
+
+  if (variant != NULL)
+    cacheFd = zcache_lookup (path, fd, variant, si->zlevel, &fill);
+
+  /* The cached variant is already compressed, so it is sent as it is stored,
+   * bypassing the stages. */
+  if (cacheFd != -1) {
+    pipe_socket_sink (&cachedSink, &si->dsfd);
+    pipe_start (&cached, &cachedSink);
+    retVal = send_file_zero_copy (si, cacheFd, &whole, tune, &cached, NULL);
+    close (cacheFd);
+    return retVal;
+  }
+
+  if (variant != NULL)
+    zs->teeFd = zcache_fill_start (&fill);
+
+  //The file itself is read, start its readahead.
+  if (range->hint != NULL)
+    rh_advance (range->hint, range->offset);
+
+  retVal = send_file_copy (si, fd, range, tune, pl, NULL);
+
+  if (variant != NULL) {
+    zcache_fill_end (&fill, retVal == 0 && si->cmdAbort == false &&
+		     zs->finished && zs->teeFd != -1);
+  }
+
+  return retVal;
+}
+
+
+/******************************************************************************
+ * Release the stages of a transfer, and add their CPU time to the server
+ * totals.
+ *
+ * Arguments:
+ *   pl - The pipeline of the transfer.
+ *   zs - The stream of the MODE Z stage, or NULL.
+ *   ac - The translation state of the ASCII stage, or NULL.
+ *****************************************************************************/
+static void end_pipeline (pipeline_t *pl, zmode_stream_t *zs,
+			  ascii_conv_t *ac)
+{
+  pipe_end (pl);
+  if (zs != NULL)
+    zmode_end (zs);
+  if (ac != NULL)
+    ascii_end (ac);
+}
+
+
+/******************************************************************************
+ * Wait until the data connection is ready to be read from or written to. The
+ * wait is limited by the command thread abort timeout, so that the caller can
+ * check si->cmdAbort between calls.
+ *
+ * Arguments:
+ *         si - The session information.
+ *   forWrite - Wait for the socket to be writable when true, readable otherwise.
+ *
+ * Return values:
+ *   1    The data connection is ready.
+ *   0    Timeout or interrupted, check for an abort and try again.
+ *  -1    Error
+ *****************************************************************************/
+static int wait_data_ready (session_info_t *si, bool forWrite)
+{
+  struct timeval timeout;
+  fd_set fds;
+  int nfds;
+  bool poll = si->flow.granted;
+
+  /* A transfer that holds a scheduler grant only polls at first, and gives up
+   * the grant before it blocks, so that its slot is not held idle while the
+   * other end catches up. */
+  for (;;) {
+    //Decrypted data waiting in the TLS session is not seen by select().
+    if (!forWrite && tls_pending (si->dsfd))
+      return 1;
+
+    FD_ZERO (&fds);
+    FD_SET (si->dsfd, &fds);
+    timeout.tv_sec = poll ? 0 : COM_THREAD_ABORT_TIMEOUT_SEC;
+    timeout.tv_usec = poll ? 0 : COM_THREAD_ABORT_TIMEOUT_USEC;
+
+    if (forWrite)
+      nfds = select (si->dsfd + 1, NULL, &fds, NULL, &timeout);
+    else
+      nfds = select (si->dsfd + 1, &fds, NULL, NULL, &timeout);
+
+    if (nfds != 0 || poll == false)
+      break;
+    sched_release (&si->flow);
+    poll = false;
+  }
+
+  if (nfds == -1) {
+    if (errno == EINTR)
+      return 0;
+    fprintf (stderr, "%s: select: %s\n", __FUNCTION__, strerror (errno));
+    return -1;
+  }
+
+  return nfds;
+}
+
+
+/******************************************************************************
+ * cmd_rest - see "transfer.h"
+ *****************************************************************************/
+void cmd_rest (session_info_t *si, char *arg)
+{
+  long long offset;
+  char *endPtr;
+  int csfd = si->csfd;
+
+  if (si->loggedin == false) {
+    send_mesg_530 (csfd, REPLY_530_REQUEST);
+    return;
+  }
+
+  if (arg == NULL) {
+    send_mesg_501 (csfd);
+    return;
+  }
+
+  //The marker must be a non-negative decimal integer.
+  errno = 0;
+  offset = strtoll (arg, &endPtr, 10);
+  if (errno != 0 || endPtr == arg || *endPtr != '\0' || offset < 0) {
+    send_mesg_501 (csfd);
+    return;
+  }
+
+  //REST replaces a byte range set by RANG.
+  si->restOffset = offset;
+  si->rangeEnd = -1;
+  send_mesg_350 (csfd, offset);
+}
+
+
+/******************************************************************************
+ * cmd_allo - see "transfer.h"
+ *****************************************************************************/
+void cmd_allo (session_info_t *si, char *arg)
+{
+  long long size, recordSize;
+  char *endPtr;
+  int csfd = si->csfd;
+
+  if (si->loggedin == false) {
+    send_mesg_530 (csfd, REPLY_530_REQUEST);
+    return;
+  }
+
+  if (arg == NULL) {
+    send_mesg_501 (csfd);
+    return;
+  }
+
+  errno = 0;
+  size = strtoll (arg, &endPtr, 10);
+  if (errno != 0 || endPtr == arg || size < 0) {
+    send_mesg_501 (csfd);
+    return;
+  }
+
+  //The record size of "ALLO <size> R <record-size>" does not apply to files.
+  if (strncasecmp (endPtr, " R ", 3) == 0) {
+    arg = endPtr + 3;
+    errno = 0;
+    recordSize = strtoll (arg, &endPtr, 10);
+    if (errno != 0 || endPtr == arg || recordSize < 0) {
+      send_mesg_501 (csfd);
+      return;
+    }
+  }
+  if (*endPtr != '\0') {
+    send_mesg_501 (csfd);
+    return;
+  }
+
+  si->alloSize = size;
+  send_mesg_200 (csfd, REPLY_200_ALLO);
+}
+
+
+/******************************************************************************
+ * cmd_rang - see "transfer.h"
+ *****************************************************************************/
+void cmd_rang (session_info_t *si, char *arg)
+{
+  long long start, end;
+  char *endPtr;
+  int csfd = si->csfd;
+
+  if (si->loggedin == false) {
+    send_mesg_530 (csfd, REPLY_530_REQUEST);
+    return;
+  }
+
+  if (arg == NULL) {
+    send_mesg_501 (csfd);
+    return;
+  }
+
+  //Two non-negative decimal integers, the first and last byte of the range.
+  errno = 0;
+  start = strtoll (arg, &endPtr, 10);
+  if (errno != 0 || endPtr == arg || *endPtr != ' ' || start < 0) {
+    send_mesg_501 (csfd);
+    return;
+  }
+  arg = endPtr;
+  end = strtoll (arg, &endPtr, 10);
+  if (errno != 0 || endPtr == arg || *endPtr != '\0' || end < 0) {
+    send_mesg_501 (csfd);
+    return;
+  }
+
+  //"RANG 1 0" resets the range, any other empty range is an error.
+  if (start == 1 && end == 0) {
+    si->restOffset = 0;
+    si->rangeEnd = -1;
+    send_mesg_350_range (csfd, 0, -1);
+    return;
+  } else if (end < start) {
+    send_mesg_501 (csfd);
+    return;
+  }
+
+  si->restOffset = start;
+  si->rangeEnd = end;
+  send_mesg_350_range (csfd, start, end);
+}
+
+
+/******************************************************************************
+ * Determine if the STOR or APPE filename argument should be permanently
+ * rejected.
+ *
+ * Arguments:
+ *     si - The control connection information maintained by session().
+ *   path - The pathname argument passed to the command function.
+ *
+ * Return values:
+ *   0    Accept the filename argument.
+ *  -1    Reject the filename argument.
+ *****************************************************************************/
+static int perm_neg_check (session_info_t *si, char *arg)
+{
+  int pathCheck;
+
+  /* If the client is anonymous or they haven't logged in, they don't have
+   * permission to run this command. */
+  if (si->loggedin == false || strcmp (si->user, "anonymous") == 0) {
+    send_mesg_530 (si->csfd, REPLY_530_REQUEST);
+    end_data_conn (si, false);
+    return -1;
+  }
+  
+  //Determine if the pathname argument should be accepted.
+  if ((pathCheck = check_future_file (si->cwd, arg, false)) == -1) {
+    cleanup_stor_recv (si, -1, 450);
+    return -1;
+  } else if (pathCheck == -2) {
+    cleanup_stor_recv (si, -1, 553);
+    return -1;
+  } else if (pathCheck == -3) {
+    cleanup_stor_recv (si, -1, 553);
+    return -1;
+  }
+  
+  return 0;
+}
+
+
+/******************************************************************************
+ * cleanup_stor_recv - see "transfer.h"
+ *****************************************************************************/
+void cleanup_stor_recv (session_info_t *si, int fd, int errcode)
+{
+  /* Send the appropriate reply to the client on the control connection when
+   * an error has occurred. */
+  if (errcode == 451) {
+    send_mesg_451 (si->csfd);
+  } else if (errcode == 553) {
+    send_mesg_553 (si->csfd);
+  } else if (errcode == 450) {
+    send_mesg_450 (si->csfd);
+  } else if (errcode == 452) {
+    send_mesg_452 (si->csfd);
+  }
+  
+  //Close the file if one is open.
+  if (fd != -1)
+    close (fd);
+
+  //Reset the data connection socket.
+  end_data_conn (si, false);
+}
+
+
+/******************************************************************************
+ * Size the next chunk of a transfer, and wait for the scheduler to grant it.
+ *
+ * Arguments:
+ *     si - The session information.
+ *   tune - The chunk sizing state of the transfer.
+ *
+ * Returns:
+ *   The size of the chunk, or 0 if the transfer was aborted while waiting.
+ *****************************************************************************/
+static size_t chunk_start (session_info_t *si, tcp_tune_t *tune)
+{
+  size_t chunk = rate_clamp (&si->rate, tune_update (tune));
+
+  if (sched_acquire (&si->flow, chunk, &si->cmdAbort) == false)
+    return 0;
+  return chunk;
+}
+
+
+/******************************************************************************
+ * Account for a chunk that has been moved. The grant is kept for the next
+ * chunk, unless the transfer is about to sleep for its bandwidth limit.
+ *
+ * Arguments:
+ *      si - The session information.
+ *   moved - The number of bytes moved.
+ *****************************************************************************/
+static void chunk_end (session_info_t *si, size_t moved)
+{
+  sched_charge (&si->flow, moved);
+  if (rate_limited (&si->rate))
+    sched_release (&si->flow);
+  rate_charge (&si->rate, moved, &si->cmdAbort);
+}
+
+
+/******************************************************************************
+ * Limit the number of bytes to send from a file to the bytes left in the
+ * range.
+ *
+ * Arguments:
+ *   range - The part of the file being sent.
+ *     len - The number of bytes the caller would send.
+ *
+ * Returns:
+ *   The number of bytes to send, 0 at the end of the range.
+ *****************************************************************************/
+static size_t range_clamp (const struct file_range *range, size_t len)
+{
+  if (range->left >= 0 && (off_t)len > range->left)
+    return range->left;
+  return len;
+}
+
+
+/******************************************************************************
+ * Limit the number of bytes to send from a file to the extent of data, or
+ * the hole, at the offset of the range. The extent is looked up when the
+ * range enters it, with SEEK_DATA and SEEK_HOLE.
+ *
+ * Arguments:
+ *      fd - The file being sent.
+ *   range - The part of the file being sent.
+ *     len - The number of bytes the caller would send, more than 0.
+ *    hole - Set to true if the bytes are in a hole, and are to be sent from
+ *           the buffer of sparse_zeros() without reading the file.
+ *
+ * Returns:
+ *   The number of bytes to send, at most the size of the buffer of zeros for
+ *   a hole.
+ *****************************************************************************/
+static size_t range_extent (int fd, struct file_range *range, size_t len,
+			    bool *hole)
+{
+  size_t zerosLen;
+
+  if (range->offset >= range->extentEnd)
+    range->extentEnd = sparse_extent (fd, range->offset, &range->hole);
+
+  if ((off_t)len > range->extentEnd - range->offset)
+    len = range->extentEnd - range->offset;
+
+  if (range->hole) {
+    sparse_zeros (&zerosLen);
+    if (len > zerosLen)
+      len = zerosLen;
+  }
+
+  *hole = range->hole;
+  return len;
+}
+
+
+/******************************************************************************
+ * Account for bytes read from a file at the offset of the range.
+ *
+ * Arguments:
+ *   range - The part of the file being sent.
+ *     len - The number of bytes read.
+ *****************************************************************************/
+static void range_advance (struct file_range *range, size_t len)
+{
+  range->offset += len;
+  if (range->left > 0)
+    range->left -= len;
+
+  if (range->hint != NULL)
+    rh_advance (range->hint, range->offset);
 }
@@ -45,6 +45,19 @@ void cmd_stor (session_info_t *si, char *cmd);
  *****************************************************************************/
 void cmd_appe (session_info_t *si, char *cmd);
 
+/******************************************************************************
+ * Extract a tar archive received on the data connection under a directory,
+ * for SITE UNTAR (see untar.h). The archive passes through the transfer mode
+ * like the data of STOR, and is always binary. The 226 reply counts the
+ * files and directories that were extracted and the entries that were
+ * skipped. If a file could not be written the reply is 451.
+ *
+ * Arguments:
+ *    si - Info for the current session.
+ *   dir - The directory to extract to, which must exist.
+ *****************************************************************************/
+void cmd_untar (session_info_t *si, char *dir);
+
 /******************************************************************************
  * Retrieve a file from the server file system.
  *
@@ -54,21 +67,146 @@ void cmd_appe (session_info_t *si, char *cmd);
  *****************************************************************************/
 void cmd_retr (session_info_t *si, char *path);
 
+/******************************************************************************
+ * Retrieve a batch of files over one data connection, for SITE MRETR. Many
+ * small files are sent without a reply and a data connection for each.
+ *
+ * Each file is sent in a frame: the length of its pathname in 2 bytes, the
+ * pathname as it was requested, the size of the file in 8 bytes, then the
+ * file. Numbers are big-endian. A frame with a pathname of length 0 ends the
+ * batch. The frames pass through the transfer mode like the data of RETR,
+ * and are always binary.
+ *
+ * A file that cannot be sent has no frame. The 226 reply lists each
+ * pathname with its own reply code: 226 sent, 553 not found or not allowed,
+ * 450 not a readable file, 451 changed while it was sent.
+ *
+ * Arguments:
+ *      si - The session information.
+ *   paths - The pathnames of the files, separated by spaces.
+ *****************************************************************************/
+void cmd_mretr (session_info_t *si, char *paths);
+
+/******************************************************************************
+ * Send the signature of a file, for SITE DSIG (see delta.h). A client that
+ * holds a changed copy of the file sends only the difference with DSTOR.
+ * The signature passes through the transfer mode like the data of RETR, and
+ * is always binary.
+ *
+ * Arguments:
+ *     si - The session information.
+ *   path - The pathname of the file.
+ *****************************************************************************/
+void cmd_dsig (session_info_t *si, char *path);
+
+/******************************************************************************
+ * Store a file from a delta against its current contents, for SITE DSTOR
+ * (see delta.h). The new file is built under a temporary name and renamed
+ * into place once it matches the MD5 at the end of the delta. The 226 reply
+ * counts the bytes received as literal data and copied from the old file.
+ *
+ * Arguments:
+ *     si - The session information.
+ *   path - The pathname of the file, which must exist.
+ *****************************************************************************/
+void cmd_dstor (session_info_t *si, char *path);
+
+/******************************************************************************
+ * Receive the signature of the client's copy of a file, for SITE DBASE (see
+ * delta.h). The signature is kept by the session for the next DRETR.
+ *
+ * Arguments:
+ *    si - The session information.
+ *   arg - Ignored.
+ *****************************************************************************/
+void cmd_dbase (session_info_t *si, char *arg);
+
+/******************************************************************************
+ * Send a file as a delta against the signature received by DBASE, for SITE
+ * DRETR (see delta.h). The signature is used once. The 226 reply counts the
+ * bytes sent as literal data and found in the client's copy.
+ *
+ * Arguments:
+ *     si - The session information.
+ *   path - The pathname of the file.
+ *****************************************************************************/
+void cmd_dretr (session_info_t *si, char *path);
+
+/******************************************************************************
+ * Set the restart marker for the next RETR or STOR command. The marker is the
+ * number of bytes of the file to skip (RETR) or keep (STOR), as described in
+ * "RFC 3659" for the stream transfer mode.
+ *
+ * The marker is used by, and reset after, the next RETR, STOR, APPE, or STOU
+ * command, regardless of whether that transfer succeeds. APPE and STOU ignore
+ * the marker.
+ *
+ * Arguments:
+ *    si - Info for the current session.
+ *   arg - The restart marker, a non-negative decimal integer.
+ *****************************************************************************/
+void cmd_rest (session_info_t *si, char *arg);
+
+/******************************************************************************
+ * Announce the size of the file sent by the next STOR, APPE, or STOU command.
+ * The space is reserved on the disk before the file is received, so that a
+ * large file is laid out in one piece, and an upload that would not fit fails
+ * at once with 452. The optional record size is ignored.
+ *
+ * Arguments:
+ *    si - Info for the current session.
+ *   arg - The size of the file in bytes, optionally followed by " R " and a
+ *         record size.
+ *****************************************************************************/
+void cmd_allo (session_info_t *si, char *arg);
+
+/******************************************************************************
+ * Set the byte range of the file sent by the next RETR command, as described
+ * by the draft "Byte Range Extension to FTP". The range includes its first
+ * and last bytes. A client may open several sessions and fetch distinct
+ * ranges of one file at once. "RANG 1 0" resets the range.
+ *
+ * Like the REST marker, the range is reset after the next transfer command.
+ * REST replaces a range, and a STOR after RANG resumes at the first byte of
+ * the range as after REST.
+ *
+ * Arguments:
+ *    si - Info for the current session.
+ *   arg - The first and last byte of the range, separated by a space.
+ *****************************************************************************/
+void cmd_rang (session_info_t *si, char *arg);
+
+
+/******************************************************************************
+ * Write the entire buffer to a file, handling partial writes.
+ *
+ * Arguments:
+ *    fd - The file to write to.
+ *   buf - The bytes to write.
+ *   len - The number of bytes to write.
+ *
+ * Return values:
+ *   0    The full buffer was written.
+ *  -1    Error, the buffer was not written in full.
+ *****************************************************************************/
+int write_all (int fd, const char *buf, size_t len);
+
+
 /******************************************************************************
  * Close all sockets, reset the stored data socket file descriptor in the
- * session_info_t structure, and close the file pointer when appropriate.
+ * session_info_t structure, and close the file when appropriate.
  *
  * This function was created to help defend against programmer error. These
  * closing statements appear in many places in the stor command.
  *
  * Arguments:
  *   si - Info for the current session.
- *   fp - The open filestream, set this to NULL if no filestream has been
+ *   fd - The open file descriptor, set this to -1 if no file has been
  *        opened.
  *   errcode - The type of error. This should be set to zero if no error
  *             has occurred (a clean exit from the caller function).
  *****************************************************************************/
-void cleanup_stor_recv (session_info_t *si, FILE *fp, int errcode);
+void cleanup_stor_recv (session_info_t *si, int fd, int errcode);
 
 
 #endif //__TRANSFER_H__
@@ -0,0 +1,797 @@
+/******************************************************************************
+ * FTP-Server
+ * Author: Evan Myers
+ * Date: October 2026
+ *
+ * Description:
+ *   Extraction of uploaded tar archives. See untar.h for an overview.
+ *
+ *   The sink reads the archive as a state machine, since the pieces it is
+ *   given do not follow the blocks of the archive. A header is gathered into
+ *   a block, then the data of its entry is handled as it arrives, followed
+ *   by the padding to the next block.
+ *****************************************************************************/
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "commit.h"
+#include "config.h"
+#include "transfer.h"
+#include "untar.h"
+
+
+//The parts of an archive.
+#define STATE_HEADER 0  //A header block.
+#define STATE_FILE   1  //The data of a file.
+#define STATE_META   2  //The data of a long name or extended header.
+#define STATE_SKIP   3  //The data of an entry that is not extracted.
+#define STATE_PAD    4  //The padding after the data.
+#define STATE_END    5  //After the end of the archive, the rest is ignored.
+
+//The defaults of the ftp.conf settings.
+#define DEFAULT_WRITERS 4
+#define DEFAULT_QUEUE 16777216
+
+//The largest file gathered in memory for a writer.
+#define JOB_MAX 1048576
+
+//The largest long name or extended header.
+#define META_MAX 65536
+
+//The permissions of extracted files and directories, as for STOR and MKD.
+#define FILE_MODE (S_IRUSR | S_IWUSR | S_IRGRP | S_IWGRP | S_IROTH | S_IWOTH)
+#define DIR_MODE S_IRWXU
+
+
+//A small file, gathered in memory for a writer thread.
+struct untar_job {
+  struct untar_job *next;
+  char *path;       //The pathname of the file.
+  time_t mtime;
+  size_t len;       //The size of the file.
+  size_t filled;    //The bytes of 'data' received so far.
+  uint8_t data[];
+};
+
+
+//Local function prototypes.
+static int untar_push (pipe_stage_t *stage, const uint8_t *data, size_t len);
+static int untar_finish (pipe_stage_t *stage);
+static int read_header (untar_t *ut);
+static int start_entry (untar_t *ut);
+static int end_entry (untar_t *ut);
+static char *entry_path (untar_t *ut, const char *name);
+static int make_parents (untar_t *ut, char *path);
+static void make_dir (untar_t *ut, char *path);
+static int start_file (untar_t *ut, char *path);
+static int end_file (untar_t *ut);
+static void drop_file (untar_t *ut);
+static int path_writer (untar_t *ut, const char *path);
+static void wait_writer (untar_t *ut, const char *path);
+static void queue_job (untar_t *ut, struct untar_job *job);
+static void *writer (void *param);
+static int write_job (struct untar_job *job);
+static void set_mtime (int fd, time_t mtime);
+
+
+//Written once by untar_load_config() before any thread is created.
+static int numWriters = DEFAULT_WRITERS;
+static size_t queueMax = DEFAULT_QUEUE;
+
+
+/******************************************************************************
+ * untar_load_config - see untar.h
+ *****************************************************************************/
+void untar_load_config (void)
+{
+  long long value;
+
+  value = get_config_number ("UNTAR_WRITERS_CONFIG", FTP_CONFIG_FILE,
+			     DEFAULT_WRITERS);
+  if (value < 0)
+    value = 0;
+  numWriters = (value > UNTAR_MAX_WRITERS) ? UNTAR_MAX_WRITERS : value;
+
+  //The queue holds at least one file of the largest size gathered.
+  value = get_config_number ("UNTAR_QUEUE_CONFIG", FTP_CONFIG_FILE,
+			     DEFAULT_QUEUE);
+  queueMax = (value < JOB_MAX) ? JOB_MAX : value;
+}
+
+
+/******************************************************************************
+ * untar_start - see untar.h
+ *****************************************************************************/
+int untar_start (untar_t *ut, const char *dirpath)
+{
+  int i;
+
+  memset (ut, 0, sizeof (*ut));
+  ut->state = STATE_HEADER;
+  ut->nextSize = -1;
+  ut->fd = -1;
+
+  if ((ut->root = strdup (dirpath)) == NULL) {
+    fprintf (stderr, "%s: strdup: %s\n", __FUNCTION__, strerror (errno));
+    return -1;
+  }
+  ut->rootLen = strlen (ut->root);
+  while (ut->rootLen > 1 && ut->root[ut->rootLen - 1] == '/')
+    ut->root[--ut->rootLen] = '\0';
+
+  pthread_mutex_init (&ut->mutex, NULL);
+  pthread_cond_init (&ut->cond, NULL);
+
+  //Without writers, each file is written as soon as it is received.
+  for (i = 0; i < numWriters; i++) {
+    if (pthread_create (&ut->writers[i], NULL, writer, ut) != 0) {
+      fprintf (stderr, "%s: pthread_create failed, %d writers\n", __FUNCTION__,
+	       i);
+      break;
+    }
+  }
+  ut->numWriters = i;
+
+  return 0;
+}
+
+
+/******************************************************************************
+ * untar_stage - see untar.h
+ *****************************************************************************/
+void untar_stage (untar_t *ut, pipe_stage_t *stage)
+{
+  pipe_stage_init (stage, "untar", untar_push, untar_finish, ut);
+}
+
+
+/******************************************************************************
+ * untar_end - see untar.h
+ *****************************************************************************/
+void untar_end (untar_t *ut, bool complete)
+{
+  struct untar_job *job;
+  int i;
+
+  pthread_mutex_lock (&ut->mutex);
+  for (i = 0; !complete && i < ut->numWriters; i++) {
+    while ((job = ut->head[i]) != NULL) {
+      ut->head[i] = job->next;
+      ut->queued -= job->len;
+      free (job->path);
+      free (job);
+    }
+    ut->tail[i] = NULL;
+  }
+  ut->stop = true;
+  pthread_cond_broadcast (&ut->cond);
+  pthread_mutex_unlock (&ut->mutex);
+
+  for (i = 0; i < ut->numWriters; i++)
+    pthread_join (ut->writers[i], NULL);
+
+  drop_file (ut);
+  pthread_mutex_destroy (&ut->mutex);
+  pthread_cond_destroy (&ut->cond);
+  free (ut->meta);
+  free (ut->root);
+}
+
+
+/******************************************************************************
+ * Read a piece of the archive. The push function of the sink.
+ *****************************************************************************/
+static int untar_push (pipe_stage_t *stage, const uint8_t *data, size_t len)
+{
+  untar_t *ut = stage->state;
+  struct untar_job *job;
+  size_t part;
+
+  while (len > 0) {
+    if (ut->state == STATE_END)
+      return 0;
+
+    if (ut->state == STATE_HEADER) {
+      part = TAR_BLOCK - ut->blockLen;
+      part = (part > len) ? len : part;
+      memcpy (ut->block + ut->blockLen, data, part);
+      ut->blockLen += part;
+      if (ut->blockLen == TAR_BLOCK && read_header (ut) == -1)
+	return -1;
+
+    } else if (ut->state == STATE_PAD) {
+      part = (ut->pad > len) ? len : ut->pad;
+      ut->pad -= part;
+      if (ut->pad == 0)
+	ut->state = STATE_HEADER;
+
+    } else {
+      part = (ut->left > (off_t)len) ? len : (size_t)ut->left;
+
+      if (ut->state == STATE_META) {
+	memcpy (ut->meta + ut->metaLen, data, part);
+	ut->metaLen += part;
+      } else if (ut->state == STATE_FILE && (job = ut->job) != NULL) {
+	memcpy (job->data + job->filled, data, part);
+	job->filled += part;
+      } else if (ut->state == STATE_FILE && wb_write (&ut->wb, data, part)
+		 == -1) {
+	return -1;
+      }
+
+      ut->left -= part;
+      if (ut->left == 0 && end_entry (ut) == -1)
+	return -1;
+    }
+
+    data += part;
+    len -= part;
+  }
+
+  return 0;
+}
+
+
+/******************************************************************************
+ * Check that the archive did not end in the middle of an entry. The finish
+ * function of the sink.
+ *****************************************************************************/
+static int untar_finish (pipe_stage_t *stage)
+{
+  untar_t *ut = stage->state;
+
+  //An archive may end without its zero blocks, but not within an entry.
+  if (ut->state == STATE_END ||
+      (ut->state == STATE_HEADER && ut->blockLen == 0))
+    return 0;
+
+  fprintf (stderr, "%s: the archive ends within an entry\n", __FUNCTION__);
+  return -1;
+}
+
+
+/******************************************************************************
+ * Read the header block that was gathered, and start its entry.
+ *
+ * Return values:
+ *   0    success
+ *  -1    The block is not a valid header.
+ *****************************************************************************/
+static int read_header (untar_t *ut)
+{
+  int retVal;
+
+  ut->blockLen = 0;
+  if ((retVal = tar_read_header (ut->block, &ut->hdr)) == -1) {
+    fprintf (stderr, "%s: invalid tar header\n", __FUNCTION__);
+    return -1;
+  } else if (retVal == 0) {
+    ut->state = STATE_END;
+    return 0;
+  }
+
+  //A long name or extended header gives the name or size of this entry.
+  if (ut->nextName[0] != '\0')
+    strcpy (ut->hdr.name, ut->nextName);
+  if (ut->nextSize >= 0)
+    ut->hdr.size = ut->nextSize;
+  ut->nextName[0] = '\0';
+  ut->nextSize = -1;
+
+  ut->left = ut->hdr.size;
+  ut->pad = tar_padding (ut->hdr.size);
+  if (start_entry (ut) == -1)
+    return -1;
+
+  //An entry without data is complete.
+  if (ut->left == 0)
+    return end_entry (ut);
+  return 0;
+}
+
+
+/******************************************************************************
+ * Start the entry of the header that was read: create a directory, or
+ * prepare to receive a file.
+ *
+ * Return values:
+ *   0    success, the entry may have been skipped.
+ *  -1    error
+ *****************************************************************************/
+static int start_entry (untar_t *ut)
+{
+  char *path;
+  char type = ut->hdr.type;
+
+  if (type == TAR_TYPE_LONGNAME || type == TAR_TYPE_PAX) {
+    if (ut->hdr.size >= META_MAX) {
+      fprintf (stderr, "%s: extended header too large\n", __FUNCTION__);
+      return -1;
+    }
+    if (ut->meta == NULL && (ut->meta = malloc (META_MAX)) == NULL) {
+      fprintf (stderr, "%s: malloc: %s\n", __FUNCTION__, strerror (errno));
+      return -1;
+    }
+    ut->metaLen = 0;
+    ut->state = STATE_META;
+    return 0;
+  }
+
+  ut->state = STATE_SKIP;
+  if (type != TAR_TYPE_FILE && type != TAR_TYPE_DIR) {
+    //A global extended header is not an entry, it is not counted.
+    if (type != 'g')
+      ut->skipped++;
+    return 0;
+  }
+
+  if ((path = entry_path (ut, ut->hdr.name)) == NULL) {
+    ut->skipped++;
+    return 0;
+  }
+
+  if (type == TAR_TYPE_DIR) {
+    make_dir (ut, path);
+  } else if (start_file (ut, path) == 0) {
+    ut->state = STATE_FILE;
+    return 0;
+  } else {
+    ut->skipped++;
+  }
+
+  free (path);
+  return 0;
+}
+
+
+/******************************************************************************
+ * End the entry whose data was received.
+ *
+ * Return values:
+ *   0    success
+ *  -1    error
+ *****************************************************************************/
+static int end_entry (untar_t *ut)
+{
+  if (ut->state == STATE_META) {
+    ut->meta[ut->metaLen] = '\0';
+    if (ut->hdr.type == TAR_TYPE_LONGNAME) {
+      //The name is terminated within its data.
+      snprintf (ut->nextName, sizeof (ut->nextName), "%s", ut->meta);
+    } else if (tar_read_pax (ut->meta, ut->metaLen, ut->nextName,
+			     &ut->nextSize) == -1) {
+      fprintf (stderr, "%s: invalid extended header\n", __FUNCTION__);
+      return -1;
+    }
+  } else if (ut->state == STATE_FILE && end_file (ut) == -1) {
+    return -1;
+  }
+
+  ut->state = (ut->pad > 0) ? STATE_PAD : STATE_HEADER;
+  return 0;
+}
+
+
+/******************************************************************************
+ * Get the pathname an entry is extracted to, and create the directories it
+ * lies in. The name must be relative, and may not contain "..". Empty and
+ * "." components are removed.
+ *
+ * The caller must free the returned string.
+ *
+ * Returns:
+ *   The pathname, or NULL if the entry may not be extracted.
+ *****************************************************************************/
+static char *entry_path (untar_t *ut, const char *name)
+{
+  char *path;
+  char *out;
+  const char *comp;
+  size_t compLen;
+
+  if (name[0] == '/') {
+    fprintf (stderr, "%s: absolute name '%s' skipped\n", __FUNCTION__, name);
+    return NULL;
+  }
+
+  if ((path = malloc (ut->rootLen + strlen (name) + 2)) == NULL) {
+    fprintf (stderr, "%s: malloc: %s\n", __FUNCTION__, strerror (errno));
+    return NULL;
+  }
+  memcpy (path, ut->root, ut->rootLen);
+  out = path + ut->rootLen;
+
+  for (comp = name; *comp != '\0'; comp += compLen) {
+    while (*comp == '/')
+      comp++;
+    compLen = strcspn (comp, "/");
+    if (compLen == 0 || (compLen == 1 && comp[0] == '.'))
+      continue;
+    if (compLen == 2 && comp[0] == '.' && comp[1] == '.') {
+      fprintf (stderr, "%s: name '%s' leaves the directory, skipped\n",
+	       __FUNCTION__, name);
+      free (path);
+      return NULL;
+    }
+    *out++ = '/';
+    memcpy (out, comp, compLen);
+    out += compLen;
+  }
+  *out = '\0';
+
+  //The target directory itself, eg. "./", is not extracted.
+  if (out == path + ut->rootLen || out - path >= PATH_MAX ||
+      make_parents (ut, path) == -1) {
+    free (path);
+    return NULL;
+  }
+
+  return path;
+}
+
+
+/******************************************************************************
+ * Create the missing directories between the target directory and an
+ * extracted pathname. Each existing component must be a directory, and not
+ * a link to one, so the pathname cannot lead out of the target directory.
+ *
+ * Return values:
+ *   0    success
+ *  -1    A component is not a directory, or cannot be created.
+ *****************************************************************************/
+static int make_parents (untar_t *ut, char *path)
+{
+  struct stat st;
+  char *slash;
+  size_t dirLen = strrchr (path, '/') - path;
+
+  //The entries of an archive are grouped by directory.
+  if (dirLen == ut->rootLen || (strlen (ut->lastDir) == dirLen &&
+				memcmp (ut->lastDir, path, dirLen) == 0))
+    return 0;
+
+  for (slash = strchr (path + ut->rootLen + 1, '/'); slash != NULL;
+       slash = strchr (slash + 1, '/')) {
+    *slash = '\0';
+    if (lstat (path, &st) == -1) {
+      if (errno != ENOENT || mkdir (path, DIR_MODE) == -1) {
+	fprintf (stderr, "%s: mkdir: %s\n", __FUNCTION__, strerror (errno));
+	*slash = '/';
+	return -1;
+      }
+      ut->dirs++;
+    } else if (!S_ISDIR (st.st_mode)) {
+      fprintf (stderr, "%s: '%s' is not a directory, entry skipped\n",
+	       __FUNCTION__, path);
+      *slash = '/';
+      return -1;
+    }
+    *slash = '/';
+  }
+
+  memcpy (ut->lastDir, path, dirLen);
+  ut->lastDir[dirLen] = '\0';
+  return 0;
+}
+
+
+/******************************************************************************
+ * Create the directory of a directory entry, unless it exists.
+ *****************************************************************************/
+static void make_dir (untar_t *ut, char *path)
+{
+  struct stat st;
+
+  if (lstat (path, &st) == 0) {
+    if (!S_ISDIR (st.st_mode))
+      ut->skipped++;
+    return;
+  }
+
+  if (mkdir (path, DIR_MODE) == -1) {
+    fprintf (stderr, "%s: mkdir: %s\n", __FUNCTION__, strerror (errno));
+    ut->skipped++;
+    return;
+  }
+  ut->dirs++;
+}
+
+
+/******************************************************************************
+ * Prepare to receive the data of a file entry. A small file is gathered for
+ * a writer, a large file is opened and written as it arrives.
+ *
+ * Arguments:
+ *     ut - The extraction state, 'hdr' is the header of the file.
+ *   path - The pathname of the file, kept by the extraction on success.
+ *
+ * Return values:
+ *   0    success
+ *  -1    The file cannot be extracted.
+ *****************************************************************************/
+static int start_file (untar_t *ut, char *path)
+{
+  struct untar_job *job;
+  struct stat st;
+
+  //A directory is not replaced by a file.
+  if (lstat (path, &st) == 0 && S_ISDIR (st.st_mode)) {
+    fprintf (stderr, "%s: '%s' is a directory, entry skipped\n",
+	     __FUNCTION__, path);
+    return -1;
+  }
+
+  ut->files++;
+  if (ut->hdr.size <= JOB_MAX) {
+    if ((job = malloc (sizeof (*job) + ut->hdr.size)) == NULL) {
+      fprintf (stderr, "%s: malloc: %s\n", __FUNCTION__, strerror (errno));
+      ut->files--;
+      return -1;
+    }
+    job->path = path;
+    job->mtime = ut->hdr.mtime;
+    job->len = ut->hdr.size;
+    job->filled = 0;
+    ut->job = job;
+    return 0;
+  }
+
+  //An earlier entry of the same name must be in place first.
+  wait_writer (ut, path);
+
+  ut->path = path;
+  ut->fd = commit_part_open (path, O_WRONLY | O_CREAT | O_TRUNC | O_NOFOLLOW,
+			     FILE_MODE, &ut->partpath);
+  if (ut->fd != -1 && wb_start (&ut->wb, ut->fd, true, false) == -1) {
+    close (ut->fd);
+    ut->fd = -1;
+  } else if (ut->fd != -1 && wb_allocate (&ut->wb, ut->hdr.size) == 0) {
+    return 0;
+  } else if (ut->fd != -1) {
+    wb_end (&ut->wb);
+    close (ut->fd);
+    ut->fd = -1;
+  }
+
+  //The path is freed by the caller.
+  if (ut->partpath != NULL)
+    unlink (ut->partpath);
+  free (ut->partpath);
+  ut->partpath = NULL;
+  ut->path = NULL;
+  ut->files--;
+  return -1;
+}
+
+
+/******************************************************************************
+ * Complete a file whose data was received: give a small file to a writer, or
+ * write out and rename a large file.
+ *
+ * Return values:
+ *   0    success, the file may have failed (see 'failed').
+ *  -1    error
+ *****************************************************************************/
+static int end_file (untar_t *ut)
+{
+  int retVal;
+
+  if (ut->job != NULL) {
+    queue_job (ut, ut->job);
+    ut->job = NULL;
+    return 0;
+  }
+
+  retVal = wb_flush (&ut->wb);
+  wb_end (&ut->wb);
+  if (retVal == 0) {
+    set_mtime (ut->fd, ut->hdr.mtime);
+    retVal = commit_upload (ut->fd, ut->partpath, ut->path);
+  }
+
+  if (retVal == -1) {
+    pthread_mutex_lock (&ut->mutex);
+    ut->failed++;
+    pthread_mutex_unlock (&ut->mutex);
+    if (ut->partpath != NULL)
+      unlink (ut->partpath);
+  }
+
+  close (ut->fd);
+  ut->fd = -1;
+  free (ut->partpath);
+  free (ut->path);
+  ut->partpath = NULL;
+  ut->path = NULL;
+  return 0;
+}
+
+
+/******************************************************************************
+ * Drop the file being received, if any, at the end of an extraction.
+ *****************************************************************************/
+static void drop_file (untar_t *ut)
+{
+  if (ut->job != NULL) {
+    free (ut->job->path);
+    free (ut->job);
+    ut->job = NULL;
+    ut->files--;
+  }
+
+  if (ut->fd != -1) {
+    wb_end (&ut->wb);
+    close (ut->fd);
+    ut->fd = -1;
+    if (ut->partpath != NULL)
+      unlink (ut->partpath);
+    free (ut->partpath);
+    free (ut->path);
+    ut->partpath = NULL;
+    ut->path = NULL;
+    ut->files--;
+  }
+}
+
+
+/******************************************************************************
+ * Choose the writer of the files of a pathname.
+ *****************************************************************************/
+static int path_writer (untar_t *ut, const char *path)
+{
+  unsigned int hash = 5381;
+
+  while (*path != '\0')
+    hash = hash * 33 + (unsigned char)*path++;
+
+  return hash % ut->numWriters;
+}
+
+
+/******************************************************************************
+ * Wait for the writer of a pathname to write the files queued for it, so
+ * that a file written by the command thread is renamed into place after any
+ * earlier entry of the same name.
+ *****************************************************************************/
+static void wait_writer (untar_t *ut, const char *path)
+{
+  int i;
+
+  if (ut->numWriters == 0)
+    return;
+
+  i = path_writer (ut, path);
+  pthread_mutex_lock (&ut->mutex);
+  while (ut->head[i] != NULL || ut->busy[i])
+    pthread_cond_wait (&ut->cond, &ut->mutex);
+  pthread_mutex_unlock (&ut->mutex);
+}
+
+
+/******************************************************************************
+ * Give a small file to its writer. The command thread waits while the queue
+ * is full, so that a fast client cannot fill the memory of the server.
+ *****************************************************************************/
+static void queue_job (untar_t *ut, struct untar_job *job)
+{
+  int i;
+
+  //Without writers, the file is written here.
+  if (ut->numWriters == 0) {
+    if (write_job (job) == -1)
+      ut->failed++;
+    free (job->path);
+    free (job);
+    return;
+  }
+
+  pthread_mutex_lock (&ut->mutex);
+  while (ut->queued > 0 && ut->queued + job->len > queueMax)
+    pthread_cond_wait (&ut->cond, &ut->mutex);
+
+  i = path_writer (ut, job->path);
+  job->next = NULL;
+  if (ut->tail[i] != NULL)
+    ut->tail[i]->next = job;
+  else
+    ut->head[i] = job;
+  ut->tail[i] = job;
+  ut->queued += job->len;
+
+  pthread_cond_broadcast (&ut->cond);
+  pthread_mutex_unlock (&ut->mutex);
+}
+
+
+/******************************************************************************
+ * The writer threads of an extraction. Each takes a queue of its own, and
+ * writes its small files in order until it is told to stop and the queue is
+ * empty.
+ *
+ * Arguments:
+ *   param - The extraction state.
+ *****************************************************************************/
+static void *writer (void *param)
+{
+  untar_t *ut = param;
+  struct untar_job *job;
+  int retVal;
+  int i;
+
+  pthread_mutex_lock (&ut->mutex);
+  i = ut->started++;
+  for (;;) {
+    while (ut->head[i] == NULL && !ut->stop)
+      pthread_cond_wait (&ut->cond, &ut->mutex);
+    if ((job = ut->head[i]) == NULL)
+      break;
+    if ((ut->head[i] = job->next) == NULL)
+      ut->tail[i] = NULL;
+    ut->busy[i] = true;
+    pthread_mutex_unlock (&ut->mutex);
+
+    retVal = write_job (job);
+
+    pthread_mutex_lock (&ut->mutex);
+    ut->busy[i] = false;
+    ut->queued -= job->len;
+    if (retVal == -1)
+      ut->failed++;
+    pthread_cond_broadcast (&ut->cond);
+    free (job->path);
+    free (job);
+  }
+  pthread_mutex_unlock (&ut->mutex);
+
+  return NULL;
+}
+
+
+/******************************************************************************
+ * Write a small file under its temporary name, and rename it into place.
+ *
+ * Return values:
+ *   0    success
+ *  -1    error
+ *****************************************************************************/
+static int write_job (struct untar_job *job)
+{
+  char *partpath;
+  int fd;
+  int retVal = -1;
+
+  if ((fd = commit_part_open (job->path, O_WRONLY | O_CREAT | O_TRUNC |
+			      O_NOFOLLOW, FILE_MODE, &partpath)) == -1)
+    return -1;
+
+  if (write_all (fd, (char *)job->data, job->len) == 0) {
+    set_mtime (fd, job->mtime);
+    retVal = commit_upload (fd, partpath, job->path);
+  }
+
+  if (retVal == -1 && partpath != NULL)
+    unlink (partpath);
+  close (fd);
+  free (partpath);
+  return retVal;
+}
+
+
+/******************************************************************************
+ * Set the modification time of an extracted file to that of its entry.
+ *****************************************************************************/
+static void set_mtime (int fd, time_t mtime)
+{
+  struct timespec times[2];
+
+  times[0].tv_sec = 0;
+  times[0].tv_nsec = UTIME_OMIT;
+  times[1].tv_sec = mtime;
+  times[1].tv_nsec = 0;
+  if (futimens (fd, times) == -1)
+    fprintf (stderr, "%s: futimens: %s\n", __FUNCTION__, strerror (errno));
+}
@@ -0,0 +1,142 @@
+/******************************************************************************
+ * FTP-Server
+ * Author: Evan Myers
+ * Date: October 2026
+ *
+ * Description:
+ *   Extraction of uploaded tar archives, for SITE UNTAR. The archive is read
+ *   from the data connection by the sink of the upload pipeline, and never
+ *   stored. A client sends thousands of small files over one data connection
+ *   instead of one for each STOR.
+ *
+ *   The entries are extracted under the target directory, which must be
+ *   within the server root directory. An entry whose name is absolute or
+ *   contains "..", or whose path crosses anything but a directory (eg. a
+ *   symbolic link), is skipped, so nothing is written outside the target.
+ *   Only directories and regular files are extracted, other entries such as
+ *   links are skipped.
+ *
+ *   Each file is received under a temporary name and renamed into place
+ *   once it is complete, as STOR does (see commit.h). Small files are
+ *   gathered in memory and written by a pool of writer threads, so that the
+ *   open, write, rename and close of each file do not hold up the network.
+ *   A large file is written by the command thread as it is received,
+ *   through write-behind.
+ *
+ *   An archive may hold several entries of one name, and the last must win.
+ *   The small files of a name always go to the same writer, which writes its
+ *   queue in order, and a large file waits for that writer to finish the
+ *   files queued before it.
+ *****************************************************************************/
+#ifndef __UNTAR_H__
+#define __UNTAR_H__
+
+
+#include <limits.h>      //Required for 'PATH_MAX' in structure.
+#include <pthread.h>     //Required for 'pthread_t' in structure.
+#include <stdbool.h>     //Required for 'bool' in function prototype.
+#include <stddef.h>      //Required for 'size_t' in structure.
+#include <stdint.h>      //Required for 'uint8_t' in structure.
+#include <sys/types.h>   //Required for 'off_t' in structure.
+#include "pipeline.h"    //Required for 'pipe_stage_t' in function prototype.
+#include "tarstream.h"   //Required for 'tar_header_t' in structure.
+#include "writebehind.h" //Required for 'write_behind_t' in structure.
+
+
+//The most writer threads of one extraction.
+#define UNTAR_MAX_WRITERS 32
+
+
+struct untar_job;
+
+
+/******************************************************************************
+ * The state of the extraction of one archive. One of these structures is
+ * created by the command thread for each SITE UNTAR. The fields marked as
+ * shared are used by the writer threads, with the mutex held.
+ *****************************************************************************/
+typedef struct {
+  int state;                 //The part of the archive being read.
+  uint8_t block[TAR_BLOCK];  //A header block being gathered.
+  size_t blockLen;
+  tar_header_t hdr;          //The header of the current entry.
+  char nextName[PATH_MAX];   //The name of the next entry, from a long name or
+                             //extended header, or "".
+  off_t nextSize;            //The size of the next entry, or -1.
+  char *meta;                //The data of a long name or extended header.
+  size_t metaLen;
+  off_t left;                //The data of the current entry still to come.
+  size_t pad;                //The padding after it still to come.
+  char *root;                //The directory the archive is extracted to.
+  size_t rootLen;
+  char lastDir[PATH_MAX];    //The last parent directory that was checked.
+  struct untar_job *job;     //A small file being gathered, or NULL.
+  int fd;                    //A large file being written, or -1.
+  char *path;                //The pathname of the large file.
+  char *partpath;            //Its temporary pathname, or NULL.
+  write_behind_t wb;
+  long files;                //The files extracted, or being extracted.
+  long dirs;                 //The directories extracted.
+  long skipped;              //The entries that were not extracted.
+  pthread_t writers[UNTAR_MAX_WRITERS];
+  int numWriters;
+  pthread_mutex_t mutex;
+  pthread_cond_t cond;
+  struct untar_job *head[UNTAR_MAX_WRITERS];  //Shared: the small files
+                                              //waiting for each writer.
+  struct untar_job *tail[UNTAR_MAX_WRITERS];  //Shared.
+  bool busy[UNTAR_MAX_WRITERS];  //Shared: the writer is writing a file.
+  int started;               //Shared: the writers that have taken a queue.
+  size_t queued;             //Shared: the bytes waiting or being written.
+  long failed;               //Shared: the files that could not be written.
+  bool stop;                 //Shared: the writers should exit.
+} untar_t;
+
+
+/******************************************************************************
+ * Read the extraction settings from the server configuration file. This
+ * function should be called once, by main(), before any client connects.
+ *
+ * Settings (ftp.conf):
+ *   UNTAR_WRITERS_CONFIG - The writer threads of each extraction. 0 writes
+ *                          every file in the command thread.
+ *   UNTAR_QUEUE_CONFIG   - The bytes of small files that may wait for the
+ *                          writers before the data connection is read again.
+ *****************************************************************************/
+void untar_load_config (void);
+
+
+/******************************************************************************
+ * Prepare the extraction of an archive, and start its writer threads.
+ *
+ * Arguments:
+ *        ut - The extraction state to initialize.
+ *   dirpath - The pathname of the directory to extract to, which exists.
+ *
+ * Return values:
+ *   0    success
+ *  -1    error
+ *****************************************************************************/
+int untar_start (untar_t *ut, const char *dirpath);
+
+
+/******************************************************************************
+ * Prepare a pipeline sink that extracts the archive pushed into it. Its
+ * finish function fails if the archive ends in the middle of an entry.
+ *****************************************************************************/
+void untar_stage (untar_t *ut, pipe_stage_t *stage);
+
+
+/******************************************************************************
+ * Wait for the writer threads to write the files given to them, and free the
+ * extraction state. The counts of the state remain valid.
+ *
+ * Arguments:
+ *         ut - The extraction state.
+ *   complete - False if the transfer failed or was aborted. The files that
+ *              wait for a writer and the file being received are dropped.
+ *****************************************************************************/
+void untar_end (untar_t *ut, bool complete);
+
+
+#endif //__UNTAR_H__
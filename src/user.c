@@ -14,8 +14,12 @@
 #include "md5.h"
 #include "net.h"
 #include "reply.h"
+#include "ratelimit.h"
+#include "fairsched.h"
 #include "session.h"
+#include "tls.h"
 #include "user.h"
+#include "writebehind.h"
 
 
 //Local function prototypes.
@@ -34,6 +38,12 @@ void cmd_user (session_info_t *si, char *arg)
     return;
   }
 
+  // The password must not be sent in the clear when TLS is required.
+  if (tls_required () && !tls_active (csfd)) {
+    send_mesg_534 (csfd);
+    return;
+  }
+
   // If the USER command is given, log the current user out.
   si->loggedin = false;
   si->user[0] = '\0';
@@ -94,6 +104,10 @@ void cmd_pass (session_info_t *si, char *arg)
   if (strcmp (md5string, pass) == 0) {
     send_mesg_230 (csfd, REPLY_230_SUCCESS);
     si->loggedin = true;
+    //Charge the user's transfers to the user's bandwidth limit.
+    rate_session_login (&si->rate, si->user);
+    si->weight = sched_user_weight (si->user);
+    si->directIO = wb_user_direct (si->user);
   } else {
     // The password did not match the password found in the user.conf file.
     send_mesg_530 (csfd, REPLY_530_FAIL);
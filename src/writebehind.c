@@ -0,0 +1,733 @@
+/******************************************************************************
+ * FTP-Server
+ * Author: Evan Myers
+ * Date: October 2026
+ *
+ * Description:
+ *   Write-behind of uploaded files. See writebehind.h for an overview.
+ *
+ *   The first write of an upload ends at a multiple of the buffer size, and
+ *   every later write is a full, aligned buffer, except for the last one.
+ *   After each write the writeback of the new data is started, and the
+ *   upload waits for the writeback of data more than one window behind. This
+ *   is the same pattern a careful "dd" uses to stream to a disk without
+ *   filling the page cache.
+ *
+ *   A direct upload reopens the file with O_DIRECT through /proc, so the
+ *   unaligned start and end of the upload can still be written through the
+ *   page cache with the descriptor of the caller. Each full buffer is handed
+ *   to a writer thread in exchange for the buffer it has finished writing.
+ *
+ *   Buffers are taken from a small pool shared by all uploads, instead of
+ *   allocating (and faulting in) a new one for each upload.
+ *****************************************************************************/
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "config.h"
+#include "session.h"
+#include "sparse.h"
+#include "writebehind.h"
+
+
+//Writes are aligned to, and the buffer is a multiple of, the page size.
+#define WB_ALIGN 4096
+
+//The defaults of the ftp.conf settings.
+#define DEFAULT_BUFFER 1048576
+#define DEFAULT_WINDOW 33554432
+
+//The most free buffers kept in the pool.
+#define POOL_SIZE 16
+
+#define USER_SETTING_LEN (sizeof ("DIRECT_IO_") + USER_STRLEN)
+
+
+//Local function prototypes.
+static int write_out (write_behind_t *wb, const void *data, size_t len);
+static int flush_buffer (write_behind_t *wb);
+static int write_span (write_behind_t *wb, int fd, const uint8_t *data,
+		       size_t len, off_t offset);
+static int pwrite_all (int fd, const uint8_t *data, size_t len, off_t offset);
+static int extend_file (write_behind_t *wb);
+static void start_writeback (write_behind_t *wb, off_t end);
+static void start_direct (write_behind_t *wb);
+static int submit_direct (write_behind_t *wb);
+static int wait_writer (write_behind_t *wb);
+static void *direct_writer (void *arg);
+static void add_direct_dir (const char *dir);
+static uint8_t *buffer_get (void);
+static void buffer_put (uint8_t *buffer);
+
+
+extern char *rootdir; //The root directory of the server, defined in 'main.c'.
+
+
+/* The settings are written once by wb_load_config() before any thread is
+ * created. Writeback is started once per 'step' bytes of new data. */
+static size_t bufferSize = DEFAULT_BUFFER;
+static off_t window = DEFAULT_WINDOW;
+static off_t step = DEFAULT_BUFFER;
+
+//The canonical pathnames of the DIRECT_IO_DIRS_CONFIG directories.
+static char **directDirs = NULL;
+static int numDirectDirs = 0;
+
+//Free buffers of 'bufferSize' bytes.
+static uint8_t *pool[POOL_SIZE];
+static int poolCount = 0;
+static pthread_mutex_t poolMutex = PTHREAD_MUTEX_INITIALIZER;
+
+
+/******************************************************************************
+ * wb_load_config - see writebehind.h
+ *****************************************************************************/
+void wb_load_config (void)
+{
+  long long size;
+  char *dirs;
+  char *dir;
+  char *save;
+
+  size = get_config_number ("WRITE_BEHIND_CONFIG", FTP_CONFIG_FILE,
+			    DEFAULT_BUFFER);
+  if (size <= 0)
+    bufferSize = 0;
+  else
+    bufferSize = (size + WB_ALIGN - 1) / WB_ALIGN * WB_ALIGN;
+
+  window = get_config_number ("WRITEBACK_WINDOW_CONFIG", FTP_CONFIG_FILE,
+			      DEFAULT_WINDOW);
+  if (window < 0)
+    window = 0;
+
+  step = (bufferSize > 0) ? (off_t)bufferSize : DEFAULT_BUFFER;
+
+  if ((dirs = get_config_value ("DIRECT_IO_DIRS_CONFIG", FTP_CONFIG_FILE)) == NULL)
+    return;
+  for (dir = strtok_r (dirs, " \t", &save); dir != NULL;
+       dir = strtok_r (NULL, " \t", &save))
+    add_direct_dir (dir);
+  free (dirs);
+}
+
+
+/******************************************************************************
+ * wb_user_direct - see writebehind.h
+ *****************************************************************************/
+bool wb_user_direct (const char *username)
+{
+  char setting[USER_SETTING_LEN];
+
+  snprintf (setting, sizeof (setting), "DIRECT_IO_%s", username);
+  return get_config_number (setting, USER_CONFIG_FILE, 0) != 0;
+}
+
+
+/******************************************************************************
+ * wb_dir_direct - see writebehind.h
+ *****************************************************************************/
+bool wb_dir_direct (int fd)
+{
+  char link[sizeof ("/proc/self/fd/") + 12];
+  char path[PATH_MAX];
+  ssize_t len;
+  size_t dirLen;
+  int i;
+
+  if (numDirectDirs == 0)
+    return false;
+
+  //The descriptor leads to the canonical pathname of the file.
+  snprintf (link, sizeof (link), "/proc/self/fd/%d", fd);
+  if ((len = readlink (link, path, sizeof (path) - 1)) == -1) {
+    fprintf (stderr, "%s: readlink: %s\n", __FUNCTION__, strerror (errno));
+    return false;
+  }
+  path[len] = '\0';
+
+  for (i = 0; i < numDirectDirs; i++) {
+    dirLen = strlen (directDirs[i]);
+    if (strncmp (path, directDirs[i], dirLen) == 0 && path[dirLen] == '/')
+      return true;
+  }
+
+  return false;
+}
+
+
+/******************************************************************************
+ * wb_start - see writebehind.h
+ *****************************************************************************/
+int wb_start (write_behind_t *wb, int fd, bool buffered, bool direct)
+{
+  wb->fd = fd;
+  wb->buffer = NULL;
+  wb->size = 0;
+  wb->len = 0;
+  wb->writeback = (window > 0);
+  wb->sparse = (buffered && sparse_stor ());
+  wb->allocEnd = 0;
+  wb->directFd = -1;
+  wb->spare = NULL;
+
+  if ((wb->offset = lseek (fd, 0, SEEK_CUR)) == -1) {
+    fprintf (stderr, "%s: lseek: %s\n", __FUNCTION__, strerror (errno));
+    return -1;
+  }
+  wb->synced = wb->offset;
+  wb->waited = wb->offset;
+
+  //Without a buffer every write goes straight to the file.
+  if (buffered && bufferSize > 0) {
+    if ((wb->buffer = buffer_get ()) == NULL)
+      return -1;
+    wb->size = bufferSize;
+
+    if (direct)
+      start_direct (wb);
+  }
+
+  return 0;
+}
+
+
+/******************************************************************************
+ * wb_allocate - see writebehind.h
+ *****************************************************************************/
+int wb_allocate (write_behind_t *wb, off_t len)
+{
+  int err;
+
+  if (len <= 0)
+    return 0;
+
+  /* FALLOC_FL_KEEP_SIZE reserves the blocks but leaves the file size alone,
+   * so an upload that is cut short does not leave a tail of zeros. */
+  if (fallocate (wb->fd, FALLOC_FL_KEEP_SIZE, wb->offset + wb->len, len) == -1) {
+    if (errno == EOPNOTSUPP || errno == ENOSYS)
+      return 0;
+    err = errno;
+    fprintf (stderr, "%s: fallocate: %s\n", __FUNCTION__, strerror (err));
+    errno = err; //The caller picks the reply from errno.
+    return -1;
+  }
+  wb->allocEnd = wb->offset + wb->len + len;
+
+  return 0;
+}
+
+
+/******************************************************************************
+ * wb_write - see writebehind.h
+ *****************************************************************************/
+int wb_write (write_behind_t *wb, const void *data, size_t len)
+{
+  const uint8_t *bytes = data;
+  size_t room;
+
+  if (wb->buffer == NULL)
+    return write_out (wb, data, len);
+
+  while (len > 0) {
+    //The room left before the next aligned offset.
+    room = wb->size - (size_t)((wb->offset + wb->len) % wb->size);
+
+    /* Skip the copy when the data would fill an empty buffer anyway. O_DIRECT
+     * needs the data in an aligned buffer. */
+    if (wb->len == 0 && len >= room && wb->directFd == -1) {
+      if (write_out (wb, bytes, room) == -1)
+	return -1;
+    } else {
+      if (room > len)
+	room = len;
+      memcpy (wb->buffer + wb->len, bytes, room);
+      wb->len += room;
+      if ((wb->offset + wb->len) % wb->size == 0 && flush_buffer (wb) == -1)
+	return -1;
+    }
+
+    bytes += room;
+    len -= room;
+  }
+
+  return 0;
+}
+
+
+/******************************************************************************
+ * wb_written - see writebehind.h
+ *****************************************************************************/
+void wb_written (write_behind_t *wb, size_t len)
+{
+  wb->offset += len;
+  start_writeback (wb, wb->offset);
+}
+
+
+/******************************************************************************
+ * wb_flush - see writebehind.h
+ *****************************************************************************/
+int wb_flush (write_behind_t *wb)
+{
+  size_t len;
+
+  if (wb->directFd != -1) {
+    if (wait_writer (wb) == -1)
+      return -1;
+
+    //Only the last partial block of the file goes through the page cache.
+    len = wb->len / WB_ALIGN * WB_ALIGN;
+    if (len > 0 && wb->offset % WB_ALIGN == 0) {
+      if (write_span (wb, wb->directFd, wb->buffer, len, wb->offset) == -1) {
+	fprintf (stderr, "%s: pwrite: %s\n", __FUNCTION__, strerror (errno));
+	return -1;
+      }
+      wb->offset += len;
+      wb->len -= len;
+      memmove (wb->buffer, wb->buffer + len, wb->len);
+    }
+  }
+
+  len = wb->len;
+  wb->len = 0;
+  if (len > 0 && write_out (wb, wb->buffer, len) == -1)
+    return -1;
+
+  return extend_file (wb);
+}
+
+
+/******************************************************************************
+ * wb_end - see writebehind.h
+ *****************************************************************************/
+void wb_end (write_behind_t *wb)
+{
+  //The writer thread finishes the buffer it was given before it exits.
+  if (wb->directFd != -1) {
+    pthread_mutex_lock (&wb->mutex);
+    wb->stop = true;
+    pthread_cond_broadcast (&wb->cond);
+    pthread_mutex_unlock (&wb->mutex);
+    pthread_join (wb->writer, NULL);
+
+    pthread_cond_destroy (&wb->cond);
+    pthread_mutex_destroy (&wb->mutex);
+    if (close (wb->directFd) == -1)
+      fprintf (stderr, "%s: close: %s\n", __FUNCTION__, strerror (errno));
+    wb->directFd = -1;
+    buffer_put (wb->spare);
+    wb->spare = NULL;
+  }
+
+  buffer_put (wb->buffer);
+  wb->buffer = NULL;
+  wb->len = 0;
+}
+
+
+/******************************************************************************
+ * Write data to the file at the offset of the buffer, and start its
+ * writeback. The buffer must be empty, or the data must be the buffer.
+ *
+ * Return values:
+ *   0    success
+ *  -1    error
+ *****************************************************************************/
+static int write_out (write_behind_t *wb, const void *data, size_t len)
+{
+  if (write_span (wb, wb->fd, data, len, wb->offset) == -1) {
+    fprintf (stderr, "%s: pwrite: %s\n", __FUNCTION__, strerror (errno));
+    return -1;
+  }
+  wb->offset += len;
+
+  start_writeback (wb, wb->offset);
+  return 0;
+}
+
+
+/******************************************************************************
+ * Write the full buffer to the file while the upload goes on. The buffer is
+ * given to the writer thread when it can be written with O_DIRECT.
+ *
+ * Return values:
+ *   0    success
+ *  -1    error
+ *****************************************************************************/
+static int flush_buffer (write_behind_t *wb)
+{
+  size_t len = wb->len;
+
+  if (len == 0)
+    return 0;
+
+  if (wb->directFd != -1 && wb->offset % WB_ALIGN == 0 && len % WB_ALIGN == 0)
+    return submit_direct (wb);
+
+  wb->len = 0;
+  return write_out (wb, wb->buffer, len);
+}
+
+
+/******************************************************************************
+ * Write data to the file at the given offset. The blocks of zeros of a sparse
+ * upload are skipped, which leaves holes, since the upload only ever writes
+ * past the end of the file. Space reserved by wb_allocate() is given back by
+ * punching the skipped blocks out of it. A partial block of zeros, left where
+ * a span does not end on a block, is skipped as well. With O_DIRECT a partial
+ * block is always written, so the runs of data stay aligned.
+ *
+ * Return values:
+ *   0    success
+ *  -1    error, see errno
+ *****************************************************************************/
+static int write_span (write_behind_t *wb, int fd, const uint8_t *data,
+		       size_t len, off_t offset)
+{
+  size_t block, run;
+  bool zero;
+  bool partial;     //Partial blocks of zeros may be skipped.
+
+  if (!wb->sparse)
+    return pwrite_all (fd, data, len, offset);
+
+  partial = (fd != wb->directFd);
+  while (len > 0) {
+    //Gather a run of blocks that are all zeros, or all data.
+    block = SPARSE_BLOCK - (size_t)(offset % SPARSE_BLOCK);
+    if (block > len)
+      block = len;
+    zero = ((block == SPARSE_BLOCK || partial) && sparse_is_zero (data, block));
+
+    for (run = block; run < len; run += block) {
+      block = (len - run < SPARSE_BLOCK) ? len - run : SPARSE_BLOCK;
+      if (((block == SPARSE_BLOCK || partial) &&
+	   sparse_is_zero (data + run, block)) != zero)
+	break;
+    }
+
+    if (!zero) {
+      if (pwrite_all (fd, data, run, offset) == -1)
+	return -1;
+    } else if (offset < wb->allocEnd) {
+      /* Holes are only punched below the end of the file, so the reserved
+       * blocks are brought into the file first. A reserved block reads as
+       * zeros anyway, so a failure is harmless. */
+      if (fallocate (fd, 0, offset, run) == 0)
+	fallocate (fd, FALLOC_FL_PUNCH_HOLE | FALLOC_FL_KEEP_SIZE, offset, run);
+    }
+
+    data += run;
+    len -= run;
+    offset += run;
+  }
+
+  return 0;
+}
+
+
+/******************************************************************************
+ * Write all of the data to a file at the given offset.
+ *
+ * Return values:
+ *   0    success
+ *  -1    error, see errno
+ *****************************************************************************/
+static int pwrite_all (int fd, const uint8_t *data, size_t len, off_t offset)
+{
+  ssize_t nwritten;
+
+  while (len > 0) {
+    if ((nwritten = pwrite (fd, data, len, offset)) == -1) {
+      if (errno == EINTR)
+	continue;
+      return -1;
+    }
+    data += nwritten;
+    len -= nwritten;
+    offset += nwritten;
+  }
+
+  return 0;
+}
+
+
+/******************************************************************************
+ * Extend a sparse upload whose last blocks were skipped to the size of the
+ * upload, leaving a hole at the end of the file.
+ *
+ * Return values:
+ *   0    success
+ *  -1    error
+ *****************************************************************************/
+static int extend_file (write_behind_t *wb)
+{
+  struct stat fileStat;
+
+  if (!wb->sparse)
+    return 0;
+
+  if (fstat (wb->fd, &fileStat) == -1) {
+    fprintf (stderr, "%s: fstat: %s\n", __FUNCTION__, strerror (errno));
+    return -1;
+  }
+
+  if (fileStat.st_size < wb->offset && ftruncate (wb->fd, wb->offset) == -1) {
+    fprintf (stderr, "%s: ftruncate: %s\n", __FUNCTION__, strerror (errno));
+    return -1;
+  }
+
+  return 0;
+}
+
+
+/******************************************************************************
+ * Start the writeback of the file up to 'end', and wait for the writeback of
+ * the data more than one window behind. Writeback is started at most once
+ * per step of new data.
+ *****************************************************************************/
+static void start_writeback (write_behind_t *wb, off_t end)
+{
+  off_t waitEnd;
+  unsigned int flags;
+
+  if (!wb->writeback || end - wb->synced < step)
+    return;
+
+  if (sync_file_range (wb->fd, wb->synced, end - wb->synced,
+		       SYNC_FILE_RANGE_WRITE) == -1) {
+    //Not a regular file, or not supported by the file system.
+    wb->writeback = false;
+    return;
+  }
+  wb->synced = end;
+
+  //Bound the dirty data of the upload to the window.
+  if ((waitEnd = wb->synced - window) > wb->waited) {
+    flags = SYNC_FILE_RANGE_WAIT_BEFORE | SYNC_FILE_RANGE_WRITE |
+      SYNC_FILE_RANGE_WAIT_AFTER;
+    if (sync_file_range (wb->fd, wb->waited, waitEnd - wb->waited,
+			 flags) == -1) {
+      wb->writeback = false;
+      return;
+    }
+    wb->waited = waitEnd;
+  }
+}
+
+
+/******************************************************************************
+ * Open the file of the upload a second time with O_DIRECT, and start the
+ * writer thread. The upload is written through the page cache if this fails.
+ *****************************************************************************/
+static void start_direct (write_behind_t *wb)
+{
+  char link[sizeof ("/proc/self/fd/") + 12];
+
+  snprintf (link, sizeof (link), "/proc/self/fd/%d", wb->fd);
+  if ((wb->directFd = open (link, O_WRONLY | O_DIRECT)) == -1) {
+    fprintf (stderr, "%s: open: %s\n", __FUNCTION__, strerror (errno));
+    return;
+  }
+
+  if ((wb->spare = buffer_get ()) == NULL) {
+    close (wb->directFd);
+    wb->directFd = -1;
+    return;
+  }
+
+  wb->spareLen = 0;
+  wb->error = 0;
+  wb->stop = false;
+  pthread_mutex_init (&wb->mutex, NULL);
+  pthread_cond_init (&wb->cond, NULL);
+  if ((errno = pthread_create (&wb->writer, NULL, direct_writer, wb)) != 0) {
+    fprintf (stderr, "%s: pthread_create: %s\n", __FUNCTION__, strerror (errno));
+    pthread_cond_destroy (&wb->cond);
+    pthread_mutex_destroy (&wb->mutex);
+    close (wb->directFd);
+    wb->directFd = -1;
+    buffer_put (wb->spare);
+    wb->spare = NULL;
+    return;
+  }
+
+  //The page cache is not used, there is no writeback to start.
+  wb->writeback = false;
+}
+
+
+/******************************************************************************
+ * Give the full buffer to the writer thread, and continue with the buffer it
+ * has written. This waits only while the writer is still busy with the
+ * previous buffer.
+ *
+ * Return values:
+ *   0    success
+ *  -1    error, an earlier direct write failed
+ *****************************************************************************/
+static int submit_direct (write_behind_t *wb)
+{
+  uint8_t *full = wb->buffer;
+
+  if (wait_writer (wb) == -1)
+    return -1;
+
+  pthread_mutex_lock (&wb->mutex);
+  wb->buffer = wb->spare;
+  wb->spare = full;
+  wb->spareLen = wb->len;
+  wb->spareOffset = wb->offset;
+  pthread_cond_broadcast (&wb->cond);
+  pthread_mutex_unlock (&wb->mutex);
+
+  wb->offset += wb->len;
+  wb->len = 0;
+  return 0;
+}
+
+
+/******************************************************************************
+ * Wait for the writer thread to finish the buffer it was given.
+ *
+ * Return values:
+ *   0    success
+ *  -1    error, a direct write failed
+ *****************************************************************************/
+static int wait_writer (write_behind_t *wb)
+{
+  int error;
+
+  pthread_mutex_lock (&wb->mutex);
+  while (wb->spareLen > 0)
+    pthread_cond_wait (&wb->cond, &wb->mutex);
+  error = wb->error;
+  pthread_mutex_unlock (&wb->mutex);
+
+  if (error != 0) {
+    fprintf (stderr, "%s: pwrite: %s\n", __FUNCTION__, strerror (error));
+    errno = error;
+    return -1;
+  }
+
+  return 0;
+}
+
+
+/******************************************************************************
+ * The writer thread of a direct upload. Writes each buffer it is given, until
+ * wb_end() stops it.
+ *****************************************************************************/
+static void *direct_writer (void *arg)
+{
+  write_behind_t *wb = arg;
+  const uint8_t *data;
+  size_t len;
+  off_t offset;
+  int error;
+
+  pthread_mutex_lock (&wb->mutex);
+  while (1) {
+    while (wb->spareLen == 0 && !wb->stop)
+      pthread_cond_wait (&wb->cond, &wb->mutex);
+    if (wb->spareLen == 0)
+      break;
+
+    data = wb->spare;
+    len = wb->spareLen;
+    offset = wb->spareOffset;
+    pthread_mutex_unlock (&wb->mutex);
+
+    error = (write_span (wb, wb->directFd, data, len, offset) == -1) ? errno : 0;
+
+    pthread_mutex_lock (&wb->mutex);
+    //Keep the first error, the rest of the upload is discarded anyway.
+    if (wb->error == 0)
+      wb->error = error;
+    wb->spareLen = 0;
+    pthread_cond_broadcast (&wb->cond);
+  }
+  pthread_mutex_unlock (&wb->mutex);
+
+  return NULL;
+}
+
+
+/******************************************************************************
+ * Add a directory, relative to the server root, to DIRECT_IO_DIRS_CONFIG. A
+ * directory that does not exist is skipped.
+ *****************************************************************************/
+static void add_direct_dir (const char *dir)
+{
+  char path[PATH_MAX];
+  char *canon;
+  char **dirs;
+
+  snprintf (path, sizeof (path), "%s/%s", rootdir, dir);
+  if ((canon = canonicalize_file_name (path)) == NULL) {
+    fprintf (stderr, "%s: canonicalize_file_name '%s': %s\n", __FUNCTION__,
+	     path, strerror (errno));
+    return;
+  }
+
+  if ((dirs = realloc (directDirs, (numDirectDirs + 1) * sizeof (*dirs))) == NULL) {
+    fprintf (stderr, "%s: realloc: %s\n", __FUNCTION__, strerror (errno));
+    free (canon);
+    return;
+  }
+  directDirs = dirs;
+  directDirs[numDirectDirs++] = canon;
+}
+
+
+/******************************************************************************
+ * Take a buffer of 'bufferSize' bytes from the pool, or allocate a new one.
+ *
+ * Return values:
+ *   The buffer, aligned for O_DIRECT, or NULL on error.
+ *****************************************************************************/
+static uint8_t *buffer_get (void)
+{
+  uint8_t *buffer = NULL;
+
+  pthread_mutex_lock (&poolMutex);
+  if (poolCount > 0)
+    buffer = pool[--poolCount];
+  pthread_mutex_unlock (&poolMutex);
+
+  if (buffer != NULL)
+    return buffer;
+
+  if ((errno = posix_memalign ((void **)&buffer, WB_ALIGN, bufferSize)) != 0) {
+    fprintf (stderr, "%s: posix_memalign: %s\n", __FUNCTION__, strerror (errno));
+    return NULL;
+  }
+
+  return buffer;
+}
+
+
+/******************************************************************************
+ * Return a buffer to the pool. The buffer is freed when the pool is full.
+ *****************************************************************************/
+static void buffer_put (uint8_t *buffer)
+{
+  if (buffer == NULL)
+    return;
+
+  pthread_mutex_lock (&poolMutex);
+  if (poolCount < POOL_SIZE) {
+    pool[poolCount++] = buffer;
+    buffer = NULL;
+  }
+  pthread_mutex_unlock (&poolMutex);
+
+  free (buffer);
+}
@@ -0,0 +1,172 @@
+/******************************************************************************
+ * FTP-Server
+ * Author: Evan Myers
+ * Date: October 2026
+ *
+ * Description:
+ *   Write-behind of uploaded files. Received data is gathered in a buffer and
+ *   written to the file in large writes that are aligned to the buffer size,
+ *   instead of one write for each received chunk. Writeback of the written
+ *   data to the disk is started as the upload goes on (sync_file_range()),
+ *   so that the dirty pages of a large upload do not pile up and stall the
+ *   end of the transfer. The space of an upload may also be reserved before
+ *   it starts (fallocate()), so that a large file is not fragmented.
+ *
+ *   Uploads of selected users and directories may be written with O_DIRECT
+ *   instead, so that bulk data which is never read back does not evict the
+ *   files being downloaded from the page cache. A writer thread writes one
+ *   buffer to the disk while the next buffer is filled from the network.
+ *
+ *   With SPARSE_STOR_CONFIG, aligned blocks of zeros in a buffered upload are
+ *   not written, and are left as holes in the file (see sparse.h).
+ *****************************************************************************/
+#ifndef __WRITEBEHIND_H__
+#define __WRITEBEHIND_H__
+
+
+#include <pthread.h>   //Required for 'pthread_t' in structure.
+#include <stdbool.h>   //Required for 'bool' in function prototype.
+#include <stddef.h>    //Required for 'size_t' in structure.
+#include <stdint.h>    //Required for 'uint8_t' in structure.
+#include <sys/types.h> //Required for 'off_t' in structure.
+
+
+/******************************************************************************
+ * The write-behind state of a single upload. One of these structures is
+ * created by the command thread for each upload. Only the fields marked as
+ * shared are used by the writer thread of a direct upload, with the mutex
+ * held.
+ *****************************************************************************/
+typedef struct {
+  int fd;              //The file being written.
+  off_t offset;        //The file offset of the first byte in the buffer.
+  uint8_t *buffer;     //An aligned buffer of 'size' bytes, NULL if unbuffered.
+  size_t size;
+  size_t len;          //The number of bytes held in the buffer.
+  off_t synced;        //Writeback has been started up to this offset.
+  off_t waited;        //Writeback has completed up to this offset.
+  bool writeback;      //False once sync_file_range() has been refused.
+  bool sparse;         //Blocks of zeros are left as holes (SPARSE_STOR_CONFIG).
+  off_t allocEnd;      //The end of the space reserved by wb_allocate().
+
+  int directFd;        //The file opened with O_DIRECT, or -1.
+  pthread_t writer;    //Writes the full buffers of a direct upload.
+  pthread_mutex_t mutex;
+  pthread_cond_t cond;
+  uint8_t *spare;      //Shared: the buffer given to, or free from, the writer.
+  size_t spareLen;     //Shared: bytes of 'spare' to write, 0 once written.
+  off_t spareOffset;   //Shared: the file offset to write 'spare' to.
+  int error;           //Shared: the errno of a failed direct write, or 0.
+  bool stop;           //Shared: the writer thread should exit.
+} write_behind_t;
+
+
+/******************************************************************************
+ * Read the write-behind settings from the server configuration file. This
+ * function should be called once, by main(), before any client connects.
+ *
+ * Settings (ftp.conf):
+ *   WRITE_BEHIND_CONFIG    - The size of the write-behind buffer, and of each
+ *                            write to the file. 0 writes each chunk as it is
+ *                            received.
+ *   WRITEBACK_WINDOW_CONFIG - The number of written bytes of an upload that
+ *                            may wait for writeback before the upload waits
+ *                            for the disk. 0 leaves writeback to the kernel.
+ *   DIRECT_IO_DIRS_CONFIG  - Directories, relative to the server root and
+ *                            separated by spaces, whose uploads are written
+ *                            with O_DIRECT.
+ *
+ * This function must be called after the server root directory is known.
+ *****************************************************************************/
+void wb_load_config (void);
+
+
+/******************************************************************************
+ * Determine if all uploads of a user are written with O_DIRECT. This is set
+ * with DIRECT_IO_<username> in user.conf, 1 to enable and 0 to disable.
+ *****************************************************************************/
+bool wb_user_direct (const char *username);
+
+
+/******************************************************************************
+ * Determine if an open file lies in one of the directories of
+ * DIRECT_IO_DIRS_CONFIG.
+ *****************************************************************************/
+bool wb_dir_direct (int fd);
+
+
+/******************************************************************************
+ * Prepare the write-behind state of an upload. The file is written from its
+ * current file offset.
+ *
+ * A direct upload is written with O_DIRECT where the file offset and length
+ * allow it, and through the page cache where they do not (the start of an
+ * append or restart, and the end of the file). A file system without
+ * O_DIRECT support is written through the page cache.
+ *
+ * Arguments:
+ *         wb - The write-behind state to initialize.
+ *         fd - The file to write, open for writing.
+ *   buffered - False if the caller writes to the file itself, and only
+ *              reports the writes with wb_written().
+ *     direct - True to write the file with O_DIRECT, 'buffered' must be true.
+ *
+ * Return values:
+ *   0    success
+ *  -1    error
+ *****************************************************************************/
+int wb_start (write_behind_t *wb, int fd, bool buffered, bool direct);
+
+
+/******************************************************************************
+ * Reserve disk space for the next 'len' bytes of the file, without changing
+ * the size of the file. File systems that cannot reserve space are ignored.
+ *
+ * Return values:
+ *   0    success, or space reservation is not supported.
+ *  -1    error, errno is ENOSPC or EDQUOT if there is not enough space.
+ *****************************************************************************/
+int wb_allocate (write_behind_t *wb, off_t len);
+
+
+/******************************************************************************
+ * Write data to the file through the write-behind buffer. Data is written
+ * straight to the file when the buffer is empty and the data would fill it,
+ * unless the upload is direct.
+ *
+ * Return values:
+ *   0    success
+ *  -1    error
+ *****************************************************************************/
+int wb_write (write_behind_t *wb, const void *data, size_t len);
+
+
+/******************************************************************************
+ * Report data written to the file by the caller, eg. with splice(), so that
+ * its writeback is started.
+ *****************************************************************************/
+void wb_written (write_behind_t *wb, size_t len);
+
+
+/******************************************************************************
+ * Write the contents of the buffer to the file. Call this once the whole
+ * upload has been received, and before the upload is abandoned, so that the
+ * received data is kept for a restart. The write of a direct upload by the
+ * writer thread is waited for. A sparse file whose end is a hole is extended
+ * to the size of the upload.
+ *
+ * Return values:
+ *   0    success
+ *  -1    error
+ *****************************************************************************/
+int wb_flush (write_behind_t *wb);
+
+
+/******************************************************************************
+ * Free the write-behind state of an upload. Buffered data that was not
+ * flushed is discarded. The buffers are kept for later uploads.
+ *****************************************************************************/
+void wb_end (write_behind_t *wb);
+
+
+#endif //__WRITEBEHIND_H__
@@ -0,0 +1,466 @@
+/******************************************************************************
+ * FTP-Server
+ * Author: Evan Myers
+ * Date: October 2026
+ *
+ * Description:
+ *   A disk cache of compressed file variants. See zcache.h for an overview.
+ *
+ *   The index of the cache is a list of entries kept in least recently used
+ *   order, protected by a mutex. The modification time of an entry file is
+ *   set to the time of its last use, so that the order is recovered from the
+ *   directory when the server is restarted.
+ *****************************************************************************/
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <unistd.h>
+#include "config.h"
+#include "md5.h"
+#include "zcache.h"
+
+
+//The default values of the ftp.conf settings.
+#define DEFAULT_ZCACHE_PATH "../zcache"
+#define DEFAULT_ZCACHE_SIZE 0
+
+//Temporary entries being written are hidden files with this prefix.
+#define ZCACHE_TEMP_PREFIX ".fill-"
+
+
+//An entry in the cache index.
+typedef struct zcache_entry {
+  char key[ZCACHE_KEY_LEN + 1];
+  off_t size;
+  time_t lastUse;
+  struct zcache_entry *prev;     //More recently used.
+  struct zcache_entry *next;     //Less recently used.
+} zcache_entry_t;
+
+
+//Local function prototypes.
+static void make_key (const char *path, const struct stat *st,
+		      const char *codec, int level, char *key);
+static char *entry_path (const char *name);
+static zcache_entry_t *find_entry (const char *key);
+static void unlink_entry (zcache_entry_t *entry);
+static void push_front (zcache_entry_t *entry);
+static void insert_by_age (zcache_entry_t *entry);
+static void evict (void);
+static void load_index (void);
+
+
+/* The cache settings and index. The settings are written once by zcache_init()
+ * before any thread is created. The index is shared by all command threads,
+ * and must only be accessed while holding the mutex. */
+static char *cacheDir = NULL;
+static off_t cacheLimit = 0;
+static pthread_mutex_t cacheMutex = PTHREAD_MUTEX_INITIALIZER;
+static zcache_entry_t *mostRecent = NULL;
+static zcache_entry_t *leastRecent = NULL;
+static off_t cacheSize = 0;
+
+
+/******************************************************************************
+ * zcache_init - see zcache.h
+ *****************************************************************************/
+void zcache_init (void)
+{
+  char *relPath;
+  char *absPath;
+
+  if ((cacheLimit = get_config_number ("ZCACHE_SIZE_CONFIG", FTP_CONFIG_FILE,
+				       DEFAULT_ZCACHE_SIZE)) == 0)
+    return;
+
+  if ((relPath = get_config_value ("ZCACHE_PATH_CONFIG",
+				   FTP_CONFIG_FILE)) == NULL) {
+    relPath = strdup (DEFAULT_ZCACHE_PATH);
+  }
+
+  //The path is relative to the server executable, like ROOT_PATH_CONFIG.
+  absPath = (relPath != NULL) ? get_config_path (relPath) : NULL;
+  free (relPath);
+  if (absPath == NULL) {
+    cacheLimit = 0;
+    return;
+  }
+
+  if (mkdir (absPath, S_IRWXU) == -1 && errno != EEXIST) {
+    fprintf (stderr, "%s: mkdir: %s\n", __FUNCTION__, strerror (errno));
+    free (absPath);
+    cacheLimit = 0;
+    return;
+  }
+
+  if ((cacheDir = canonicalize_file_name (absPath)) == NULL) {
+    fprintf (stderr, "%s: canonicalize_file_name: %s\n", __FUNCTION__,
+	     strerror (errno));
+    free (absPath);
+    cacheLimit = 0;
+    return;
+  }
+  free (absPath);
+
+  load_index ();
+  evict ();
+}
+
+
+/******************************************************************************
+ * zcache_lookup - see zcache.h
+ *****************************************************************************/
+int zcache_lookup (const char *path, int srcFd, const char *codec, int level,
+		   zcache_fill_t *fill)
+{
+  struct stat srcStat;
+  zcache_entry_t *entry;
+  char *entryName;
+  int fd;
+
+  fill->key[0] = '\0';
+  fill->tempPath = NULL;
+  fill->fd = -1;
+
+  if (cacheLimit == 0)
+    return -1;
+
+  if (fstat (srcFd, &srcStat) == -1) {
+    fprintf (stderr, "%s: fstat: %s\n", __FUNCTION__, strerror (errno));
+    return -1;
+  }
+  make_key (path, &srcStat, codec, level, fill->key);
+  fill->srcFd = srcFd;
+  fill->srcSize = srcStat.st_size;
+  fill->srcMtime = srcStat.st_mtim;
+
+  pthread_mutex_lock (&cacheMutex);
+  if ((entry = find_entry (fill->key)) == NULL) {
+    pthread_mutex_unlock (&cacheMutex);
+    return -1;
+  }
+
+  /* Open the entry while holding the mutex, so that it cannot be evicted
+   * between finding it and opening it. Once open, eviction is harmless. */
+  if ((entryName = entry_path (entry->key)) == NULL ||
+      (fd = open (entryName, O_RDONLY)) == -1) {
+    //The entry was removed from the directory behind our back.
+    unlink_entry (entry);
+    cacheSize -= entry->size;
+    free (entry);
+    pthread_mutex_unlock (&cacheMutex);
+    free (entryName);
+    return -1;
+  }
+
+  //Mark the entry as the most recently used, in memory and on disk.
+  unlink_entry (entry);
+  push_front (entry);
+  entry->lastUse = time (NULL);
+  pthread_mutex_unlock (&cacheMutex);
+
+  futimens (fd, NULL);
+  free (entryName);
+  return fd;
+}
+
+
+/******************************************************************************
+ * zcache_fill_start - see zcache.h
+ *****************************************************************************/
+int zcache_fill_start (zcache_fill_t *fill)
+{
+  char *template;
+
+  if (cacheLimit == 0 || fill->key[0] == '\0')
+    return -1;
+
+  if ((template = malloc (strlen (cacheDir) + sizeof (ZCACHE_TEMP_PREFIX) +
+			  ZCACHE_KEY_LEN + sizeof ("/.XXXXXX"))) == NULL)
+    return -1;
+  sprintf (template, "%s/%s%s.XXXXXX", cacheDir, ZCACHE_TEMP_PREFIX, fill->key);
+
+  if ((fill->fd = mkstemp (template)) == -1) {
+    fprintf (stderr, "%s: mkstemp: %s\n", __FUNCTION__, strerror (errno));
+    free (template);
+    return -1;
+  }
+
+  fill->tempPath = template;
+  return fill->fd;
+}
+
+
+/******************************************************************************
+ * zcache_fill_end - see zcache.h
+ *****************************************************************************/
+void zcache_fill_end (zcache_fill_t *fill, bool keep)
+{
+  struct stat entryStat;
+  struct stat srcStat;
+  zcache_entry_t *entry;
+  char *entryName = NULL;
+
+  if (fill->tempPath == NULL)
+    return;
+
+  if (keep && fstat (fill->fd, &entryStat) == -1)
+    keep = false;
+
+  //A file rewritten while it was compressed would be cached under its old key.
+  if (keep && (fstat (fill->srcFd, &srcStat) == -1 ||
+	       srcStat.st_size != fill->srcSize ||
+	       srcStat.st_mtim.tv_sec != fill->srcMtime.tv_sec ||
+	       srcStat.st_mtim.tv_nsec != fill->srcMtime.tv_nsec))
+    keep = false;
+  close (fill->fd);
+  fill->fd = -1;
+
+  if (keep && (entryName = entry_path (fill->key)) == NULL)
+    keep = false;
+
+  if (!keep) {
+    unlink (fill->tempPath);
+    free (fill->tempPath);
+    fill->tempPath = NULL;
+    return;
+  }
+
+  pthread_mutex_lock (&cacheMutex);
+  /* Another session may have filled the same entry in the meantime. The
+   * rename replaces its file, so replace its size in the index as well. */
+  if (rename (fill->tempPath, entryName) == -1) {
+    fprintf (stderr, "%s: rename: %s\n", __FUNCTION__, strerror (errno));
+    unlink (fill->tempPath);
+  } else {
+    if ((entry = find_entry (fill->key)) != NULL) {
+      unlink_entry (entry);
+      cacheSize -= entry->size;
+    } else if ((entry = malloc (sizeof (*entry))) != NULL) {
+      strcpy (entry->key, fill->key);
+    }
+
+    if (entry != NULL) {
+      entry->size = entryStat.st_size;
+      entry->lastUse = time (NULL);
+      push_front (entry);
+      cacheSize += entry->size;
+      evict ();
+    } else {
+      unlink (entryName);
+    }
+  }
+  pthread_mutex_unlock (&cacheMutex);
+
+  free (entryName);
+  free (fill->tempPath);
+  fill->tempPath = NULL;
+}
+
+
+/******************************************************************************
+ * Build the name of the cache entry for a file. The name is the MD5 digest of
+ * every value in the key, so that any change produces a different entry.
+ *
+ * Arguments:
+ *    path - The pathname of the file.
+ *      st - The file status, for the size and modification time.
+ *   codec - The name of the compression format.
+ *   level - The compression level.
+ *     key - Set to the entry name, at least ZCACHE_KEY_LEN + 1 characters.
+ *****************************************************************************/
+static void make_key (const char *path, const struct stat *st,
+		      const char *codec, int level, char *key)
+{
+  struct md5CTX md5struct;
+  byte_t digest[MD5_DIGEST_BYTES];
+  char fields[128];
+  int i;
+
+  sprintf (fields, "%lld:%lld.%09ld:%s:%d", (long long)st->st_size,
+	   (long long)st->st_mtim.tv_sec, st->st_mtim.tv_nsec, codec, level);
+
+  //Include the terminator of the path, so that it cannot run into the fields.
+  md5Start (&md5struct);
+  md5Add (&md5struct, (const byte_t *)path, strlen (path) + 1);
+  md5Add (&md5struct, (const byte_t *)fields, strlen (fields));
+  md5End (&md5struct, digest);
+
+  for (i = 0; i < MD5_DIGEST_BYTES; ++i)
+    sprintf (&key[i*2], "%02x", (unsigned int)digest[i]);
+  strcat (key, ".z");
+}
+
+
+/******************************************************************************
+ * Create the absolute pathname of a file in the cache directory. The caller
+ * must free the returned string.
+ *****************************************************************************/
+static char *entry_path (const char *name)
+{
+  char *path;
+
+  if ((path = malloc (strlen (cacheDir) + strlen (name) + 2)) == NULL) {
+    fprintf (stderr, "%s: malloc failed\n", __FUNCTION__);
+    return NULL;
+  }
+  sprintf (path, "%s/%s", cacheDir, name);
+  return path;
+}
+
+
+/******************************************************************************
+ * Find an entry in the index. The mutex must be held.
+ *****************************************************************************/
+static zcache_entry_t *find_entry (const char *key)
+{
+  zcache_entry_t *entry;
+
+  for (entry = mostRecent; entry != NULL; entry = entry->next) {
+    if (strcmp (entry->key, key) == 0)
+      return entry;
+  }
+  return NULL;
+}
+
+
+/******************************************************************************
+ * Remove an entry from the index list, without freeing it. The mutex must be
+ * held.
+ *****************************************************************************/
+static void unlink_entry (zcache_entry_t *entry)
+{
+  if (entry->prev != NULL)
+    entry->prev->next = entry->next;
+  else
+    mostRecent = entry->next;
+
+  if (entry->next != NULL)
+    entry->next->prev = entry->prev;
+  else
+    leastRecent = entry->prev;
+
+  entry->prev = entry->next = NULL;
+}
+
+
+/******************************************************************************
+ * Add an entry to the index as the most recently used. The mutex must be held.
+ *****************************************************************************/
+static void push_front (zcache_entry_t *entry)
+{
+  entry->prev = NULL;
+  entry->next = mostRecent;
+  if (mostRecent != NULL)
+    mostRecent->prev = entry;
+  else
+    leastRecent = entry;
+  mostRecent = entry;
+}
+
+
+/******************************************************************************
+ * Add an entry to the index in order of its last use. Only used while loading
+ * the index, when the entries are found in directory order.
+ *****************************************************************************/
+static void insert_by_age (zcache_entry_t *entry)
+{
+  zcache_entry_t *iter;
+
+  for (iter = mostRecent; iter != NULL; iter = iter->next) {
+    if (iter->lastUse <= entry->lastUse)
+      break;
+  }
+
+  if (iter == NULL) {
+    //Older than every entry, add it to the end of the list.
+    entry->next = NULL;
+    entry->prev = leastRecent;
+    if (leastRecent != NULL)
+      leastRecent->next = entry;
+    else
+      mostRecent = entry;
+    leastRecent = entry;
+  } else if (iter == mostRecent) {
+    push_front (entry);
+  } else {
+    entry->next = iter;
+    entry->prev = iter->prev;
+    iter->prev->next = entry;
+    iter->prev = entry;
+  }
+}
+
+
+/******************************************************************************
+ * Remove the least recently used entries until the cache is within its size
+ * limit. Sessions that are still sending a removed entry keep their open file
+ * descriptor, so the removal does not disturb them. The mutex must be held.
+ *****************************************************************************/
+static void evict (void)
+{
+  zcache_entry_t *entry;
+  char *entryName;
+
+  while (cacheSize > cacheLimit && (entry = leastRecent) != NULL) {
+    unlink_entry (entry);
+    cacheSize -= entry->size;
+
+    if ((entryName = entry_path (entry->key)) != NULL) {
+      if (unlink (entryName) == -1 && errno != ENOENT)
+	fprintf (stderr, "%s: unlink: %s\n", __FUNCTION__, strerror (errno));
+      free (entryName);
+    }
+    free (entry);
+  }
+}
+
+
+/******************************************************************************
+ * Index the entries found in the cache directory, and remove temporary
+ * entries left behind by a server that did not shut down cleanly.
+ *****************************************************************************/
+static void load_index (void)
+{
+  DIR *dp;
+  struct dirent *ep;
+  struct stat entryStat;
+  zcache_entry_t *entry;
+  char *entryName;
+
+  if ((dp = opendir (cacheDir)) == NULL) {
+    fprintf (stderr, "%s: opendir: %s\n", __FUNCTION__, strerror (errno));
+    cacheLimit = 0;
+    return;
+  }
+
+  while ((ep = readdir (dp)) != NULL) {
+    if (strcmp (ep->d_name, ".") == 0 || strcmp (ep->d_name, "..") == 0)
+      continue;
+    if ((entryName = entry_path (ep->d_name)) == NULL)
+      continue;
+
+    if (strncmp (ep->d_name, ZCACHE_TEMP_PREFIX,
+		 strlen (ZCACHE_TEMP_PREFIX)) == 0) {
+      unlink (entryName);
+    } else if (strlen (ep->d_name) == ZCACHE_KEY_LEN &&
+	       stat (entryName, &entryStat) == 0 &&
+	       S_ISREG (entryStat.st_mode) &&
+	       (entry = malloc (sizeof (*entry))) != NULL) {
+      strcpy (entry->key, ep->d_name);
+      entry->size = entryStat.st_size;
+      entry->lastUse = entryStat.st_mtime;
+      insert_by_age (entry);
+      cacheSize += entry->size;
+    }
+    free (entryName);
+  }
+
+  closedir (dp);
+}
@@ -0,0 +1,108 @@
+/******************************************************************************
+ * FTP-Server
+ * Author: Evan Myers
+ * Date: October 2026
+ *
+ * Description:
+ *   A disk cache of compressed file variants. When a file is retrieved in
+ *   MODE Z, the compressed stream is stored in the cache directory, so that
+ *   the next compressed download of the same file at the same level is sent
+ *   straight from the cache with sendfile(), without compressing it again.
+ *
+ *   Entries are keyed by the path, size and modification time of the file,
+ *   along with the codec and compression level. A changed file gets a new key,
+ *   and its old entries age out. The cache is limited in size, and the least
+ *   recently used entries are removed first.
+ *****************************************************************************/
+#ifndef __ZCACHE_H__
+#define __ZCACHE_H__
+
+
+#include <stdbool.h>    //Required for 'bool' in function prototype.
+#include <sys/types.h>  //Required for 'off_t' in structure.
+#include <time.h>       //Required for 'struct timespec' in structure.
+
+
+//The length of a cache entry name, an MD5 hex digest plus ".z".
+#define ZCACHE_KEY_LEN (32 + 2)
+
+
+/******************************************************************************
+ * The state of a cache entry that is being written while a file is being
+ * compressed for a client. The entry only becomes visible to other sessions
+ * once zcache_fill_end() is called with 'keep' set.
+ *****************************************************************************/
+typedef struct {
+  char key[ZCACHE_KEY_LEN + 1];  //The name of the entry in the cache directory.
+  char *tempPath;                //The file being written, NULL if none.
+  int fd;                        //Open for writing on tempPath, or -1.
+  int srcFd;                     //The file being compressed.
+  off_t srcSize;                 //Its size and modification time in the key.
+  struct timespec srcMtime;
+} zcache_fill_t;
+
+
+/******************************************************************************
+ * Read the cache settings from the server configuration file, create the
+ * cache directory if needed, and index the entries already in it. This
+ * function should be called once, by main(), before any client connects. The
+ * cache is disabled if it cannot be set up.
+ *
+ * Settings (ftp.conf):
+ *   ZCACHE_PATH_CONFIG - The cache directory, relative to the server
+ *                        executable.
+ *   ZCACHE_SIZE_CONFIG - The largest total size of the cache in bytes, or 0
+ *                        to disable the cache.
+ *****************************************************************************/
+void zcache_init (void);
+
+
+/******************************************************************************
+ * Look up the compressed variant of an open file.
+ *
+ * Arguments:
+ *    path - The pathname the file was opened with.
+ *   srcFd - The file, open for reading.
+ *   codec - The name of the compression format, eg. "deflate".
+ *   level - The compression level.
+ *    fill - Set up on a miss, so that zcache_fill_start() can create the
+ *           entry.
+ *
+ * Return values:
+ *   >=0  A cache hit, a file descriptor open for reading on the compressed
+ *        variant. The caller must close it.
+ *   -1   A miss, or the cache is disabled.
+ *****************************************************************************/
+int zcache_lookup (const char *path, int srcFd, const char *codec, int level,
+		   zcache_fill_t *fill);
+
+
+/******************************************************************************
+ * Begin writing a new cache entry after a miss.
+ *
+ * Arguments:
+ *   fill - The state set up by zcache_lookup().
+ *
+ * Return values:
+ *   >=0  A file descriptor to write the compressed variant to.
+ *   -1   The entry cannot be written, the transfer should continue without
+ *        the cache.
+ *****************************************************************************/
+int zcache_fill_start (zcache_fill_t *fill);
+
+
+/******************************************************************************
+ * Finish writing a cache entry. A kept entry is added to the cache, and the
+ * least recently used entries are removed while the cache is over its size
+ * limit. An entry that is not kept (the transfer failed or was aborted, or the
+ * entry could not be written in full) is removed, as is one whose file was
+ * changed while it was compressed, since its key no longer describes it.
+ *
+ * Arguments:
+ *   fill - The state passed to zcache_fill_start().
+ *   keep - True if the entry holds the complete compressed variant.
+ *****************************************************************************/
+void zcache_fill_end (zcache_fill_t *fill, bool keep);
+
+
+#endif //__ZCACHE_H__
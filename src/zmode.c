@@ -0,0 +1,254 @@
+/******************************************************************************
+ * FTP-Server
+ * Author: Evan Myers
+ * Date: October 2026
+ *
+ * Description:
+ *   Deflate compression for the MODE Z transfer mode. Data sent on the data
+ *   connection is compressed as a single zlib stream per transfer, and data
+ *   received on the data connection is decompressed before it is stored.
+ *****************************************************************************/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <zlib.h>
+#include "pipeline.h"
+#include "transfer.h"
+#include "zmode.h"
+
+
+//The size of the buffer that holds the output of zlib.
+#define ZMODE_OUT_SIZE (128 * 1024)
+
+
+//Local function prototypes.
+static int deflate_run (pipe_stage_t *stage, const uint8_t *data, size_t len,
+			bool finish);
+static int deflate_push (pipe_stage_t *stage, const uint8_t *data, size_t len);
+static int deflate_finish (pipe_stage_t *stage);
+static int inflate_push (pipe_stage_t *stage, const uint8_t *data, size_t len);
+static int inflate_finish (pipe_stage_t *stage);
+
+
+/******************************************************************************
+ * zmode_start - see zmode.h
+ *****************************************************************************/
+int zmode_start (zmode_stream_t *zs, bool compress, int level)
+{
+  int zrv;
+
+  memset (&zs->strm, 0, sizeof (zs->strm));
+  zs->compress = compress;
+  zs->finished = false;
+  zs->teeFd = -1;
+
+  if ((zs->out = malloc (ZMODE_OUT_SIZE)) == NULL) {
+    fprintf (stderr, "%s: malloc of %d bytes failed\n", __FUNCTION__,
+	     ZMODE_OUT_SIZE);
+    return -1;
+  }
+  zs->outSize = ZMODE_OUT_SIZE;
+
+  if (compress)
+    zrv = deflateInit (&zs->strm, level);
+  else
+    zrv = inflateInit (&zs->strm);
+
+  if (zrv != Z_OK) {
+    fprintf (stderr, "%s: zlib: %s\n", __FUNCTION__,
+	     zs->strm.msg ? zs->strm.msg : "initialization failed");
+    free (zs->out);
+    zs->out = NULL;
+    return -1;
+  }
+
+  return 0;
+}
+
+
+/******************************************************************************
+ * zmode_stage - see zmode.h
+ *****************************************************************************/
+void zmode_stage (zmode_stream_t *zs, pipe_stage_t *stage)
+{
+  if (zs->compress)
+    pipe_stage_init (stage, "deflate", deflate_push, deflate_finish, zs);
+  else
+    pipe_stage_init (stage, "inflate", inflate_push, inflate_finish, zs);
+}
+
+
+/******************************************************************************
+ * zmode_end - see zmode.h
+ *****************************************************************************/
+void zmode_end (zmode_stream_t *zs)
+{
+  if (zs->compress)
+    deflateEnd (&zs->strm);
+  else
+    inflateEnd (&zs->strm);
+
+  free (zs->out);
+  zs->out = NULL;
+}
+
+
+/******************************************************************************
+ * zmode_send_all - see zmode.h
+ *****************************************************************************/
+int zmode_send_all (int sfd, const uint8_t *data, size_t len, int level)
+{
+  zmode_stream_t zs;
+  pipeline_t pl;
+  pipe_stage_t deflater;
+  pipe_stage_t sink;
+  int retVal;
+
+  if (zmode_start (&zs, true, level) == -1)
+    return -1;
+
+  //The compressed listing is sent straight to the socket.
+  pipe_socket_sink (&sink, &sfd);
+  pipe_start (&pl, &sink);
+  zmode_stage (&zs, &deflater);
+  pipe_add (&pl, &deflater);
+
+  if ((retVal = pipe_push (&pl, data, len)) == 0)
+    retVal = pipe_finish (&pl);
+  pipe_end (&pl);
+  zmode_end (&zs);
+
+  return retVal;
+}
+
+
+/******************************************************************************
+ * Compress data and pass the result to the next stage. Compressed output is
+ * only passed on once zlib has produced it, so not every call passes data
+ * on. The output is also written to zs->teeFd when it is set; a failed write
+ * to it sets zs->teeFd to -1 instead of failing the transfer.
+ *
+ * Arguments:
+ *    stage - The stage of a stream started for compression.
+ *     data - The uncompressed data. May be NULL when len is 0.
+ *      len - The number of bytes of data.
+ *   finish - True when this is the last of the data, the stream is then
+ *            flushed and terminated.
+ *
+ * Return values:
+ *   0    success
+ *  -1    error
+ *****************************************************************************/
+static int deflate_run (pipe_stage_t *stage, const uint8_t *data, size_t len,
+			bool finish)
+{
+  zmode_stream_t *zs = stage->state;
+  int flush = finish ? Z_FINISH : Z_NO_FLUSH;
+  size_t produced;
+  int zrv;
+
+  zs->strm.next_in = (Bytef *)data;
+  zs->strm.avail_in = len;
+
+  /* Run deflate() until it has consumed all input, and when finishing, until
+   * the end of the stream has been written. */
+  do {
+    zs->strm.next_out = zs->out;
+    zs->strm.avail_out = zs->outSize;
+
+    zrv = deflate (&zs->strm, flush);
+    if (zrv == Z_STREAM_ERROR) {
+      fprintf (stderr, "%s: deflate: stream error\n", __FUNCTION__);
+      return -1;
+    }
+
+    if ((produced = zs->outSize - zs->strm.avail_out) > 0) {
+      if (pipe_next (stage, zs->out, produced) == -1)
+	return -1;
+      if (zs->teeFd != -1 && write_all (zs->teeFd, (char *)zs->out,
+					produced) == -1)
+	zs->teeFd = -1;
+    }
+  } while (zs->strm.avail_out == 0 || (finish && zrv != Z_STREAM_END));
+
+  if (finish)
+    zs->finished = true;
+
+  return 0;
+}
+
+
+/******************************************************************************
+ * The stage that compresses data to be sent.
+ *****************************************************************************/
+static int deflate_push (pipe_stage_t *stage, const uint8_t *data, size_t len)
+{
+  return deflate_run (stage, data, len, false);
+}
+
+
+/******************************************************************************
+ * Terminate the compressed stream at the end of the data.
+ *****************************************************************************/
+static int deflate_finish (pipe_stage_t *stage)
+{
+  return deflate_run (stage, NULL, 0, true);
+}
+
+
+/******************************************************************************
+ * The stage that decompresses received data. Any data received after the end
+ * of the zlib stream is ignored.
+ *****************************************************************************/
+static int inflate_push (pipe_stage_t *stage, const uint8_t *data, size_t len)
+{
+  zmode_stream_t *zs = stage->state;
+  size_t produced;
+  int zrv;
+
+  if (zs->finished)
+    return 0;
+
+  zs->strm.next_in = (Bytef *)data;
+  zs->strm.avail_in = len;
+
+  do {
+    zs->strm.next_out = zs->out;
+    zs->strm.avail_out = zs->outSize;
+
+    zrv = inflate (&zs->strm, Z_NO_FLUSH);
+    if (zrv != Z_OK && zrv != Z_STREAM_END && zrv != Z_BUF_ERROR) {
+      fprintf (stderr, "%s: inflate: %s\n", __FUNCTION__,
+	       zs->strm.msg ? zs->strm.msg : "invalid stream");
+      return -1;
+    }
+
+    if ((produced = zs->outSize - zs->strm.avail_out) > 0) {
+      if (pipe_next (stage, zs->out, produced) == -1)
+	return -1;
+    }
+
+    if (zrv == Z_STREAM_END) {
+      zs->finished = true;
+      break;
+    }
+  } while (zs->strm.avail_out == 0);
+
+  return 0;
+}
+
+
+/******************************************************************************
+ * A compressed upload must contain a complete stream.
+ *****************************************************************************/
+static int inflate_finish (pipe_stage_t *stage)
+{
+  zmode_stream_t *zs = stage->state;
+
+  if (!zs->finished) {
+    fprintf (stderr, "%s: compressed stream is truncated\n", __FUNCTION__);
+    return -1;
+  }
+
+  return 0;
+}
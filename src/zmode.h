@@ -0,0 +1,94 @@
+/******************************************************************************
+ * FTP-Server
+ * Author: Evan Myers
+ * Date: October 2026
+ *
+ * Description:
+ *   Deflate compression for the MODE Z transfer mode. Data sent on the data
+ *   connection is compressed as a single zlib stream per transfer, and data
+ *   received on the data connection is decompressed before it is stored.
+ *****************************************************************************/
+#ifndef __ZMODE_H__
+#define __ZMODE_H__
+
+
+#include <stdbool.h>  //Required for 'bool' in structure.
+#include <stddef.h>   //Required for 'size_t' in structure.
+#include <stdint.h>   //Required for 'uint8_t' in structure.
+#include <zlib.h>     //Required for 'z_stream' in structure.
+#include "pipeline.h" //Required for 'pipe_stage_t' in function prototype.
+
+
+//The compression level used until OPTS MODE Z LEVEL is sent.
+#define ZMODE_DEFAULT_LEVEL 6
+
+
+/******************************************************************************
+ * The state of one compressed transfer. One of these structures is created by
+ * the command thread for each MODE Z transfer.
+ *****************************************************************************/
+typedef struct {
+  z_stream strm;
+  bool compress;    //Deflating (sending) when true, inflating otherwise.
+  bool finished;    //The end of the zlib stream has been sent or received.
+  uint8_t *out;     //Holds compressed or decompressed output.
+  size_t outSize;
+  int teeFd;        //A copy of the compressed output is written here, or -1.
+} zmode_stream_t;
+
+
+/******************************************************************************
+ * Prepare a stream for compressing or decompressing one transfer.
+ *
+ * Arguments:
+ *         zs - The stream to initialize.
+ *   compress - True to compress data that will be sent, false to decompress
+ *              data that was received.
+ *      level - The compression level 0-9, ignored when decompressing.
+ *
+ * Return values:
+ *   0    success
+ *  -1    error, the stream must not be used.
+ *****************************************************************************/
+int zmode_start (zmode_stream_t *zs, bool compress, int level);
+
+
+/******************************************************************************
+ * Prepare a pipeline stage that compresses data to be sent, or decompresses
+ * received data, depending on how the stream was started.
+ *
+ * Compressed output is only passed on once zlib has produced it, and the
+ * stream is terminated when the stage is finished. When zs->teeFd is set,
+ * the compressed output is also written to that file; a failed write to it
+ * sets zs->teeFd to -1 instead of failing the transfer.
+ *
+ * Decompression ignores any data received after the end of the zlib stream,
+ * and fails when the stage is finished before the end of the stream.
+ *****************************************************************************/
+void zmode_stage (zmode_stream_t *zs, pipe_stage_t *stage);
+
+
+/******************************************************************************
+ * Release the memory held by a stream.
+ *****************************************************************************/
+void zmode_end (zmode_stream_t *zs);
+
+
+/******************************************************************************
+ * Compress a complete message as one zlib stream and send it on a socket.
+ * This is used for directory listings, which are built in memory.
+ *
+ * Arguments:
+ *     sfd - The data connection socket.
+ *    data - The message.
+ *     len - The length of the message.
+ *   level - The compression level 0-9.
+ *
+ * Return values:
+ *   0    The full message was compressed and sent.
+ *  -1    error
+ *****************************************************************************/
+int zmode_send_all (int sfd, const uint8_t *data, size_t len, int level);
+
+
+#endif //__ZMODE_H__
@@ -0,0 +1,135 @@
+###############################################################################
+# FTP-Server
+# Author: Evan Myers
+# Date: October 2026
+#
+# Description:
+#   Helpers shared by the tests. A test starts the built server (src/ftpd) in
+#   a scratch directory laid out like the repository, with conf/ftp.conf
+#   copied and changed by the settings the test gives, and talks to it on
+#   the loopback interface as the user "tester".
+#
+#   The tests are run from src/ with "make check", or one at a time with
+#   "python3 tests/test_<name>.py".
+###############################################################################
+import ftplib
+import os
+import shutil
+import socket
+import subprocess
+import sys
+import tempfile
+import time
+
+
+REPO = os.path.dirname(os.path.dirname(os.path.abspath(__file__)))
+USER = 'tester'
+PASSWORD = 'tester'
+
+#How long the server may take to start, in seconds.
+START_TIMEOUT = 10
+
+
+def free_port():
+    """Find a TCP port on the loopback interface that nothing listens on."""
+    s = socket.socket()
+    s.bind(('127.0.0.1', 0))
+    port = s.getsockname()[1]
+    s.close()
+    return port
+
+
+class Server:
+    """A server run in a scratch directory, stopped when the test leaves the
+    with block. The settings replace those of the repository's ftp.conf.
+    binary is the server executable, src/ftpd of the repository if None."""
+
+    def __init__(self, binary=None, **settings):
+        self.binary = binary or os.path.join(REPO, 'src', 'ftpd')
+        self.port = free_port()
+        self.settings = {'INTERFACE_CONFIG': 'lo',
+                         'DEFAULT_PORT_CONFIG': str(self.port)}
+        self.settings.update(settings)
+        self.dir = tempfile.mkdtemp(prefix='ftpd-test-')
+        self.root = os.path.join(self.dir, 'rootdir')
+        self.proc = None
+
+    def __enter__(self):
+        for sub in ('src', 'conf', 'rootdir'):
+            os.mkdir(os.path.join(self.dir, sub))
+        shutil.copy(self.binary, os.path.join(self.dir, 'src', 'ftpd'))
+        shutil.copy(os.path.join(REPO, 'conf', 'user.conf'),
+                    os.path.join(self.dir, 'conf'))
+        self.write_conf()
+
+        #The server reads its own commands from stdin, which is kept open.
+        self.proc = subprocess.Popen(['./ftpd'], cwd=os.path.join(self.dir, 'src'),
+                                     stdin=subprocess.PIPE,
+                                     stdout=subprocess.DEVNULL,
+                                     stderr=open(os.path.join(self.dir, 'err.log'), 'w'))
+        deadline = time.time() + START_TIMEOUT
+        while True:
+            try:
+                #The greeting is read, a server may not outlive a reset.
+                ftp = ftplib.FTP()
+                ftp.connect('127.0.0.1', self.port, timeout=START_TIMEOUT)
+                ftp.quit()
+                return self
+            except (OSError, EOFError):
+                if self.proc.poll() is not None or time.time() > deadline:
+                    self.__exit__(None, None, None)
+                    raise RuntimeError('the server did not start')
+                time.sleep(0.1)
+
+    def __exit__(self, *exc):
+        if self.proc is not None:
+            try:
+                self.proc.stdin.write(b'shutdown\n')
+                self.proc.stdin.close()
+                self.proc.wait(START_TIMEOUT)
+            except (OSError, subprocess.TimeoutExpired):
+                self.proc.kill()
+                self.proc.wait()
+        shutil.rmtree(self.dir, ignore_errors=True)
+        return False
+
+    def write_conf(self):
+        out = []
+        with open(os.path.join(REPO, 'conf', 'ftp.conf')) as f:
+            for line in f:
+                key = line.split(' ', 1)[0].strip()
+                if not line.startswith('#') and key in self.settings:
+                    line = '%s %s\n' % (key, self.settings[key])
+                out.append(line)
+        with open(os.path.join(self.dir, 'conf', 'ftp.conf'), 'w') as f:
+            f.writelines(out)
+
+    def path(self, name):
+        return os.path.join(self.root, name)
+
+    def login(self):
+        """Open a control connection, logged in."""
+        ftp = ftplib.FTP()
+        ftp.connect('127.0.0.1', self.port, timeout=30)
+        ftp.login(USER, PASSWORD)
+        return ftp
+
+
+class Checker:
+    """Counts the checks of a test, and prints the ones that fail."""
+
+    def __init__(self, name):
+        self.name = name
+        self.failed = 0
+        self.run = 0
+
+    def check(self, ok, what):
+        self.run += 1
+        if not ok:
+            self.failed += 1
+            print('FAIL %s: %s' % (self.name, what))
+
+    def done(self):
+        print('%s: %d of %d checks passed' % (self.name, self.run - self.failed,
+                                              self.run))
+        sys.exit(1 if self.failed else 0)
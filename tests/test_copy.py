@@ -0,0 +1,117 @@
+###############################################################################
+# FTP-Server
+# Author: Evan Myers
+# Date: October 2026
+#
+# Description:
+#   Server-side copies (SITE CPY). A file is copied and the copy compared
+#   with it. During the copy of a large file STAT reports the progress, and
+#   ABOR stops the copy without leaving the copy or its temporary file. A
+#   source or destination outside the server root is refused.
+#
+#   The large file is sparse, but the copy is not where the file system has
+#   no reflinks, which gives STAT and ABOR time to run.
+###############################################################################
+import ftplib
+import os
+import re
+import sys
+
+sys.path.insert(0, os.path.dirname(os.path.abspath(__file__)))
+from ftptest import Checker, Server
+
+
+MIB = 1024 * 1024
+CONTENT = os.urandom(3 * MIB + 123)
+BIG_SIZE = 1024 * MIB
+
+
+def code(reply):
+    return reply[:3]
+
+
+def cpy(ftp, args):
+    """Send SITE CPY, and return the reply that ends it."""
+    try:
+        reply = ftp.sendcmd('SITE CPY ' + args)
+    except ftplib.Error as e:
+        return str(e)
+    if reply.startswith('150'):
+        reply = ftp.getline()
+    return reply
+
+
+def copied(reply):
+    """The bytes copied and the size of the file of a STAT reply, or None."""
+    match = re.match(r'213 Copied (\d+) of (\d+) bytes', reply)
+    return (int(match.group(1)), int(match.group(2))) if match else None
+
+
+def leftovers(server):
+    """The files of the root that are not the test's own."""
+    return sorted(set(os.listdir(server.root)) - {'data.bin', 'big.bin'})
+
+
+def main():
+    t = Checker('test_copy')
+
+    with Server() as server:
+        with open(server.path('data.bin'), 'wb') as f:
+            f.write(CONTENT)
+        with open(server.path('big.bin'), 'wb') as f:
+            f.truncate(BIG_SIZE)
+        with open(os.path.join(server.dir, 'outside.bin'), 'wb') as f:
+            f.write(CONTENT)
+        ftp = server.login()
+
+        #A copy, and a copy over an existing file.
+        for dst in ('copy.bin', 'copy.bin'):
+            reply = cpy(ftp, 'data.bin ' + dst)
+            with open(server.path(dst), 'rb') as f:
+                same = f.read() == CONTENT
+            t.check(code(reply) == '250' and same,
+                    'copy to %s: %s, the copy is %s'
+                    % (dst, reply, 'the same' if same else 'different'))
+        os.unlink(server.path('copy.bin'))
+
+        #Progress while a large file is copied.
+        reply = ftp.sendcmd('SITE CPY big.bin bigcopy.bin')
+        t.check(code(reply) == '150', 'large copy: %s' % reply)
+        first = copied(ftp.sendcmd('STAT'))
+        second = copied(ftp.sendcmd('STAT'))
+        t.check(first is not None and second is not None and
+                first[1] == second[1] == BIG_SIZE and
+                first[0] <= second[0] <= BIG_SIZE,
+                'STAT during the copy: %s, %s' % (first, second))
+        reply = ftp.getline()
+        t.check(code(reply) == '250' and
+                os.path.getsize(server.path('bigcopy.bin')) == BIG_SIZE,
+                'large copy: %s' % reply)
+        os.unlink(server.path('bigcopy.bin'))
+
+        #ABOR of a copy leaves nothing behind.
+        reply = ftp.sendcmd('SITE CPY big.bin bigcopy.bin')
+        ftp.putcmd('ABOR')
+        replies = sorted(code(ftp.getline()) for _ in range(2))
+        t.check(code(reply) == '150' and replies == ['226', '426'] and
+                leftovers(server) == [],
+                'ABOR of a copy: %s, left %s' % (replies, leftovers(server)))
+        reply = cpy(ftp, 'data.bin copy.bin')
+        t.check(code(reply) == '250', 'copy after ABOR: %s' % reply)
+        os.unlink(server.path('copy.bin'))
+
+        #Pathnames outside the root.
+        for args in ('../outside.bin in.bin', 'sub/../../outside.bin in.bin',
+                     'data.bin ../out.bin', 'data.bin /../out.bin'):
+            reply = cpy(ftp, args)
+            t.check(code(reply) in ('450', '553') and leftovers(server) == []
+                    and not os.path.exists(os.path.join(server.dir,
+                                                        'out.bin')),
+                    'outside the root: %s: %s' % (args, reply))
+        ftp.quit()
+
+    t.done()
+
+
+if __name__ == '__main__':
+    main()
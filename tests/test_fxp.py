@@ -0,0 +1,218 @@
+###############################################################################
+# FTP-Server
+# Author: Evan Myers
+# Date: October 2026
+#
+# Description:
+#   Data connections with hosts other than the client (FXP_ALLOW_CONFIG).
+#   The client connects from 127.0.0.1, and the other loopback addresses
+#   stand in for the other servers of a server-to-server transfer.
+#
+#   Without FXP_ALLOW_CONFIG only the client may be the other end: PORT to
+#   another host is refused with 504, and a PASV socket drops a connection
+#   from another host and waits on for the client. With it, the listed hosts
+#   and networks are allowed as well, and any other host is still refused.
+#
+#   Last, two servers that allow each other send a file from one to the
+#   other, with the client connected to both from 127.0.0.2: one server is
+#   told PASV, the other PORT with the address of the first, and the file
+#   RETRieved from the second is STORed on the first.
+###############################################################################
+import os
+import re
+import socket
+import ftplib
+import sys
+
+sys.path.insert(0, os.path.dirname(os.path.abspath(__file__)))
+from ftptest import PASSWORD, USER, Checker, Server
+
+
+CLIENT = '127.0.0.1'
+
+#The client of a server-to-server transfer, and the address of the servers.
+FXP_CLIENT = '127.0.0.2'
+SERVER = '127.0.0.1'
+CONTENT = os.urandom(100000)
+
+
+def read_all(sock):
+    data = []
+    while True:
+        chunk = sock.recv(65536)
+        if not chunk:
+            return b''.join(data)
+        data.append(chunk)
+
+
+def port_peer(ftp, host):
+    """Send PORT for a listener on a host, and RETR the file to it if PORT is
+    accepted. Returns the reply to PORT, and the data received."""
+    listener = socket.socket()
+    listener.bind((host, 0))
+    listener.listen(1)
+    listener.settimeout(10)
+    port = listener.getsockname()[1]
+    arg = ','.join(host.split('.') + [str(port >> 8), str(port & 0xff)])
+    try:
+        reply = ftp.sendcmd('PORT ' + arg)
+    except Exception as e:
+        listener.close()
+        return str(e), None
+
+    ftp.putcmd('RETR data.bin')
+    conn, peer = listener.accept()
+    listener.close()
+    ftp.getresp()
+    data = read_all(conn)
+    conn.close()
+    ftp.voidresp()
+    return reply, data
+
+
+def pasv_peer(ftp, host):
+    """Send PASV, and connect to it from a host, then from the client if the
+    host was turned away. Returns true if the host was accepted, and the data
+    that RETR sent on the connection that was kept."""
+    reply = ftp.sendcmd('PASV')
+    nums = re.search(r'\((\d+),(\d+),(\d+),(\d+),(\d+),(\d+)\)', reply).groups()
+    addr = ('.'.join(nums[:4]), int(nums[4]) * 256 + int(nums[5]))
+
+    conn = socket.socket()
+    conn.bind((host, 0))
+    conn.settimeout(10)
+    conn.connect(addr)
+
+    #A host that is turned away sees the connection closed at once.
+    conn.settimeout(1)
+    try:
+        accepted = conn.recv(1) != b''
+    except socket.timeout:
+        accepted = True
+    except ConnectionResetError:
+        accepted = False
+    conn.settimeout(10)
+    if not accepted:
+        conn.close()
+        conn = socket.create_connection(addr, 10, (CLIENT, 0))
+
+    ftp.putcmd('RETR data.bin')
+    ftp.getresp()
+    data = read_all(conn)
+    conn.close()
+    ftp.voidresp()
+    return accepted, data
+
+
+def login_from(server, host):
+    """Open a control connection from a host, logged in."""
+    ftp = ftplib.FTP()
+    ftp.connect(SERVER, server.port, timeout=30, source_address=(host, 0))
+    ftp.login(USER, PASSWORD)
+    ftp.voidcmd('TYPE I')
+    return ftp
+
+
+def server_to_server(dest, source):
+    """Send PASV to one server and PORT with its address to the other, then
+    STOR copy.bin on the first and RETR data.bin from the second. Returns the
+    reply to PORT, and the replies to STOR and RETR if PORT was accepted."""
+    host, port = ftplib.parse227(dest.sendcmd('PASV'))
+    arg = ','.join(host.split('.') + [str(port >> 8), str(port & 0xff)])
+    try:
+        reply = source.sendcmd('PORT ' + arg)
+    except ftplib.Error as e:
+        return str(e), None, None
+
+    dest.putcmd('STOR copy.bin')
+    source.putcmd('RETR data.bin')
+    replies = []
+    for ftp in (dest, source):
+        try:
+            ftp.getresp()
+            replies.append(ftp.voidresp())
+        except ftplib.Error as e:
+            replies.append(str(e))
+    return reply, replies[0], replies[1]
+
+
+def main():
+    t = Checker('test_fxp')
+
+    #The default: only the client.
+    with Server(FXP_ALLOW_CONFIG='') as server:
+        with open(server.path('data.bin'), 'wb') as f:
+            f.write(CONTENT)
+        ftp = server.login()
+        ftp.voidcmd('TYPE I')
+
+        reply, data = port_peer(ftp, CLIENT)
+        t.check(reply.startswith('200') and data == CONTENT,
+                'default: PORT to the client: %s' % reply)
+        reply, data = port_peer(ftp, '127.0.0.2')
+        t.check(reply.startswith('504') and data is None,
+                'default: PORT to another host: %s' % reply)
+
+        accepted, data = pasv_peer(ftp, CLIENT)
+        t.check(accepted and data == CONTENT, 'default: PASV from the client')
+        accepted, data = pasv_peer(ftp, '127.0.0.2')
+        t.check(not accepted and data == CONTENT,
+                'default: PASV from another host was not turned away')
+        ftp.quit()
+
+    #A listed host and a listed network.
+    with Server(FXP_ALLOW_CONFIG='127.0.0.2 127.0.0.8/30') as server:
+        with open(server.path('data.bin'), 'wb') as f:
+            f.write(CONTENT)
+        ftp = server.login()
+        ftp.voidcmd('TYPE I')
+
+        for host in ('127.0.0.2', '127.0.0.9'):
+            reply, data = port_peer(ftp, host)
+            t.check(reply.startswith('200') and data == CONTENT,
+                    'allowed: PORT to %s: %s' % (host, reply))
+            accepted, data = pasv_peer(ftp, host)
+            t.check(accepted and data == CONTENT,
+                    'allowed: PASV from %s was turned away' % host)
+
+        for host in ('127.0.0.3', '127.0.0.12'):
+            reply, data = port_peer(ftp, host)
+            t.check(reply.startswith('504') and data is None,
+                    'refused: PORT to %s: %s' % (host, reply))
+            accepted, data = pasv_peer(ftp, host)
+            t.check(not accepted and data == CONTENT,
+                    'refused: PASV from %s was not turned away' % host)
+        ftp.quit()
+
+    #Two servers that allow each other, and two that do not.
+    for allow in (SERVER, ''):
+        with Server(FXP_ALLOW_CONFIG=allow) as dest, \
+             Server(FXP_ALLOW_CONFIG=allow) as source:
+            with open(source.path('data.bin'), 'wb') as f:
+                f.write(CONTENT)
+            dftp = login_from(dest, FXP_CLIENT)
+            sftp = login_from(source, FXP_CLIENT)
+
+            reply, stored, sent = server_to_server(dftp, sftp)
+            copied = None
+            if os.path.exists(dest.path('copy.bin')):
+                with open(dest.path('copy.bin'), 'rb') as f:
+                    copied = f.read()
+            if allow:
+                t.check(reply.startswith('200') and stored.startswith('226')
+                        and sent.startswith('226') and copied == CONTENT,
+                        'server to server: PORT %s, STOR %s, RETR %s, the copy '
+                        'is %s' % (reply, stored, sent,
+                                   'the same' if copied == CONTENT else
+                                   'different'))
+            else:
+                t.check(reply.startswith('504') and copied is None,
+                        'server to server, not allowed: PORT %s' % reply)
+            dftp.close()
+            sftp.close()
+
+    t.done()
+
+
+if __name__ == '__main__':
+    main()
@@ -0,0 +1,138 @@
+###############################################################################
+# FTP-Server
+# Author: Evan Myers
+# Date: October 2026
+#
+# Description:
+#   Round trip of a sparse file (SPARSE_STOR_CONFIG 1). The file is uploaded
+#   with STOR, with and without the write-behind buffer, and the stored copy
+#   must have the same content, with its aligned blocks of zeros left as
+#   holes (SEEK_HOLE/SEEK_DATA). It is then downloaded with RETR, which sends
+#   the holes from memory, and must come back unchanged.
+###############################################################################
+import io
+import os
+import sys
+
+sys.path.insert(0, os.path.dirname(os.path.abspath(__file__)))
+from ftptest import Checker, Server
+
+
+MIB = 1024 * 1024
+BLOCK = 4096  #SPARSE_BLOCK
+
+
+def sparse_image():
+    """Data and zeros in runs that do not start on a block, a short run of
+    zeros within blocks of data, and a tail of zeros that must stay a hole.
+    Returns the file, and the runs of zeros that must be holes."""
+    parts = [os.urandom(MIB + 100),
+             bytes(16 * MIB),
+             os.urandom(3000),
+             bytes(3000),
+             os.urandom(MIB),
+             bytes(8 * MIB)]
+    holes = []
+    offset = 0
+    for part in parts:
+        if len(part) >= 4 * BLOCK and not any(part):
+            start = (offset + BLOCK - 1) // BLOCK * BLOCK
+            holes.append((start, (offset + len(part)) // BLOCK * BLOCK))
+        offset += len(part)
+    return b''.join(parts), holes
+
+
+def holes_supported(directory):
+    """Determine if the file system of a directory keeps holes."""
+    probe = os.path.join(directory, '.probe')
+    with open(probe, 'wb') as f:
+        f.truncate(8 * MIB)
+        f.seek(8 * MIB)
+        f.write(b'x')
+    blocks = os.stat(probe).st_blocks
+    os.unlink(probe)
+    return blocks * 512 < MIB
+
+
+def allocated(path):
+    return os.stat(path).st_blocks * 512
+
+
+def data_extents(path):
+    """The extents of data of a file, found with SEEK_DATA and SEEK_HOLE."""
+    extents = []
+    fd = os.open(path, os.O_RDONLY)
+    try:
+        size = os.fstat(fd).st_size
+        offset = 0
+        while offset < size:
+            try:
+                start = os.lseek(fd, offset, os.SEEK_DATA)
+            except OSError:
+                break
+            end = os.lseek(fd, start, os.SEEK_HOLE)
+            extents.append((start, end))
+            offset = end
+    finally:
+        os.close(fd)
+    return extents
+
+
+def round_trip(t, server, name, image, holes, dataBytes):
+    ftp = server.login()
+    ftp.storbinary('STOR ' + name, io.BytesIO(image))
+    path = server.path(name)
+
+    with open(path, 'rb') as f:
+        t.check(f.read() == image, '%s: stored content differs' % name)
+    t.check(os.path.getsize(path) == len(image),
+            '%s: stored size %d' % (name, os.path.getsize(path)))
+    t.check(allocated(path) < dataBytes + MIB,
+            '%s: %d bytes allocated for %d of data' % (name, allocated(path),
+                                                       dataBytes))
+    extents = data_extents(path)
+    for start, end in holes:
+        inside = [e for e in extents if e[0] < end and e[1] > start]
+        t.check(not inside, '%s: data %s in the hole at %d-%d' % (name, inside,
+                                                                 start, end))
+
+    out = io.BytesIO()
+    ftp.retrbinary('RETR ' + name, out.write)
+    t.check(out.getvalue() == image, '%s: retrieved content differs' % name)
+    ftp.quit()
+
+
+def main():
+    t = Checker('test_sparse')
+    image, holes = sparse_image()
+    dataBytes = len(image) - 24 * MIB
+
+    for writeBehind in ('1048576', '0'):
+        with Server(SPARSE_STOR_CONFIG='1',
+                    WRITE_BEHIND_CONFIG=writeBehind) as server:
+            if not holes_supported(server.root):
+                print('test_sparse: skipped, the file system has no holes')
+                return
+            round_trip(t, server, 'sparse-wb%s.img' % writeBehind, image,
+                       holes, dataBytes)
+
+            #A file made sparse on the server is sent from its extents.
+            path = server.path('made.img')
+            with open(path, 'wb') as f:
+                f.write(image[:MIB])
+                f.truncate(64 * MIB)
+                f.seek(40 * MIB)
+                f.write(image[:4096])
+            with open(path, 'rb') as f:
+                expected = f.read()
+            ftp = server.login()
+            out = io.BytesIO()
+            ftp.retrbinary('RETR made.img', out.write)
+            t.check(out.getvalue() == expected, 'made.img: content differs')
+            ftp.quit()
+
+    t.done()
+
+
+if __name__ == '__main__':
+    main()
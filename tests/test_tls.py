@@ -0,0 +1,176 @@
+###############################################################################
+# FTP-Server
+# Author: Evan Myers
+# Date: October 2026
+#
+# Description:
+#   Data connections that must resume the TLS session of their control
+#   connection (TLS_REUSE_CONFIG 1). A client that resumes its own session
+#   downloads a file over TLS 1.2 and TLS 1.3. A data connection that does
+#   not resume a session, or that resumes the session of another client of
+#   the server, is refused with 425 and given no data.
+#
+#   A client that sends part of a TLS record and no more does not hold up
+#   the shutdown of the server.
+#
+#   ftplib does not resume the session on its data connections, so the
+#   client here does.
+###############################################################################
+import ftplib
+import os
+import shutil
+import socket
+import ssl
+import subprocess
+import sys
+import tempfile
+import time
+
+sys.path.insert(0, os.path.dirname(os.path.abspath(__file__)))
+from ftptest import PASSWORD, USER, Checker, Server
+
+
+CONTENT = os.urandom(100000)
+
+#How long the server may take to shut down, in seconds.
+SHUTDOWN_TIMEOUT = 5
+
+
+class ResumingFTP(ftplib.FTP_TLS):
+    """A client that resumes the session of its control connection on its
+    data connections."""
+
+    def ntransfercmd(self, cmd, rest=None):
+        conn, size = ftplib.FTP.ntransfercmd(self, cmd, rest)
+        if self._prot_p:
+            conn = self.context.wrap_socket(conn, server_hostname=self.host,
+                                            session=self.sock.session)
+        return conn, size
+
+
+def context(version):
+    ctx = ssl.SSLContext(ssl.PROTOCOL_TLS_CLIENT)
+    ctx.check_hostname = False
+    ctx.verify_mode = ssl.CERT_NONE
+    ctx.minimum_version = ctx.maximum_version = version
+    return ctx
+
+
+def login(server, version, cls=ResumingFTP):
+    """Open a control connection secured with AUTH TLS, logged in, with PROT P
+    set."""
+    ftp = cls(context=context(version))
+    ftp.connect('127.0.0.1', server.port, timeout=30)
+    ftp.auth()
+    ftp.login(USER, PASSWORD)
+    ftp.prot_p()
+    ftp.voidcmd('TYPE I')
+    return ftp
+
+
+def retr(ftp):
+    """RETR the file, and return the data, or the error reply."""
+    data = []
+    try:
+        ftp.retrbinary('RETR data.bin', data.append)
+    except ftplib.error_temp as e:
+        return str(e)
+    except (ssl.SSLError, OSError):
+        #The handshake was cut off, the reply is still to be read.
+        try:
+            return ftp.getresp()
+        except ftplib.error_temp as e:
+            return str(e)
+    return b''.join(data)
+
+
+def retr_stolen(victim, thief):
+    """Connect to the PASV socket of a client's RETR with the session of
+    another client. Returns the reply to RETR, and the data received."""
+    host, port = ftplib.parse227(victim.sendcmd('PASV'))
+    victim.putcmd('RETR data.bin')
+    data = b''
+    try:
+        conn = socket.create_connection((host, port), 10)
+        conn = thief.context.wrap_socket(conn, server_hostname=thief.host,
+                                         session=thief.sock.session)
+        while True:
+            chunk = conn.recv(65536)
+            if not chunk:
+                break
+            data += chunk
+        conn.close()
+    except (ssl.SSLError, OSError):
+        pass
+
+    reply = victim.getline()
+    if reply.startswith('150'):
+        reply = victim.getline()
+    return reply, data
+
+
+def main():
+    t = Checker('test_tls')
+    keys = tempfile.mkdtemp(prefix='ftpd-test-')
+    cert = os.path.join(keys, 'cert.pem')
+    key = os.path.join(keys, 'key.pem')
+    subprocess.run(['openssl', 'req', '-x509', '-newkey', 'rsa:2048', '-nodes',
+                    '-keyout', key, '-out', cert, '-days', '1',
+                    '-subj', '/CN=localhost'], check=True,
+                   stdout=subprocess.DEVNULL, stderr=subprocess.DEVNULL)
+
+    try:
+        with Server(TLS_CERT_CONFIG=cert, TLS_KEY_CONFIG=key,
+                    TLS_REUSE_CONFIG='1') as server:
+            with open(server.path('data.bin'), 'wb') as f:
+                f.write(CONTENT)
+
+            for name, version in (('TLS 1.2', ssl.TLSVersion.TLSv1_2),
+                                  ('TLS 1.3', ssl.TLSVersion.TLSv1_3)):
+                ftp = login(server, version)
+                for i in range(2):
+                    data = retr(ftp)
+                    t.check(data == CONTENT, '%s: RETR %d with the session '
+                            'of the client: %s' % (name, i + 1, data[:60]))
+
+                plain = login(server, version, ftplib.FTP_TLS)
+                data = retr(plain)
+                t.check(isinstance(data, str) and data.startswith('425'),
+                        '%s: RETR without resuming a session: %s'
+                        % (name, data[:60]))
+                plain.quit()
+
+                other = login(server, version)
+                t.check(retr(other) == CONTENT,
+                        '%s: RETR of the second client' % name)
+                reply, data = retr_stolen(ftp, other)
+                t.check(reply.startswith('425') and data == b'',
+                        '%s: RETR with the session of another client: %s, '
+                        '%d bytes' % (name, reply, len(data)))
+                t.check(retr(ftp) == CONTENT,
+                        '%s: RETR after the refused connection' % name)
+                other.quit()
+                ftp.quit()
+
+            #The header of a record of 64 bytes, and 10 bytes of it.
+            ftp = login(server, ssl.TLSVersion.TLSv1_3)
+            raw = socket.socket(fileno=os.dup(ftp.sock.fileno()))
+            raw.sendall(b'\x17\x03\x03\x00\x40' + bytes(10))
+            time.sleep(0.5)
+            server.proc.stdin.write(b'shutdown\n')
+            server.proc.stdin.flush()
+            try:
+                server.proc.wait(SHUTDOWN_TIMEOUT)
+                stopped = True
+            except subprocess.TimeoutExpired:
+                stopped = False
+            t.check(stopped, 'shutdown with part of a record received')
+            raw.close()
+    finally:
+        shutil.rmtree(keys, ignore_errors=True)
+
+    t.done()
+
+
+if __name__ == '__main__':
+    main()
@@ -0,0 +1,123 @@
+###############################################################################
+# FTP-Server
+# Author: Evan Myers
+# Date: October 2026
+#
+# Description:
+#   Archives extracted by SITE UNTAR. A tar of files and directories is
+#   extracted into the target directory, each file the same as in the
+#   archive. An entry with an absolute name, a name with "..", or a name that
+#   goes through a symbolic link is skipped, and nothing is written outside
+#   the target directory.
+###############################################################################
+import ftplib
+import io
+import os
+import re
+import sys
+import tarfile
+
+sys.path.insert(0, os.path.dirname(os.path.abspath(__file__)))
+from ftptest import Checker, Server
+
+
+FILES = {'a.bin': os.urandom(1000),
+         'sub/b.bin': os.urandom(300000),
+         'sub/deeper/c.bin': os.urandom(5 * 1024 * 1024 + 7),
+         'empty.bin': b''}
+
+
+def archive(entries):
+    """A tar of (name, bytes) files, and (name, target) symbolic links where
+    the second item is a str."""
+    buf = io.BytesIO()
+    with tarfile.open(fileobj=buf, mode='w', format=tarfile.USTAR_FORMAT) \
+            as tar:
+        for name, data in entries:
+            info = tarfile.TarInfo(name)
+            if isinstance(data, str):
+                info.type = tarfile.SYMTYPE
+                info.linkname = data
+                tar.addfile(info)
+            else:
+                info.size = len(data)
+                tar.addfile(info, io.BytesIO(data))
+    return buf.getvalue()
+
+
+def untar(ftp, dest, tar):
+    """Send the archive with SITE UNTAR, and return the reply."""
+    try:
+        return ftp.storbinary('SITE UNTAR ' + dest, io.BytesIO(tar))
+    except ftplib.Error as e:
+        return str(e)
+
+
+def skipped(reply):
+    """The number of entries skipped of a 226 reply, or None."""
+    match = re.search(r'skipped (\d+) entries', reply)
+    return int(match.group(1)) if match else None
+
+
+def outside(server, dest):
+    """The files and links under the test directory, but not in dest."""
+    found = set()
+    for top, dirs, files in os.walk(server.dir):
+        if os.path.abspath(top) == os.path.abspath(dest):
+            dirs[:] = []
+            continue
+        found.update(os.path.join(top, name) for name in dirs + files)
+    return found
+
+
+def main():
+    t = Checker('test_untar')
+
+    with Server() as server:
+        dest = server.path('dest')
+        ftp = server.login()
+        ftp.voidcmd('TYPE I')
+
+        #A normal archive.
+        os.mkdir(dest)
+        reply = untar(ftp, 'dest', archive(sorted(FILES.items())))
+        same = True
+        for name, data in FILES.items():
+            try:
+                with open(os.path.join(dest, name), 'rb') as f:
+                    same = same and f.read() == data
+            except OSError:
+                same = False
+        t.check(reply.startswith('226') and skipped(reply) == 0 and same,
+                'archive of %d files: %s, the files are %s'
+                % (len(FILES), reply.splitlines()[0],
+                   'the same' if same else 'different'))
+
+        #A link in the target directory to the directory outside the root.
+        os.symlink(server.dir, os.path.join(dest, 'out'))
+        before = outside(server, dest)
+
+        cases = (('absolute name', [('/abs.bin', b'x')]),
+                 ('absolute name outside the root',
+                  [(os.path.join(server.dir, 'abs.bin'), b'x')]),
+                 ('".." name', [('../escape.bin', b'x')]),
+                 ('".." inside a name', [('sub/../../escape.bin', b'x')]),
+                 ('file through a link of the archive',
+                  [('link', server.dir), ('link/evil.bin', b'x')]),
+                 ('file through a link of the directory',
+                  [('out/evil.bin', b'x')]))
+        for name, entries in cases:
+            reply = untar(ftp, 'dest', archive(entries))
+            escaped = sorted(outside(server, dest) - before)
+            t.check(reply.startswith('226') and skipped(reply) and
+                    not escaped and
+                    not os.path.islink(os.path.join(dest, 'link')),
+                    '%s: %s, written outside %s'
+                    % (name, reply.splitlines()[0], escaped))
+        ftp.quit()
+
+    t.done()
+
+
+if __name__ == '__main__':
+    main()